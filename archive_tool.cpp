@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "src/tools/tool_commands.hpp"
+
+// アーカイブの保守・解析用ツール
+static void printToolUsage(const std::string &programName)
+{
+    std::cout << "Usage: " << programName << " <command> [arguments]" << std::endl;
+    std::cout << "Commands:" << std::endl;
+    std::cout << "  info [--verify] <archive>..." << std::endl;
+    std::cout << "                       Show the contents of .lz4 archives and .lz4c run containers" << std::endl;
+    std::cout << "                       (--verify: re-read each block from disk and check it)" << std::endl;
+    std::cout << "  bench <file|dir>...  Measure ratio and speed of each codec on TIFF files" << std::endl;
+    std::cout << "  repack [--target-mb=N] [--codec=C] <output_dir>" << std::endl;
+    std::cout << "                       Merge consecutive archives of a run into larger ones (updates the catalog)" << std::endl;
+    std::cout << "  migrate [--threads=N] [--io-mb-per-sec=N] [--codec=C] [--max-growth=<percent>] [--progress=<file>] <dir>..." << std::endl;
+    std::cout << "                       Convert v1 archives under the directories to v2 (resumable;" << std::endl;
+    std::cout << "                       archives that would grow by more than 10% stay v1)" << std::endl;
+    std::cout << "  spots [--frames=A-B] [--summary] <archive|output_dir>..." << std::endl;
+    std::cout << "                       Print the spot lists stored at ingest (--spots) without decoding frames" << std::endl;
+    std::cout << "  retry <output_dir> [all | [--subdir=<path>] <run> <set>]" << std::endl;
+    std::cout << "                       List the sets quarantined by the compressor, or ask it to retry them" << std::endl;
+}
+
+bool splitToolOption(const std::string &arg, std::string &name, std::string &value)
+{
+    if (arg.compare(0, 2, "--") != 0)
+        return false;
+
+    size_t eqPos = arg.find('=');
+    name = arg.substr(0, eqPos);
+    value = (eqPos != std::string::npos) ? arg.substr(eqPos + 1) : "";
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printToolUsage(argv[0]);
+        return 1;
+    }
+
+    std::string command = argv[1];
+    std::vector<std::string> args(argv + 2, argv + argc);
+
+    if (command == "info")
+        return infoCommand(args);
+    if (command == "bench")
+        return benchCommand(args);
+    if (command == "repack")
+        return repackCommand(args);
+    if (command == "migrate")
+        return migrateCommand(args);
+    if (command == "spots")
+        return spotsCommand(args);
+    if (command == "retry")
+        return retryCommand(args);
+
+    std::cerr << "Unknown command: " << command << std::endl;
+    printToolUsage(argv[0]);
+    return 1;
+}
@@ -1,5 +1,6 @@
 #include "src/common/common.hpp"
 #include "src/compress/directory_monitor.hpp"
+#include "src/compress/compressor_options.hpp"
 #include <iostream>
 #include <string>
 
@@ -18,6 +19,14 @@ int main(int argc, char *argv[])
     const bool deleteAfter = true;      // Always delete source files after processing
     const bool stopOnInterrupt = false; // Never stop on Enter key
 
+    // コマンドラインオプション（対話入力以外の動作設定）
+    CompressorOptions options;
+    if (!parseCompressorOptions(argc, argv, options))
+    {
+        printCompressorUsage(argv[0]);
+        return 1;
+    }
+
     std::cout << "=== bl02b1_tif_compressor ===" << std::endl;
     std::cout << "Version 0.2.0" << std::endl;
     std::cout << "Author: Shungo AOYAGI" << std::endl;
@@ -70,11 +79,45 @@ int main(int argc, char *argv[])
         }
     }
 
+    // マイクロセットはセットを等分する大きさにする
+    if (options.microSetSize > 0 && (options.microSetSize >= setSize || setSize % options.microSetSize != 0))
+    {
+        std::cerr << "--micro-sets=" << options.microSetSize << " must be smaller than and divide the set size ("
+                  << setSize << ")" << std::endl;
+        return 1;
+    }
+
     std::cout << "\n=== Monitor Configuration ===" << std::endl;
     std::cout << "Watch directory: " << watchDir << std::endl;
     std::cout << "Output directory: " << outputDir << std::endl;
+    for (const auto &root : options.outputRoots)
+    {
+        std::cout << "Additional output root: " << root << std::endl;
+    }
     std::cout << "File pattern: " << basePattern << std::endl;
     std::cout << "Set size: " << setSize << std::endl;
+    if (options.microSetSize > 0)
+        std::cout << "Micro-sets: " << options.microSetSize << " files (compacted in the background)" << std::endl;
+    for (const auto &rule : options.readSplitRules)
+        std::cout << "Split reads: " << (rule.root.empty() ? "all files" : rule.root) << " (" << rule.rangeBytes / 1024
+                  << " KiB x " << rule.concurrency << ")" << std::endl;
+    if (options.targetSetBytes > 0)
+        std::cout << "Target set size: " << options.targetSetBytes / (1024 * 1024) << " MiB (files per set chosen per run)" << std::endl;
+    std::cout << "Run container: " << (options.runContainer ? "enabled" : "disabled") << std::endl;
+    std::cout << "Readback verification: " << (options.verifyReadback ? "enabled" : "disabled") << std::endl;
+    std::cout << "Archive format: v" << options.archiveVersion;
+    if (options.archiveVersion >= 2)
+    {
+        std::cout << " (" << blockCodecName(options.codec) << (options.alignBlocks ? ", 4 KiB aligned" : "");
+        if (options.checkpointInterval > 0)
+            std::cout << ", checkpoints every " << options.checkpointInterval << " frames";
+        if (options.findSpots)
+            std::cout << ", spots >= " << options.spotFinder.threshold;
+        if (options.storeThreshold < 1.0)
+            std::cout << ", stored raw above " << options.storeThreshold * 100 << "%";
+        std::cout << ")";
+    }
+    std::cout << std::endl;
 
     // ログファイルを出力ディレクトリに作成
     initLogFile(outputDir);
@@ -84,7 +127,7 @@ int main(int argc, char *argv[])
 
     try
     {
-        monitorDirectory(watchDir, outputDir, basePattern, setSize, pollInterval, maxThreads, maxProcesses, lz4Acceleration, deleteAfter, stopOnInterrupt);
+        monitorDirectory(watchDir, outputDir, basePattern, setSize, pollInterval, maxThreads, maxProcesses, lz4Acceleration, deleteAfter, stopOnInterrupt, options);
     }
     catch (const std::exception &e)
     {
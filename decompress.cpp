@@ -5,15 +5,21 @@
 #include <filesystem>
 #include <thread>
 #include <mutex>
+#include <memory>
 #include <ctime>
 #include <cmath>
 #include <cstdarg>
+#include <algorithm>
+#include <set>
 #include <tiffio.h>
 
 #include "src/common/common.hpp"
 #include "src/decompress/lz4_decompressor.hpp"
+#include "src/decompress/archive_locator.hpp"
 #include "src/decompress/tiff_processor.hpp"
 #include "src/decompress/rename_finf.h"
+#include "src/decompress/sidecar_writer.hpp"
+#include "src/decompress/checkpoint_merge.hpp"
 
 namespace fs = std::filesystem;
 
@@ -26,24 +32,64 @@ void quietTiffWarningHandler(const char *module, const char *fmt, va_list ap)
 /// LZ4ファイルを処理する関数
 /// run_type = 0: 解凍したtifファイルをそのまま出力
 /// run_type = 1: 解凍したtifファイルをマージして出力
-int processLZ4File(const std::string &filename, const int mergeImageNumber,
+/// アーカイブに同梱された付随ファイル（.finfなど）はsidecarWriterで書き出す
+/// s_img, e_img はアーカイブが含むフレームの範囲。マージの窓と出力はwindows（run全体で共通）で決まる
+int processLZ4File(const ArchiveLocation &location, MergeWindows *windows,
                    const std::string &outputFolder, const std::string &prefix_with_run,
-                   const int runNumber, const int s_img, const int e_img, const int run_type)
+                   const int runNumber, const int s_img, const int e_img, const int run_type,
+                   SidecarWriter &sidecarWriter)
 {
     try
     {
-        std::cout << "Processing: " << filename << std::endl;
+        std::cout << "Processing: " << location.describe() << std::endl;
 
-        // 1. LZ4アーカイブを解凍してメモリ上に展開
-        auto entries = decompressLZ4Archive(filename);
+        // 1. LZ4アーカイブ（単独ファイルまたはランコンテナのセグメント）を解凍してメモリ上に展開
+        // マージでアーカイブにチェックポイント（累積和画像）がある場合は、必要なフレームだけを復号してマージする
+        std::vector<FileEntry> entries;
+        if (run_type == 1)
+        {
+            AlignedBuffer buffer;
+            const char *archiveData = nullptr;
+            size_t archiveSize = 0;
+            if (!readArchiveAt(location, buffer, archiveData, archiveSize))
+            {
+                std::cerr << "No files extracted from: " << location.describe() << std::endl;
+                return 1;
+            }
+
+            std::vector<FileEntry> sidecars;
+            if (mergeTiffFilesWithCheckpoints(archiveData, archiveSize, prefix_with_run, s_img, e_img, *windows,
+                                              sidecars))
+            {
+                for (const auto &sidecar : sidecars)
+                {
+                    sidecarWriter.write(sidecar, s_img);
+                }
+                return 0;
+            }
+            entries = decompressLZ4ArchiveBuffer(archiveData, archiveSize);
+        }
+        else
+        {
+            entries = decompressArchiveAt(location);
+        }
         
         if (entries.empty())
         {
-            std::cerr << "No files extracted from: " << filename << std::endl;
+            std::cerr << "No files extracted from: " << location.describe() << std::endl;
             return 1;
         }
 
-        // 2. 処理方法の分岐
+        // 2. 付随ファイルを書き出し、フレームだけを残す
+        auto sidecarEnd = std::stable_partition(entries.begin(), entries.end(), [](const FileEntry &entry)
+                                                { return !entry.sidecar; });
+        for (auto it = sidecarEnd; it != entries.end(); ++it)
+        {
+            sidecarWriter.write(*it, s_img);
+        }
+        entries.erase(sidecarEnd, entries.end());
+
+        // 3. 処理方法の分岐
         if (run_type == 0)
         {
             // run_typeが0の場合：tifファイルをそのまま出力
@@ -52,12 +98,12 @@ int processLZ4File(const std::string &filename, const int mergeImageNumber,
         else
         {
             // run_typeが1の場合：libtiffによるTIFFファイルのマージ処理を呼び出し
-            mergeTiffFilesWithLibTiff(entries, prefix_with_run, outputFolder, s_img, e_img, mergeImageNumber);
+            mergeTiffFilesWithLibTiff(entries, prefix_with_run, s_img, e_img, *windows);
         }
     }
     catch (const std::exception &ex)
     {
-        std::cerr << "File " << filename << " exception error: " << ex.what() << std::endl;
+        std::cerr << "File " << location.describe() << " exception error: " << ex.what() << std::endl;
         return 1;
     }
     return 0;
@@ -66,7 +112,7 @@ int processLZ4File(const std::string &filename, const int mergeImageNumber,
 /// バッチ処理による最適化版 processLZ4Files
 int processLZ4Files(const std::string &input_dir, const std::string &output_dir, const std::string &prefix,
                     const int s_run, const int e_run, const int s_img, const int e_img,
-                    const int merge_frame_num, const int run_type)
+                    const int merge_frame_num, const int run_type, SidecarWriter &sidecarWriter)
 {
     int incre_num = e_img - s_img + 1;
     const int file_num_per_lz4 = 100;
@@ -84,10 +130,52 @@ int processLZ4Files(const std::string &input_dir, const std::string &output_dir,
 
     std::mutex cout_mutex;
 
+    // repackや --micro-sets でまとめたアーカイブは複数のセットから見つかるため、同じアーカイブは1回だけ処理する
+    std::set<std::pair<std::string, uint64_t>> processed_locations;
+    std::mutex location_mutex;
+
+    // 入力ディレクトリは ';' 区切りで複数指定できる（圧縮時に出力先を振り分けた場合）
+    std::vector<std::string> input_roots = splitPathList(input_dir);
+
+    // カタログがあればアーカイブを開かずに格納場所を引く（最初に見つかったカタログを使う）
+    std::unique_ptr<ArchiveCatalog> catalog;
+    const ArchiveCatalog *catalogPtr = nullptr;
+    for (const auto &root : input_roots)
+    {
+        catalog = std::make_unique<ArchiveCatalog>(root);
+        if (catalog->load())
+        {
+            catalogPtr = catalog.get();
+            std::cout << "Catalog loaded: " << getCatalogPath(root) << std::endl;
+            if (catalog->getSkippedLines() > 0)
+            {
+                std::cout << "Warning: " << catalog->getSkippedLines() << " damaged catalog line(s) ignored" << std::endl;
+            }
+            break;
+        }
+    }
+
     for (int j = s_run; j <= e_run; j++)
     {
         std::string run = "_" + zeroPad(j, 2) + "_";
 
+        // runの概要（カタログがある場合のみ）
+        if (catalogPtr)
+        {
+            auto runEntries = catalogPtr->findRange(prefix, j, s_img, e_img);
+            uint64_t rawBytes = 0, storedBytes = 0;
+            for (const auto &entry : runEntries)
+            {
+                rawBytes += entry.rawSize;
+                storedBytes += entry.size;
+            }
+            std::cout << "Run " << zeroPad(j, 2) << ": " << runEntries.size() << " archive(s), "
+                      << rawBytes << " bytes raw, " << storedBytes << " bytes stored" << std::endl;
+        }
+
+        // マージの窓はrun全体で s_img から区切る（セットの境界と揃わない窓は、隣り合うアーカイブの和を足して出力する）
+        MergeWindows windows(output_dir, prefix + run, s_img, e_img, merge_frame_num);
+
         // バッチ単位で処理するためのスレッド配列
         std::vector<std::thread> threads;
 
@@ -105,7 +193,7 @@ int processLZ4Files(const std::string &input_dir, const std::string &output_dir,
             }
 
             // バッチ処理用のスレッドを作成
-            threads.emplace_back([=, &cout_mutex]()
+            threads.emplace_back([=, &cout_mutex, &sidecarWriter, &processed_locations, &location_mutex, &windows]()
                                  {
                 {
                     std::lock_guard<std::mutex> lock(cout_mutex);
@@ -115,14 +203,50 @@ int processLZ4Files(const std::string &input_dir, const std::string &output_dir,
                 
                 // バッチ内の各ファイルを処理
                 for (int i = batch_start; i <= batch_end; i++) {
-                    std::string lz4_file = input_dir + "/" + prefix + run + 
-                                          zeroPad(i * file_num_per_lz4 + 1, 5) + ".lz4";
-                    
-                    processLZ4File(
-                        lz4_file, merge_frame_num, output_dir,
-                        prefix + run, j,
-                        i * file_num_per_lz4 + 1, (i + 1) * file_num_per_lz4, run_type
-                    );
+                    // カタログがある場合はセットの範囲に含まれるアーカイブをすべて処理する
+                    // （--micro-sets でまとめる前は、1つのセットにマイクロセットのアーカイブが複数ある）
+                    std::vector<ArchiveLocation> locations;
+                    if (catalogPtr) {
+                        for (const auto &entry : catalogPtr->findRange(prefix, j, i * file_num_per_lz4 + 1, (i + 1) * file_num_per_lz4)) {
+                            locations.push_back(locationFromCatalog(*catalogPtr, entry, input_roots));
+                        }
+                    }
+
+                    // 単独の.lz4ファイル、またはランコンテナ内のセグメントを探す
+                    if (locations.empty()) {
+                        ArchiveLocation location;
+                        if (!locateArchive(input_roots, prefix, j, i * file_num_per_lz4 + 1, location, catalogPtr)) {
+                            std::lock_guard<std::mutex> lock(cout_mutex);
+                            std::cerr << "Archive not found: " << prefix + run
+                                      << zeroPad(i * file_num_per_lz4 + 1, 5) << std::endl;
+                            continue;
+                        }
+                        locations.push_back(location);
+                    }
+
+                    for (const auto &location : locations) {
+                        {
+                            std::lock_guard<std::mutex> lock(location_mutex);
+                            if (!processed_locations.insert(std::make_pair(location.path, location.offset)).second) {
+                                continue;
+                            }
+                        }
+
+                        // アーカイブの範囲で処理する（まとめたアーカイブ、マイクロセットのアーカイブ、
+                        // セットの境界が異なるアーカイブ（--target-set-mb）はセットの範囲と一致しない）
+                        // 範囲が分からない場合（カタログがない場合）はセットの範囲とする
+                        int set_first = std::max(location.firstFrame, s_img);
+                        int set_last = std::min(location.lastFrame > 0 ? location.lastFrame
+                                                                       : location.firstFrame + file_num_per_lz4 - 1,
+                                                e_img);
+
+                        processLZ4File(
+                            location, &windows, output_dir,
+                            prefix + run, j,
+                            set_first, set_last, run_type,
+                            sidecarWriter
+                        );
+                    }
                 }
                 
                 {
@@ -147,6 +271,12 @@ int processLZ4Files(const std::string &input_dir, const std::string &output_dir,
         {
             thread.join();
         }
+
+        // アーカイブが見つからず範囲が揃わなかった窓を出力する
+        if (run_type == 1)
+        {
+            windows.flush();
+        }
     }
 
     return 0;
@@ -192,26 +322,38 @@ int main()
         std::cin >> merge_frame_num;
     }
 
+    // Ask if user wants to convert .finf files
+    // (asked up front so that .finf files bundled in the archives are converted during extraction)
+    std::cout << "Convert .finf and save to output directory? (y/n): ";
+    std::string response;
+    std::cin >> response;
+    bool convert_finf = (response == "y" || response == "Y");
+
+    SidecarWriter sidecarWriter(output_dir, convert_finf);
+
     clock_t start_time = clock();
 
-    processLZ4Files(input_dir, output_dir, prefix, s_run, e_run, s_img, e_img, merge_frame_num, run_type);
+    processLZ4Files(input_dir, output_dir, prefix, s_run, e_run, s_img, e_img, merge_frame_num, run_type, sidecarWriter);
     
     clock_t end_time = clock();
     double elapsed_time = static_cast<double>(end_time - start_time) / CLOCKS_PER_SEC;
     std::cout << "Elapsed time: " << elapsed_time << " seconds" << std::endl;
+
+    if (sidecarWriter.getOtherCount() > 0) {
+        std::cout << "\nRestored " << sidecarWriter.getOtherCount() << " bundled sidecar file(s)" << std::endl;
+    }
     
-    // Ask if user wants to convert .finf files
-    std::cout << "\nConvert .finf and save to output directory? (y/n): ";
-    std::string response;
-    std::cin >> response;
-    
-    if (response == "y" || response == "Y") {
+    if (convert_finf && sidecarWriter.getFinfCount() > 0) {
+        std::cout << "\n.finf file conversion completed (" << sidecarWriter.getFinfCount()
+                  << " file(s) from archives)" << std::endl;
+    } else if (convert_finf) {
+        // No .finf bundled in the archives: look for them next to the archives as before
         std::cout << "\nStarting .finf file conversion..." << std::endl;
         
-        // First search for .finf files in input directory
-        std::vector<std::string> finf_files = search_finf_files(input_dir);
-        
-        std::string finf_input_dir = input_dir;
+        // First search for .finf files in input directory (the first one if several are given)
+        std::vector<std::string> input_roots = splitPathList(input_dir);
+        std::string finf_input_dir = input_roots.empty() ? input_dir : input_roots.front();
+        std::vector<std::string> finf_files = search_finf_files(finf_input_dir);
         
         // If no .finf files found, ask user to specify input directory
         if (finf_files.empty()) {
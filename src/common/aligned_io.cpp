@@ -0,0 +1,321 @@
+#include "aligned_io.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignDown(uint64_t value, uint64_t alignment)
+{
+    return value - value % alignment;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return alignDown(value + alignment - 1, alignment);
+}
+
+AlignedBuffer::AlignedBuffer() : ptr(nullptr), capacity(0)
+{
+}
+
+AlignedBuffer::~AlignedBuffer()
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+bool AlignedBuffer::reserve(size_t size)
+{
+    if (size <= capacity)
+        return true;
+
+    size_t newCapacity = static_cast<size_t>(alignUp(size, DIRECT_IO_ALIGNMENT));
+#ifdef _WIN32
+    _aligned_free(ptr);
+    ptr = static_cast<char *>(_aligned_malloc(newCapacity, DIRECT_IO_ALIGNMENT));
+#else
+    std::free(ptr);
+    void *p = nullptr;
+    ptr = (posix_memalign(&p, DIRECT_IO_ALIGNMENT, newCapacity) == 0) ? static_cast<char *>(p) : nullptr;
+#endif
+    capacity = ptr ? newCapacity : 0;
+    return ptr != nullptr;
+}
+
+// 通常の（ページキャッシュを使う）読み込み
+static bool readFileRangeBuffered(const std::string &path, uint64_t offset, uint64_t size, char *dst)
+{
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile)
+        return false;
+    inFile.seekg(static_cast<std::streamoff>(offset));
+    inFile.read(dst, static_cast<std::streamsize>(size));
+    return static_cast<bool>(inFile);
+}
+
+#if defined(_WIN32)
+#define HAVE_DIRECT_READ 1
+// FILE_FLAG_NO_BUFFERINGで [alignedOffset, alignedOffset + alignedSize) を読む（ファイル末尾で短くなるのは許容する）
+// 位置・長さ・バッファはセクタ境界に揃える必要がある（DIRECT_IO_ALIGNMENTはセクタの倍数）
+static bool readDirect(const std::string &path, uint64_t alignedOffset, uint64_t alignedSize, char *dst,
+                       uint64_t requiredSize)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    uint64_t done = 0;
+    bool ok = true;
+    while (done < alignedSize)
+    {
+        OVERLAPPED overlapped = {};
+        uint64_t position = alignedOffset + done;
+        overlapped.Offset = static_cast<DWORD>(position & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+        DWORD chunk = static_cast<DWORD>(std::min<uint64_t>(alignedSize - done, 64 * 1024 * 1024));
+        DWORD n = 0;
+        if (!ReadFile(file, dst + done, chunk, &n, &overlapped))
+        {
+            ok = GetLastError() == ERROR_HANDLE_EOF;
+            break;
+        }
+        if (n == 0)
+            break; // ファイル末尾
+        done += n;
+    }
+    CloseHandle(file);
+    return ok && done >= requiredSize;
+}
+#elif defined(__linux__) && defined(O_DIRECT)
+#define HAVE_DIRECT_READ 1
+// O_DIRECTで [alignedOffset, alignedOffset + alignedSize) を読む（ファイル末尾で短くなるのは許容する）
+static bool readDirect(const std::string &path, uint64_t alignedOffset, uint64_t alignedSize, char *dst,
+                       uint64_t requiredSize)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+    if (fd < 0)
+        return false;
+
+    uint64_t done = 0;
+    bool ok = true;
+    while (done < alignedSize)
+    {
+        ssize_t n = ::pread(fd, dst + done, static_cast<size_t>(alignedSize - done),
+                            static_cast<off_t>(alignedOffset + done));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = false; // EINVAL: ファイルシステムがO_DIRECTに対応していない
+            break;
+        }
+        if (n == 0)
+            break; // ファイル末尾
+        done += static_cast<uint64_t>(n);
+    }
+    ::close(fd);
+    return ok && done >= requiredSize;
+}
+#endif
+
+bool readFileRangeDirect(const std::string &path, uint64_t offset, uint64_t size, AlignedBuffer &buffer,
+                         const char *&data, bool *usedDirect)
+{
+    uint64_t alignedOffset = alignDown(offset, DIRECT_IO_ALIGNMENT);
+    uint64_t head = offset - alignedOffset;
+    uint64_t alignedSize = alignUp(head + size, DIRECT_IO_ALIGNMENT);
+    if (!buffer.reserve(static_cast<size_t>(alignedSize)))
+        return false;
+
+    if (usedDirect)
+        *usedDirect = false;
+
+#ifdef HAVE_DIRECT_READ
+    if (readDirect(path, alignedOffset, alignedSize, buffer.data(), head + size))
+    {
+        data = buffer.data() + head;
+        if (usedDirect)
+            *usedDirect = true;
+        return true;
+    }
+#endif
+
+    if (!readFileRangeBuffered(path, offset, size, buffer.data()))
+        return false;
+    data = buffer.data();
+    return true;
+}
+
+bool readFileRangeUncached(const std::string &path, uint64_t offset, uint64_t size, AlignedBuffer &buffer,
+                           const char *&data, UncachedReadMode &mode)
+{
+    mode = UncachedReadMode::None;
+    uint64_t alignedOffset = alignDown(offset, DIRECT_IO_ALIGNMENT);
+    uint64_t head = offset - alignedOffset;
+    uint64_t alignedSize = alignUp(head + size, DIRECT_IO_ALIGNMENT);
+    if (!buffer.reserve(static_cast<size_t>(alignedSize)))
+        return false;
+
+#ifdef HAVE_DIRECT_READ
+    if (readDirect(path, alignedOffset, alignedSize, buffer.data(), head + size))
+    {
+        data = buffer.data() + head;
+        mode = UncachedReadMode::Direct;
+        return true;
+    }
+#endif
+
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+    // ダイレクトI/Oに対応しないファイルシステム: 書き込んだページをディスクに書き出してからキャッシュを捨て、読み直す
+    // （書き出していないページは捨てられないため、先にfdatasyncする）
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool dropped = ::fdatasync(fd) == 0 &&
+                   ::posix_fadvise(fd, static_cast<off_t>(alignedOffset), static_cast<off_t>(alignedSize), POSIX_FADV_DONTNEED) == 0;
+    bool ok = false;
+    if (dropped)
+    {
+        uint64_t done = 0;
+        ok = true;
+        while (done < size)
+        {
+            ssize_t n = ::pread(fd, buffer.data() + done, static_cast<size_t>(size - done), static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                ok = false;
+                break;
+            }
+            done += static_cast<uint64_t>(n);
+        }
+    }
+    ::close(fd);
+    if (!dropped)
+        return false;
+    mode = UncachedReadMode::DroppedCache;
+    data = buffer.data();
+    return ok;
+#else
+    return false;
+#endif
+}
+
+MappedFileRange::MappedFileRange()
+    : base(nullptr), mappedSize(0), view(nullptr), viewSize(0)
+#ifdef _WIN32
+      ,
+      mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFileRange::~MappedFileRange()
+{
+    unmap();
+}
+
+#ifdef _WIN32
+bool MappedFileRange::map(const std::string &path, uint64_t offset, uint64_t size)
+{
+    unmap();
+    if (size == 0)
+        return false;
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+
+    // MapViewOfFileのオフセットは割り当て粒度（通常64KB）に揃える必要がある
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    uint64_t mapOffset = alignDown(offset, info.dwAllocationGranularity);
+    uint64_t head = offset - mapOffset;
+    void *p = MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(mapOffset >> 32),
+                            static_cast<DWORD>(mapOffset & 0xFFFFFFFF), static_cast<SIZE_T>(head + size));
+    if (!p)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    mappingHandle = mapping;
+    base = p;
+    mappedSize = static_cast<size_t>(head + size);
+    view = static_cast<const char *>(p) + head;
+    viewSize = static_cast<size_t>(size);
+    return true;
+}
+
+void MappedFileRange::unmap()
+{
+    if (base)
+        UnmapViewOfFile(base);
+    if (mappingHandle)
+        CloseHandle(static_cast<HANDLE>(mappingHandle));
+    base = nullptr;
+    mappingHandle = nullptr;
+    mappedSize = 0;
+    view = nullptr;
+    viewSize = 0;
+}
+#else
+bool MappedFileRange::map(const std::string &path, uint64_t offset, uint64_t size)
+{
+    unmap();
+    if (size == 0)
+        return false;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t mapOffset = alignDown(offset, pageSize);
+    uint64_t head = offset - mapOffset;
+    void *p = ::mmap(nullptr, static_cast<size_t>(head + size), PROT_READ, MAP_SHARED, fd,
+                     static_cast<off_t>(mapOffset));
+    ::close(fd); // マップはファイルを閉じても有効
+    if (p == MAP_FAILED)
+        return false;
+
+    base = p;
+    mappedSize = static_cast<size_t>(head + size);
+    view = static_cast<const char *>(p) + head;
+    viewSize = static_cast<size_t>(size);
+    return true;
+}
+
+void MappedFileRange::unmap()
+{
+    if (base)
+        ::munmap(base, mappedSize);
+    base = nullptr;
+    mappedSize = 0;
+    view = nullptr;
+    viewSize = 0;
+}
+#endif
@@ -0,0 +1,78 @@
+#ifndef ALIGNED_IO_HPP
+#define ALIGNED_IO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ダイレクトI/O（O_DIRECT）とページ境界のマッピングで使う境界（ブロック形式アーカイブの --align-blocks と同じ）
+constexpr uint64_t DIRECT_IO_ALIGNMENT = 4096;
+
+// 境界を揃えて確保したバッファ（O_DIRECTの読み込み先）
+class AlignedBuffer
+{
+private:
+    char *ptr;
+    size_t capacity;
+
+public:
+    AlignedBuffer();
+    ~AlignedBuffer();
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    // size バイト以上を DIRECT_IO_ALIGNMENT 境界に確保する（内容は保持しない）
+    bool reserve(size_t size);
+
+    char *data() { return ptr; }
+    size_t size() const { return capacity; }
+};
+
+// ファイルの [offset, offset + size) を読み込み、先頭をdataに返す（dataはbuffer内を指す）
+// 範囲を DIRECT_IO_ALIGNMENT 境界に広げてダイレクトI/O（LinuxはO_DIRECT、WindowsはFILE_FLAG_NO_BUFFERING）で読む。
+// ダイレクトI/Oが使えない場合（tmpfsなど）は通常の読み込みに切り替える
+// usedDirect: ダイレクトI/Oで読めたかどうかの出力先（不要ならnullptr）
+bool readFileRangeDirect(const std::string &path, uint64_t offset, uint64_t size, AlignedBuffer &buffer,
+                         const char *&data, bool *usedDirect = nullptr);
+
+// ページキャッシュを介さずに読んだ方法
+enum class UncachedReadMode
+{
+    None,        // キャッシュを避けられなかった（読み込んでいない）
+    Direct,      // ダイレクトI/O
+    DroppedCache // fdatasyncで書き出してからキャッシュを捨てて（POSIX_FADV_DONTNEED）通常の読み込み
+};
+
+// 書き込んだばかりの範囲を、ページキャッシュではなくディスク（またはネットワーク共有）から読み直す（読み戻し検証用）
+// ダイレクトI/Oが使えない場合はキャッシュを捨ててから読む。どちらもできない場合はmodeをNoneにしてfalseを返す
+bool readFileRangeUncached(const std::string &path, uint64_t offset, uint64_t size, AlignedBuffer &buffer,
+                           const char *&data, UncachedReadMode &mode);
+
+// ファイルの一部を読み込み専用でメモリにマップする
+// offsetがページ境界に揃っていれば data() もページ境界になる（揃っていない場合も data() は offset の位置を指す）
+class MappedFileRange
+{
+private:
+    void *base;        // マップした領域の先頭
+    size_t mappedSize; // マップした領域のバイト数
+    const char *view;  // 要求した範囲の先頭
+    size_t viewSize;
+#ifdef _WIN32
+    void *mappingHandle;
+#endif
+
+public:
+    MappedFileRange();
+    ~MappedFileRange();
+    MappedFileRange(const MappedFileRange &) = delete;
+    MappedFileRange &operator=(const MappedFileRange &) = delete;
+
+    bool map(const std::string &path, uint64_t offset, uint64_t size);
+    void unmap();
+
+    const char *data() const { return view; }
+    size_t size() const { return viewSize; }
+    bool isMapped() const { return base != nullptr; }
+};
+
+#endif // ALIGNED_IO_HPP
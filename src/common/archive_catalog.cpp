@@ -0,0 +1,224 @@
+#include "archive_catalog.hpp"
+#include "checksum.hpp"
+#include "common.hpp"
+#include <sstream>
+
+// 同一プロセス内でのカタログへの同時追記を防ぐ
+static std::mutex catalogMutex;
+
+CatalogEntry::CatalogEntry()
+    : run(0), firstFrame(0), lastFrame(0), fileCount(0), offset(0), size(0), rawSize(0),
+      checksum(0), compressMs(0), committedAt(0), removed(false), setSize(0)
+{
+}
+
+std::string getCatalogPath(const std::string &dir)
+{
+    return dir + "/compressor_catalog.tsv";
+}
+
+static std::string toHex(uint64_t value)
+{
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return oss.str();
+}
+
+// チェックサムを除いた行の内容
+static std::string formatEntry(const CatalogEntry &entry)
+{
+    std::ostringstream oss;
+    oss << entry.prefix << '\t' << entry.run << '\t' << entry.firstFrame << '\t' << entry.lastFrame << '\t'
+        << entry.fileCount << '\t' << entry.archive << '\t' << entry.offset << '\t' << entry.size << '\t'
+        << entry.rawSize << '\t' << toHex(entry.checksum) << '\t' << entry.compressMs << '\t'
+        << entry.committedAt << '\t' << (entry.removed ? 1 : 0) << '\t' << entry.root << '\t'
+        << entry.setSize;
+    return oss.str();
+}
+
+static bool parseEntry(const std::string &line, CatalogEntry &entry)
+{
+    // 末尾のフィールドが行のチェックサム
+    size_t lastTab = line.rfind('\t');
+    if (lastTab == std::string::npos)
+        return false;
+
+    std::string content = line.substr(0, lastTab);
+    if (toHex(computeChecksum64(content)) != line.substr(lastTab + 1))
+        return false;
+
+    std::vector<std::string> fields;
+    std::istringstream iss(content);
+    std::string field;
+    while (std::getline(iss, field, '\t'))
+    {
+        fields.push_back(field);
+    }
+    if (fields.size() < 13)
+        return false;
+
+    try
+    {
+        entry.prefix = fields[0];
+        entry.run = std::stoi(fields[1]);
+        entry.firstFrame = std::stoi(fields[2]);
+        entry.lastFrame = std::stoi(fields[3]);
+        entry.fileCount = static_cast<uint32_t>(std::stoul(fields[4]));
+        entry.archive = fields[5];
+        entry.offset = std::stoull(fields[6]);
+        entry.size = std::stoull(fields[7]);
+        entry.rawSize = std::stoull(fields[8]);
+        entry.checksum = std::stoull(fields[9], nullptr, 16);
+        entry.compressMs = std::stoll(fields[10]);
+        entry.committedAt = std::stoll(fields[11]);
+        entry.removed = fields[12] == "1";
+        // v1の行にはroot列がない
+        entry.root = fields.size() > 13 ? fields[13] : "";
+        // v2以前の行にはset_size列がない
+        entry.setSize = fields.size() > 14 ? std::stoi(fields[14]) : 0;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool appendCatalogEntry(const std::string &dir, const CatalogEntry &entry)
+{
+    std::lock_guard<std::mutex> lock(catalogMutex);
+
+    try
+    {
+        std::string catalogPath = getCatalogPath(dir);
+        bool isNew = !fs::exists(catalogPath);
+
+        std::string content = formatEntry(entry);
+        std::string line;
+
+        // 前回の書き込みが行の途中で途切れている場合は改行を補い、新しい行を巻き込まないようにする
+        if (!isNew && fs::file_size(catalogPath) > 0)
+        {
+            std::ifstream inFile(catalogPath, std::ios::binary);
+            inFile.seekg(-1, std::ios::end);
+            char lastChar = '\n';
+            if (inFile.get(lastChar) && lastChar != '\n')
+            {
+                line += '\n';
+            }
+        }
+
+        if (isNew)
+        {
+            line += "# bl02b1_tif_compressor catalog v" + std::to_string(ARCHIVE_CATALOG_VERSION) +
+                    "\n# prefix\trun\tfirst_frame\tlast_frame\tfile_count\tarchive\toffset\tsize\traw_size"
+                    "\tchecksum\tcompress_ms\tcommitted_at\tremoved\troot\tset_size\tline_checksum\n";
+        }
+        line += content + '\t' + toHex(computeChecksum64(content)) + '\n';
+
+        // 1行を1回の書き込みで追記する
+        std::ofstream outFile(catalogPath, std::ios::binary | std::ios::app);
+        if (!outFile)
+        {
+            LOG("Error: Cannot open catalog: " << catalogPath);
+            return false;
+        }
+        outFile.write(line.data(), line.size());
+        outFile.flush();
+        if (!outFile)
+        {
+            LOG("Error: Failed to append to catalog: " << catalogPath);
+            return false;
+        }
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Error appending to catalog: " << e.what());
+        return false;
+    }
+}
+
+ArchiveCatalog::ArchiveCatalog(const std::string &dir) : dir(dir), skippedLines(0)
+{
+}
+
+bool ArchiveCatalog::load()
+{
+    latest.clear();
+    skippedLines = 0;
+
+    std::ifstream inFile(getCatalogPath(dir), std::ios::binary);
+    if (!inFile)
+        return false;
+
+    std::string line;
+    while (std::getline(inFile, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        // 最終行が途切れている場合（改行なし）も、チェックサムで弾かれる
+        CatalogEntry entry;
+        if (!parseEntry(line, entry))
+        {
+            skippedLines++;
+            continue;
+        }
+        latest[Key(entry.prefix, entry.run, entry.firstFrame)] = entry;
+    }
+    return true;
+}
+
+std::vector<CatalogEntry> ArchiveCatalog::entries() const
+{
+    std::vector<CatalogEntry> result;
+    for (const auto &pair : latest)
+    {
+        if (!pair.second.removed)
+            result.push_back(pair.second);
+    }
+    return result;
+}
+
+bool ArchiveCatalog::findFrame(const std::string &prefix, int run, int frame, CatalogEntry &entry) const
+{
+    // firstFrame <= frame となる最後のエントリから遡って探す
+    auto it = latest.upper_bound(Key(prefix, run, frame));
+    while (it != latest.begin())
+    {
+        --it;
+        const CatalogEntry &candidate = it->second;
+        if (candidate.prefix != prefix || candidate.run != run)
+            break;
+        if (candidate.removed)
+            continue;
+        if (candidate.lastFrame >= frame)
+        {
+            entry = candidate;
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+std::vector<CatalogEntry> ArchiveCatalog::findRange(const std::string &prefix, int run, int firstFrame, int lastFrame) const
+{
+    std::vector<CatalogEntry> result;
+    for (auto it = latest.lower_bound(Key(prefix, run, 0)); it != latest.end(); ++it)
+    {
+        const CatalogEntry &entry = it->second;
+        if (entry.prefix != prefix || entry.run != run || entry.firstFrame > lastFrame)
+            break;
+        if (!entry.removed && entry.lastFrame >= firstFrame)
+            result.push_back(entry);
+    }
+    return result;
+}
+
+std::string ArchiveCatalog::resolvePath(const CatalogEntry &entry) const
+{
+    const std::string &base = entry.root.empty() ? dir : entry.root;
+    return (fs::path(base) / entry.archive).string();
+}
@@ -0,0 +1,83 @@
+#ifndef ARCHIVE_CATALOG_HPP
+#define ARCHIVE_CATALOG_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// 出力ディレクトリごとのアーカイブカタログ（compressor_catalog.tsv）
+// セットを書き込むたびに1行をタブ区切りで追記する。各行の末尾に行のチェックサムを付け、
+// 途中で途切れた行や破損した行は読み込み時に無視する。
+// 同じ (prefix, run, firstFrame) の行が複数ある場合は後の行が有効（再処理・置き換え）。
+// 解析ツールからも直接読めるよう、アーカイブを開かずに範囲検索に必要な情報をすべて持つ。
+
+// v2: 出力先ルート（root列）を追加。v1の行はroot列なしとして読み込む
+// v3: runのセットのファイル数（set_size列）を追加。v2以前の行は不明（0）として読み込む
+constexpr int ARCHIVE_CATALOG_VERSION = 3;
+
+// カタログの1エントリ（1アーカイブ、またはランコンテナ内の1セグメント）
+struct CatalogEntry
+{
+    std::string prefix;   // ファイル名の接頭辞（"<prefix>_<run>_<番号>.tif" の <prefix>）
+    int run;
+    int firstFrame;       // アーカイブに含まれる最初のファイル番号
+    int lastFrame;        // アーカイブに含まれる最後のファイル番号
+    uint32_t fileCount;
+    std::string archive;  // 出力先ルートからの相対パス（.lz4 または .lz4c）
+    uint64_t offset;      // ファイル内のアーカイブ先頭位置（ランコンテナのセグメントの場合は非0）
+    uint64_t size;        // アーカイブのバイト数
+    uint64_t rawSize;     // 元ファイルの合計バイト数
+    uint64_t checksum;    // アーカイブのバイト列のチェックサム
+    int64_t compressMs;   // 読み込み〜圧縮〜検証にかかった時間
+    int64_t committedAt;  // 登録時刻（エポックミリ秒）
+    bool removed;         // 削除・置き換え済み（以後の検索対象外）
+    std::string root;     // 出力先ルート（空の場合はカタログのあるディレクトリ）
+    int setSize;          // runのセットのファイル数（セットの境界。0: 不明）
+
+    CatalogEntry();
+};
+
+// カタログファイルのパス
+std::string getCatalogPath(const std::string &dir);
+
+// エントリを1行追記する（同一プロセス内の同時追記は直列化される）
+// 戻り値: 成功した場合true
+bool appendCatalogEntry(const std::string &dir, const CatalogEntry &entry);
+
+// カタログの読み込みと検索
+class ArchiveCatalog
+{
+private:
+    using Key = std::tuple<std::string, int, int>; // (prefix, run, firstFrame)
+
+    std::string dir;
+    std::map<Key, CatalogEntry> latest; // キーごとの最新エントリ
+    size_t skippedLines;
+
+public:
+    explicit ArchiveCatalog(const std::string &dir);
+
+    // カタログを読み込む。カタログが存在しない場合false
+    bool load();
+
+    // 有効なエントリ（削除済みを除く）を (prefix, run, firstFrame) 順で返す
+    std::vector<CatalogEntry> entries() const;
+
+    // 指定したフレームを含むアーカイブを探す
+    bool findFrame(const std::string &prefix, int run, int frame, CatalogEntry &entry) const;
+
+    // [firstFrame, lastFrame] と重なるアーカイブを順に返す
+    std::vector<CatalogEntry> findRange(const std::string &prefix, int run, int firstFrame, int lastFrame) const;
+
+    // 破損などで無視した行数
+    size_t getSkippedLines() const { return skippedLines; }
+
+    const std::string &getDir() const { return dir; }
+
+    // エントリのアーカイブのパス（出力先ルートを考慮）
+    std::string resolvePath(const CatalogEntry &entry) const;
+};
+
+#endif // ARCHIVE_CATALOG_HPP
@@ -0,0 +1,390 @@
+#include "block_archive.hpp"
+#include "checksum.hpp"
+#include "index_footer.hpp"
+#include "predictive_codec.hpp"
+#include "block_probe.hpp"
+#include <lz4.h>
+#include <lz4hc.h>
+#include <algorithm>
+#include <cstring>
+
+BlockEntry::BlockEntry()
+    : kind(BlockKind::File), codec(BlockCodec::Store), flags(0), rawSize(0), storedSize(0), offset(0),
+      rawChecksum(0), storedChecksum(0)
+{
+}
+
+const char *blockCodecName(BlockCodec codec)
+{
+    switch (codec)
+    {
+    case BlockCodec::Store:
+        return "store";
+    case BlockCodec::LZ4:
+        return "lz4";
+    case BlockCodec::Predictive:
+        return "predictive";
+    case BlockCodec::Auto:
+        return "auto";
+    }
+    return "unknown";
+}
+
+const char *blockKindName(BlockKind kind)
+{
+    switch (kind)
+    {
+    case BlockKind::File:
+        return "file";
+    case BlockKind::Sidecar:
+        return "sidecar";
+    case BlockKind::Checkpoint:
+        return "checkpoint";
+    case BlockKind::Spots:
+        return "spots";
+    }
+    return "unknown";
+}
+
+bool parseBlockCodec(const std::string &name, BlockCodec &codec)
+{
+    if (name == "store")
+        codec = BlockCodec::Store;
+    else if (name == "lz4")
+        codec = BlockCodec::LZ4;
+    else if (name == "predictive")
+        codec = BlockCodec::Predictive;
+    else if (name == "auto")
+        codec = BlockCodec::Auto;
+    else
+        return false;
+    return true;
+}
+
+// --codec=auto でLZ4HCを選んだブロックの圧縮レベル
+// 疎なフレームではレベル3でLZ4の約2/3の大きさになり、それ以上は大きさがほとんど変わらず符号化が遅くなる
+constexpr int AUTO_LZ4HC_LEVEL = LZ4HC_CLEVEL_MIN;
+
+// maxStoredSize: 圧縮後のサイズの上限（超える場合は途中で打ち切ってfalseを返す）
+// highCompression: LZ4HCで圧縮する（lz4Accelerationは使わない）
+static bool encodeLZ4(const std::string &raw, int lz4Acceleration, bool highCompression, size_t maxStoredSize,
+                      std::string &stored)
+{
+    int maxCompressedSize = LZ4_compressBound(static_cast<int>(raw.size()));
+    if (maxCompressedSize <= 0)
+        return false;
+    maxCompressedSize = static_cast<int>(std::min<size_t>(maxCompressedSize, maxStoredSize));
+    if (maxCompressedSize <= 0)
+        return false;
+
+    stored.resize(maxCompressedSize);
+    int compressedSize = highCompression
+                             ? LZ4_compress_HC(raw.data(), &stored[0], static_cast<int>(raw.size()), maxCompressedSize,
+                                               AUTO_LZ4HC_LEVEL)
+                             : LZ4_compress_fast(raw.data(), &stored[0], static_cast<int>(raw.size()), maxCompressedSize,
+                                                 lz4Acceleration);
+    if (compressedSize <= 0)
+        return false;
+    stored.resize(compressedSize);
+    return true;
+}
+
+bool encodeBlock(const std::string &raw, BlockCodec codec, int lz4Acceleration, std::string &stored,
+                 BlockCodec &usedCodec, double storeThreshold, uint16_t *flags)
+{
+    if (flags)
+        *flags &= ~BLOCK_FLAG_LZ4HC;
+
+    // ブロックを調べてコーデックを選ぶ（ほとんど縮まないブロックは圧縮を試さずに無圧縮で格納する）
+    bool highCompression = false;
+    if (codec == BlockCodec::Auto)
+    {
+        codec = chooseBlockCodec(probeBlock(raw.data(), raw.size()), lz4Acceleration, lz4Acceleration, highCompression);
+        if (codec == BlockCodec::Store)
+        {
+            usedCodec = BlockCodec::Store;
+            stored = raw;
+            return !raw.empty();
+        }
+    }
+
+    // 格納データの上限（元より小さく、元のstoreThreshold倍以下）
+    size_t maxStoredSize = raw.empty() ? 0 : raw.size() - 1;
+    if (storeThreshold < 1.0)
+        maxStoredSize = std::min(maxStoredSize, static_cast<size_t>(std::max(0.0, storeThreshold) * raw.size()));
+
+    usedCodec = codec;
+    bool encoded = false;
+    if (codec == BlockCodec::Predictive)
+    {
+        encoded = encodePredictiveFile(raw, stored);
+        if (!encoded)
+            usedCodec = BlockCodec::LZ4;
+    }
+    if (usedCodec == BlockCodec::LZ4)
+    {
+        encoded = encodeLZ4(raw, lz4Acceleration, highCompression, maxStoredSize, stored);
+    }
+
+    // 圧縮できない（上限まで小さくならない）場合は無圧縮で格納
+    if (usedCodec == BlockCodec::Store || !encoded || stored.size() > maxStoredSize)
+    {
+        bool storedRaw = usedCodec != BlockCodec::Store && !raw.empty();
+        usedCodec = BlockCodec::Store;
+        stored = raw;
+        return storedRaw;
+    }
+    if (flags && highCompression && usedCodec == BlockCodec::LZ4)
+        *flags |= BLOCK_FLAG_LZ4HC;
+    return false;
+}
+
+bool decodeBlock(const BlockEntry &entry, const char *stored, std::vector<char> &raw, int maxThreads)
+{
+    raw.resize(entry.rawSize);
+    switch (entry.codec)
+    {
+    case BlockCodec::Store:
+        if (entry.storedSize != entry.rawSize)
+            return false;
+        std::memcpy(raw.data(), stored, entry.rawSize);
+        return true;
+    case BlockCodec::LZ4:
+    {
+        int decompressedSize = LZ4_decompress_safe(stored, raw.data(), static_cast<int>(entry.storedSize),
+                                                   static_cast<int>(entry.rawSize));
+        return decompressedSize >= 0 && static_cast<uint64_t>(decompressedSize) == entry.rawSize;
+    }
+    case BlockCodec::Predictive:
+        return decodePredictiveFile(stored, entry.storedSize, raw.data(), raw.size(), maxThreads);
+    case BlockCodec::Auto:
+        break;
+    }
+    return false;
+}
+
+bool decodeAndVerifyBlock(const BlockEntry &entry, const char *stored, std::vector<char> &raw, int maxThreads)
+{
+    if (computeChecksum64(stored, entry.storedSize) != entry.storedChecksum)
+        return false;
+    if (!decodeBlock(entry, stored, raw, maxThreads))
+        return false;
+    return computeChecksum64(raw.data(), raw.size()) == entry.rawChecksum;
+}
+
+BlockArchiveBuilder::BlockArchiveBuilder(uint64_t alignment)
+    : baseOffset(0), alignment(alignment), paddingBytes(0), addedCount(0)
+{
+    data.append(reinterpret_cast<const char *>(&BLOCK_ARCHIVE_MAGIC), sizeof(uint32_t));
+    data.append(reinterpret_cast<const char *>(&BLOCK_ARCHIVE_VERSION), sizeof(uint32_t));
+}
+
+BlockArchiveBuilder::BlockArchiveBuilder(const std::vector<BlockEntry> &existing, uint64_t baseSize, uint64_t alignment)
+    : entries(existing), baseOffset(baseSize), alignment(alignment), paddingBytes(0), addedCount(0)
+{
+}
+
+void BlockArchiveBuilder::addBlock(BlockEntry entry, const std::string &stored)
+{
+    // 同じ名前のブロックは新しい方で置き換える（インデックスはオフセット順を保つため末尾に移す）
+    auto existing = std::find_if(entries.begin(), entries.end(), [&entry](const BlockEntry &e)
+                                 { return e.name == entry.name && e.kind == entry.kind; });
+    if (existing != entries.end())
+    {
+        if (existing->rawSize == entry.rawSize && existing->rawChecksum == entry.rawChecksum)
+            return;
+        entries.erase(existing);
+    }
+
+    if (alignment > 0)
+    {
+        uint64_t remainder = (baseOffset + data.size()) % alignment;
+        if (remainder != 0)
+        {
+            data.append(static_cast<size_t>(alignment - remainder), '\0');
+            paddingBytes += alignment - remainder;
+        }
+        entry.flags |= BLOCK_FLAG_ALIGNED;
+    }
+    else
+    {
+        entry.flags &= ~BLOCK_FLAG_ALIGNED;
+    }
+    entry.offset = baseOffset + data.size();
+    entry.storedSize = stored.size();
+    entry.storedChecksum = computeChecksum64(stored);
+    data.append(stored);
+    entries.push_back(std::move(entry));
+    addedCount++;
+}
+
+std::string BlockArchiveBuilder::finish()
+{
+    std::string indexData = serializeBlockIndex(entries);
+    data.append(buildIndexTrailer(indexData, baseOffset + data.size(), BLOCK_ARCHIVE_MAGIC, BLOCK_ARCHIVE_VERSION));
+    std::string result;
+    result.swap(data);
+    return result;
+}
+
+template <typename T>
+static void appendValue(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+std::string serializeBlockIndex(const std::vector<BlockEntry> &entries)
+{
+    // エントリ数(4) + 各エントリ: 名前の長さ(2) + 名前 + 種類(1) + コーデック(1) + フラグ(2)
+    //                             + 復号後サイズ(8) + 格納サイズ(8) + 位置(8) + チェックサム(8×2)
+    std::string out;
+    appendValue(out, static_cast<uint32_t>(entries.size()));
+    for (const auto &entry : entries)
+    {
+        appendValue(out, static_cast<uint16_t>(entry.name.size()));
+        out.append(entry.name);
+        appendValue(out, static_cast<uint8_t>(entry.kind));
+        appendValue(out, static_cast<uint8_t>(entry.codec));
+        appendValue(out, entry.flags);
+        appendValue(out, entry.rawSize);
+        appendValue(out, entry.storedSize);
+        appendValue(out, entry.offset);
+        appendValue(out, entry.rawChecksum);
+        appendValue(out, entry.storedChecksum);
+    }
+    return out;
+}
+
+bool deserializeBlockIndex(const std::string &indexData, std::vector<BlockEntry> &entries)
+{
+    size_t offset = 0;
+    auto read = [&](void *dst, size_t n)
+    {
+        if (offset + n > indexData.size())
+            return false;
+        std::memcpy(dst, indexData.data() + offset, n);
+        offset += n;
+        return true;
+    };
+
+    uint32_t count;
+    if (!read(&count, sizeof(count)))
+        return false;
+
+    entries.clear();
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        BlockEntry entry;
+        uint16_t nameLen;
+        uint8_t kind, codec;
+        if (!read(&nameLen, sizeof(nameLen)) || offset + nameLen > indexData.size())
+            return false;
+        entry.name.assign(indexData, offset, nameLen);
+        offset += nameLen;
+        if (!read(&kind, 1) || !read(&codec, 1) || !read(&entry.flags, 2) || !read(&entry.rawSize, 8) ||
+            !read(&entry.storedSize, 8) || !read(&entry.offset, 8) || !read(&entry.rawChecksum, 8) ||
+            !read(&entry.storedChecksum, 8))
+            return false;
+        entry.kind = static_cast<BlockKind>(kind);
+        entry.codec = static_cast<BlockCodec>(codec);
+        entries.push_back(std::move(entry));
+    }
+    return offset == indexData.size();
+}
+
+bool isBlockArchive(const char *data, size_t size)
+{
+    uint32_t magic;
+    if (size < BLOCK_ARCHIVE_HEADER_SIZE)
+        return false;
+    std::memcpy(&magic, data, sizeof(uint32_t));
+    return magic == BLOCK_ARCHIVE_MAGIC;
+}
+
+bool readBlockArchiveIndex(const char *data, size_t size, std::vector<BlockEntry> &entries)
+{
+    if (!isBlockArchive(data, size))
+        return false;
+
+    IndexFooter footer;
+    std::string indexData;
+    if (!findLatestIndex(data, size, BLOCK_ARCHIVE_MAGIC, footer, indexData))
+        return false;
+    if (!deserializeBlockIndex(indexData, entries))
+        return false;
+
+    // ブロックがインデックスより前に収まっているか確認
+    for (const auto &entry : entries)
+    {
+        if (entry.offset < BLOCK_ARCHIVE_HEADER_SIZE || entry.offset + entry.storedSize > footer.indexOffset)
+            return false;
+    }
+    return true;
+}
+
+bool readBlockArchiveIndex(std::istream &in, uint64_t regionOffset, uint64_t regionSize, std::vector<BlockEntry> &entries)
+{
+    char header[BLOCK_ARCHIVE_HEADER_SIZE];
+    if (regionSize < BLOCK_ARCHIVE_HEADER_SIZE)
+        return false;
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(regionOffset));
+    if (!in.read(header, sizeof(header)) || !isBlockArchive(header, sizeof(header)))
+        return false;
+
+    IndexFooter footer;
+    std::string indexData;
+    if (!findLatestIndex(in, regionOffset, regionSize, BLOCK_ARCHIVE_MAGIC, footer, indexData))
+        return false;
+    if (!deserializeBlockIndex(indexData, entries))
+        return false;
+
+    for (const auto &entry : entries)
+    {
+        if (entry.offset < BLOCK_ARCHIVE_HEADER_SIZE || entry.offset + entry.storedSize > footer.indexOffset)
+            return false;
+    }
+    return true;
+}
+
+uint64_t countBlockPadding(const std::vector<BlockEntry> &entries)
+{
+    uint64_t padding = 0;
+    uint64_t position = BLOCK_ARCHIVE_HEADER_SIZE;
+    for (const auto &entry : entries)
+    {
+        if (entry.offset > position)
+            padding += entry.offset - position;
+        position = entry.offset + entry.storedSize;
+    }
+    return padding;
+}
+
+bool buildBlockArchiveAppend(const char *existing, size_t existingSize, const char *addition, size_t additionSize,
+                             uint64_t alignment, std::string &appendData, std::vector<BlockEntry> *merged,
+                             size_t *addedCount)
+{
+    std::vector<BlockEntry> existingEntries, additionEntries;
+    if (!readBlockArchiveIndex(existing, existingSize, existingEntries) ||
+        !readBlockArchiveIndex(addition, additionSize, additionEntries))
+        return false;
+
+    // 既存のブロックが境界に揃っている場合は、追記するブロックも揃える
+    if (alignment == 0 && std::any_of(existingEntries.begin(), existingEntries.end(), [](const BlockEntry &entry)
+                                      { return (entry.flags & BLOCK_FLAG_ALIGNED) != 0; }))
+        alignment = BLOCK_ALIGNMENT;
+
+    // 格納データはそのまま写す（再圧縮しない）
+    BlockArchiveBuilder builder(existingEntries, existingSize, alignment);
+    for (const auto &entry : additionEntries)
+    {
+        builder.addBlock(entry, std::string(addition + entry.offset, entry.storedSize));
+    }
+    appendData = builder.finish();
+
+    if (merged)
+        *merged = builder.getEntries();
+    if (addedCount)
+        *addedCount = builder.getAddedCount();
+    return true;
+}
@@ -0,0 +1,153 @@
+#ifndef BLOCK_ARCHIVE_HPP
+#define BLOCK_ARCHIVE_HPP
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// ブロック形式アーカイブ（v2）
+// ファイルごとに独立したブロックとして圧縮し、末尾のインデックスに各ブロックの位置・コーデック・
+// チェックサムを記録する。セット全体を1つのLZ4ブロックにするv1と異なり、1ファイルだけを取り出したり、
+// ファイルごとに適したコーデックを選んだりできる。
+//
+// [ヘッダー: マジック "LZ4B"(4) + バージョン(4)][ブロック...][インデックス][IndexFooter]
+// インデックスの位置はIndexFooterから求める（v1と同じく.lz4ファイル、ランコンテナのセグメントとして使える）
+//
+// 後から届いたフレームは、既存のアーカイブの末尾に [ブロック...][インデックス][IndexFooter] を追記して加える。
+// 新しいインデックスは既存のブロックも含めて列挙し、最新のフッターだけが読まれるため古いインデックスは無効になる
+// （追記が途中で途切れた場合は後方スキャンで古いインデックスに戻る）
+
+constexpr uint32_t BLOCK_ARCHIVE_MAGIC = 0x42345A4C; // "LZ4B" in little endian
+constexpr uint32_t BLOCK_ARCHIVE_VERSION = 2;
+constexpr size_t BLOCK_ARCHIVE_HEADER_SIZE = 8;
+
+// ブロックのフラグ
+constexpr uint16_t BLOCK_FLAG_ALIGNED = 0x0001;    // ブロックの先頭がアーカイブ先頭から BLOCK_ALIGNMENT の倍数の位置にある
+constexpr uint16_t BLOCK_FLAG_STORED_RAW = 0x0002; // 圧縮しても十分に小さくならないため無圧縮で格納した（codecはStore）
+constexpr uint16_t BLOCK_FLAG_LZ4HC = 0x0004;      // LZ4HCで圧縮した（codecはLZ4、復号はLZ4と同じ。--codec=auto）
+
+// --align-blocks で揃える境界（O_DIRECTでの読み込み、ページ境界でのマッピング用）
+constexpr uint64_t BLOCK_ALIGNMENT = 4096;
+
+// ブロックのコーデック
+enum class BlockCodec : uint8_t
+{
+    Store = 0,     // 無圧縮
+    LZ4 = 1,       // LZ4
+    Predictive = 2, // 予測符号化（非圧縮の整数TIFF）
+    Auto = 255      // 符号化時の指定のみ: ブロックごとに調べて上のいずれかを選ぶ（block_probe.hpp。インデックスには記録しない）
+};
+
+// ブロックの種類
+enum class BlockKind : uint8_t
+{
+    File = 0,       // 元ファイル（フレーム）
+    Sidecar = 1,    // runに付随するファイル（.finfなど）
+    Checkpoint = 2, // フレームの累積和画像（frame_checkpoint.hpp、解凍時のマージ用）
+    Spots = 3       // フレームごとのスポットの一覧（spot_finder.hpp）
+};
+
+// インデックスの1エントリ
+struct BlockEntry
+{
+    std::string name;        // ファイル名
+    BlockKind kind;
+    BlockCodec codec;
+    uint16_t flags;
+    uint64_t rawSize;        // 復号後のバイト数
+    uint64_t storedSize;     // 格納されているバイト数
+    uint64_t offset;         // アーカイブ先頭からの位置
+    uint64_t rawChecksum;    // 復号後のデータのチェックサム
+    uint64_t storedChecksum; // 格納されているデータのチェックサム
+
+    BlockEntry();
+};
+
+// コーデック名（"store", "lz4", "predictive", "auto"）
+const char *blockCodecName(BlockCodec codec);
+
+// ブロックの種類の名前（"file", "sidecar", "checkpoint", "spots"）
+const char *blockKindName(BlockKind kind);
+
+// コーデック名からコーデックを取得する（不明な場合false）
+bool parseBlockCodec(const std::string &name, BlockCodec &codec);
+
+// データをブロックとして符号化する
+// 指定したコーデックが使えない場合（予測符号化に対応しない形式）はLZ4を、
+// 圧縮後のサイズが元のstoreThreshold倍を超える場合は無圧縮を使う。実際に使ったコーデックをusedCodecに返す
+// （LZ4は出力先の大きさを上限に制限して符号化し、上限を超えた時点で打ち切る）
+// codecがAutoの場合はブロックを調べてコーデックとLZ4の設定を選ぶ（ほとんど縮まないと判定したブロックは無圧縮）
+// flags: nullptr以外の場合、LZ4HCで圧縮したらBLOCK_FLAG_LZ4HCを設定し、それ以外はクリアする
+// 戻り値: 圧縮できずに無圧縮で格納した場合true（codecにStoreを指定した場合はfalse）
+bool encodeBlock(const std::string &raw, BlockCodec codec, int lz4Acceleration, std::string &stored,
+                 BlockCodec &usedCodec, double storeThreshold = 1.0, uint16_t *flags = nullptr);
+
+// ブロックを復号する（rawはentry.rawSizeバイトに設定される）
+// チェックサムは検証しない（呼び出し側でverifyBlockを使う）
+bool decodeBlock(const BlockEntry &entry, const char *stored, std::vector<char> &raw, int maxThreads = 1);
+
+// 格納データと復号後のデータのチェックサムを検証して復号する
+bool decodeAndVerifyBlock(const BlockEntry &entry, const char *stored, std::vector<char> &raw, int maxThreads = 1);
+
+// アーカイブのバイト列を組み立てる
+// 追記用に作成した場合は、既存のアーカイブの末尾に書き足すバイト列だけを組み立てる
+class BlockArchiveBuilder
+{
+private:
+    std::string data;
+    std::vector<BlockEntry> entries;
+    uint64_t baseOffset;   // dataの先頭のアーカイブ内での位置（追記の場合は既存のアーカイブのサイズ）
+    uint64_t alignment;    // ブロックの先頭を揃える境界（0: 揃えない）
+    uint64_t paddingBytes; // 境界を揃えるために挿入したバイト数
+    size_t addedCount;     // 追加したブロック数
+
+public:
+    // alignment: 0以外の場合、各ブロックの先頭がアーカイブ先頭からalignmentの倍数の位置になるよう0で埋める
+    explicit BlockArchiveBuilder(uint64_t alignment = 0);
+
+    // 既存のアーカイブ（インデックスexisting、サイズbaseSize）への追記用
+    BlockArchiveBuilder(const std::vector<BlockEntry> &existing, uint64_t baseSize, uint64_t alignment = 0);
+
+    // ブロックを追加する（offset、storedChecksum、flagsのBLOCK_FLAG_ALIGNEDは設定される）
+    // 同じ名前のブロックが既にある場合は置き換える（内容が同じ場合は追加しない）
+    void addBlock(BlockEntry entry, const std::string &stored);
+
+    // インデックスとフッターを付けてアーカイブ（追記の場合は追記するバイト列）を完成させる
+    std::string finish();
+
+    const std::vector<BlockEntry> &getEntries() const { return entries; }
+    uint64_t getPaddingBytes() const { return paddingBytes; }
+    size_t getAddedCount() const { return addedCount; }
+};
+
+// 既存のアーカイブの末尾に、別のアーカイブ（addition）のブロックを追記するバイト列を作る
+// existing: 既存のアーカイブのバイト列（existingSize バイト）
+// alignment: 追記するブロックの先頭を揃える境界（既存のブロックが揃っている場合は0でも揃える）
+// merged: 追記後のインデックスの出力先（不要ならnullptr）
+// addedCount: 実際に追記したブロック数の出力先（既存と同じ内容のブロックは追記しない）
+// 戻り値: 成功した場合true（どちらかがブロック形式アーカイブでない場合false）
+bool buildBlockArchiveAppend(const char *existing, size_t existingSize, const char *addition, size_t additionSize,
+                             uint64_t alignment, std::string &appendData, std::vector<BlockEntry> *merged = nullptr,
+                             size_t *addedCount = nullptr);
+
+// インデックスのシリアライズ／デシリアライズ
+std::string serializeBlockIndex(const std::vector<BlockEntry> &entries);
+bool deserializeBlockIndex(const std::string &indexData, std::vector<BlockEntry> &entries);
+
+// バイト列がブロック形式アーカイブか（先頭のマジックナンバーで判定）
+bool isBlockArchive(const char *data, size_t size);
+
+// メモリ上のアーカイブからインデックスを読み込む
+bool readBlockArchiveIndex(const char *data, size_t size, std::vector<BlockEntry> &entries);
+
+// ファイル内の領域 [regionOffset, regionOffset + regionSize) にあるアーカイブから、ヘッダーと末尾のインデックスだけを読み込む
+// （ブロックのoffsetは領域先頭からの相対位置）
+bool readBlockArchiveIndex(std::istream &in, uint64_t regionOffset, uint64_t regionSize, std::vector<BlockEntry> &entries);
+
+// ブロックの配置を集計する（境界揃えのための埋め草のバイト数）
+// ブロック間の隙間（ヘッダー直後から最後のブロックまで）の合計を返す
+// 追記したアーカイブでは、置き換えられたブロックと古いインデックスも隙間に含まれる
+uint64_t countBlockPadding(const std::vector<BlockEntry> &entries);
+
+#endif // BLOCK_ARCHIVE_HPP
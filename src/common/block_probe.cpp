@@ -0,0 +1,133 @@
+#include "block_probe.hpp"
+#include "tiff_layout.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// 調べる窓の数と大きさ（合計64KiB）
+constexpr size_t PROBE_SAMPLE_WINDOWS = 16;
+constexpr size_t PROBE_WINDOW_BYTES = 4096;
+
+// コーデックを選ぶ閾値
+constexpr double PROBE_STORE_ENTROPY = 7.5;  // これ以上はLZ4でもほとんど縮まない（無圧縮）
+constexpr double PROBE_EMPTY_FRACTION = 0.95; // これ以上0の画素があるフレームはほとんど空（高速なLZ4）
+constexpr double PROBE_SPARSE_FRACTION = 0.7; // これ以上0の画素があるフレームは疎（LZ4HC）
+constexpr int PROBE_EMPTY_ACCELERATION = 32;  // ほとんど空のフレームのLZ4のacceleration（0の連続は同じように縮む）
+
+BlockProbe::BlockProbe() : integerTiff(false), zeroFraction(0.0), entropy(8.0), sampledBytes(0)
+{
+}
+
+// 窓の中の0の要素を数える（要素の大きさごとの単純なループにしてコンパイラのベクトル化に任せる）
+template <typename T>
+static size_t countZeroElements(const char *data, size_t count)
+{
+    size_t zeros = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        T value;
+        std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+        zeros += value == 0;
+    }
+    return zeros;
+}
+
+BlockProbe probeBlock(const char *data, size_t size)
+{
+    BlockProbe probe;
+
+    // 整数TIFFは画素データだけを調べる（ヘッダーを数えない、0の判定を画素単位にする）
+    const char *region = data;
+    size_t regionSize = size;
+    size_t elementSize = 1;
+    TiffLayout layout;
+    if (parseTiffLayout(data, size, layout))
+    {
+        probe.integerTiff = true;
+        region = data + layout.pixelOffset;
+        regionSize = static_cast<size_t>(layout.pixelBytes);
+        elementSize = layout.bitsPerSample / 8;
+    }
+    if (regionSize == 0)
+        return probe;
+
+    // 等間隔の窓（要素の境界に揃える）
+    size_t windowBytes = std::min(PROBE_WINDOW_BYTES, regionSize) / elementSize * elementSize;
+    size_t windows = std::min(PROBE_SAMPLE_WINDOWS, regionSize / std::max<size_t>(1, windowBytes));
+    if (windowBytes == 0 || windows == 0)
+        return probe;
+    size_t stride = windows > 1 ? (regionSize - windowBytes) / (windows - 1) / elementSize * elementSize : 0;
+
+    // バイトの出現頻度は4つの表に分けて数える（連続する同じ値での依存を避ける）
+    uint32_t histogram[4][256] = {};
+    size_t zeros = 0, elements = 0;
+    for (size_t w = 0; w < windows; ++w)
+    {
+        const unsigned char *window = reinterpret_cast<const unsigned char *>(region + w * stride);
+        size_t i = 0;
+        for (; i + 4 <= windowBytes; i += 4)
+        {
+            histogram[0][window[i]]++;
+            histogram[1][window[i + 1]]++;
+            histogram[2][window[i + 2]]++;
+            histogram[3][window[i + 3]]++;
+        }
+        for (; i < windowBytes; ++i)
+            histogram[0][window[i]]++;
+
+        size_t count = windowBytes / elementSize;
+        const char *begin = reinterpret_cast<const char *>(window);
+        switch (elementSize)
+        {
+        case 2:
+            zeros += countZeroElements<uint16_t>(begin, count);
+            break;
+        case 4:
+            zeros += countZeroElements<uint32_t>(begin, count);
+            break;
+        default:
+            zeros += countZeroElements<uint8_t>(begin, count);
+            break;
+        }
+        elements += count;
+    }
+
+    probe.sampledBytes = windows * windowBytes;
+    probe.zeroFraction = static_cast<double>(zeros) / elements;
+    double entropy = 0.0;
+    for (int value = 0; value < 256; ++value)
+    {
+        uint32_t count = histogram[0][value] + histogram[1][value] + histogram[2][value] + histogram[3][value];
+        if (count == 0)
+            continue;
+        double p = static_cast<double>(count) / probe.sampledBytes;
+        entropy -= p * std::log2(p);
+    }
+    probe.entropy = entropy;
+    return probe;
+}
+
+BlockCodec chooseBlockCodec(const BlockProbe &probe, int baseAcceleration, int &acceleration, bool &highCompression)
+{
+    acceleration = baseAcceleration;
+    highCompression = false;
+    if (probe.sampledBytes == 0)
+        return BlockCodec::LZ4;
+    if (probe.entropy >= PROBE_STORE_ENTROPY)
+        return BlockCodec::Store;
+    if (probe.zeroFraction >= PROBE_EMPTY_FRACTION)
+    {
+        // 0の連続はaccelerationを上げても同じように縮む
+        acceleration = std::max(baseAcceleration, PROBE_EMPTY_ACCELERATION);
+        return BlockCodec::LZ4;
+    }
+    if (probe.zeroFraction >= PROBE_SPARSE_FRACTION || !probe.integerTiff)
+    {
+        // 疎なフレームと画像以外のデータは、より長い一致を探すと縮む
+        highCompression = true;
+        return BlockCodec::LZ4;
+    }
+    // 画素値の詰まったフレームは一致が少なく、予測の残差を符号化する方が縮む
+    return BlockCodec::Predictive;
+}
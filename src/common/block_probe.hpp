@@ -0,0 +1,30 @@
+#ifndef BLOCK_PROBE_HPP
+#define BLOCK_PROBE_HPP
+
+#include "block_archive.hpp"
+#include <cstddef>
+
+// 符号化前のブロックの簡易な統計（--codec=auto）
+// ブロック全体ではなく、等間隔に取った一部（PROBE_SAMPLE_WINDOWS 個の窓）だけを調べる。
+// 非圧縮の整数TIFFの場合は画素データだけを画素単位で、それ以外はバイト単位で数える
+struct BlockProbe
+{
+    bool integerTiff;    // 予測符号化に対応する形式（非圧縮の整数TIFF）
+    double zeroFraction; // 値が0の画素（TIFF以外はバイト）の割合
+    double entropy;      // バイトの出現頻度から求めたエントロピー（ビット/バイト、0〜8）
+    size_t sampledBytes; // 調べたバイト数
+
+    BlockProbe();
+};
+
+// ブロックを調べる（サイズに関わらず数十KiB程度しか読まない）
+BlockProbe probeBlock(const char *data, size_t size);
+
+// 調べた結果からブロックのコーデックを選ぶ
+// ほとんど空のフレームは高速なLZ4（accelerationを上げる）、疎なフレームはLZ4HC、
+// 画素値の詰まったフレームは予測符号化、ほとんど圧縮できないブロックは無圧縮
+// acceleration: LZ4を選んだ場合のacceleration（baseAccelerationを基準にする）
+// highCompression: LZ4HCで圧縮する場合true
+BlockCodec chooseBlockCodec(const BlockProbe &probe, int baseAcceleration, int &acceleration, bool &highCompression);
+
+#endif // BLOCK_PROBE_HPP
@@ -0,0 +1,147 @@
+#include "checksum.hpp"
+#include <cstring>
+
+namespace
+{
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+// 32バイト未満の残りを処理して最終値を得る
+uint64_t finalize(uint64_t h, const unsigned char *p, size_t len)
+{
+    while (len >= 8)
+    {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4)
+    {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0)
+    {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+        --len;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+} // namespace
+
+uint64_t computeChecksum64(const void *data, size_t size, uint64_t seed)
+{
+    Checksum64 state(seed);
+    state.update(data, size);
+    return state.digest();
+}
+
+Checksum64::Checksum64(uint64_t seed)
+    : v1(seed + PRIME1 + PRIME2), v2(seed + PRIME2), v3(seed), v4(seed - PRIME1),
+      seed(seed), totalLength(0), bufferSize(0)
+{
+}
+
+void Checksum64::update(const void *data, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    totalLength += size;
+
+    // 前回の端数と合わせて32バイトになる場合は先に処理
+    if (bufferSize + size < 32)
+    {
+        std::memcpy(buffer + bufferSize, p, size);
+        bufferSize += size;
+        return;
+    }
+    if (bufferSize > 0)
+    {
+        size_t fill = 32 - bufferSize;
+        std::memcpy(buffer + bufferSize, p, fill);
+        v1 = round(v1, read64(buffer));
+        v2 = round(v2, read64(buffer + 8));
+        v3 = round(v3, read64(buffer + 16));
+        v4 = round(v4, read64(buffer + 24));
+        p += fill;
+        size -= fill;
+        bufferSize = 0;
+    }
+
+    // 32バイト単位のメインループ
+    while (size >= 32)
+    {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+        size -= 32;
+    }
+
+    std::memcpy(buffer, p, size);
+    bufferSize = size;
+}
+
+uint64_t Checksum64::digest() const
+{
+    uint64_t h;
+    if (totalLength >= 32)
+    {
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    }
+    else
+    {
+        h = seed + PRIME5;
+    }
+    h += totalLength;
+    return finalize(h, buffer, bufferSize);
+}
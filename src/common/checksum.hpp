@@ -0,0 +1,33 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// XXH64互換の64ビットチェックサム
+// アーカイブ・インデックスの破損検出に使用する（暗号学的強度は不要）
+uint64_t computeChecksum64(const void *data, size_t size, uint64_t seed = 0);
+
+inline uint64_t computeChecksum64(const std::string &data, uint64_t seed = 0)
+{
+    return computeChecksum64(data.data(), data.size(), seed);
+}
+
+// 大きなデータを分割して渡すためのストリーミング版
+class Checksum64
+{
+private:
+    uint64_t v1, v2, v3, v4;
+    uint64_t seed;
+    uint64_t totalLength;
+    unsigned char buffer[32];
+    size_t bufferSize;
+
+public:
+    explicit Checksum64(uint64_t seed = 0);
+    void update(const void *data, size_t size);
+    uint64_t digest() const;
+};
+
+#endif // CHECKSUM_HPP
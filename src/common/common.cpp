@@ -56,3 +56,16 @@ std::string zeroPad(int number, int width)
     return oss.str();
 }
 
+
+std::vector<std::string> splitPathList(const std::string &list)
+{
+    std::vector<std::string> result;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ';'))
+    {
+        if (!item.empty())
+            result.push_back(item);
+    }
+    return result;
+}
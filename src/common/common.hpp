@@ -11,6 +11,7 @@
 #include <ctime>
 #include <string>
 #include <cstdint>
+#include <vector>
 
 // ファイルシステム名前空間のエイリアス
 namespace fs = std::filesystem;
@@ -76,5 +77,8 @@ void closeLogFile();
 // ユーティリティ関数：数値を指定桁数のゼロ埋め文字列に変換
 std::string zeroPad(int number, int width);
 
+// ユーティリティ関数：';' 区切りのパスのリストを分解する（空の要素は除く）
+std::vector<std::string> splitPathList(const std::string &list);
+
 #endif // COMMON_HPP
 
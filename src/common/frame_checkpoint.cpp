@@ -0,0 +1,146 @@
+#include "frame_checkpoint.hpp"
+#include "checksum.hpp"
+#include "common.hpp"
+#include <cstring>
+#include <limits>
+
+// シリアライズしたチェックポイントのマジックナンバー（"CKP1"）
+constexpr uint32_t CHECKPOINT_MAGIC = 0x31504B43;
+
+FrameCheckpoint::FrameCheckpoint()
+    : baseFrame(0), lastFrame(0), frameCount(0), framesChecksum(0), width(0), height(0)
+{
+}
+
+int getFrameNumber(const std::string &fileName)
+{
+    size_t dot = fileName.find_last_of('.');
+    size_t underscore = fileName.find_last_of('_', dot);
+    if (dot == std::string::npos || underscore == std::string::npos || dot == underscore + 1)
+        return -1;
+
+    int number = 0;
+    for (size_t i = underscore + 1; i < dot; ++i)
+    {
+        if (fileName[i] < '0' || fileName[i] > '9' || number > 100000000)
+            return -1;
+        number = number * 10 + (fileName[i] - '0');
+    }
+    return number;
+}
+
+std::string getCheckpointName(const std::string &frameName, int lastFrame)
+{
+    size_t underscore = frameName.find_last_of('_', frameName.find_last_of('.'));
+    std::string prefixWithRun = underscore == std::string::npos ? frameName + "_" : frameName.substr(0, underscore + 1);
+    return prefixWithRun + zeroPad(lastFrame, 5) + ".ckpt";
+}
+
+bool addFramePixels(const std::vector<int64_t> &pixels, uint32_t frameWidth, uint32_t frameHeight,
+                    std::vector<int64_t> &sums, uint32_t &width, uint32_t &height)
+{
+    size_t count = static_cast<size_t>(frameWidth) * frameHeight;
+    if (pixels.size() != count)
+        return false;
+    if (sums.empty())
+    {
+        width = frameWidth;
+        height = frameHeight;
+        sums.assign(count, 0);
+    }
+    else if (frameWidth != width || frameHeight != height || sums.size() != count)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        sums[i] += pixels[i];
+    }
+    return true;
+}
+
+uint64_t computeFramesChecksum(const std::vector<uint64_t> &rawChecksums)
+{
+    return computeChecksum64(rawChecksums.data(), rawChecksums.size() * sizeof(uint64_t));
+}
+
+template <typename T>
+static void appendValue(std::string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+std::string serializeCheckpoint(const FrameCheckpoint &checkpoint)
+{
+    bool fitsInt32 = true;
+    for (int64_t sum : checkpoint.sums)
+    {
+        if (sum < std::numeric_limits<int32_t>::min() || sum > std::numeric_limits<int32_t>::max())
+        {
+            fitsInt32 = false;
+            break;
+        }
+    }
+    uint32_t valueBytes = fitsInt32 ? 4 : 8;
+
+    std::string out;
+    out.reserve(40 + checkpoint.sums.size() * valueBytes);
+    appendValue(out, CHECKPOINT_MAGIC);
+    appendValue(out, checkpoint.baseFrame);
+    appendValue(out, checkpoint.lastFrame);
+    appendValue(out, checkpoint.frameCount);
+    appendValue(out, checkpoint.framesChecksum);
+    appendValue(out, checkpoint.width);
+    appendValue(out, checkpoint.height);
+    appendValue(out, valueBytes);
+    for (int64_t sum : checkpoint.sums)
+    {
+        if (fitsInt32)
+            appendValue(out, static_cast<int32_t>(sum));
+        else
+            appendValue(out, sum);
+    }
+    return out;
+}
+
+bool deserializeCheckpoint(const char *data, size_t size, FrameCheckpoint &checkpoint)
+{
+    size_t offset = 0;
+    auto read = [&](void *dst, size_t n)
+    {
+        if (offset + n > size)
+            return false;
+        std::memcpy(dst, data + offset, n);
+        offset += n;
+        return true;
+    };
+
+    uint32_t magic = 0, valueBytes = 0;
+    if (!read(&magic, 4) || magic != CHECKPOINT_MAGIC || !read(&checkpoint.baseFrame, 4) ||
+        !read(&checkpoint.lastFrame, 4) || !read(&checkpoint.frameCount, 4) || !read(&checkpoint.framesChecksum, 8) ||
+        !read(&checkpoint.width, 4) || !read(&checkpoint.height, 4) || !read(&valueBytes, 4))
+    {
+        return false;
+    }
+
+    size_t count = static_cast<size_t>(checkpoint.width) * checkpoint.height;
+    if ((valueBytes != 4 && valueBytes != 8) || size - offset != count * valueBytes)
+        return false;
+
+    checkpoint.sums.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (valueBytes == 4)
+        {
+            int32_t value = 0;
+            read(&value, 4);
+            checkpoint.sums[i] = value;
+        }
+        else
+        {
+            read(&checkpoint.sums[i], 8);
+        }
+    }
+    return true;
+}
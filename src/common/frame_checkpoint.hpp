@@ -0,0 +1,48 @@
+#ifndef FRAME_CHECKPOINT_HPP
+#define FRAME_CHECKPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// フレームの累積和画像（チェックポイント）
+// セット内の先頭フレーム（baseFrame）から lastFrame までの全フレームの画素ごとの和。
+// 圧縮時に一定フレームごとに求めてブロック形式アーカイブに BlockKind::Checkpoint として格納し、
+// 解凍時のマージでは窓 [a, b] の和を C(b) - C(a - 1) として、チェックポイントの位置からずれた分のフレームだけを
+// 復号して求める（チェックポイントの位置に揃った窓はフレームを復号しない）
+//
+// 後から届いたフレームの追記などで和に含まれるフレームが変わった場合は、framesChecksum が一致しないため使わない
+struct FrameCheckpoint
+{
+    int32_t baseFrame;       // 和の最初のフレーム番号
+    int32_t lastFrame;       // 和の最後のフレーム番号（この番号以下のフレームを含む）
+    uint32_t frameCount;     // 和に含まれるフレーム数
+    uint64_t framesChecksum; // 和に含まれるフレームのブロックのrawChecksumから求めたチェックサム
+    uint32_t width;
+    uint32_t height;
+    std::vector<int64_t> sums; // width * height 画素の和
+
+    FrameCheckpoint();
+};
+
+// "<prefix>_<run>_<番号>.<拡張子>" の番号（形式が異なる場合は-1）
+int getFrameNumber(const std::string &fileName);
+
+// チェックポイントのブロック名（フレーム名の番号をlastFrameに、拡張子を ".ckpt" にしたもの）
+std::string getCheckpointName(const std::string &frameName, int lastFrame);
+
+// フレームの画素（readTiffPixelsで読み込んだもの）をsumsに加える（sumsが空の場合は画像の大きさで確保する）
+// 戻り値: 画像の大きさがwidth・heightと一致する場合true
+bool addFramePixels(const std::vector<int64_t> &pixels, uint32_t frameWidth, uint32_t frameHeight,
+                    std::vector<int64_t> &sums, uint32_t &width, uint32_t &height);
+
+// 和に含まれるフレームのrawChecksum（フレーム番号順）からframesChecksumを求める
+uint64_t computeFramesChecksum(const std::vector<uint64_t> &rawChecksums);
+
+// チェックポイントのシリアライズ／デシリアライズ
+// 和がすべて32ビットに収まる場合は画素あたり4バイトで格納する
+std::string serializeCheckpoint(const FrameCheckpoint &checkpoint);
+bool deserializeCheckpoint(const char *data, size_t size, FrameCheckpoint &checkpoint);
+
+#endif // FRAME_CHECKPOINT_HPP
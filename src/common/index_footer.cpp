@@ -0,0 +1,157 @@
+#include "index_footer.hpp"
+#include "checksum.hpp"
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+#include <vector>
+
+// 後方スキャン時に一度に読むサイズ
+constexpr uint64_t FOOTER_SCAN_CHUNK = 1024 * 1024;
+
+std::string buildIndexTrailer(const std::string &indexData, uint64_t indexOffset,
+                              uint32_t magic, uint32_t version)
+{
+    IndexFooter footer;
+    footer.indexOffset = indexOffset;
+    footer.indexSize = indexData.size();
+    footer.indexChecksum = computeChecksum64(indexData);
+    footer.magic = magic;
+    footer.version = version;
+
+    std::string trailer;
+    trailer.reserve(indexData.size() + INDEX_FOOTER_SIZE);
+    trailer.append(indexData);
+    trailer.append(reinterpret_cast<const char *>(&footer.indexOffset), sizeof(uint64_t));
+    trailer.append(reinterpret_cast<const char *>(&footer.indexSize), sizeof(uint64_t));
+    trailer.append(reinterpret_cast<const char *>(&footer.indexChecksum), sizeof(uint64_t));
+    trailer.append(reinterpret_cast<const char *>(&footer.magic), sizeof(uint32_t));
+    trailer.append(reinterpret_cast<const char *>(&footer.version), sizeof(uint32_t));
+    return trailer;
+}
+
+// footerEnd（領域先頭からの相対位置）で終わるフッター候補を検証する
+static bool tryFooterAt(std::istream &in, uint64_t regionOffset, uint64_t footerEnd, const char *footerBytes,
+                        uint32_t magic, IndexFooter &footer, std::string &indexData)
+{
+    IndexFooter candidate;
+    std::memcpy(&candidate.indexOffset, footerBytes, sizeof(uint64_t));
+    std::memcpy(&candidate.indexSize, footerBytes + 8, sizeof(uint64_t));
+    std::memcpy(&candidate.indexChecksum, footerBytes + 16, sizeof(uint64_t));
+    std::memcpy(&candidate.magic, footerBytes + 24, sizeof(uint32_t));
+    std::memcpy(&candidate.version, footerBytes + 28, sizeof(uint32_t));
+
+    if (candidate.magic != magic)
+        return false;
+
+    // インデックス本体はフッターの直前に隙間なく置かれている
+    uint64_t footerStart = footerEnd - INDEX_FOOTER_SIZE;
+    if (candidate.indexSize > footerStart || candidate.indexOffset != footerStart - candidate.indexSize)
+        return false;
+
+    std::string data(candidate.indexSize, '\0');
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(regionOffset + candidate.indexOffset));
+    in.read(&data[0], static_cast<std::streamsize>(candidate.indexSize));
+    if (!in)
+    {
+        in.clear();
+        return false;
+    }
+
+    if (computeChecksum64(data) != candidate.indexChecksum)
+        return false;
+
+    footer = candidate;
+    indexData.swap(data);
+    return true;
+}
+
+bool findLatestIndex(std::istream &in, uint64_t regionOffset, uint64_t regionSize,
+                     uint32_t magic, IndexFooter &footer, std::string &indexData)
+{
+    if (regionSize < INDEX_FOOTER_SIZE)
+        return false;
+
+    // 通常は末尾のフッターがそのまま有効
+    char tail[INDEX_FOOTER_SIZE];
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(regionOffset + regionSize - INDEX_FOOTER_SIZE));
+    in.read(tail, INDEX_FOOTER_SIZE);
+    if (in && tryFooterAt(in, regionOffset, regionSize, tail, magic, footer, indexData))
+        return true;
+
+    // 末尾が途切れている: マジックナンバーを手掛かりに後方スキャン
+    std::vector<char> chunk;
+    uint64_t scanEnd = regionSize - 1; // 末尾の候補は検証済み
+    while (scanEnd >= INDEX_FOOTER_SIZE)
+    {
+        uint64_t scanStart = (scanEnd > FOOTER_SCAN_CHUNK) ? scanEnd - FOOTER_SCAN_CHUNK : 0;
+        chunk.resize(scanEnd - scanStart);
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(regionOffset + scanStart));
+        in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        if (!in)
+        {
+            in.clear();
+            return false;
+        }
+
+        // footerEnd を大きい方から順に試す（マジックはフッター末尾の8バイト手前）
+        for (uint64_t footerEnd = scanEnd; footerEnd >= scanStart + INDEX_FOOTER_SIZE; --footerEnd)
+        {
+            const char *footerBytes = chunk.data() + (footerEnd - INDEX_FOOTER_SIZE - scanStart);
+            uint32_t candidateMagic;
+            std::memcpy(&candidateMagic, footerBytes + 24, sizeof(uint32_t));
+            if (candidateMagic != magic)
+                continue;
+
+            if (tryFooterAt(in, regionOffset, footerEnd, footerBytes, magic, footer, indexData))
+                return true;
+        }
+
+        if (scanStart == 0)
+            break;
+        // チャンク境界をまたぐフッターを取りこぼさないよう重ねて読む
+        scanEnd = scanStart + INDEX_FOOTER_SIZE - 1;
+    }
+
+    return false;
+}
+
+namespace
+{
+    // メモリ上のバイト列を読み込み専用のストリームとして扱う
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf(const char *data, uint64_t size)
+        {
+            char *begin = const_cast<char *>(data);
+            setg(begin, begin, begin + size);
+        }
+
+    protected:
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override
+        {
+            char *target = (dir == std::ios_base::beg) ? eback() + off
+                           : (dir == std::ios_base::cur) ? gptr() + off
+                                                         : egptr() + off;
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode mode) override
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, mode);
+        }
+    };
+}
+
+bool findLatestIndex(const char *data, uint64_t size, uint32_t magic, IndexFooter &footer, std::string &indexData)
+{
+    MemoryStreamBuf buffer(data, size);
+    std::istream in(&buffer);
+    return findLatestIndex(in, 0, size, magic, footer, indexData);
+}
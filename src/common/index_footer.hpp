@@ -0,0 +1,36 @@
+#ifndef INDEX_FOOTER_HPP
+#define INDEX_FOOTER_HPP
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+// 追記型ファイルの末尾に置くインデックスフッター（32バイト固定）
+// [データ][インデックス][フッター] を追記するたびに最新のフッターがファイル末尾に来る。
+// 書き込み途中でクラッシュした場合は、末尾から後方に有効なフッターを探して直前の状態に戻る。
+struct IndexFooter
+{
+    uint64_t indexOffset;   // インデックス本体の先頭（領域先頭からの相対オフセット）
+    uint64_t indexSize;     // インデックス本体のサイズ
+    uint64_t indexChecksum; // インデックス本体のチェックサム
+    uint32_t magic;         // ファイル種別ごとのマジックナンバー
+    uint32_t version;
+};
+
+constexpr size_t INDEX_FOOTER_SIZE = 32;
+
+// インデックス本体とフッターを連結したバイト列を作る
+// indexOffset: インデックス本体を書き込む位置（領域先頭からの相対オフセット）
+std::string buildIndexTrailer(const std::string &indexData, uint64_t indexOffset,
+                              uint32_t magic, uint32_t version);
+
+// 領域 [regionOffset, regionOffset + regionSize) の末尾から有効な最新フッターを探し、インデックス本体を読み込む
+// 末尾が途切れている場合は後方スキャンで直前の有効なフッターを採用する
+// 戻り値: 有効なフッターが見つかった場合true
+bool findLatestIndex(std::istream &in, uint64_t regionOffset, uint64_t regionSize,
+                     uint32_t magic, IndexFooter &footer, std::string &indexData);
+
+// メモリ上のバイト列（アーカイブ全体）から有効な最新フッターを探す
+bool findLatestIndex(const char *data, uint64_t size, uint32_t magic, IndexFooter &footer, std::string &indexData);
+
+#endif // INDEX_FOOTER_HPP
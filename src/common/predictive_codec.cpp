@@ -0,0 +1,529 @@
+#include "predictive_codec.hpp"
+#include "tiff_layout.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 符号化データのマジックナンバー（"PRD1"）
+constexpr uint32_t PREDICTIVE_MAGIC = 0x31445250;
+
+// 帯（独立に符号化する単位）の行数
+constexpr uint32_t ROWS_PER_BAND = 64;
+
+// Rice符号のパラメータを共有する画素数
+constexpr size_t CHUNK_PIXELS = 32;
+
+// チャンク内がすべて0（パラメータ欄にこの値を書く）
+constexpr uint32_t ZERO_CHUNK = 63;
+
+// 商がこの値以上の場合はエスケープして残差をそのまま書く
+constexpr uint32_t ESCAPE_QUOTIENT = 24;
+
+namespace
+{
+    // ヘッダー（固定長部分）
+    struct PredictiveHeader
+    {
+        uint32_t magic;
+        uint32_t width;
+        uint32_t height;
+        uint8_t bitsPerSample;
+        uint8_t isSigned;
+        uint8_t bigEndian;
+        uint8_t reserved;
+        uint64_t pixelOffset;
+        uint64_t pixelBytes;
+        uint32_t rowsPerBand;
+        uint32_t bandCount;
+    };
+
+    inline int countLeadingZeros(uint64_t value)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return 63 - static_cast<int>(index);
+#else
+        return __builtin_clzll(value);
+#endif
+    }
+
+    inline uint64_t zigzag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    inline int64_t unzigzag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // MED予測（a: 左, b: 上, c: 左上）
+    inline int64_t medPredict(int64_t a, int64_t b, int64_t c)
+    {
+        int64_t mn = std::min(a, b);
+        int64_t mx = std::max(a, b);
+        if (c >= mx)
+            return mn;
+        if (c <= mn)
+            return mx;
+        return a + b - c;
+    }
+
+    // 上位ビットから詰めて書き込む
+    class BitWriter
+    {
+    private:
+        std::string &out;
+        uint64_t acc;
+        int bits;
+
+    public:
+        explicit BitWriter(std::string &out) : out(out), acc(0), bits(0) {}
+
+        // valueの下位nbitsビットを書く（nbits <= 56）
+        void put(uint64_t value, int nbits)
+        {
+            acc = (acc << nbits) | value;
+            bits += nbits;
+            while (bits >= 8)
+            {
+                bits -= 8;
+                out.push_back(static_cast<char>(acc >> bits));
+            }
+        }
+
+        void flush()
+        {
+            if (bits > 0)
+            {
+                out.push_back(static_cast<char>(acc << (8 - bits)));
+                bits = 0;
+            }
+        }
+    };
+
+    class BitReader
+    {
+    private:
+        const uint8_t *p;
+        const uint8_t *end;
+        uint64_t buf; // 次に読むビットが最上位
+        int count;
+        int padding; // 末尾を越えて補った0バイト数
+
+    public:
+        BitReader(const char *data, size_t size)
+            : p(reinterpret_cast<const uint8_t *>(data)), end(reinterpret_cast<const uint8_t *>(data) + size),
+              buf(0), count(0), padding(0) {}
+
+        inline void refill()
+        {
+            while (count <= 56)
+            {
+                uint64_t byte = 0;
+                if (p < end)
+                    byte = *p++;
+                else
+                    padding++;
+                buf |= byte << (56 - count);
+                count += 8;
+            }
+        }
+
+        inline uint64_t get(int nbits)
+        {
+            if (nbits == 0)
+                return 0;
+            refill();
+            uint64_t value = buf >> (64 - nbits);
+            buf <<= nbits;
+            count -= nbits;
+            return value;
+        }
+
+        // 1が現れるまでの0の個数を読み、1も読み捨てる（ESCAPE_QUOTIENTを超える場合は破損）
+        inline uint32_t unary()
+        {
+            refill();
+            if (buf == 0)
+                return ESCAPE_QUOTIENT + 1;
+            int zeros = countLeadingZeros(buf);
+            buf <<= zeros + 1;
+            count -= zeros + 1;
+            return static_cast<uint32_t>(zeros);
+        }
+
+        // データの末尾を越えて読んだ場合true
+        bool overrun() const { return padding * 8 > count; }
+    };
+
+    // サンプルの読み書き（ファイルのバイトオーダーを考慮）
+    template <typename T>
+    inline int64_t loadSample(const unsigned char *p, bool bigEndian)
+    {
+        T value;
+        if (bigEndian)
+        {
+            unsigned char bytes[sizeof(T)];
+            for (size_t i = 0; i < sizeof(T); ++i)
+                bytes[i] = p[sizeof(T) - 1 - i];
+            std::memcpy(&value, bytes, sizeof(T));
+        }
+        else
+        {
+            std::memcpy(&value, p, sizeof(T));
+        }
+        return static_cast<int64_t>(value);
+    }
+
+    template <typename T>
+    inline void storeSample(unsigned char *p, int64_t sample, bool bigEndian)
+    {
+        T value = static_cast<T>(sample);
+        if (bigEndian)
+        {
+            unsigned char bytes[sizeof(T)];
+            std::memcpy(bytes, &value, sizeof(T));
+            for (size_t i = 0; i < sizeof(T); ++i)
+                p[i] = bytes[sizeof(T) - 1 - i];
+        }
+        else
+        {
+            std::memcpy(p, &value, sizeof(T));
+        }
+    }
+
+    // 画素位置xの予測値（帯の先頭行は左のみ、各行の先頭は上から予測）
+    inline int64_t predict(const std::vector<int64_t> &cur, const std::vector<int64_t> &prev, size_t x, bool firstRow)
+    {
+        if (firstRow)
+            return x > 0 ? cur[x - 1] : 0;
+        if (x == 0)
+            return prev[0];
+        return medPredict(cur[x - 1], prev[x], prev[x - 1]);
+    }
+
+    // チャンクの符号長が最小になるRiceパラメータを選ぶ
+    uint32_t chooseRiceParameter(const uint64_t *values, size_t n, int escapeBits)
+    {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < n; ++i)
+            sum += values[i];
+
+        // 平均値から目安を求め、その付近（外れ値が多い場合に備えて小さい側を広め）を比較する
+        uint32_t kMean = 0;
+        while (kMean + 1 < static_cast<uint32_t>(escapeBits) && (static_cast<uint64_t>(n) << (kMean + 1)) <= sum)
+            kMean++;
+
+        uint32_t bestK = kMean;
+        uint64_t bestCost = UINT64_MAX;
+        uint32_t kLow = kMean > 4 ? kMean - 4 : 0;
+        uint32_t kHigh = std::min<uint32_t>(kMean + 1, escapeBits - 1);
+        for (uint32_t k = kLow; k <= kHigh; ++k)
+        {
+            uint64_t cost = 0;
+            for (size_t i = 0; i < n; ++i)
+            {
+                uint64_t q = values[i] >> k;
+                cost += (q < ESCAPE_QUOTIENT) ? q + 1 + k : ESCAPE_QUOTIENT + 1 + escapeBits;
+            }
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestK = k;
+            }
+        }
+        return bestK;
+    }
+
+    template <typename T>
+    void encodeBand(const unsigned char *pixels, const TiffLayout &layout, uint32_t row0, uint32_t row1, std::string &out)
+    {
+        const size_t width = layout.width;
+        const int escapeBits = static_cast<int>(sizeof(T) * 8) + 2;
+        std::vector<int64_t> prev(width), cur(width);
+        std::vector<uint64_t> residuals(width);
+        BitWriter writer(out);
+
+        for (uint32_t row = row0; row < row1; ++row)
+        {
+            const unsigned char *rowData = pixels + static_cast<size_t>(row) * width * sizeof(T);
+            for (size_t x = 0; x < width; ++x)
+                cur[x] = loadSample<T>(rowData + x * sizeof(T), layout.bigEndian);
+
+            bool firstRow = (row == row0);
+            for (size_t x = 0; x < width; ++x)
+                residuals[x] = zigzag(cur[x] - predict(cur, prev, x, firstRow));
+
+            for (size_t start = 0; start < width; start += CHUNK_PIXELS)
+            {
+                size_t n = std::min(CHUNK_PIXELS, width - start);
+                const uint64_t *values = residuals.data() + start;
+
+                bool allZero = true;
+                for (size_t i = 0; i < n && allZero; ++i)
+                    allZero = (values[i] == 0);
+                if (allZero)
+                {
+                    writer.put(ZERO_CHUNK, 6);
+                    continue;
+                }
+
+                uint32_t k = chooseRiceParameter(values, n, escapeBits);
+                writer.put(k, 6);
+                uint64_t mask = (1ULL << k) - 1;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    uint64_t q = values[i] >> k;
+                    if (q < ESCAPE_QUOTIENT)
+                    {
+                        writer.put(1, static_cast<int>(q) + 1);
+                        writer.put(values[i] & mask, k);
+                    }
+                    else
+                    {
+                        writer.put(1, ESCAPE_QUOTIENT + 1);
+                        writer.put(values[i], escapeBits);
+                    }
+                }
+            }
+            std::swap(prev, cur);
+        }
+        writer.flush();
+    }
+
+    template <typename T>
+    bool decodeBand(const char *data, size_t size, const TiffLayout &layout, uint32_t row0, uint32_t row1,
+                    unsigned char *pixels)
+    {
+        const size_t width = layout.width;
+        const int escapeBits = static_cast<int>(sizeof(T) * 8) + 2;
+        std::vector<int64_t> prev(width), cur(width);
+        BitReader reader(data, size);
+
+        for (uint32_t row = row0; row < row1; ++row)
+        {
+            bool firstRow = (row == row0);
+            for (size_t start = 0; start < width; start += CHUNK_PIXELS)
+            {
+                size_t end = std::min(start + CHUNK_PIXELS, width);
+                uint32_t k = static_cast<uint32_t>(reader.get(6));
+                if (k == ZERO_CHUNK)
+                {
+                    for (size_t x = start; x < end; ++x)
+                        cur[x] = predict(cur, prev, x, firstRow);
+                    continue;
+                }
+                if (k >= static_cast<uint32_t>(escapeBits))
+                    return false;
+
+                for (size_t x = start; x < end; ++x)
+                {
+                    uint32_t q = reader.unary();
+                    uint64_t value;
+                    if (q < ESCAPE_QUOTIENT)
+                        value = (static_cast<uint64_t>(q) << k) | reader.get(k);
+                    else if (q == ESCAPE_QUOTIENT)
+                        value = reader.get(escapeBits);
+                    else
+                        return false;
+                    cur[x] = predict(cur, prev, x, firstRow) + unzigzag(value);
+                }
+            }
+
+            unsigned char *rowData = pixels + static_cast<size_t>(row) * width * sizeof(T);
+            for (size_t x = 0; x < width; ++x)
+                storeSample<T>(rowData + x * sizeof(T), cur[x], layout.bigEndian);
+            std::swap(prev, cur);
+        }
+        return !reader.overrun();
+    }
+
+    // サンプル型ごとに振り分ける
+    void encodeBandAny(const unsigned char *pixels, const TiffLayout &layout, uint32_t row0, uint32_t row1, std::string &out)
+    {
+        switch (layout.bitsPerSample)
+        {
+        case 8:
+            layout.isSigned ? encodeBand<int8_t>(pixels, layout, row0, row1, out) : encodeBand<uint8_t>(pixels, layout, row0, row1, out);
+            break;
+        case 16:
+            layout.isSigned ? encodeBand<int16_t>(pixels, layout, row0, row1, out) : encodeBand<uint16_t>(pixels, layout, row0, row1, out);
+            break;
+        default:
+            layout.isSigned ? encodeBand<int32_t>(pixels, layout, row0, row1, out) : encodeBand<uint32_t>(pixels, layout, row0, row1, out);
+            break;
+        }
+    }
+
+    bool decodeBandAny(const char *data, size_t size, const TiffLayout &layout, uint32_t row0, uint32_t row1,
+                       unsigned char *pixels)
+    {
+        switch (layout.bitsPerSample)
+        {
+        case 8:
+            return layout.isSigned ? decodeBand<int8_t>(data, size, layout, row0, row1, pixels)
+                                   : decodeBand<uint8_t>(data, size, layout, row0, row1, pixels);
+        case 16:
+            return layout.isSigned ? decodeBand<int16_t>(data, size, layout, row0, row1, pixels)
+                                   : decodeBand<uint16_t>(data, size, layout, row0, row1, pixels);
+        case 32:
+            return layout.isSigned ? decodeBand<int32_t>(data, size, layout, row0, row1, pixels)
+                                   : decodeBand<uint32_t>(data, size, layout, row0, row1, pixels);
+        default:
+            return false;
+        }
+    }
+
+    // 帯の処理を最大maxThreadsスレッドに分配する
+    template <typename Func>
+    void forEachBand(uint32_t bandCount, int maxThreads, Func func)
+    {
+        int threadCount = std::max(1, std::min<int>(maxThreads, static_cast<int>(bandCount)));
+        if (threadCount == 1)
+        {
+            for (uint32_t band = 0; band < bandCount; ++band)
+                func(band);
+            return;
+        }
+
+        std::atomic<uint32_t> nextBand(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&]()
+                                 {
+                for (uint32_t band = nextBand++; band < bandCount; band = nextBand++)
+                    func(band); });
+        }
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    template <typename T>
+    void appendValue(std::string &out, T value)
+    {
+        out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+}
+
+bool encodePredictiveFile(const std::string &raw, std::string &encoded, int maxThreads)
+{
+    TiffLayout layout;
+    if (!parseTiffLayout(raw.data(), raw.size(), layout))
+        return false;
+
+    PredictiveHeader header;
+    header.magic = PREDICTIVE_MAGIC;
+    header.width = layout.width;
+    header.height = layout.height;
+    header.bitsPerSample = static_cast<uint8_t>(layout.bitsPerSample);
+    header.isSigned = layout.isSigned ? 1 : 0;
+    header.bigEndian = layout.bigEndian ? 1 : 0;
+    header.reserved = 0;
+    header.pixelOffset = layout.pixelOffset;
+    header.pixelBytes = layout.pixelBytes;
+    header.rowsPerBand = ROWS_PER_BAND;
+    header.bandCount = (layout.height + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+
+    // 帯ごとに符号化
+    const unsigned char *pixels = reinterpret_cast<const unsigned char *>(raw.data()) + layout.pixelOffset;
+    std::vector<std::string> bands(header.bandCount);
+    forEachBand(header.bandCount, maxThreads, [&](uint32_t band)
+                {
+        uint32_t row0 = band * ROWS_PER_BAND;
+        uint32_t row1 = std::min(row0 + ROWS_PER_BAND, layout.height);
+        encodeBandAny(pixels, layout, row0, row1, bands[band]); });
+
+    // [ヘッダー][帯のサイズ×帯数][画素データより前の部分][画素データより後の部分][帯のデータ]
+    encoded.clear();
+    appendValue(encoded, header.magic);
+    appendValue(encoded, header.width);
+    appendValue(encoded, header.height);
+    appendValue(encoded, header.bitsPerSample);
+    appendValue(encoded, header.isSigned);
+    appendValue(encoded, header.bigEndian);
+    appendValue(encoded, header.reserved);
+    appendValue(encoded, header.pixelOffset);
+    appendValue(encoded, header.pixelBytes);
+    appendValue(encoded, header.rowsPerBand);
+    appendValue(encoded, header.bandCount);
+    for (const auto &band : bands)
+        appendValue(encoded, static_cast<uint64_t>(band.size()));
+    encoded.append(raw, 0, layout.pixelOffset);
+    encoded.append(raw, layout.pixelOffset + layout.pixelBytes, std::string::npos);
+    for (const auto &band : bands)
+        encoded.append(band);
+    return true;
+}
+
+bool decodePredictiveFile(const char *encoded, size_t encodedSize, char *raw, size_t rawSize, int maxThreads)
+{
+    size_t offset = 0;
+    auto read = [&](void *dst, size_t n)
+    {
+        if (offset + n > encodedSize)
+            return false;
+        std::memcpy(dst, encoded + offset, n);
+        offset += n;
+        return true;
+    };
+
+    PredictiveHeader header;
+    if (!read(&header.magic, 4) || header.magic != PREDICTIVE_MAGIC || !read(&header.width, 4) ||
+        !read(&header.height, 4) || !read(&header.bitsPerSample, 1) || !read(&header.isSigned, 1) ||
+        !read(&header.bigEndian, 1) || !read(&header.reserved, 1) || !read(&header.pixelOffset, 8) ||
+        !read(&header.pixelBytes, 8) || !read(&header.rowsPerBand, 4) || !read(&header.bandCount, 4))
+        return false;
+
+    if (header.rowsPerBand == 0 || header.pixelOffset + header.pixelBytes > rawSize ||
+        header.pixelBytes != static_cast<uint64_t>(header.width) * header.height * (header.bitsPerSample / 8) ||
+        header.bandCount != (header.height + header.rowsPerBand - 1) / header.rowsPerBand)
+        return false;
+
+    std::vector<uint64_t> bandSizes(header.bandCount);
+    for (auto &size : bandSizes)
+    {
+        if (!read(&size, 8))
+            return false;
+    }
+
+    // 画素データ以外の部分
+    size_t suffixSize = rawSize - header.pixelOffset - header.pixelBytes;
+    if (!read(raw, header.pixelOffset) || !read(raw + header.pixelOffset + header.pixelBytes, suffixSize))
+        return false;
+
+    std::vector<uint64_t> bandOffsets(header.bandCount);
+    for (uint32_t band = 0; band < header.bandCount; ++band)
+    {
+        bandOffsets[band] = offset;
+        offset += bandSizes[band];
+    }
+    if (offset != encodedSize)
+        return false;
+
+    TiffLayout layout;
+    layout.width = header.width;
+    layout.height = header.height;
+    layout.bitsPerSample = header.bitsPerSample;
+    layout.isSigned = header.isSigned != 0;
+    layout.bigEndian = header.bigEndian != 0;
+
+    unsigned char *pixels = reinterpret_cast<unsigned char *>(raw) + header.pixelOffset;
+    std::atomic<bool> ok(true);
+    forEachBand(header.bandCount, maxThreads, [&](uint32_t band)
+                {
+        uint32_t row0 = band * header.rowsPerBand;
+        uint32_t row1 = std::min(row0 + header.rowsPerBand, header.height);
+        if (!decodeBandAny(encoded + bandOffsets[band], bandSizes[band], layout, row0, row1, pixels))
+            ok = false; });
+    return ok;
+}
@@ -0,0 +1,23 @@
+#ifndef PREDICTIVE_CODEC_HPP
+#define PREDICTIVE_CODEC_HPP
+
+#include <cstddef>
+#include <string>
+
+// 検出器フレーム（非圧縮の整数TIFF）向けの可逆予測符号化
+// 画素ごとにメディアン予測（MED: 左・上・左上から予測）の残差を求め、
+// 32画素ごとに最適なパラメータを選んだRice符号で符号化する。
+// 画像は一定行数の帯に分割して独立に符号化するため、帯ごとに並列で符号化・復号できる。
+// TIFFのヘッダーなど画素データ以外の部分はそのまま格納する。
+
+// TIFFファイル全体を符号化する
+// 戻り値: 対応する画像形式（非圧縮・1サンプル・8/16/32ビット整数・連続ストリップ）の場合true
+//         対応しない場合はfalse（呼び出し側で別のコーデックを使う）
+bool encodePredictiveFile(const std::string &raw, std::string &encoded, int maxThreads = 1);
+
+// encodePredictiveFileで符号化したデータを復号する
+// raw: rawSizeバイトの出力先（元ファイルのサイズ）
+// 戻り値: 成功した場合true（破損を検出した場合false）
+bool decodePredictiveFile(const char *encoded, size_t encodedSize, char *raw, size_t rawSize, int maxThreads = 1);
+
+#endif // PREDICTIVE_CODEC_HPP
@@ -0,0 +1,258 @@
+#include "run_container.hpp"
+#include "checksum.hpp"
+#include "common.hpp"
+#include "index_footer.hpp"
+#include "smoothed_writer.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+// 同一プロセス内でのコンテナへの同時追記を防ぐ
+static std::mutex containerMutex;
+
+// 追記のたびにインデックスを読み直さないためのキャッシュ（ファイルサイズが一致する間だけ有効）
+struct CachedContainerIndex
+{
+    uint64_t fileSize;
+    std::vector<RunSegment> segments;
+};
+static std::map<std::string, CachedContainerIndex> containerIndexCache;
+
+static std::string serializeSegments(const std::vector<RunSegment> &segments)
+{
+    std::string output;
+    uint64_t count = segments.size();
+    output.append(reinterpret_cast<const char *>(&count), sizeof(uint64_t));
+
+    for (const auto &segment : segments)
+    {
+        output.append(reinterpret_cast<const char *>(&segment.setNumber), sizeof(int32_t));
+        output.append(reinterpret_cast<const char *>(&segment.fileCount), sizeof(uint32_t));
+        output.append(reinterpret_cast<const char *>(&segment.offset), sizeof(uint64_t));
+        output.append(reinterpret_cast<const char *>(&segment.size), sizeof(uint64_t));
+        output.append(reinterpret_cast<const char *>(&segment.checksum), sizeof(uint64_t));
+    }
+    return output;
+}
+
+static bool deserializeSegments(const std::string &data, std::vector<RunSegment> &segments)
+{
+    constexpr size_t entrySize = sizeof(int32_t) + sizeof(uint32_t) + 3 * sizeof(uint64_t);
+    if (data.size() < sizeof(uint64_t))
+        return false;
+
+    uint64_t count;
+    std::memcpy(&count, data.data(), sizeof(uint64_t));
+    if (data.size() != sizeof(uint64_t) + count * entrySize)
+        return false;
+
+    segments.clear();
+    segments.reserve(count);
+    const char *p = data.data() + sizeof(uint64_t);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        RunSegment segment;
+        std::memcpy(&segment.setNumber, p, sizeof(int32_t));
+        std::memcpy(&segment.fileCount, p + 4, sizeof(uint32_t));
+        std::memcpy(&segment.offset, p + 8, sizeof(uint64_t));
+        std::memcpy(&segment.size, p + 16, sizeof(uint64_t));
+        std::memcpy(&segment.checksum, p + 24, sizeof(uint64_t));
+        segments.push_back(segment);
+        p += entrySize;
+    }
+    return true;
+}
+
+static bool loadSegments(const std::string &containerPath, uint64_t fileSize, std::vector<RunSegment> &segments)
+{
+    std::ifstream inFile(containerPath, std::ios::binary);
+    if (!inFile)
+        return false;
+
+    IndexFooter footer;
+    std::string indexData;
+    if (!findLatestIndex(inFile, 0, fileSize, RUN_CONTAINER_MAGIC, footer, indexData))
+        return false;
+
+    return deserializeSegments(indexData, segments);
+}
+
+std::string getRunContainerPath(const std::string &dir, const std::string &prefixWithRun)
+{
+    return dir + "/" + prefixWithRun + ".lz4c";
+}
+
+bool appendRunSegment(const std::string &containerPath, int setNumber, uint32_t fileCount,
+                      const std::string &segmentData, RunSegment *appended,
+                      uint64_t alignment, uint64_t *paddingBytes)
+{
+    std::lock_guard<std::mutex> lock(containerMutex);
+
+    try
+    {
+        // 現在のファイル末尾（途切れた書き込みが残っていてもその後ろに追記する）
+        uint64_t fileSize = fs::exists(containerPath) ? fs::file_size(containerPath) : 0;
+
+        std::vector<RunSegment> segments;
+        auto cacheIt = containerIndexCache.find(containerPath);
+        if (cacheIt != containerIndexCache.end() && cacheIt->second.fileSize == fileSize)
+        {
+            segments = cacheIt->second.segments;
+        }
+        else if (fileSize > 0 && !loadSegments(containerPath, fileSize, segments))
+        {
+            LOG("Warning: No valid index found in run container, starting a new index: " << containerPath);
+            segments.clear();
+        }
+
+        // セグメントの先頭を境界に揃える（埋め草は直前のフッターの後ろに置く）
+        uint64_t padding = (alignment > 0 && fileSize % alignment != 0) ? alignment - fileSize % alignment : 0;
+
+        RunSegment segment;
+        segment.setNumber = setNumber;
+        segment.fileCount = fileCount;
+        segment.offset = fileSize + padding;
+        segment.size = segmentData.size();
+        segment.checksum = computeChecksum64(segmentData);
+
+        // 同じセットの古いセグメントは新しいもので置き換える（再処理時）
+        segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                      [setNumber](const RunSegment &s)
+                                      { return s.setNumber == setNumber; }),
+                       segments.end());
+        segments.push_back(segment);
+        std::sort(segments.begin(), segments.end(), [](const RunSegment &a, const RunSegment &b)
+                  { return a.setNumber < b.setNumber; });
+
+        std::string trailer = buildIndexTrailer(serializeSegments(segments), segment.offset + segmentData.size(),
+                                                RUN_CONTAINER_MAGIC, RUN_CONTAINER_VERSION);
+
+        fs::create_directories(fs::path(containerPath).parent_path());
+        SmoothedFileWriter outFile;
+        if (!outFile.open(containerPath, true))
+        {
+            LOG("Error: Cannot open run container: " << containerPath);
+            return false;
+        }
+
+        // セグメント本体を先に書き、フッターは最後に書く（途中で落ちても旧インデックスが有効なまま）
+        bool written = true;
+        if (padding > 0)
+        {
+            std::string zeros(static_cast<size_t>(padding), '\0');
+            written = outFile.write(zeros.data(), zeros.size());
+        }
+        written = written && outFile.write(segmentData.data(), segmentData.size()) &&
+                  outFile.write(trailer.data(), trailer.size());
+        written = outFile.close() && written;
+
+        uint64_t expectedSize = segment.offset + segmentData.size() + trailer.size();
+        uint64_t actualSize = fs::file_size(containerPath);
+        if (!written || actualSize != expectedSize)
+        {
+            LOG("Error: Run container size mismatch. Expected: " << expectedSize << ", Actual: " << actualSize);
+            containerIndexCache.erase(containerPath);
+            return false;
+        }
+
+        containerIndexCache[containerPath] = CachedContainerIndex{expectedSize, segments};
+        if (appended)
+        {
+            *appended = segment;
+        }
+        if (paddingBytes)
+        {
+            *paddingBytes = padding;
+        }
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Error appending to run container: " << e.what());
+        containerIndexCache.erase(containerPath);
+        return false;
+    }
+}
+
+bool removeRunSegment(const std::string &containerPath, int setNumber)
+{
+    std::lock_guard<std::mutex> lock(containerMutex);
+
+    try
+    {
+        uint64_t fileSize = fs::file_size(containerPath);
+        std::vector<RunSegment> segments;
+        if (!loadSegments(containerPath, fileSize, segments))
+        {
+            LOG("Error: No valid index found in run container: " << containerPath);
+            return false;
+        }
+        size_t count = segments.size();
+        segments.erase(std::remove_if(segments.begin(), segments.end(),
+                                      [setNumber](const RunSegment &s)
+                                      { return s.setNumber == setNumber; }),
+                       segments.end());
+        if (segments.size() == count)
+            return true;
+
+        std::string trailer = buildIndexTrailer(serializeSegments(segments), fileSize, RUN_CONTAINER_MAGIC, RUN_CONTAINER_VERSION);
+        SmoothedFileWriter outFile;
+        bool written = outFile.open(containerPath, true) && outFile.write(trailer.data(), trailer.size());
+        written = outFile.close() && written;
+        if (!written || fs::file_size(containerPath) != fileSize + trailer.size())
+        {
+            LOG("Error: Failed to rewrite run container index: " << containerPath);
+            containerIndexCache.erase(containerPath);
+            return false;
+        }
+        containerIndexCache[containerPath] = CachedContainerIndex{fileSize + trailer.size(), segments};
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Error removing segment from run container: " << e.what());
+        containerIndexCache.erase(containerPath);
+        return false;
+    }
+}
+
+bool readRunContainerIndex(const std::string &containerPath, std::vector<RunSegment> &segments)
+{
+    std::error_code ec;
+    uint64_t fileSize = fs::file_size(containerPath, ec);
+    if (ec)
+        return false;
+    return loadSegments(containerPath, fileSize, segments);
+}
+
+bool findRunSegment(const std::string &containerPath, int setNumber, RunSegment &segment)
+{
+    std::vector<RunSegment> segments;
+    if (!readRunContainerIndex(containerPath, segments))
+        return false;
+
+    for (const auto &s : segments)
+    {
+        if (s.setNumber == setNumber)
+        {
+            segment = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readRunSegment(const std::string &containerPath, const RunSegment &segment, std::vector<char> &data)
+{
+    std::ifstream inFile(containerPath, std::ios::binary);
+    if (!inFile)
+        return false;
+
+    data.resize(segment.size);
+    inFile.seekg(static_cast<std::streamoff>(segment.offset));
+    inFile.read(data.data(), static_cast<std::streamsize>(segment.size));
+    if (!inFile)
+        return false;
+
+    return computeChecksum64(data.data(), data.size()) == segment.checksum;
+}
@@ -0,0 +1,51 @@
+#ifndef RUN_CONTAINER_HPP
+#define RUN_CONTAINER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ランコンテナ形式
+// 1つのrunの全セットを1ファイルにまとめ、各セットのアーカイブ（.lz4と同一のバイト列）をセグメントとして追記する
+//   [セグメント0][インデックス][フッター][セグメント1][インデックス][フッター]...
+// 追記のたびに全セグメントを列挙したインデックスを書き直すため、最新のフッターだけを読めばよい
+constexpr uint32_t RUN_CONTAINER_MAGIC = 0x58494352; // "RCIX" in little endian
+constexpr uint32_t RUN_CONTAINER_VERSION = 1;
+
+// コンテナ内のセグメント情報
+struct RunSegment
+{
+    int32_t setNumber;  // セットの先頭ファイル番号
+    uint32_t fileCount; // セグメント内のファイル数
+    uint64_t offset;    // コンテナ先頭からのオフセット
+    uint64_t size;      // セグメントのバイト数
+    uint64_t checksum;  // セグメントのチェックサム
+};
+
+// ランコンテナのパスを生成（例: <dir>/<prefix>_01.lz4c）
+std::string getRunContainerPath(const std::string &dir, const std::string &prefixWithRun);
+
+// セグメントを追記してインデックスを更新する（同じsetNumberが既にあれば新しいセグメントで置き換える）
+// appended: 追記したセグメントの情報の出力先（不要ならnullptr）
+// alignment: 0以外の場合、セグメントの先頭がコンテナ先頭からalignmentの倍数の位置になるよう0で埋める
+// paddingBytes: 埋めたバイト数の出力先（不要ならnullptr）
+// 戻り値: 成功した場合true
+bool appendRunSegment(const std::string &containerPath, int setNumber, uint32_t fileCount,
+                      const std::string &segmentData, RunSegment *appended = nullptr,
+                      uint64_t alignment = 0, uint64_t *paddingBytes = nullptr);
+
+// 指定したセットのセグメントをインデックスから外す（外したインデックスを末尾に追記する。セグメント本体は残る）
+// 戻り値: 成功した場合true（セットのセグメントがない場合も何もせずtrue）
+bool removeRunSegment(const std::string &containerPath, int setNumber);
+
+// 最新のインデックスを読み込む
+// 戻り値: コンテナが存在し、有効なインデックスが見つかった場合true
+bool readRunContainerIndex(const std::string &containerPath, std::vector<RunSegment> &segments);
+
+// 指定したセットのセグメント情報を探す
+bool findRunSegment(const std::string &containerPath, int setNumber, RunSegment &segment);
+
+// セグメントのバイト列を読み込み、チェックサムを検証する
+bool readRunSegment(const std::string &containerPath, const RunSegment &segment, std::vector<char> &data);
+
+#endif // RUN_CONTAINER_HPP
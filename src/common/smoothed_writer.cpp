@@ -0,0 +1,140 @@
+#include "smoothed_writer.hpp"
+#include <algorithm>
+#include <atomic>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static std::atomic<uint64_t> defaultDirtyWindow(0);
+
+void setDirtyWindow(uint64_t bytes)
+{
+    defaultDirtyWindow = bytes;
+}
+
+uint64_t getDirtyWindow()
+{
+    return defaultDirtyWindow;
+}
+
+SmoothedFileWriter::SmoothedFileWriter(uint64_t dirtyWindow)
+    : window(dirtyWindow), fd(-1), position(0), kicked(0), pendingOffset(0), pendingSize(0)
+{
+#if !defined(__linux__)
+    window = 0;
+#endif
+}
+
+SmoothedFileWriter::SmoothedFileWriter() : SmoothedFileWriter(getDirtyWindow())
+{
+}
+
+SmoothedFileWriter::~SmoothedFileWriter()
+{
+    close();
+}
+
+bool SmoothedFileWriter::open(const std::string &filePath, bool append)
+{
+    path = filePath;
+    if (window == 0)
+    {
+        stream.open(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+        return static_cast<bool>(stream);
+    }
+
+#if defined(__linux__)
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd < 0)
+        return false;
+    off_t end = ::lseek(fd, 0, SEEK_END);
+    position = end > 0 ? static_cast<uint64_t>(end) : 0;
+    kicked = position;
+    pendingSize = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SmoothedFileWriter::kickWindow(uint64_t size)
+{
+#if defined(__linux__)
+    // 1つ前の窓の書き出し完了を待ち、書き出し済みのページはページキャッシュから外す（アーカイブは書き込み後に読まない）
+    if (pendingSize > 0)
+    {
+        ::sync_file_range(fd, static_cast<off_t>(pendingOffset), static_cast<off_t>(pendingSize),
+                          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(fd, static_cast<off_t>(pendingOffset), static_cast<off_t>(pendingSize), POSIX_FADV_DONTNEED);
+    }
+    // この窓の書き出しを開始する（完了は待たない）
+    ::sync_file_range(fd, static_cast<off_t>(kicked), static_cast<off_t>(size), SYNC_FILE_RANGE_WRITE);
+    pendingOffset = kicked;
+    pendingSize = size;
+    kicked += size;
+#endif
+}
+
+bool SmoothedFileWriter::write(const char *data, size_t size)
+{
+    if (window == 0)
+    {
+        stream.write(data, static_cast<std::streamsize>(size));
+        return static_cast<bool>(stream);
+    }
+
+#if defined(__linux__)
+    if (fd < 0)
+        return false;
+    while (size > 0)
+    {
+        // 窓の境界で区切って書く
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, kicked + window - position));
+        ssize_t written = ::write(fd, data, chunk);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+        position += static_cast<uint64_t>(written);
+        if (position - kicked >= window)
+            kickWindow(window);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SmoothedFileWriter::close()
+{
+    if (window == 0)
+    {
+        if (!stream.is_open())
+            return true;
+        stream.close();
+        return static_cast<bool>(stream);
+    }
+
+#if defined(__linux__)
+    if (fd < 0)
+        return true;
+    bool ok = ::fdatasync(fd) == 0;
+    if (pendingSize > 0 || position > kicked)
+    {
+        uint64_t start = pendingSize > 0 ? pendingOffset : kicked;
+        ::posix_fadvise(fd, static_cast<off_t>(start), static_cast<off_t>(position - start), POSIX_FADV_DONTNEED);
+    }
+    ok = ::close(fd) == 0 && ok;
+    fd = -1;
+    return ok;
+#else
+    return true;
+#endif
+}
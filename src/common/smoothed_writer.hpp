@@ -0,0 +1,52 @@
+#ifndef SMOOTHED_WRITER_HPP
+#define SMOOTHED_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// ライトバックを平滑化したファイル書き込み
+// 通常の書き込みはページキャッシュにダーティページを溜め、カーネルがまとめて書き出す間に後続の書き込みが止まる
+// （セットの処理時間が周期的に数秒伸びる）。窓（dirtyWindowバイト）を書くごとにその範囲の書き出しを開始し
+// （Linuxの sync_file_range）、1つ前の窓の書き出し完了を待つことで、ファイルあたりのダーティページを2窓分までに抑え、
+// 出力の帯域を一定にする。閉じる際は fdatasync で残りの書き出しを待つ。
+// 窓が0の場合、またはLinux以外では std::ofstream で書き込む（従来どおり）
+class SmoothedFileWriter
+{
+private:
+    std::string path;
+    uint64_t window;
+    std::ofstream stream; // 平滑化しない場合
+    int fd;               // 平滑化する場合
+    uint64_t position;    // ファイル内の現在の書き込み位置
+    uint64_t kicked;      // 書き出しを開始した範囲の終端
+    uint64_t pendingOffset; // 書き出しを開始して完了を待っていない窓
+    uint64_t pendingSize;
+
+    // [kicked, kicked + size) の書き出しを開始し、1つ前の窓の完了を待つ
+    void kickWindow(uint64_t size);
+
+public:
+    // dirtyWindow: 書き出しを開始する単位（既定はsetDirtyWindowで設定した値）
+    explicit SmoothedFileWriter(uint64_t dirtyWindow);
+    SmoothedFileWriter();
+    ~SmoothedFileWriter();
+    SmoothedFileWriter(const SmoothedFileWriter &) = delete;
+    SmoothedFileWriter &operator=(const SmoothedFileWriter &) = delete;
+
+    // append: 既存のファイルの末尾に追記する（falseの場合は切り詰める）
+    bool open(const std::string &filePath, bool append = false);
+
+    bool write(const char *data, size_t size);
+
+    // 残りを書き出して閉じる
+    // 戻り値: すべての書き込みと書き出しに成功した場合true
+    bool close();
+};
+
+// 以後に作成するSmoothedFileWriterの既定の窓（バイト、0: 平滑化しない。--dirty-window-mb）
+void setDirtyWindow(uint64_t bytes);
+uint64_t getDirtyWindow();
+
+#endif // SMOOTHED_WRITER_HPP
@@ -0,0 +1,160 @@
+#include "spot_finder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+void findSpots(const std::vector<int64_t> &pixels, uint32_t width, uint32_t height, const SpotFinderParams &params,
+               std::vector<Spot> &spots)
+{
+    spots.clear();
+    size_t count = static_cast<size_t>(width) * height;
+    if (pixels.size() != count || count == 0)
+        return;
+
+    // 閾値以上の画素の印（分岐のない比較だけのループにして、コンパイラのSIMD化に任せる）
+    std::vector<uint8_t> mask(count);
+    const int64_t *values = pixels.data();
+    uint8_t *marks = mask.data();
+    const int64_t threshold = params.threshold;
+    for (size_t i = 0; i < count; ++i)
+    {
+        marks[i] = static_cast<uint8_t>(values[i] >= threshold);
+    }
+
+    // 印の付いた画素から8近傍で領域を広げる（訪れた画素の印は消す）
+    std::vector<uint32_t> stack;
+    for (size_t start = 0; start < count; ++start)
+    {
+        // 大部分の画素は閾値未満なので、8画素ずつまとめて読み飛ばす
+        if (start + 8 <= count && start % 8 == 0)
+        {
+            uint64_t word;
+            std::memcpy(&word, marks + start, 8);
+            if (word == 0)
+            {
+                start += 7;
+                continue;
+            }
+        }
+        if (!marks[start])
+            continue;
+
+        marks[start] = 0;
+        stack.assign(1, static_cast<uint32_t>(start));
+        double sumX = 0.0, sumY = 0.0, weight = 0.0;
+        Spot spot{0.0, 0.0, 0, 0, values[start]};
+        while (!stack.empty())
+        {
+            uint32_t index = stack.back();
+            stack.pop_back();
+            uint32_t x = index % width;
+            uint32_t y = index / width;
+            int64_t value = values[index];
+
+            spot.intensity += value;
+            spot.pixels++;
+            spot.peak = std::max(spot.peak, value);
+            sumX += static_cast<double>(value) * x;
+            sumY += static_cast<double>(value) * y;
+            weight += static_cast<double>(value);
+
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                if ((dy < 0 && y == 0) || (dy > 0 && y + 1 >= height))
+                    continue;
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    if ((dx < 0 && x == 0) || (dx > 0 && x + 1 >= width))
+                        continue;
+                    uint32_t neighbor = (y + dy) * width + (x + dx);
+                    if (marks[neighbor])
+                    {
+                        marks[neighbor] = 0;
+                        stack.push_back(neighbor);
+                    }
+                }
+            }
+        }
+
+        if (spot.pixels < params.minPixels || spot.pixels > params.maxPixels || weight <= 0.0)
+            continue;
+        spot.x = sumX / weight;
+        spot.y = sumY / weight;
+        spots.push_back(spot);
+    }
+}
+
+std::string getSpotListName(const std::string &firstFrameName, const SpotFinderParams &params)
+{
+    std::string base = firstFrameName.substr(0, firstFrameName.find_last_of('.'));
+    if (params.listTimestamp != 0)
+        base += "." + std::to_string(params.listTimestamp);
+    return base + ".spots";
+}
+
+std::string serializeSpotList(const std::vector<FrameSpots> &frames, const SpotFinderParams &params)
+{
+    std::ostringstream out;
+    out << "# threshold=" << params.threshold << " min_pixels=" << params.minPixels
+        << " max_pixels=" << params.maxPixels << "\n";
+    out << "frame\tx\ty\tintensity\tpixels\tpeak\n";
+    out << std::fixed << std::setprecision(2);
+    for (const auto &frame : frames)
+    {
+        if (frame.spots.empty())
+        {
+            out << frame.frame << "\n";
+            continue;
+        }
+        for (const auto &spot : frame.spots)
+        {
+            out << frame.frame << "\t" << spot.x << "\t" << spot.y << "\t" << spot.intensity << "\t" << spot.pixels
+                << "\t" << spot.peak << "\n";
+        }
+    }
+    return out.str();
+}
+
+bool parseSpotList(const char *data, size_t size, std::vector<FrameSpots> &frames)
+{
+    std::istringstream in(std::string(data, size));
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#' || line.compare(0, 6, "frame\t") == 0)
+            continue;
+
+        std::vector<std::string> fields;
+        std::istringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() != 1 && fields.size() != 6)
+            return false;
+
+        if (frames.empty() || frames.back().frame != fields[0])
+        {
+            frames.push_back(FrameSpots());
+            frames.back().frame = fields[0];
+        }
+        if (fields.size() == 1)
+            continue;
+
+        try
+        {
+            Spot spot;
+            spot.x = std::stod(fields[1]);
+            spot.y = std::stod(fields[2]);
+            spot.intensity = std::stoll(fields[3]);
+            spot.pixels = static_cast<uint32_t>(std::stoul(fields[4]));
+            spot.peak = std::stoll(fields[5]);
+            frames.back().spots.push_back(spot);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SPOT_FINDER_HPP
+#define SPOT_FINDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 回折斑点（ブラッグスポット）の検出
+// 閾値以上の画素を8近傍で連結した領域を1つのスポットとし、画素値で重み付けした重心を求める。
+// 圧縮時にメモリ上のフレームから検出してセットごとの一覧をブロック形式アーカイブに BlockKind::Spots として格納し、
+// 解析（指数付けなど）では画素データを復号せずに一覧だけを読めるようにする
+
+// 検出の設定
+struct SpotFinderParams
+{
+    int64_t threshold = 0;      // この値以上の画素をスポットの候補にする
+    uint32_t minPixels = 2;     // これより画素数の少ない領域は除く（孤立したノイズ）
+    uint32_t maxPixels = 10000; // これより画素数の多い領域は除く（ビームストップの縁など）
+    int64_t listTimestamp = 0;  // 0以外の場合、一覧のブロック名に付ける（後から届いたフレームの一覧を別のブロックにする）
+};
+
+// 1つのスポット
+struct Spot
+{
+    double x;          // 重心の列（画素単位、左端の画素の中心が0）
+    double y;          // 重心の行
+    int64_t intensity; // 領域の画素値の合計
+    uint32_t pixels;   // 領域の画素数
+    int64_t peak;      // 領域の最大値
+};
+
+// 1フレーム分の一覧
+struct FrameSpots
+{
+    std::string frame; // フレームのファイル名
+    std::vector<Spot> spots;
+};
+
+// 画素（width * height、行優先）からスポットを検出する
+void findSpots(const std::vector<int64_t> &pixels, uint32_t width, uint32_t height, const SpotFinderParams &params,
+               std::vector<Spot> &spots);
+
+// 一覧のブロック名（"<prefix>_<run>_<先頭の番号>.spots"、listTimestampがある場合は ".<時刻>.spots"）
+std::string getSpotListName(const std::string &firstFrameName, const SpotFinderParams &params);
+
+// 一覧のシリアライズ（タブ区切り: frame, x, y, intensity, pixels, peak。スポットのないフレームはframeのみの行）
+std::string serializeSpotList(const std::vector<FrameSpots> &frames, const SpotFinderParams &params);
+
+// serializeSpotListの出力を読み込む
+bool parseSpotList(const char *data, size_t size, std::vector<FrameSpots> &frames);
+
+#endif // SPOT_FINDER_HPP
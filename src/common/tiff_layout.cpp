@@ -0,0 +1,241 @@
+#include "tiff_layout.hpp"
+#include <cstring>
+#include <vector>
+
+// 使用するTIFFタグ
+constexpr uint16_t TAG_IMAGE_WIDTH = 256;
+constexpr uint16_t TAG_IMAGE_LENGTH = 257;
+constexpr uint16_t TAG_BITS_PER_SAMPLE = 258;
+constexpr uint16_t TAG_COMPRESSION = 259;
+constexpr uint16_t TAG_STRIP_OFFSETS = 273;
+constexpr uint16_t TAG_SAMPLES_PER_PIXEL = 277;
+constexpr uint16_t TAG_STRIP_BYTE_COUNTS = 279;
+constexpr uint16_t TAG_SAMPLE_FORMAT = 339;
+
+// TIFFのフィールド型
+constexpr uint16_t TYPE_SHORT = 3;
+constexpr uint16_t TYPE_LONG = 4;
+
+TiffLayout::TiffLayout()
+    : width(0), height(0), bitsPerSample(0), isSigned(false), bigEndian(false), pixelOffset(0), pixelBytes(0)
+{
+}
+
+namespace
+{
+    // バイトオーダーを考慮した読み込み
+    class TiffReader
+    {
+    private:
+        const unsigned char *data;
+        size_t size;
+        bool bigEndian;
+
+    public:
+        TiffReader(const char *data, size_t size, bool bigEndian)
+            : data(reinterpret_cast<const unsigned char *>(data)), size(size), bigEndian(bigEndian) {}
+
+        bool u16(uint64_t offset, uint16_t &value) const
+        {
+            if (offset + 2 > size)
+                return false;
+            value = bigEndian ? static_cast<uint16_t>((data[offset] << 8) | data[offset + 1])
+                              : static_cast<uint16_t>(data[offset] | (data[offset + 1] << 8));
+            return true;
+        }
+
+        bool u32(uint64_t offset, uint32_t &value) const
+        {
+            if (offset + 4 > size)
+                return false;
+            const unsigned char *p = data + offset;
+            value = bigEndian ? (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]
+                              : uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+            return true;
+        }
+
+        // SHORTまたはLONGの配列（値が4バイト以内ならエントリ内に格納されている）
+        bool values(uint64_t entryOffset, uint16_t type, uint32_t count, std::vector<uint32_t> &out) const
+        {
+            size_t elemSize = (type == TYPE_SHORT) ? 2 : (type == TYPE_LONG) ? 4 : 0;
+            if (elemSize == 0 || count == 0)
+                return false;
+
+            uint64_t valueOffset = entryOffset + 8;
+            if (elemSize * count > 4)
+            {
+                uint32_t pointer;
+                if (!u32(entryOffset + 8, pointer))
+                    return false;
+                valueOffset = pointer;
+            }
+
+            out.resize(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                if (type == TYPE_SHORT)
+                {
+                    uint16_t v;
+                    if (!u16(valueOffset + i * 2, v))
+                        return false;
+                    out[i] = v;
+                }
+                else if (!u32(valueOffset + i * 4, out[i]))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+}
+
+bool parseTiffLayout(const char *data, size_t size, TiffLayout &layout)
+{
+    if (size < 8)
+        return false;
+
+    bool bigEndian;
+    if (data[0] == 'I' && data[1] == 'I')
+        bigEndian = false;
+    else if (data[0] == 'M' && data[1] == 'M')
+        bigEndian = true;
+    else
+        return false;
+
+    TiffReader reader(data, size, bigEndian);
+    uint16_t version;
+    uint32_t ifdOffset;
+    uint16_t entryCount;
+    if (!reader.u16(2, version) || version != 42 || !reader.u32(4, ifdOffset) || !reader.u16(ifdOffset, entryCount))
+        return false;
+
+    TiffLayout result;
+    result.bigEndian = bigEndian;
+    uint32_t compression = 1;
+    uint32_t samplesPerPixel = 1;
+    uint32_t sampleFormat = 1;
+    std::vector<uint32_t> stripOffsets;
+    std::vector<uint32_t> stripByteCounts;
+
+    for (uint16_t i = 0; i < entryCount; ++i)
+    {
+        uint64_t entryOffset = static_cast<uint64_t>(ifdOffset) + 2 + i * 12;
+        uint16_t tag, type;
+        uint32_t count;
+        if (!reader.u16(entryOffset, tag) || !reader.u16(entryOffset + 2, type) || !reader.u32(entryOffset + 4, count))
+            return false;
+
+        std::vector<uint32_t> values;
+        switch (tag)
+        {
+        case TAG_IMAGE_WIDTH:
+        case TAG_IMAGE_LENGTH:
+        case TAG_BITS_PER_SAMPLE:
+        case TAG_COMPRESSION:
+        case TAG_SAMPLES_PER_PIXEL:
+        case TAG_SAMPLE_FORMAT:
+            if (!reader.values(entryOffset, type, 1, values))
+                return false;
+            if (tag == TAG_IMAGE_WIDTH)
+                result.width = values[0];
+            else if (tag == TAG_IMAGE_LENGTH)
+                result.height = values[0];
+            else if (tag == TAG_BITS_PER_SAMPLE)
+                result.bitsPerSample = static_cast<uint16_t>(values[0]);
+            else if (tag == TAG_COMPRESSION)
+                compression = values[0];
+            else if (tag == TAG_SAMPLES_PER_PIXEL)
+                samplesPerPixel = values[0];
+            else
+                sampleFormat = values[0];
+            break;
+        case TAG_STRIP_OFFSETS:
+            if (!reader.values(entryOffset, type, count, stripOffsets))
+                return false;
+            break;
+        case TAG_STRIP_BYTE_COUNTS:
+            if (!reader.values(entryOffset, type, count, stripByteCounts))
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (compression != 1 || samplesPerPixel != 1 || (sampleFormat != 1 && sampleFormat != 2))
+        return false;
+    if (result.bitsPerSample != 8 && result.bitsPerSample != 16 && result.bitsPerSample != 32)
+        return false;
+    if (result.width == 0 || result.height == 0 || stripOffsets.empty() || stripOffsets.size() != stripByteCounts.size())
+        return false;
+
+    // ストリップが隙間なく連続している場合のみ扱う
+    uint64_t expected = stripOffsets[0];
+    for (size_t i = 0; i < stripOffsets.size(); ++i)
+    {
+        if (stripOffsets[i] != expected)
+            return false;
+        expected += stripByteCounts[i];
+    }
+
+    result.isSigned = (sampleFormat == 2);
+    result.pixelOffset = stripOffsets[0];
+    result.pixelBytes = static_cast<uint64_t>(result.width) * result.height * (result.bitsPerSample / 8);
+    if (expected - result.pixelOffset != result.pixelBytes || result.pixelOffset + result.pixelBytes > size)
+        return false;
+
+    layout = result;
+    return true;
+}
+
+// 画素を1つ読み込む（エンディアンを変換する）
+template <typename T>
+static inline int64_t loadPixel(const unsigned char *p, bool bigEndian)
+{
+    T value;
+    if (bigEndian)
+    {
+        unsigned char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i)
+            bytes[i] = p[sizeof(T) - 1 - i];
+        std::memcpy(&value, bytes, sizeof(T));
+    }
+    else
+    {
+        std::memcpy(&value, p, sizeof(T));
+    }
+    return static_cast<int64_t>(value);
+}
+
+template <typename T>
+static void loadPixels(const unsigned char *src, size_t count, bool bigEndian, int64_t *pixels)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        pixels[i] = loadPixel<T>(src + i * sizeof(T), bigEndian);
+    }
+}
+
+bool readTiffPixels(const char *data, const TiffLayout &layout, std::vector<int64_t> &pixels)
+{
+    size_t count = static_cast<size_t>(layout.width) * layout.height;
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(data) + layout.pixelOffset;
+    pixels.resize(count);
+    switch (layout.bitsPerSample)
+    {
+    case 8:
+        layout.isSigned ? loadPixels<int8_t>(src, count, false, pixels.data())
+                        : loadPixels<uint8_t>(src, count, false, pixels.data());
+        return true;
+    case 16:
+        layout.isSigned ? loadPixels<int16_t>(src, count, layout.bigEndian, pixels.data())
+                        : loadPixels<uint16_t>(src, count, layout.bigEndian, pixels.data());
+        return true;
+    case 32:
+        layout.isSigned ? loadPixels<int32_t>(src, count, layout.bigEndian, pixels.data())
+                        : loadPixels<uint32_t>(src, count, layout.bigEndian, pixels.data());
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,32 @@
+#ifndef TIFF_LAYOUT_HPP
+#define TIFF_LAYOUT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 非圧縮TIFFの画素データの配置
+// 検出器のフレーム（1サンプル/画素の整数、非圧縮、ストリップが連続）を想定し、
+// libtiffを使わずにファイルのバイト列から画素データの位置を求める
+struct TiffLayout
+{
+    uint32_t width;
+    uint32_t height;
+    uint16_t bitsPerSample; // 8, 16, 32
+    bool isSigned;          // SampleFormat = 2（符号付き整数）
+    bool bigEndian;         // "MM" 形式
+    uint64_t pixelOffset;   // ファイル先頭から画素データまでのバイト数
+    uint64_t pixelBytes;    // 画素データのバイト数（width * height * bitsPerSample / 8）
+
+    TiffLayout();
+};
+
+// TIFFの先頭IFDを解析して画素データの配置を求める
+// 戻り値: 非圧縮・1サンプル・連続ストリップの整数画像で、画素データがファイル内に収まる場合true
+bool parseTiffLayout(const char *data, size_t size, TiffLayout &layout);
+
+// 画素値を読み込む（parseTiffLayoutで求めた配置、pixelsはwidth * height個に設定される）
+// 戻り値: 対応するビット数（8, 16, 32）の場合true
+bool readTiffPixels(const char *data, const TiffLayout &layout, std::vector<int64_t> &pixels);
+
+#endif // TIFF_LAYOUT_HPP
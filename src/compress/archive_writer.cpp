@@ -0,0 +1,714 @@
+#include "archive_writer.hpp"
+#include "file_processor.hpp"
+#include "file_link.hpp"
+#include "file_reader.hpp"
+#include "../common/common.hpp"
+#include "../common/aligned_io.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/checksum.hpp"
+#include "../common/run_container.hpp"
+#include "../common/smoothed_writer.hpp"
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+// 書き込んだアーカイブのカタログエントリを作成
+// outputRoot: アーカイブを書き込んだ出力先（主出力ディレクトリ以外の場合はカタログに記録する）
+static CatalogEntry makeCatalogEntry(const FileSet &fileSet, const std::string &outputDir, const std::string &outputRoot,
+                                     const std::string &archivePath, uint64_t offset, const ArchiveStats &stats)
+{
+    CatalogEntry entry;
+    entry.run = fileSet.run;
+    entry.firstFrame = INT_MAX;
+    entry.lastFrame = 0;
+    for (const auto &file : fileSet.files)
+    {
+        std::string prefix;
+        int run = 0;
+        int frameNumber = 0;
+        if (parseFrameFileName(file, prefix, run, frameNumber))
+        {
+            entry.prefix = prefix;
+            entry.firstFrame = std::min(entry.firstFrame, frameNumber);
+            entry.lastFrame = std::max(entry.lastFrame, frameNumber);
+        }
+    }
+    if (entry.firstFrame == INT_MAX)
+    {
+        entry.firstFrame = fileSet.setNumber;
+    }
+    entry.fileCount = static_cast<uint32_t>(fileSet.files.size());
+    entry.setSize = fileSet.setSize;
+    entry.archive = fs::path(archivePath).lexically_relative(outputRoot).generic_string();
+    if (outputRoot != outputDir)
+    {
+        entry.root = fs::absolute(outputRoot).lexically_normal().generic_string();
+    }
+    entry.offset = offset;
+    entry.size = stats.archiveSize;
+    entry.rawSize = stats.rawSize;
+    entry.checksum = stats.checksum;
+    entry.compressMs = stats.compressMs;
+    entry.committedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    return entry;
+}
+
+// アーカイブの書き込みがディスクへの書き出しの完了を待つか（--dirty-window-mb はLinuxのみ。出力先の書き込み速度の計測に使う）
+static bool writesWaitForDisk()
+{
+#if defined(__linux__)
+    return getDirtyWindow() > 0;
+#else
+    return false;
+#endif
+}
+
+// 読み戻し検証で一致しなかった場合に書き直す回数
+constexpr int MAX_READBACK_REWRITES = 2;
+
+// 書き込んだ範囲をページキャッシュを介さずに読み戻し、チェックサムを確認する
+// ブロック形式アーカイブで一致しない場合は、格納データのチェックサムが一致しないブロックをログに出す
+// キャッシュを避けて読めない場合はmodeをNoneにしてfalseを返す（検証できない）
+static bool readbackArchive(const WriteTask &task, UncachedReadMode &mode)
+{
+    AlignedBuffer buffer;
+    const char *data = nullptr;
+    if (!readFileRangeUncached(task.writtenPath, task.writtenOffset, task.writtenSize, buffer, data, mode))
+    {
+        if (mode != UncachedReadMode::None)
+            LOG("Error: Failed to read back archive: " << task.writtenPath);
+        return false;
+    }
+    if (computeChecksum64(data, task.writtenSize) == task.writtenChecksum)
+        return true;
+
+    std::vector<BlockEntry> blocks;
+    if (readBlockArchiveIndex(data, task.writtenSize, blocks))
+    {
+        for (const auto &block : blocks)
+        {
+            if (computeChecksum64(data + block.offset, block.storedSize) != block.storedChecksum)
+                LOG("  Corrupted block: " << block.name);
+        }
+    }
+    return false;
+}
+
+ArchiveWriter::ArchiveWriter(FailureHandler onFailure, CommitHandler onCommit, const std::vector<std::string> &outputRoots,
+                             StripePolicy policy, size_t maxPending, bool verifyReadback)
+    : running(true), busy(false), writerStopped(false), maxPending(std::max<size_t>(1, maxPending)),
+      onFailure(std::move(onFailure)), onCommit(std::move(onCommit)), striper(outputRoots, policy, writesWaitForDisk()), verifyReadback(verifyReadback), verifyBusy(false)
+{
+    worker_thread = std::thread(&ArchiveWriter::worker, this);
+    if (verifyReadback)
+    {
+        verify_thread = std::thread(&ArchiveWriter::verifyWorker, this);
+    }
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running = false;
+    }
+    cv.notify_all();
+    verify_cv.notify_all();
+    space_cv.notify_all();
+    // 書き込みを先に終え、読み戻し検証は残りを検証し切ってから終える
+    if (worker_thread.joinable())
+    {
+        worker_thread.join();
+    }
+    verify_cv.notify_all();
+    if (verify_thread.joinable())
+    {
+        verify_thread.join();
+    }
+}
+
+void ArchiveWriter::push(WriteTask &&task)
+{
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        space_cv.wait(lock, [this]
+                      { return tasks.size() < maxPending; });
+        tasks.push(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void ArchiveWriter::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    space_cv.wait(lock, [this]
+                  { return tasks.empty() && !busy && verifyTasks.empty() && !verifyBusy; });
+}
+
+size_t ArchiveWriter::size()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return tasks.size();
+}
+
+bool ArchiveWriter::writeTask(WriteTask &task)
+{
+    const FileSet &fileSet = task.fileSet;
+    if (fileSet.lateFrames)
+    {
+        return appendTask(task);
+    }
+    auto writeStart = std::chrono::high_resolution_clock::now();
+
+    // ---------- 出力先を選ぶ ----------
+    // ランコンテナは1つのrunを同じ出力先に置き続ける
+    size_t rootIndex = 0;
+    std::string outputPath;
+    if (task.runContainer)
+    {
+        std::string containerName = fs::path(fileSet.getContainerPath(".")).filename().string();
+        rootIndex = striper.chooseRoot(task.archiveData.size(), containerName);
+        outputPath = fileSet.getContainerPath(fileSet.getOutputDir(striper.getRoot(rootIndex)));
+    }
+    else
+    {
+        // 読み戻し検証後の書き直しは同じアーカイブを上書きする
+        std::string archiveName = fs::path(fileSet.getOutputPath(".")).filename().string();
+        rootIndex = striper.chooseRoot(task.archiveData.size(), task.readbackFailures > 0 ? archiveName : "");
+        outputPath = fileSet.getOutputPath(fileSet.getOutputDir(striper.getRoot(rootIndex)));
+    }
+    // サブディレクトリのセット（--recursive）は出力先にも同じ構成で置く
+    const std::string outputRoot = fileSet.getOutputDir(striper.getRoot(rootIndex));
+    if (!fileSet.subdirectory.empty())
+    {
+        std::error_code ec;
+        fs::create_directories(outputRoot, ec);
+    }
+
+    // ---------- アーカイブを書き込む ----------
+    uint64_t archiveOffset = 0;
+    uint64_t segmentPadding = 0;
+    if (task.runContainer)
+    {
+        RunSegment segment;
+        if (!appendRunSegment(outputPath, fileSet.setNumber, static_cast<uint32_t>(fileSet.files.size()),
+                              task.archiveData, &segment, task.segmentAlignment, &segmentPadding))
+        {
+            LOG("Error: Failed to append set " << fileSet.setNumber << " to run container: " << outputPath);
+            return false;
+        }
+        archiveOffset = segment.offset;
+    }
+    else if (!writeLZ4Archive(task.archiveData, outputPath))
+    {
+        LOG("Error: Failed to write archive: " << outputPath);
+        return false;
+    }
+
+    auto archiveWritten = std::chrono::high_resolution_clock::now();
+    striper.recordWrite(rootIndex, task.archiveData.size(),
+                        std::chrono::duration<double, std::milli>(archiveWritten - writeStart).count());
+
+    // カタログに登録（アーカイブの書き込み完了後。読み戻し検証を有効にした場合は検証後）
+    task.catalogEntry = makeCatalogEntry(fileSet, task.outputDir, outputRoot, outputPath, archiveOffset, task.stats);
+    task.catalogPending = verifyReadback;
+    if (!task.catalogPending)
+    {
+        registerCatalog(task);
+    }
+
+    task.writtenPath = outputPath;
+    task.writtenOffset = archiveOffset;
+    task.writtenSize = task.archiveData.size();
+    task.writtenChecksum = task.stats.checksum;
+
+    // ---------- 先頭ファイルを出力ディレクトリに配置 ----------
+    // 可能ならreflink/ハードリンクでデータのコピーを避ける（書き直しの場合は配置済み）
+    LinkMethod linkMethod = LinkMethod::Failed;
+    if (task.copyFirstFile && !fileSet.firstFile.empty() && task.readbackFailures == 0)
+    {
+        fs::path firstFilePath(fileSet.firstFile);
+        fs::path destPath = fs::path(task.outputDir) / firstFilePath.filename();
+        linkMethod = linkOrCopyFile(firstFilePath.string(), destPath.string());
+    }
+
+    // 元ファイルの削除とリースの解放はワーカーで行う（読み戻し検証を有効にした場合は検証後）
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto writeTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - writeStart).count();
+    auto totalTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - task.startTime).count();
+
+    std::string firstFileNote = task.copyFirstFile && task.readbackFailures == 0
+                                    ? std::string(", first file: ") + linkMethodName(linkMethod)
+                                    : "";
+    // 境界揃えの埋め草（--align-blocks）の割合を表示
+    uint64_t paddingBytes = task.stats.paddingBytes + segmentPadding;
+    if (paddingBytes > 0)
+    {
+        std::ostringstream note;
+        note << ", padding " << paddingBytes << " bytes (" << std::fixed << std::setprecision(1)
+             << (100.0 * paddingBytes / std::max<uint64_t>(1, task.stats.archiveSize + segmentPadding)) << "%)";
+        firstFileNote += note.str();
+    }
+    // 圧縮できずに無圧縮で格納したフレームの数を表示
+    if (task.stats.storedRawBlocks > 0)
+    {
+        firstFileNote += ", stored raw " + std::to_string(task.stats.storedRawBlocks) + " of " +
+                         std::to_string(fileSet.files.size()) + " file(s)";
+    }
+    // --codec=auto で選んだコーデックの内訳を表示
+    if (!task.stats.codecSummary.empty())
+    {
+        firstFileNote += ", codecs: " + task.stats.codecSummary;
+    }
+    // 出力先が複数ある場合はどこに書いたかを表示
+    std::string displayName = striper.getRootCount() > 1 ? outputPath : fs::path(outputPath).filename().string();
+    if (task.runContainer)
+    {
+        LOG("Appended: " << displayName << " (set " << fileSet.setNumber
+            << ") - Processing time: " << totalTime << " ms (write " << writeTime << " ms" << firstFileNote << ")");
+    }
+    else
+    {
+        LOG("Created: " << displayName << " - Processing time: " << totalTime
+            << " ms (write " << writeTime << " ms" << firstFileNote << ")");
+    }
+    return true;
+}
+
+bool ArchiveWriter::appendTask(WriteTask &task)
+{
+    const FileSet &fileSet = task.fileSet;
+    auto writeStart = std::chrono::high_resolution_clock::now();
+
+    // マイクロセットのまとめ直しと同じアーカイブを同時に読み書きしない
+    std::unique_lock<std::mutex> archiveLock;
+    if (microCompactor)
+    {
+        archiveLock = std::unique_lock<std::mutex>(microCompactor->getArchiveMutex());
+    }
+
+    // ---------- 既存のアーカイブを探して読み込む ----------
+    std::string outputPath;
+    std::string outputRoot;
+    std::string existing;
+    for (size_t i = 0; i < striper.getRootCount() && outputPath.empty(); ++i)
+    {
+        const std::string root = fileSet.getOutputDir(striper.getRoot(i));
+        if (task.runContainer)
+        {
+            RunSegment segment;
+            std::vector<char> data;
+            std::string containerPath = fileSet.getContainerPath(root);
+            if (!findRunSegment(containerPath, fileSet.setNumber, segment))
+                continue;
+            if (!readRunSegment(containerPath, segment, data))
+            {
+                LOG("Error: Failed to read set " << fileSet.setNumber << " from run container: " << containerPath);
+                return false;
+            }
+            existing.assign(data.begin(), data.end());
+            outputPath = containerPath;
+            outputRoot = root;
+        }
+        else if (fs::exists(fileSet.getOutputPath(root)))
+        {
+            outputPath = fileSet.getOutputPath(root);
+            outputRoot = root;
+            if (!readWholeFile(outputPath, existing))
+            {
+                LOG("Error: Failed to read archive: " << outputPath);
+                return false;
+            }
+        }
+    }
+    // マイクロセットのアーカイブが既にまとめられている場合は、まとめたアーカイブに追記する
+    if (outputPath.empty() && microCompactor && !task.runContainer &&
+        microCompactor->findCompactedArchive(fileSet, outputPath, outputRoot) && !readWholeFile(outputPath, existing))
+    {
+        LOG("Error: Failed to read archive: " << outputPath);
+        return false;
+    }
+    if (outputPath.empty())
+    {
+        LOG("Warning: Archive for late frame(s) not found: run " << fileSet.run << ", set " << fileSet.setNumber);
+        return false;
+    }
+
+    // v1（セット全体で1ブロック）のアーカイブには追記できない（元ファイルは残す）
+    if (!isBlockArchive(existing.data(), existing.size()))
+    {
+        LOG("Warning: Cannot append late frame(s) to a v1 archive, leaving source files: " << outputPath);
+        task.deleteAfter = false;
+        return true;
+    }
+
+    // ---------- 追記するブロックと新しいインデックスを組み立てる ----------
+    std::string appendData;
+    std::vector<BlockEntry> merged;
+    size_t addedCount = 0;
+    if (!buildBlockArchiveAppend(existing.data(), existing.size(), task.archiveData.data(), task.archiveData.size(),
+                                 task.blockAlignment, appendData, &merged, &addedCount))
+    {
+        LOG("Error: Failed to read block index of archive: " << outputPath);
+        return false;
+    }
+
+    // ---------- 追記する ----------
+    // フッターは最後に書かれるため、途中で失敗しても既存のインデックスが有効なまま残る
+    uint64_t archiveOffset = 0;
+    uint64_t archiveSize = existing.size();
+    uint64_t archiveChecksum = 0;
+    uint32_t fileCount = static_cast<uint32_t>(std::count_if(merged.begin(), merged.end(), [](const BlockEntry &entry)
+                                                             { return entry.kind == BlockKind::File; }));
+    if (addedCount > 0)
+    {
+        if (task.runContainer)
+        {
+            // ランコンテナのセグメントは途中に書き足せないため、既存のブロックごと新しいセグメントとして追記する（再圧縮はしない）
+            existing.append(appendData);
+            RunSegment segment;
+            if (!appendRunSegment(outputPath, fileSet.setNumber, fileCount, existing, &segment, task.segmentAlignment))
+            {
+                LOG("Error: Failed to append late frame(s) of set " << fileSet.setNumber << " to run container: " << outputPath);
+                return false;
+            }
+            archiveOffset = segment.offset;
+            archiveSize = existing.size();
+            archiveChecksum = segment.checksum;
+        }
+        else
+        {
+            SmoothedFileWriter outFile;
+            bool written = outFile.open(outputPath, true) && outFile.write(appendData.data(), appendData.size());
+            written = outFile.close() && written;
+            std::error_code ec;
+            if (!written || fs::file_size(outputPath, ec) != existing.size() + appendData.size())
+            {
+                LOG("Error: Failed to append late frame(s) to archive: " << outputPath);
+                return false;
+            }
+            Checksum64 checksum;
+            checksum.update(existing.data(), existing.size());
+            checksum.update(appendData.data(), appendData.size());
+            archiveSize = existing.size() + appendData.size();
+            archiveChecksum = checksum.digest();
+        }
+        task.writtenPath = outputPath;
+        task.writtenOffset = archiveOffset;
+        task.writtenSize = archiveSize;
+        task.writtenChecksum = archiveChecksum;
+
+        // カタログに新しい行を登録する（後の行が有効になる）
+        FileSet catalogSet = fileSet;
+        catalogSet.files.clear();
+        ArchiveStats stats;
+        for (const auto &entry : merged)
+        {
+            if (entry.kind == BlockKind::File)
+                catalogSet.files.insert(entry.name);
+            stats.rawSize += entry.rawSize;
+        }
+        stats.archiveSize = archiveSize;
+        stats.checksum = archiveChecksum;
+        stats.compressMs = task.stats.compressMs;
+        task.catalogEntry = makeCatalogEntry(catalogSet, task.outputDir, outputRoot, outputPath, archiveOffset, stats);
+        task.catalogPending = verifyReadback;
+        if (!task.catalogPending)
+        {
+            registerCatalog(task);
+        }
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    auto writeTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - writeStart).count();
+    std::string displayName = striper.getRootCount() > 1 ? outputPath : fs::path(outputPath).filename().string();
+    if (addedCount == 0)
+    {
+        LOG("Late frame(s) already archived: " << displayName << " (set " << fileSet.setNumber << ", "
+            << fileSet.files.size() << " file(s))");
+    }
+    else
+    {
+        LOG("Appended " << addedCount << " late frame(s): " << displayName << " (set " << fileSet.setNumber
+            << ", " << fileCount << " files, +" << appendData.size() << " bytes) - write " << writeTime << " ms");
+    }
+    return true;
+}
+
+void ArchiveWriter::releaseSources(const WriteTask &task)
+{
+    const FileSet &fileSet = task.fileSet;
+
+    // 元ファイルを削除 - 削除キューに追加（展開テストと書き込みの成功後のみ）
+    // 複数プロセスで分担している場合は、リースを保持しているプロセスだけが削除する
+    std::string leaseKey = LeaseManager::keyFor(fileSet);
+    bool ownsSet = !leaseManager || leaseManager->isOwned(leaseKey);
+    if (!ownsSet)
+    {
+        LOG("Warning: Lease was taken over during processing, leaving source files: run "
+            << fileSet.run << ", set " << fileSet.setNumber);
+    }
+    if (task.deleteAfter && ownsSet)
+    {
+        deleteQueue->push(fileSet.files);
+        if (!fileSet.sidecars.empty())
+        {
+            deleteQueue->push(fileSet.sidecars);
+        }
+    }
+
+    // リースはアーカイブの書き込み後に解放する（他のプロセスは取得後に処理済みであることを確認できる）
+    if (leaseManager)
+    {
+        leaseManager->release(leaseKey);
+    }
+}
+
+void ArchiveWriter::registerCatalog(const WriteTask &task)
+{
+    if (!appendCatalogEntry(task.outputDir, task.catalogEntry))
+    {
+        LOG("Warning: Failed to register set in catalog: run " << task.fileSet.run << ", set " << task.fileSet.setNumber);
+    }
+}
+
+void ArchiveWriter::commitTask(const WriteTask &task)
+{
+    if (task.catalogPending)
+    {
+        registerCatalog(task);
+    }
+    releaseSources(task);
+
+    // 書き込んだ（追記した）マイクロセットのアーカイブをまとめ直しの対象にする
+    if (microCompactor && task.writtenSize > 0)
+    {
+        microCompactor->add(task.catalogEntry);
+    }
+
+    if (onCommit)
+    {
+        onCommit(task.fileSet);
+    }
+}
+
+void ArchiveWriter::discardTask(const WriteTask &task)
+{
+    const FileSet &fileSet = task.fileSet;
+
+    // 後から届いたフレームの追記は既存のフレームと同じアーカイブのため残す（カタログは追記前の行のまま）
+    if (!fileSet.lateFrames)
+    {
+        // 以前の処理で登録された同じセットの行も無効にする
+        CatalogEntry tombstone = task.catalogEntry;
+        tombstone.removed = true;
+        tombstone.committedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                    std::chrono::system_clock::now().time_since_epoch())
+                                    .count();
+        if (!appendCatalogEntry(task.outputDir, tombstone))
+        {
+            LOG("Warning: Failed to mark archive as removed in catalog: run " << fileSet.run << ", set " << fileSet.setNumber);
+        }
+
+        // 書き込み済みと判定されて再処理が飛ばされないよう、アーカイブ（セグメント）を消す
+        bool removed = false;
+        std::error_code ec;
+        if (task.runContainer)
+            removed = removeRunSegment(task.writtenPath, fileSet.setNumber);
+        else
+            removed = fs::remove(task.writtenPath, ec) && !ec;
+        if (!removed)
+        {
+            LOG("Warning: Failed to remove unverified archive: " << task.writtenPath);
+        }
+    }
+
+    if (onFailure)
+    {
+        onFailure(fileSet);
+    }
+}
+
+void ArchiveWriter::worker()
+{
+    try
+    {
+        while (true)
+        {
+            WriteTask task;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                // 終了時も待機中のタスクは書き切る（読み戻し検証からの書き直しを含む）
+                cv.wait(lock, [this]
+                        { return !tasks.empty() || (!running && verifyTasks.empty() && !verifyBusy); });
+                if (tasks.empty())
+                {
+                    writerStopped = true;
+                    break;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop();
+                busy = true;
+            }
+            space_cv.notify_all();
+
+            bool ok = false;
+            try
+            {
+                ok = writeTask(task);
+            }
+            catch (const std::exception &e)
+            {
+                LOG("Error in archive writer: " << e.what());
+            }
+
+            if (!ok)
+            {
+                if (onFailure)
+                    onFailure(task.fileSet);
+            }
+            else if (verifyReadback && task.writtenSize > 0)
+            {
+                // 検証待ちが上限に達している場合は空くまで待つ（検証スレッドはこのスレッドを待たない）
+                {
+                    std::unique_lock<std::mutex> lock(queue_mutex);
+                    space_cv.wait(lock, [this]
+                                  { return verifyTasks.size() < maxPending; });
+                    verifyTasks.push(std::move(task));
+                }
+                verify_cv.notify_one();
+            }
+            else
+            {
+                commitTask(task);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                busy = false;
+            }
+            space_cv.notify_all();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Fatal error in archive writer thread: " << e.what());
+    }
+    catch (...)
+    {
+        LOG("Unknown fatal error in archive writer thread");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        writerStopped = true;
+    }
+    verify_cv.notify_all();
+}
+
+void ArchiveWriter::verifyWorker()
+{
+    try
+    {
+        while (true)
+        {
+            WriteTask task;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                verify_cv.wait(lock, [this]
+                               { return !verifyTasks.empty() || writerStopped; });
+                // 書き込みが終了した後も、検証待ちのタスクは検証し切る
+                if (verifyTasks.empty())
+                    break;
+
+                task = std::move(verifyTasks.front());
+                verifyTasks.pop();
+                verifyBusy = true;
+            }
+            space_cv.notify_all();
+
+            auto verifyStart = std::chrono::high_resolution_clock::now();
+            UncachedReadMode mode = UncachedReadMode::None;
+            bool ok = false;
+            try
+            {
+                ok = readbackArchive(task, mode);
+            }
+            catch (const std::exception &e)
+            {
+                LOG("Error in readback verification: " << e.what());
+            }
+            auto verifyTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                  std::chrono::high_resolution_clock::now() - verifyStart)
+                                  .count();
+
+            std::string displayName = fs::path(task.writtenPath).filename().string();
+            if (ok)
+            {
+                LOG("Verified on disk: " << displayName << " (set " << task.fileSet.setNumber << ", "
+                    << task.writtenSize << " bytes, " << (mode == UncachedReadMode::Direct ? "direct I/O" : "cache dropped")
+                    << ", " << verifyTime << " ms)");
+                commitTask(task);
+            }
+            else if (mode == UncachedReadMode::None)
+            {
+                // ページキャッシュの内容を読み直しても書き込み経路の検証にならないため、検証できなかったものとして元ファイルを残す
+                LOG("Warning: Cannot read back archive bypassing the page cache, leaving source files unverified: "
+                    << task.writtenPath << " (run " << task.fileSet.run << ", set " << task.fileSet.setNumber << ")");
+                task.deleteAfter = false;
+                commitTask(task);
+            }
+            else
+            {
+                // メモリ上のアーカイブを書き込みステージに戻して書き直す（待機数の上限によらず追加する）
+                // 後から届いたフレームの追記は既存のブロックと同じ内容として飛ばされるため、書き直さない
+                bool requeued = false;
+                if (!task.fileSet.lateFrames && task.readbackFailures < MAX_READBACK_REWRITES)
+                {
+                    std::lock_guard<std::mutex> lock(queue_mutex);
+                    if (!writerStopped)
+                    {
+                        LOG("Warning: Readback checksum mismatch, rewriting: " << task.writtenPath << " (set "
+                            << task.fileSet.setNumber << ")");
+                        task.readbackFailures++;
+                        task.writtenSize = 0;
+                        tasks.push(std::move(task));
+                        requeued = true;
+                    }
+                }
+                if (requeued)
+                {
+                    cv.notify_one();
+                }
+                else
+                {
+                    LOG("Error: Readback verification failed, discarding archive and leaving source files: " << task.writtenPath
+                        << " (run " << task.fileSet.run << ", set " << task.fileSet.setNumber << ")");
+                    discardTask(task);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                verifyBusy = false;
+            }
+            space_cv.notify_all();
+            cv.notify_all();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Fatal error in readback verification thread: " << e.what());
+    }
+    catch (...)
+    {
+        LOG("Unknown fatal error in readback verification thread");
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef ARCHIVE_WRITER_HPP
+#define ARCHIVE_WRITER_HPP
+
+#include "file_set.hpp"
+#include "compress_to_lz4.hpp"
+#include "output_striper.hpp"
+#include "../common/archive_catalog.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+// 書き込みステージに渡すタスク（圧縮済みのアーカイブ）
+struct WriteTask
+{
+    FileSet fileSet;
+    std::string outputDir;    // 主出力ディレクトリ（カタログ・先頭ファイルの配置先、--recursiveの場合はその下のセットのサブディレクトリ）
+    std::string archiveData;  // アーカイブのバイト列
+    ArchiveStats stats;
+    bool runContainer = false;
+    uint64_t segmentAlignment = 0; // ランコンテナのセグメントの先頭を揃える境界（0: 揃えない）
+    uint64_t blockAlignment = 0;   // 既存のアーカイブに追記するブロックの先頭を揃える境界（0: 揃えない）
+    bool copyFirstFile = true;
+    bool deleteAfter = true;
+    std::chrono::high_resolution_clock::time_point startTime; // セットの処理開始時刻
+
+    // 書き込んだ範囲（読み戻し検証用。writtenSizeが0の場合は何も書き込んでいない）
+    std::string writtenPath;
+    uint64_t writtenOffset = 0;
+    uint64_t writtenSize = 0;
+    uint64_t writtenChecksum = 0;
+    int readbackFailures = 0; // 読み戻し検証に失敗して書き直した回数
+    CatalogEntry catalogEntry; // 登録したカタログエントリ（マイクロセットのまとめ直しに渡す）
+    bool catalogPending = false; // カタログへの登録を読み戻し検証の成功後に行う
+};
+
+// 書き込みステージ
+// 圧縮スレッドから受け取ったアーカイブの出力先の選択と書き込み、カタログ登録、先頭ファイルの配置、
+// 削除キューへの投入を専用スレッドで行い、次のセットの圧縮と並行させる
+// 後から届いたフレームの既存のアーカイブへの追記も、同じアーカイブへの書き込みと競合しないようこのスレッドで行う
+//
+// 読み戻し検証（verifyReadback）を有効にした場合は、書き込んだ範囲を別のスレッドでページキャッシュを介さずに読み戻して
+// チェックサムを確認してからカタログに登録し、削除キューに投入する（次のセットの書き込みと並行する）。
+// 一致しない場合はメモリ上のアーカイブを書き直し、それでも一致しない場合はアーカイブを無効にして書き込みの失敗として扱う
+class ArchiveWriter
+{
+public:
+    using FailureHandler = std::function<void(const FileSet &)>;
+    using CommitHandler = std::function<void(const FileSet &)>;
+
+private:
+    std::queue<WriteTask> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable cv;       // ワーカーへの通知
+    std::condition_variable space_cv; // pushの待機解除用
+    std::thread worker_thread;
+    bool running;
+    bool busy;          // ワーカーがタスクを処理中
+    bool writerStopped; // ワーカーが終了した（読み戻し検証から書き直しを戻せない）
+    size_t maxPending;  // 待機できるタスク数の上限（メモリ使用量の抑制）
+    FailureHandler onFailure;
+    CommitHandler onCommit;
+    OutputStriper striper; // 出力先の選択
+
+    // 読み戻し検証
+    bool verifyReadback;
+    std::queue<WriteTask> verifyTasks;
+    std::condition_variable verify_cv;
+    std::thread verify_thread;
+    bool verifyBusy;
+
+    // ワーカースレッド関数
+    void worker();
+
+    // 読み戻し検証スレッド関数
+    void verifyWorker();
+
+    // 1タスク分の書き込み処理（書き込んだ範囲をtask.written*に設定する）
+    bool writeTask(WriteTask &task);
+
+    // 後から届いたフレームのブロックを既存のアーカイブに追記する（task.fileSet.lateFramesの場合）
+    bool appendTask(WriteTask &task);
+
+    // 元ファイルを削除キューに投入し、リースを解放する（書き込み、または読み戻し検証の成功後）
+    void releaseSources(const WriteTask &task);
+
+    // 書き込んだアーカイブをカタログに登録する
+    void registerCatalog(const WriteTask &task);
+
+    // 書き込み（または読み戻し検証）に成功したタスクを完了する（カタログへの登録、元ファイルの解放、マイクロセットのまとめ直しへの登録）
+    void commitTask(const WriteTask &task);
+
+    // 読み戻し検証に失敗し続けたアーカイブを無効にし、書き込みの失敗として通知する
+    void discardTask(const WriteTask &task);
+
+public:
+    // onFailure: 書き込みに失敗したセットを通知する（未処理に戻して再キューするため）
+    // onCommit: 書き込み（読み戻し検証を含む）を終えたセットを通知する
+    // outputRoots: アーカイブの出力先（先頭が主出力ディレクトリ）
+    // verifyReadback: 書き込んだアーカイブを読み戻して検証してから元ファイルを削除する
+    ArchiveWriter(FailureHandler onFailure, CommitHandler onCommit, const std::vector<std::string> &outputRoots,
+                  StripePolicy policy = StripePolicy::RoundRobin, size_t maxPending = 2, bool verifyReadback = false);
+    ~ArchiveWriter();
+
+    // タスクを追加する（待機中のタスクが上限に達している場合は空くまで待つ）
+    void push(WriteTask &&task);
+
+    // 待機中のタスクがすべて書き込まれる（読み戻し検証を含む）まで待つ
+    void waitIdle();
+
+    size_t size();
+};
+
+#endif // ARCHIVE_WRITER_HPP
@@ -0,0 +1,350 @@
+#include "compress_to_blocks.hpp"
+#include "file_reader.hpp"
+#include "../common/common.hpp"
+#include "../common/checksum.hpp"
+#include "../common/frame_checkpoint.hpp"
+#include "../common/spot_finder.hpp"
+#include "../common/tiff_layout.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 1ファイル分の符号化結果
+struct EncodedBlock
+{
+    BlockEntry entry;
+    std::string stored;
+    bool success = false;
+    bool analyzed = false; // spotsにスポットを検出した結果がある
+    FrameSpots spots;
+};
+
+// チェックポイントの区間ごとのフレームの和
+// 区間 b は baseFrame + b * interval から interval フレーム分。各スレッドが読み込んだフレームを区間ごとにロックして加え、
+// 全フレームの読み込み後に先頭から順に足し合わせて累積和にする
+struct CheckpointBuckets
+{
+    int baseFrame = 0;
+    int interval = 0;
+    std::vector<std::vector<int64_t>> sums;
+    std::vector<uint32_t> widths;
+    std::vector<uint32_t> heights;
+    std::vector<std::mutex> mutexes;
+    std::atomic<bool> failed{false}; // 対応しない形式のフレームがあった（チェックポイントを作らない）
+
+    CheckpointBuckets(int baseFrame, int lastFrame, int interval)
+        : baseFrame(baseFrame), interval(interval), sums((lastFrame - baseFrame) / interval + 1),
+          widths(sums.size(), 0), heights(sums.size(), 0), mutexes(sums.size())
+    {
+    }
+
+    void add(const std::string &fileName, const std::vector<int64_t> &pixels, uint32_t width, uint32_t height)
+    {
+        int frame = getFrameNumber(fileName);
+        size_t bucket = frame < baseFrame ? sums.size() : static_cast<size_t>((frame - baseFrame) / interval);
+        if (bucket >= sums.size())
+        {
+            failed = true;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutexes[bucket]);
+        if (!addFramePixels(pixels, width, height, sums[bucket], widths[bucket], heights[bucket]))
+            failed = true;
+    }
+};
+
+// フレームがメモリ上にある間に画素から求めるもの
+struct FrameAnalysis
+{
+    CheckpointBuckets *checkpoints = nullptr;   // チェックポイントの区間の和に加える
+    const SpotFinderParams *spotFinder = nullptr; // スポットを検出する
+};
+
+// フレームの画素を読み込んでチェックポイントの和に加え、スポットを検出する
+static void analyzeFrame(const std::string &raw, const FrameAnalysis &analysis, EncodedBlock &result)
+{
+    TiffLayout layout;
+    std::vector<int64_t> pixels;
+    if (!parseTiffLayout(raw.data(), raw.size(), layout) || !readTiffPixels(raw.data(), layout, pixels))
+    {
+        if (analysis.checkpoints)
+            analysis.checkpoints->failed = true;
+        return;
+    }
+
+    if (analysis.checkpoints)
+        analysis.checkpoints->add(result.entry.name, pixels, layout.width, layout.height);
+    if (analysis.spotFinder)
+    {
+        result.spots.frame = result.entry.name;
+        findSpots(pixels, layout.width, layout.height, *analysis.spotFinder, result.spots.spots);
+        result.analyzed = true;
+    }
+}
+
+// ファイルを読み込み、符号化し、メモリ上で復号テストを行う
+// storeThreshold: 圧縮後のサイズが元のこの倍数を超える場合は無圧縮で格納する（BLOCK_FLAG_STORED_RAW）
+// analysis: nullptr以外の場合、読み込んだフレームの画素を解析する
+static void encodeFileBlock(const std::string &path, BlockKind kind, BlockCodec codec, int lz4Acceleration,
+                            double storeThreshold, EncodedBlock &result, const FrameAnalysis *analysis = nullptr)
+{
+    std::string raw;
+    if (!readWholeFile(path, raw))
+    {
+        LOG("Error: Failed to read file: " << path);
+        return;
+    }
+
+    result.entry.name = fs::path(path).filename().string();
+    result.entry.kind = kind;
+    result.entry.rawSize = raw.size();
+    result.entry.rawChecksum = computeChecksum64(raw);
+    if (analysis)
+        analyzeFrame(raw, *analysis, result);
+    if (encodeBlock(raw, codec, lz4Acceleration, result.stored, result.entry.codec, storeThreshold, &result.entry.flags))
+        result.entry.flags |= BLOCK_FLAG_STORED_RAW;
+    result.entry.storedSize = result.stored.size();
+
+    // 無圧縮のブロックは元のデータの写しなので復号テストは不要
+    if (result.entry.codec == BlockCodec::Store)
+    {
+        result.success = true;
+        return;
+    }
+
+    // 復号して元のデータと一致するか確認（書き込み前の整合性チェック）
+    std::vector<char> decoded;
+    if (!decodeBlock(result.entry, result.stored.data(), decoded) ||
+        computeChecksum64(decoded.data(), decoded.size()) != result.entry.rawChecksum)
+    {
+        LOG("Error: Block decode test failed in memory: " << path << " (" << blockCodecName(result.entry.codec) << ")");
+        return;
+    }
+    result.success = true;
+}
+
+// 区間ごとの和を累積和にしてチェックポイントのブロックを作る
+// blocks: 先頭のframeCount個がフレームのブロック（フレーム番号順）
+static bool encodeCheckpointBlocks(const CheckpointBuckets &checkpoints, const std::vector<EncodedBlock> &blocks,
+                                   size_t frameCount, int lz4Acceleration, std::vector<EncodedBlock> &results)
+{
+    FrameCheckpoint checkpoint;
+    checkpoint.baseFrame = checkpoints.baseFrame;
+    std::vector<uint64_t> rawChecksums;
+    size_t nextFrame = 0;
+    int lastFrame = getFrameNumber(blocks[frameCount - 1].entry.name);
+
+    for (size_t b = 0; b < checkpoints.sums.size(); ++b)
+    {
+        // フレームのない区間は前のチェックポイントと同じになるため作らない
+        if (checkpoints.sums[b].empty())
+            continue;
+        if (checkpoint.sums.empty())
+        {
+            checkpoint.width = checkpoints.widths[b];
+            checkpoint.height = checkpoints.heights[b];
+            checkpoint.sums.assign(checkpoints.sums[b].size(), 0);
+        }
+        if (checkpoints.widths[b] != checkpoint.width || checkpoints.heights[b] != checkpoint.height)
+            return false;
+        for (size_t p = 0; p < checkpoint.sums.size(); ++p)
+            checkpoint.sums[p] += checkpoints.sums[b][p];
+
+        checkpoint.lastFrame = std::min(lastFrame, checkpoints.baseFrame + static_cast<int>(b + 1) * checkpoints.interval - 1);
+        while (nextFrame < frameCount && getFrameNumber(blocks[nextFrame].entry.name) <= checkpoint.lastFrame)
+        {
+            rawChecksums.push_back(blocks[nextFrame++].entry.rawChecksum);
+        }
+        checkpoint.frameCount = static_cast<uint32_t>(rawChecksums.size());
+        checkpoint.framesChecksum = computeFramesChecksum(rawChecksums);
+
+        EncodedBlock block;
+        std::string raw = serializeCheckpoint(checkpoint);
+        block.entry.name = getCheckpointName(blocks.front().entry.name, checkpoint.lastFrame);
+        block.entry.kind = BlockKind::Checkpoint;
+        block.entry.rawSize = raw.size();
+        block.entry.rawChecksum = computeChecksum64(raw);
+        encodeBlock(raw, BlockCodec::LZ4, lz4Acceleration, block.stored, block.entry.codec);
+        block.entry.storedSize = block.stored.size();
+        block.success = true;
+        results.push_back(std::move(block));
+    }
+    return true;
+}
+
+// 各フレームのスポットを1つの一覧のブロックにする
+// blocks: 先頭のframeCount個がフレームのブロック
+static bool encodeSpotListBlock(const std::vector<EncodedBlock> &blocks, size_t frameCount, const SpotFinderParams &params,
+                                int lz4Acceleration, EncodedBlock &result)
+{
+    std::vector<FrameSpots> frames;
+    size_t spotCount = 0;
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        if (!blocks[i].analyzed)
+            continue;
+        frames.push_back(blocks[i].spots);
+        spotCount += blocks[i].spots.spots.size();
+    }
+    if (frames.empty())
+    {
+        LOG("Note: Frames are not uncompressed integer TIFF, spot finding skipped");
+        return false;
+    }
+    if (frames.size() < frameCount)
+    {
+        LOG("Note: Spot finding skipped for " << (frameCount - frames.size()) << " of " << frameCount << " frame(s)");
+    }
+    LOG("Spots: " << spotCount << " in " << frames.size() << " frame(s)");
+
+    std::string raw = serializeSpotList(frames, params);
+    result.entry.name = getSpotListName(blocks.front().entry.name, params);
+    result.entry.kind = BlockKind::Spots;
+    result.entry.rawSize = raw.size();
+    result.entry.rawChecksum = computeChecksum64(raw);
+    encodeBlock(raw, BlockCodec::LZ4, lz4Acceleration, result.stored, result.entry.codec);
+    result.entry.storedSize = result.stored.size();
+    result.success = true;
+    return true;
+}
+
+bool buildBlockArchive(const std::set<std::string> &files,
+                       const std::set<std::string> &sidecars,
+                       std::string &archiveData,
+                       int maxThreads,
+                       BlockCodec codec,
+                       int lz4Acceleration,
+                       uint64_t alignment,
+                       int checkpointInterval,
+                       const SpotFinderParams *spotFinder,
+                       double storeThreshold,
+                       ArchiveStats *stats)
+{
+    if (files.empty())
+    {
+        LOG("Error: No files to compress");
+        return false;
+    }
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // ---------- ファイル単位で並列に読み込み・符号化・復号テスト ----------
+    // フレームの後ろに付随ファイルを並べる
+    std::vector<std::string> fileList(files.begin(), files.end());
+    fileList.insert(fileList.end(), sidecars.begin(), sidecars.end());
+    std::vector<EncodedBlock> blocks(fileList.size());
+
+    // チェックポイントの区間（フレーム番号が読めない場合は作らない）
+    std::unique_ptr<CheckpointBuckets> checkpoints;
+    if (checkpointInterval > 0)
+    {
+        int firstFrame = getFrameNumber(fs::path(fileList.front()).filename().string());
+        int lastFrame = getFrameNumber(fs::path(fileList[files.size() - 1]).filename().string());
+        if (firstFrame >= 0 && lastFrame >= firstFrame)
+            checkpoints = std::make_unique<CheckpointBuckets>(firstFrame, lastFrame, checkpointInterval);
+        else
+            LOG("Note: Frame numbers not found in file names, checkpoints skipped");
+    }
+
+    FrameAnalysis analysis;
+    analysis.checkpoints = checkpoints.get();
+    analysis.spotFinder = spotFinder;
+    bool analyze = analysis.checkpoints || analysis.spotFinder;
+
+    std::atomic<size_t> nextFile(0);
+    std::vector<std::thread> threads;
+    int threadCount = std::max(1, std::min<int>(maxThreads, static_cast<int>(fileList.size())));
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            for (size_t i = nextFile++; i < fileList.size(); i = nextFile++)
+            {
+                if (i < files.size())
+                    encodeFileBlock(fileList[i], BlockKind::File, codec, lz4Acceleration, storeThreshold, blocks[i],
+                                    analyze ? &analysis : nullptr);
+                else
+                    encodeFileBlock(fileList[i], BlockKind::Sidecar, BlockCodec::LZ4, lz4Acceleration, storeThreshold,
+                                    blocks[i]);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    // ---------- スポットの一覧とチェックポイント（付随ファイルの後ろに格納する） ----------
+    bool allRead = std::all_of(blocks.begin(), blocks.end(), [](const EncodedBlock &block)
+                               { return block.success; });
+    if (spotFinder && allRead)
+    {
+        EncodedBlock spotList;
+        if (encodeSpotListBlock(blocks, files.size(), *spotFinder, lz4Acceleration, spotList))
+            blocks.push_back(std::move(spotList));
+    }
+    if (checkpoints)
+    {
+        std::vector<EncodedBlock> checkpointBlocks;
+        if (allRead && !checkpoints->failed &&
+            encodeCheckpointBlocks(*checkpoints, blocks, files.size(), lz4Acceleration, checkpointBlocks))
+        {
+            for (auto &block : checkpointBlocks)
+                blocks.push_back(std::move(block));
+        }
+        else if (allRead)
+        {
+            LOG("Note: Frames are not uncompressed integer TIFF of one size, checkpoints skipped");
+        }
+    }
+
+    // ---------- 元の順序でアーカイブを組み立てる ----------
+    BlockArchiveBuilder builder(alignment);
+    uint64_t totalSize = 0;
+    size_t fallbackCount = 0, storedRawCount = 0;
+    std::map<std::string, size_t> chosenCodecs; // --codec=auto で選んだコーデックごとのフレーム数
+    for (auto &block : blocks)
+    {
+        if (!block.success)
+            return false;
+        if (block.entry.kind == BlockKind::File && codec == BlockCodec::Auto)
+            chosenCodecs[(block.entry.flags & BLOCK_FLAG_LZ4HC) ? "lz4hc" : blockCodecName(block.entry.codec)]++;
+        if (block.entry.kind == BlockKind::File && (block.entry.flags & BLOCK_FLAG_STORED_RAW))
+            storedRawCount++;
+        else if (block.entry.kind == BlockKind::File && block.entry.codec != codec && codec != BlockCodec::Auto)
+            fallbackCount++;
+        if (block.entry.kind != BlockKind::Checkpoint && block.entry.kind != BlockKind::Spots)
+            totalSize += block.entry.rawSize;
+        builder.addBlock(block.entry, block.stored);
+        block.stored.clear();
+        block.stored.shrink_to_fit();
+    }
+    archiveData = builder.finish();
+
+    if (fallbackCount > 0)
+    {
+        LOG("Note: " << fallbackCount << " of " << files.size() << " file(s) stored with a codec other than "
+            << blockCodecName(codec));
+    }
+
+    if (stats)
+    {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        stats->rawSize = totalSize;
+        stats->archiveSize = archiveData.size();
+        stats->checksum = computeChecksum64(archiveData);
+        stats->compressMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+        stats->paddingBytes = builder.getPaddingBytes();
+        stats->storedRawBlocks = storedRawCount;
+        for (const auto &pair : chosenCodecs)
+        {
+            stats->codecSummary += (stats->codecSummary.empty() ? "" : " ") + pair.first + " " + std::to_string(pair.second);
+        }
+    }
+
+    return true;
+}
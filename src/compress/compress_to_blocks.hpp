@@ -0,0 +1,32 @@
+#ifndef COMPRESS_TO_BLOCKS_HPP
+#define COMPRESS_TO_BLOCKS_HPP
+
+#include "compress_to_lz4.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/spot_finder.hpp"
+#include <set>
+#include <string>
+
+// ファイルのセットをファイルごとに独立したブロックとして圧縮し、ブロック形式アーカイブ（v2）をメモリ上に作成する
+// 読み込み・符号化・メモリ上での復号テストはファイル単位でmaxThreadsスレッドに分配する
+// codec: 使用するコーデック（予測符号化に対応しないファイルはLZ4、圧縮できないファイルは無圧縮で格納）
+// alignment: 0以外の場合、各ブロックの先頭をアーカイブ先頭からalignmentの倍数の位置に揃える
+// sidecars: フレームの後ろに BlockKind::Sidecar として格納する付随ファイル（.finfなど、LZ4で圧縮）
+// checkpointInterval: 0以外の場合、先頭のフレームからこのフレーム数ごと（と最後のフレーム）までの累積和画像を
+//                     BlockKind::Checkpoint として末尾に格納する（frame_checkpoint.hpp）
+// spotFinder: nullptr以外の場合、読み込んだフレームからスポットを検出し、セットの一覧を BlockKind::Spots として格納する
+// storeThreshold: 圧縮後のサイズが元のこの倍数を超えるファイルは無圧縮で格納する（BLOCK_FLAG_STORED_RAW、1.0は小さくならない場合のみ）
+// 戻り値: 成功した場合true（読み込み失敗や復号テストの失敗時はfalse）
+bool buildBlockArchive(const std::set<std::string> &files,
+                       const std::set<std::string> &sidecars,
+                       std::string &archiveData,
+                       int maxThreads = 4,
+                       BlockCodec codec = BlockCodec::LZ4,
+                       int lz4Acceleration = 1,
+                       uint64_t alignment = 0,
+                       int checkpointInterval = 0,
+                       const SpotFinderParams *spotFinder = nullptr,
+                       double storeThreshold = 1.0,
+                       ArchiveStats *stats = nullptr);
+
+#endif // COMPRESS_TO_BLOCKS_HPP
@@ -1,5 +1,8 @@
 #include "compress_to_lz4.hpp"
 #include "../common/common.hpp"
+#include "../common/checksum.hpp"
+#include "../common/smoothed_writer.hpp"
+#include "file_reader.hpp"
 #include <lz4.h>
 #include <fstream>
 #include <vector>
@@ -13,15 +16,6 @@
 constexpr uint32_t LZ4_ARCHIVE_MAGIC = 0x41345A4C;  // "LZ4A" in little endian
 constexpr uint32_t LZ4_ARCHIVE_VERSION = 1;
 
-// ファイル読み込み結果を格納する構造体
-struct FileReadResult
-{
-    std::string filepath;
-    std::string data;
-    size_t index;     // 元の順序を保持
-    bool success;
-};
-
 // メタデータ構造体
 struct FileMetadata
 {
@@ -68,64 +62,11 @@ static void serializeMetadata(const std::vector<FileMetadata>& metadata, std::st
     }
 }
 
-// 並列でファイルを読み込む内部関数
-static void readFileWorker(const std::vector<std::string>& filesToRead,
-                          size_t startIdx,
-                          size_t endIdx,
-                          std::vector<FileReadResult>& results,
-                          std::mutex& resultsMutex)
-{
-    for (size_t i = startIdx; i < endIdx; ++i)
-    {
-        FileReadResult result;
-        result.filepath = filesToRead[i];
-        result.index = i;
-        result.success = false;
-
-        try
-        {
-            std::ifstream file(filesToRead[i], std::ios::binary);
-            if (file)
-            {
-                // ファイルサイズを取得
-                file.seekg(0, std::ios::end);
-                std::streamsize fileSize = file.tellg();
-                file.seekg(0, std::ios::beg);
-
-                // データを読み込む
-                result.data.resize(fileSize);
-                file.read(result.data.data(), fileSize);
-                
-                // 実際に読み込んだバイト数を確認（短い読み取り検出）
-                std::streamsize bytesRead = file.gcount();
-                if (bytesRead == fileSize)
-                {
-                    result.success = true;
-                }
-                else
-                {
-                    LOG("Warning: Short read on " << filesToRead[i] 
-                        << " - expected " << fileSize << " bytes, got " << bytesRead << " bytes");
-                }
-            }
-        }
-        catch (const std::exception& e)
-        {
-            LOG("Error reading file " << filesToRead[i] << ": " << e.what());
-        }
-
-        // 結果を追加（排他制御）
-        {
-            std::lock_guard<std::mutex> lock(resultsMutex);
-            results.push_back(result);
-        }
-    }
-}
-
-bool compressFilesToLZ4(const std::set<std::string>& files,
-                        const std::string& outputPath,
-                        int maxThreads,
-                        int lz4Acceleration)
+bool buildLZ4Archive(const std::set<std::string>& files,
+                     std::string& archiveData,
+                     int maxThreads,
+                     int lz4Acceleration,
+                     ArchiveStats* stats)
 {
     if (files.empty())
     {
@@ -140,61 +81,12 @@ bool compressFilesToLZ4(const std::set<std::string>& files,
     
     // ---------- 並列でファイルを読み込む ----------
     std::vector<FileReadResult> readResults;
-    std::mutex resultsMutex;
-    std::vector<std::thread> threads;
-
-    // ファイルを各スレッドに分配
-    size_t filesPerThread = (fileList.size() + maxThreads - 1) / maxThreads;
-    
-    auto readStart = std::chrono::high_resolution_clock::now();
-
-    for (int threadId = 0; threadId < maxThreads; ++threadId)
-    {
-        size_t startIdx = threadId * filesPerThread;
-        size_t endIdx = std::min(startIdx + filesPerThread, fileList.size());
-
-        if (startIdx >= fileList.size())
-            break;
-
-        threads.emplace_back(readFileWorker, std::ref(fileList), startIdx, endIdx, 
-                           std::ref(readResults), std::ref(resultsMutex));
-    }
-
-    // 全スレッドの完了を待機
-    for (auto& thread : threads)
-    {
-        if (thread.joinable())
-        {
-            thread.join();
-        }
-    }
-
-    auto readEnd = std::chrono::high_resolution_clock::now();
-    auto readTime = std::chrono::duration_cast<std::chrono::milliseconds>(readEnd - readStart).count();
-
-    // 読み込み結果を確認
-    if (readResults.size() != fileList.size())
+    if (!readFilesParallel(fileList, maxThreads, readResults))
     {
-        LOG("Error: Not all files were read successfully");
         return false;
     }
 
-    for (const auto& result : readResults)
-    {
-        if (!result.success)
-        {
-            LOG("Error: Failed to read file: " << result.filepath);
-            return false;
-        }
-    }
-
     // ---------- 読み込んだデータを元の順序で連結 ----------
-    // インデックスでソート
-    std::sort(readResults.begin(), readResults.end(),
-              [](const FileReadResult& a, const FileReadResult& b) {
-                  return a.index < b.index;
-              });
-
     // メタデータを作成
     std::vector<FileMetadata> metadataList;
     size_t currentOffset = 0;
@@ -304,33 +196,71 @@ bool compressFilesToLZ4(const std::set<std::string>& files,
     // メタデータのサイズ
     uint64_t metadataSize = serializedMetadata.size();
 
+    // ---------- アーカイブのバイト列を組み立てる ----------
+    archiveData.clear();
+    archiveData.reserve(sizeof(uint64_t) + metadataSize + sizeof(uint64_t) + compressedSize);
+
+    // 1. メタデータのサイズ（8バイト）
+    archiveData.append(reinterpret_cast<const char*>(&metadataSize), sizeof(uint64_t));
+
+    // 2. メタデータ
+    archiveData.append(serializedMetadata);
+
+    // 3. 圧縮されたデータサイズ（8バイト）
+    uint64_t compressedDataSize = compressedSize;
+    archiveData.append(reinterpret_cast<const char*>(&compressedDataSize), sizeof(uint64_t));
+
+    // 4. 圧縮データ
+    archiveData.append(compressed.data(), compressedSize);
+
+    if (stats)
+    {
+        auto endTime = std::chrono::high_resolution_clock::now();
+        stats->rawSize = totalSize;
+        stats->archiveSize = archiveData.size();
+        stats->checksum = computeChecksum64(archiveData);
+        stats->compressMs = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+    }
+
+    return true;
+}
+
+bool compressFilesToLZ4(const std::set<std::string>& files,
+                        const std::string& outputPath,
+                        int maxThreads,
+                        int lz4Acceleration,
+                        ArchiveStats* stats)
+{
+    std::string archiveData;
+    if (!buildLZ4Archive(files, archiveData, maxThreads, lz4Acceleration, stats))
+    {
+        return false;
+    }
+
+    return writeLZ4Archive(archiveData, outputPath);
+}
+
+bool writeLZ4Archive(const std::string& archiveData, const std::string& outputPath)
+{
     // ---------- 出力ファイルに書き込む ----------
     try
     {
         // 出力ディレクトリが存在しない場合は作成
         fs::create_directories(fs::path(outputPath).parent_path());
 
-        std::ofstream outFile(outputPath, std::ios::binary);
-        if (!outFile)
+        // ライトバックを平滑化して書き込む（--dirty-window-mb）
+        SmoothedFileWriter outFile;
+        if (!outFile.open(outputPath))
         {
             LOG("Error: Cannot open output file: " << outputPath);
             return false;
         }
 
-        // 1. メタデータのサイズを書き込む（8バイト）
-        outFile.write(reinterpret_cast<const char*>(&metadataSize), sizeof(uint64_t));
-        
-        // 2. メタデータを書き込む
-        outFile.write(serializedMetadata.data(), serializedMetadata.size());
-        
-        // 3. 圧縮されたデータサイズを書き込む（8バイト）
-        uint64_t compressedDataSize = compressedSize;
-        outFile.write(reinterpret_cast<const char*>(&compressedDataSize), sizeof(uint64_t));
-        
-        // 4. 圧縮データを書き込む
-        outFile.write(compressed.data(), compressedSize);
-        
-        outFile.close();
+        if (!outFile.write(archiveData.data(), archiveData.size()) || !outFile.close())
+        {
+            LOG("Error: Failed to write output file: " << outputPath);
+            return false;
+        }
 
         // ファイルが正しく書き込まれたか確認
         if (!fs::exists(outputPath))
@@ -339,7 +269,7 @@ bool compressFilesToLZ4(const std::set<std::string>& files,
             return false;
         }
 
-        auto expectedSize = sizeof(uint64_t) + metadataSize + sizeof(uint64_t) + compressedSize;
+        auto expectedSize = archiveData.size();
         auto actualSize = fs::file_size(outputPath);
         if (actualSize != expectedSize)
         {
@@ -348,9 +278,6 @@ bool compressFilesToLZ4(const std::set<std::string>& files,
             return false;
         }
 
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto totalTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
-
         return true;
     }
     catch (const std::exception& e)
@@ -359,4 +286,3 @@ bool compressFilesToLZ4(const std::set<std::string>& files,
         return false;
     }
 }
-
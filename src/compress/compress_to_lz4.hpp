@@ -3,6 +3,19 @@
 
 #include <string>
 #include <set>
+#include <cstdint>
+
+// 作成したアーカイブの統計情報（カタログ登録用）
+struct ArchiveStats
+{
+    uint64_t rawSize = 0;     // 元ファイルの合計バイト数
+    uint64_t archiveSize = 0; // アーカイブのバイト数
+    uint64_t checksum = 0;    // アーカイブのバイト列のチェックサム
+    int64_t compressMs = 0;   // 読み込み〜圧縮〜展開テストの所要時間
+    uint64_t paddingBytes = 0; // ブロックの境界を揃えるための埋め草（--align-blocks）
+    uint32_t storedRawBlocks = 0; // 圧縮しても十分に小さくならず無圧縮で格納したフレーム数（--store-threshold）
+    std::string codecSummary;     // --codec=auto で選んだコーデックごとのフレーム数（例: "lz4 3 predictive 97"）
+};
 
 // ファイルのセットを並列で読み込み、LZ4で圧縮する
 // ファイル名、ファイルサイズ、ファイル形式などのメタデータを含めて圧縮する
@@ -10,11 +23,27 @@
 // outputPath: 出力ファイルパス
 // maxThreads: 並列読み込みの最大スレッド数（デフォルト: 4）
 // lz4Acceleration: LZ4圧縮の高速化パラメータ（1=default、高いほど高速だが圧縮率低下、デフォルト: 1）
+// stats: 統計情報の出力先（不要ならnullptr）
 // 戻り値: 成功した場合true、失敗した場合false
 bool compressFilesToLZ4(const std::set<std::string>& files, 
                         const std::string& outputPath,
                         int maxThreads = 4,
-                        int lz4Acceleration = 1);
+                        int lz4Acceleration = 1,
+                        ArchiveStats* stats = nullptr);
+
+// compressFilesToLZ4と同じ処理でアーカイブをメモリ上に作成する（ファイルには書き込まない）
+// 生成されるバイト列は.lz4ファイルの内容と同一で、ランコンテナのセグメントとしても使用する
+// archiveData: 生成したアーカイブのバイト列
+// 戻り値: 成功した場合true、失敗した場合false
+bool buildLZ4Archive(const std::set<std::string>& files,
+                     std::string& archiveData,
+                     int maxThreads = 4,
+                     int lz4Acceleration = 1,
+                     ArchiveStats* stats = nullptr);
+
+// buildLZ4Archiveで作成したアーカイブを.lz4ファイルとして書き込む（書き込み後にサイズを検証）
+// 戻り値: 成功した場合true、失敗した場合false
+bool writeLZ4Archive(const std::string& archiveData, const std::string& outputPath);
 
 #endif // COMPRESS_TO_LZ4_HPP
 
@@ -0,0 +1,325 @@
+#include "compressor_options.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+bool parseCompressorOptions(int argc, char *argv[], CompressorOptions &options)
+{
+    bool archiveVersionGiven = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string name = arg;
+        std::string value;
+        bool hasValue = false;
+
+        size_t eqPos = arg.find('=');
+        if (eqPos != std::string::npos)
+        {
+            name = arg.substr(0, eqPos);
+            value = arg.substr(eqPos + 1);
+            hasValue = true;
+        }
+
+        try
+        {
+            if (name == "--run-container" && !hasValue)
+            {
+                options.runContainer = true;
+            }
+            else if (name == "--output-roots" && hasValue)
+            {
+                options.outputRoots = splitPathList(value);
+            }
+            else if (name == "--stripe-policy" && hasValue)
+            {
+                if (!parseStripePolicy(value, options.stripePolicy))
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--cooperative" && !hasValue)
+            {
+                options.cooperative = true;
+            }
+            else if (name == "--instance-id" && hasValue && !value.empty())
+            {
+                options.instanceId = value;
+            }
+            else if (name == "--lease-timeout" && hasValue)
+            {
+                options.leaseTimeout = std::stoi(value);
+                if (options.leaseTimeout <= 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--archive-version" && hasValue)
+            {
+                options.archiveVersion = std::stoi(value);
+                if (options.archiveVersion != 1 && options.archiveVersion != 2)
+                    throw std::invalid_argument(value);
+                archiveVersionGiven = true;
+            }
+            else if (name == "--codec" && hasValue)
+            {
+                if (!parseBlockCodec(value, options.codec))
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--align-blocks" && !hasValue)
+            {
+                options.alignBlocks = true;
+            }
+            else if (name == "--sidecars")
+            {
+                options.sidecarExtensions.clear();
+                for (auto extension : splitPathList(hasValue ? value : ".finf"))
+                {
+                    if (extension[0] != '.')
+                        extension = "." + extension;
+                    if (extension == ".tif")
+                        throw std::invalid_argument(value);
+                    options.sidecarExtensions.push_back(extension);
+                }
+                if (options.sidecarExtensions.empty())
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--checkpoints")
+            {
+                options.checkpointInterval = hasValue ? std::stoi(value) : 10;
+                if (options.checkpointInterval <= 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--spots" && hasValue)
+            {
+                options.spotFinder.threshold = std::stoll(value);
+                if (options.spotFinder.threshold <= 0)
+                    throw std::invalid_argument(value);
+                options.findSpots = true;
+            }
+            else if (name == "--spot-min-pixels" && hasValue)
+            {
+                int minPixels = std::stoi(value);
+                if (minPixels <= 0)
+                    throw std::invalid_argument(value);
+                options.spotFinder.minPixels = static_cast<uint32_t>(minPixels);
+            }
+            else if (name == "--store-threshold" && hasValue)
+            {
+                options.storeThreshold = std::stod(value);
+                if (!(options.storeThreshold > 0.0 && options.storeThreshold <= 1.0))
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--verify-readback" && !hasValue)
+            {
+                options.verifyReadback = true;
+            }
+            else if (name == "--dirty-window-mb" && hasValue)
+            {
+                int megabytes = std::stoi(value);
+                if (megabytes <= 0)
+                    throw std::invalid_argument(value);
+                options.dirtyWindowBytes = static_cast<uint64_t>(megabytes) * 1024 * 1024;
+            }
+            else if (name == "--target-set-mb" && hasValue)
+            {
+                int megabytes = std::stoi(value);
+                if (megabytes <= 0)
+                    throw std::invalid_argument(value);
+                options.targetSetBytes = static_cast<uint64_t>(megabytes) * 1024 * 1024;
+            }
+            else if (name == "--rescan-interval" && hasValue)
+            {
+                options.rescanInterval = std::stoi(value);
+                if (options.rescanInterval < 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--probe-frames" && hasValue)
+            {
+                options.probeFrames = std::stoi(value);
+                if (options.probeFrames < 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--probe-listing-interval" && hasValue)
+            {
+                options.probeListingInterval = std::stoi(value);
+                if (options.probeListingInterval <= 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--recursive" && !hasValue)
+            {
+                options.recursive = true;
+            }
+            else if (name == "--warm-start" && !hasValue)
+            {
+                options.warmStart = true;
+            }
+            else if (name == "--quarantine-after" && hasValue)
+            {
+                options.quarantineAfter = std::stoi(value);
+                if (options.quarantineAfter < 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--tree-walkers" && hasValue)
+            {
+                options.treeWalkers = std::stoi(value);
+                if (options.treeWalkers <= 0)
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--split-reads" && hasValue)
+            {
+                for (const auto &item : splitPathList(value))
+                {
+                    ReadSplitRule rule;
+                    if (!parseReadSplitRule(item, rule))
+                        throw std::invalid_argument(item);
+                    options.readSplitRules.push_back(rule);
+                }
+            }
+            else if (name == "--micro-sets" && hasValue)
+            {
+                options.microSetSize = std::stoi(value);
+                if (options.microSetSize <= 0)
+                    throw std::invalid_argument(value);
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return false;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            return false;
+        }
+    }
+
+    // v1はLZ4のみ（他のコーデックはファイルごとのブロックが必要）
+    if (options.codec != BlockCodec::LZ4 && options.archiveVersion == 1)
+    {
+        if (archiveVersionGiven)
+        {
+            std::cerr << "--codec=" << blockCodecName(options.codec) << " requires --archive-version=2" << std::endl;
+            return false;
+        }
+        options.archiveVersion = 2;
+    }
+
+    // 境界揃え・付随ファイルの同梱・チェックポイント・スポットの一覧・無圧縮での格納・マイクロセットのまとめ直しは
+    // ファイルごとのブロックが必要
+    const char *blockOption = options.alignBlocks                  ? "--align-blocks"
+                              : !options.sidecarExtensions.empty() ? "--sidecars"
+                              : options.checkpointInterval > 0     ? "--checkpoints"
+                              : options.findSpots                  ? "--spots"
+                              : options.storeThreshold < 1.0       ? "--store-threshold"
+                              : options.microSetSize > 0           ? "--micro-sets"
+                                                                   : nullptr;
+    if (blockOption && options.archiveVersion == 1)
+    {
+        if (archiveVersionGiven)
+        {
+            std::cerr << blockOption << " requires --archive-version=2" << std::endl;
+            return false;
+        }
+        options.archiveVersion = 2;
+    }
+
+    // ランコンテナへの追記はプロセス内でしか直列化されないため、複数プロセスでの分担とは併用できない
+    if (options.cooperative && options.runContainer)
+    {
+        std::cerr << "--cooperative cannot be combined with --run-container" << std::endl;
+        return false;
+    }
+
+    // マイクロセットのまとめ直しはプロセス内の書き込みステージと直列化するため、
+    // 複数プロセスでの分担とは併用できない（ランコンテナは既にrunで1ファイル）
+    if (options.microSetSize > 0 && (options.cooperative || options.runContainer))
+    {
+        std::cerr << "--micro-sets cannot be combined with " << (options.cooperative ? "--cooperative" : "--run-container")
+                  << std::endl;
+        return false;
+    }
+
+    // マイクロセットはセットのファイル数を等分するため、runごとに変わるセットのファイル数とは併用できない
+    if (options.microSetSize > 0 && options.targetSetBytes > 0)
+    {
+        std::cerr << "--micro-sets cannot be combined with --target-set-mb" << std::endl;
+        return false;
+    }
+
+    // マイクロセットのまとめ直しは出力ディレクトリ1つを前提にするため、サブディレクトリごとの出力とは併用できない
+    if (options.microSetSize > 0 && options.recursive)
+    {
+        std::cerr << "--micro-sets cannot be combined with --recursive" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void printCompressorUsage(const std::string &programName)
+{
+    std::cout << "Usage: " << programName << " [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --run-container    Append sets as segments to one container file per run (.lz4c)" << std::endl;
+    std::cout << "  --output-roots=<dir>[;<dir>...]" << std::endl;
+    std::cout << "                     Additional output directories; archives are striped across them" << std::endl;
+    std::cout << "  --stripe-policy=round-robin|balanced" << std::endl;
+    std::cout << "                     How to choose the output directory (balanced: free space and write speed;" << std::endl;
+    std::cout << "                     write speed is measured only with --dirty-window-mb)" << std::endl;
+    std::cout << "  --cooperative      Share the watch directory with other instances using lease files" << std::endl;
+    std::cout << "  --instance-id=<id> Lease owner name (default: <hostname>-<pid>)" << std::endl;
+    std::cout << "  --lease-timeout=<seconds>" << std::endl;
+    std::cout << "                     Take over leases not renewed for this long (default: 120)" << std::endl;
+    std::cout << "  --archive-version=1|2" << std::endl;
+    std::cout << "                     1: one LZ4 block per set (default), 2: one block per file" << std::endl;
+    std::cout << "  --codec=lz4|predictive|store|auto" << std::endl;
+    std::cout << "                     Block codec for version 2 archives (implies version 2 unless lz4)" << std::endl;
+    std::cout << "                     auto: sample each frame and pick store, fast LZ4, LZ4HC or predictive" << std::endl;
+    std::cout << "  --align-blocks     Start each block on a 4 KiB boundary for O_DIRECT/mmap readers (implies version 2)" << std::endl;
+    std::cout << "  --sidecars[=<ext>[;<ext>...]]" << std::endl;
+    std::cout << "                     Bundle run sidecar files (default: .finf) into the archives (implies version 2)" << std::endl;
+    std::cout << "  --checkpoints[=N]  Store cumulative frame sums every N frames (default: 10) for fast merging (implies version 2)" << std::endl;
+    std::cout << "  --spots=<threshold>" << std::endl;
+    std::cout << "                     Store a list of spots (connected pixels >= threshold) per set (implies version 2)" << std::endl;
+    std::cout << "  --spot-min-pixels=N" << std::endl;
+    std::cout << "                     Ignore spots with fewer pixels than this (default: 2)" << std::endl;
+    std::cout << "  --store-threshold=F" << std::endl;
+    std::cout << "                     Store blocks uncompressed when compression keeps more than F of the size" << std::endl;
+    std::cout << "                     (default: 1.0, implies version 2 when below 1)" << std::endl;
+    std::cout << "  --verify-readback  Re-read each written archive bypassing the page cache and check it before deleting sources" << std::endl;
+    std::cout << "                     (sources are kept when the page cache cannot be bypassed)" << std::endl;
+    std::cout << "  --dirty-window-mb=N" << std::endl;
+    std::cout << "                     Flush archive writes every N MiB instead of letting dirty pages pile up (Linux)" << std::endl;
+    std::cout << "  --micro-sets=N     Archive every N files to free sources quickly, then merge them into full sets" << std::endl;
+    std::cout << "                     in the background without recompressing (N must divide the set size, implies version 2)" << std::endl;
+    std::cout << "  --rescan-interval=N" << std::endl;
+    std::cout << "                     Skip listing the watch directory while its timestamps are unchanged, but list it" << std::endl;
+    std::cout << "                     at least every N seconds (default: 5, 0: list on every scan)" << std::endl;
+    std::cout << "  --probe-frames=N   Instead of listing the watch directory, check only the next expected frame names" << std::endl;
+    std::cout << "                     of each active run (up to N past the last one found) and the first frame of the next run" << std::endl;
+    std::cout << "  --probe-listing-interval=N" << std::endl;
+    std::cout << "                     With --probe-frames, still list the directory every N seconds and after a gap (default: 60)" << std::endl;
+    std::cout << "  --recursive        Also watch subdirectories of the watch directory; each keeps its own index and" << std::endl;
+    std::cout << "                     catalog, and its archives are written to the same subdirectory under the output" << std::endl;
+    std::cout << "  --tree-walkers=N   Number of workers scanning the subdirectories in parallel with --recursive (default: 4)" << std::endl;
+    std::cout << "  --warm-start       On restart, trust the saved index after spot-checking it instead of rescanning the" << std::endl;
+    std::cout << "                     whole watch directory, and reconcile the index in the background" << std::endl;
+    std::cout << "  --quarantine-after=N" << std::endl;
+    std::cout << "                     Retry failing sets with growing delays (2 s doubling up to 300 s) and quarantine a" << std::endl;
+    std::cout << "                     set after N failures until 'archive_tool retry' (default: 0, never quarantine)" << std::endl;
+    std::cout << "  --split-reads=<KiB>x<N>[@<dir>][;...]" << std::endl;
+    std::cout << "                     Read files larger than KiB under <dir> (default: all) as KiB ranges with N concurrent" << std::endl;
+    std::cout << "                     preads, e.g. 4096x8@/mnt/share for SMB/NFS mounts" << std::endl;
+    std::cout << "  --target-set-mb=N  Choose the files per set for each run so that a set holds about N MiB of frames" << std::endl;
+    std::cout << "                     (sized from the first frame of the run; the entered set size is the fallback)" << std::endl;
+}
+
+std::vector<std::string> getOutputRoots(const std::string &outputDir, const CompressorOptions &options)
+{
+    std::vector<std::string> roots;
+    roots.push_back(outputDir);
+    for (const auto &root : options.outputRoots)
+    {
+        if (std::find(roots.begin(), roots.end(), root) == roots.end())
+            roots.push_back(root);
+    }
+    return roots;
+}
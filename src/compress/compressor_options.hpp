@@ -0,0 +1,122 @@
+#ifndef COMPRESSOR_OPTIONS_HPP
+#define COMPRESSOR_OPTIONS_HPP
+
+#include "output_striper.hpp"
+#include "file_reader.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/spot_finder.hpp"
+#include <string>
+#include <vector>
+
+// 対話入力以外の動作オプション（コマンドライン引数で指定）
+// 既定値はすべて従来どおりの動作になるように設定する。例外:
+// - 監視ディレクトリの時刻が変わらない間は一覧を省く（--rescan-interval=5。0で従来どおり毎回一覧を取る）
+// - 処理に失敗したセットはすぐに再キューせず、失敗のたびに倍にした間隔を空けて再試行する（隔離は --quarantine-after で有効にする）
+struct CompressorOptions
+{
+    // --run-container: 各セットを個別の.lz4ではなく、runごとのコンテナ（.lz4c）にセグメントとして追記する
+    bool runContainer = false;
+
+    // --output-roots=<dir>[;<dir>...]: アーカイブの追加の出力先（別ディスクなど）
+    // 主出力ディレクトリも出力先の1つとして使う。インデックス・カタログ・ログは主出力ディレクトリに置く
+    std::vector<std::string> outputRoots;
+
+    // --stripe-policy=round-robin|balanced: 出力先の選択方針
+    StripePolicy stripePolicy = StripePolicy::RoundRobin;
+
+    // --cooperative: 同じ監視ディレクトリ・出力ディレクトリを複数のプロセス（別ホスト可）で分担する
+    // セットごとに出力ディレクトリの leases/ にリースファイルを作成できたプロセスだけが処理する
+    bool cooperative = false;
+
+    // --instance-id=<id>: リースの所有者名（既定は "<ホスト名>-<プロセスID>"）
+    std::string instanceId;
+
+    // --lease-timeout=<秒>: この時間更新されないリースは停止したプロセスのものとして引き継ぐ
+    int leaseTimeout = 120;
+
+    // --archive-version=1|2: アーカイブ形式（1: セット全体を1つのLZ4ブロック、2: ファイルごとのブロック）
+    int archiveVersion = 1;
+
+    // --codec=lz4|predictive|store: v2のブロックのコーデック（lz4以外を指定した場合はv2になる）
+    BlockCodec codec = BlockCodec::LZ4;
+
+    // --align-blocks: v2の各ブロックの先頭を4 KiB境界に揃える（O_DIRECTでの読み込み、ページ境界でのマッピング用）
+    // ランコンテナの場合はセグメントの先頭も揃える。v2になる
+    bool alignBlocks = false;
+
+    // --sidecars[=<拡張子>[;<拡張子>...]]: 監視ディレクトリにある run の付随ファイル（既定は .finf）を
+    // そのrunのアーカイブにブロックとして同梱する（フレームと同様に処理後に削除する）。v2になる
+    // 対象は "<prefix>_<run>.<拡張子>" と "<prefix>_<run>_<番号>.<拡張子>"
+    std::vector<std::string> sidecarExtensions;
+
+    // --checkpoints[=N]: セットの先頭からNフレームごと（既定10）とセットの最後までのフレームの累積和画像を
+    // アーカイブに格納する（解凍時のマージで、チェックポイントの位置からずれた分のフレームだけを復号する）。v2になる
+    int checkpointInterval = 0;
+
+    // --spots=<閾値>: フレームがメモリ上にある間にスポット（閾値以上の画素の連結領域）を検出し、
+    // セットごとの一覧をアーカイブに格納する（解析では画素データを復号せずに読める）。v2になる
+    bool findSpots = false;
+    // --spot-min-pixels=N: 画素数がこれより少ない領域はスポットにしない（既定2）
+    SpotFinderParams spotFinder;
+
+    // --store-threshold=F: 圧縮後のサイズが元のF倍（0 < F <= 1）を超えるブロックは無圧縮で格納する
+    // （1.0は従来どおり小さくならない場合のみ）。カウントの多いフレームやノイズの多いフレームで、
+    // ほとんど縮まない圧縮データの復号を避ける
+    double storeThreshold = 1.0;
+
+    // --verify-readback: 書き込んだアーカイブをページキャッシュを介さずに読み戻してチェックサムを確認してから
+    // 元ファイルを削除する（書き込み経路やネットワーク共有での破損を検出する。次のセットの処理と並行する）
+    bool verifyReadback = false;
+
+    // --micro-sets=N: Nフレーム（セットのファイル数の約数）ごとに圧縮・書き込みして元ファイルを早く解放し、
+    // 同じセットのアーカイブは再圧縮せずにバックグラウンドで1つにまとめる。v2になる
+    int microSetSize = 0;
+
+    // --dirty-window-mb=N: アーカイブをNメガバイト書くごとに書き出しを開始し、1つ前の窓の完了を待つ
+    // （ダーティページを溜めてまとめて書き出す間の書き込みの停止を避け、出力の帯域を一定にする。Linuxのみ）
+    uint64_t dirtyWindowBytes = 0;
+
+    // --target-set-mb=N: セットのファイル数をrunごとに、セットの合計サイズがNメガバイトに近くなるよう決める
+    // （runの最初のフレームのサイズから。セットの境界はフレーム番号の倍数のまま、展開時はカタログから範囲がわかる）
+    uint64_t targetSetBytes = 0;
+
+    // --split-reads=<KiB>x<N>[@<dir>][;...]: <dir>の下（省略時はすべて）のKiBより大きいファイルを
+    // KiBごとの範囲に分け、N本のpreadで同時に読む（ネットワーク共有で1ファイルの読み込みを帯域に近づける。マウントごとに指定できる）
+    std::vector<ReadSplitRule> readSplitRules;
+
+    // --rescan-interval=N: 監視ディレクトリの更新時刻が前回の一覧から変わっていなければ一覧と照合を省き、
+    // N秒ごとにだけ念のため取り直す（0: 従来どおり毎回一覧を取る。ファイルの上書きはディレクトリの更新時刻を変えないため）
+    int rescanInterval = 5;
+
+    // --probe-frames=N: 一覧を取る代わりに、runごとに次に届くはずのフレーム（見つからなくなってからN個先まで）と
+    // 次のrunの最初のフレームだけを確認する（ポーリングの手間がディレクトリのファイル数によらない）。
+    // 番号の飛びを見つけた場合と --probe-listing-interval=N 秒ごとには一覧を取る（0: 確認せず一覧を取る）
+    int probeFrames = 0;
+    int probeListingInterval = 60;
+
+    // --recursive: 監視ディレクトリの下のサブディレクトリも監視し、出力ディレクトリの下に同じ構成で出力する
+    // （ディレクトリごとにインデックスとカタログを持ち、--tree-walkers=N 本のワーカーで並列に走査する）
+    bool recursive = false;
+    int treeWalkers = 4;
+
+    // --warm-start: 再起動時、保存されたインデックスの一部を確認して信用できれば全体のスキャンを省いて増分スキャンから始め、
+    // インデックス全体の確認（消えたファイルの除去）は低い優先度で後から行う
+    bool warmStart = false;
+
+    // --quarantine-after=N: 処理に失敗したセットは失敗のたびに倍の間隔（2秒から最大300秒）を空けて再試行し、
+    // N回失敗したら隔離して archive_tool retry で要求されるまで処理しない（0: 隔離しない。無人運転で一時的な障害のセットを
+    // 止めないよう既定では隔離しない）
+    int quarantineAfter = 0;
+};
+
+// 主出力ディレクトリと追加の出力先を合わせた出力先の一覧（先頭が主出力ディレクトリ、重複は除く）
+std::vector<std::string> getOutputRoots(const std::string &outputDir, const CompressorOptions &options);
+
+// コマンドライン引数（--name または --name=value）を解析する
+// 戻り値: 解析に成功した場合true（不明なオプションや不正な値の場合false）
+bool parseCompressorOptions(int argc, char *argv[], CompressorOptions &options);
+
+// 使用方法を表示する
+void printCompressorUsage(const std::string &programName);
+
+#endif // COMPRESSOR_OPTIONS_HPP
@@ -6,17 +6,63 @@
 #endif
 
 #include "directory_monitor.hpp"
+#include "directory_tree.hpp"
+#include "set_quarantine.hpp"
 #include "../common/common.hpp"
 #include "file_processor.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/smoothed_writer.hpp"
 #include <chrono>
 #include <set>
 #include <algorithm>
 #include <iostream>
 #include <atomic>
 #include <future>
+#include <cctype>
 
-IndexedDirectoryMonitor::IndexedDirectoryMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern, int setSize)
-    : running(true), newDataAvailable(false), producerFinishedScan(false)
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// 一覧を取った時刻とこれ以上近いディレクトリの更新時刻は信用しない
+// （更新時刻の粒度が粗いファイルシステムで、一覧の直後の追加が同じ時刻になる場合に備える）
+constexpr auto DIRECTORY_STAMP_MARGIN = std::chrono::seconds(2);
+
+// 再開時（--warm-start）にインデックスを信用するか判定するため確認するファイル数と、許容する不一致の割合
+constexpr size_t WARM_START_SAMPLES = 64;
+constexpr double WARM_START_MAX_MISMATCH = 0.25;
+// 再開後のインデックスの確認を区切るファイル数と、区切りごとの休止（走査と処理の邪魔をしない）
+constexpr size_t RECONCILE_BATCH = 256;
+constexpr auto RECONCILE_PAUSE = std::chrono::milliseconds(20);
+
+// 正規表現の特殊文字をエスケープする
+static std::string escapeRegex(const std::string &text)
+{
+    static const std::string special = R"(\^$.|?*+()[]{})";
+    std::string escaped;
+    for (char c : text)
+    {
+        if (special.find(c) != std::string::npos)
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+IndexedDirectoryMonitor::IndexedDirectoryMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern, int setSize,
+                                                 const std::string &indexFileName, const std::vector<std::string> &sidecarExtensions,
+                                                 bool trackLateFrames, uint64_t targetSetBytes, int rescanInterval,
+                                                 int probeFrames, int probeListingInterval,
+                                                 const std::string &subdirectory, bool recursive, bool warmStart)
+    : running(true), newDataAvailable(false), collectSidecars(!sidecarExtensions.empty()), trackLateFrames(trackLateFrames),
+      producerFinishedScan(false), rescanInterval(rescanInterval), listedStampValid(false), probeFrames(probeFrames),
+      probeListingInterval(probeListingInterval), sidecarExtensions(sidecarExtensions), listingRequested(false),
+      subdirectory(subdirectory), recordSubdirectories(recursive), warmStart(warmStart)
 {
     task.watchDir = watchDir;
     task.basePattern = basePattern;
@@ -33,14 +79,41 @@ IndexedDirectoryMonitor::IndexedDirectoryMonitor(const std::string &watchDir, co
     }
 
     // メモリマップドインデックスを初期化（outputディレクトリに保存）
-    std::string indexFilePath = outputDir + "/compressor_file_index.bin";
-    fileIndex = std::make_unique<MemoryMappedFileIndex>(indexFilePath, setSize);
+    std::string indexFilePath = outputDir + "/" + indexFileName;
+    fileIndex = std::make_unique<MemoryMappedFileIndex>(indexFilePath, setSize, targetSetBytes);
+
+    // インデックスを保存する前に終了した場合も、処理済みのrunのセットの境界を変えない
+    if (targetSetBytes > 0)
+    {
+        loadRunSetSizes(outputDir, basePattern);
+    }
+
+    // 再起動前に処理したセットにも、後から届いたフレームを追記できるようにする
+    if (trackLateFrames)
+    {
+        loadArchivedSets(outputDir, basePattern);
+    }
 
     // 正規表現パターン作成
-    filePattern = std::regex(basePattern.substr(0, basePattern.find("_##_")) +
-                             "_([0-9]{2})_([0-9]{5})\\.tif");
+    filePrefix = basePattern.substr(0, basePattern.find("_##_"));
+    filePattern = std::regex(filePrefix + "_([0-9]{2})_([0-9]{5})\\.tif");
+
+    // 付随ファイルのパターン（例："test_(\d\d)(_(\d\d\d\d\d))?(\.finf)"）
+    if (collectSidecars)
+    {
+        std::string extensions;
+        for (const auto &extension : sidecarExtensions)
+        {
+            extensions += (extensions.empty() ? "" : "|") + escapeRegex(extension);
+        }
+        sidecarPattern = std::regex(filePrefix + "_([0-9]{2})(_([0-9]{5}))?(" + extensions + ")");
+    }
 
-    scanner_thread = std::thread(&IndexedDirectoryMonitor::scannerWorker, this);
+    // 木の監視では、ディレクトリごとにスレッドを持たず共有のワーカーが走査する
+    if (!recursive)
+    {
+        scanner_thread = std::thread(&IndexedDirectoryMonitor::scannerWorker, this);
+    }
 }
 
 IndexedDirectoryMonitor::~IndexedDirectoryMonitor()
@@ -53,31 +126,228 @@ IndexedDirectoryMonitor::~IndexedDirectoryMonitor()
     {
         scanner_thread.join();
     }
+    if (reconcile_thread.joinable())
+    {
+        reconcile_thread.join();
+    }
 }
 
-void IndexedDirectoryMonitor::scannerWorker()
+void IndexedDirectoryMonitor::scanOnce()
+{
+    if (!producerFinishedScan)
+    {
+        // 保存されたインデックスを信用できれば全体のスキャンを省く（確認は1度だけ）
+        if (warmStart)
+        {
+            warmStart = false;
+            if (performWarmStart())
+            {
+                updateFileSets();
+                return;
+            }
+        }
+
+        // 失敗した場合（ディレクトリにアクセスできないなど）は次回も全体をスキャンする
+        performFullScan();
+        if (producerFinishedScan)
+        {
+            LOG("Initial full scan completed. Switching to incremental scanning only.");
+        }
+    }
+    else
+    {
+        performIncrementalScan();
+    }
+    recordListedStamp();
+
+    // 1セットずつ効率的に取得（メモリ節約）
+    updateFileSets();
+}
+
+bool IndexedDirectoryMonitor::hasFinishedInitialScan() const
 {
-    bool firstScan = true;
+    return producerFinishedScan;
+}
+
+std::vector<std::string> IndexedDirectoryMonitor::getSubdirectories()
+{
+    std::lock_guard<std::mutex> lock(subdirectory_mutex);
+    return subdirectories;
+}
+
+void IndexedDirectoryMonitor::recordListedStamp()
+{
+    if (rescanInterval <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (listedStampValid)
+        fileIndex->setDirectoryStamp(listedStamp.modified, listedStamp.changed);
+    else
+        fileIndex->clearDirectoryStamp();
+}
 
+size_t IndexedDirectoryMonitor::enqueueIndexedSets()
+{
+    // getAllFileSetsで未処理のセットを取得してキューに積む
+    std::vector<FileSet> allSets;
+    std::map<int, int> setSizes;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        allSets = fileIndex->getAllFileSets(false);
+        for (const auto &fileSet : allSets)
+            setSizes.emplace(fileSet.run, fileIndex->getSetSize(fileSet.run));
+    }
+
+    size_t enqueuedCount = 0;
+    for (const auto &fileSet : allSets)
+    {
+        // 完全なセット（setSize個のファイルがある）をキューに積む
+        if (fileSet.files.size() >= static_cast<size_t>(setSizes[fileSet.run]))
+        {
+            enqueueTask(fileSet.run, fileSet.setNumber);
+            enqueuedCount++;
+        }
+    }
+    return enqueuedCount;
+}
+
+bool IndexedDirectoryMonitor::performWarmStart()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> pending;
+    std::vector<FileSet> allSets;
+    int64_t savedModified = 0, savedChanged = 0;
+    bool haveSavedStamp;
+    size_t indexedFiles;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        indexedFiles = fileIndex->size();
+        pending = fileIndex->getPaths(false);
+        allSets = fileIndex->getAllFileSets(true);
+        haveSavedStamp = fileIndex->getDirectoryStamp(savedModified, savedChanged);
+    }
+    if (indexedFiles == 0)
+    {
+        LOG("Warm start: no saved index, performing full scan");
+        return false;
+    }
+
+    // 未処理のセットのファイルを等間隔に確認する（処理済みのセットのファイルは削除されていてよい）
+    size_t samples = std::min(pending.size(), WARM_START_SAMPLES);
+    size_t mismatches = 0;
+    for (size_t i = 0; i < samples; ++i)
+    {
+        const std::string &path = pending[i * pending.size() / samples];
+        std::error_code ec;
+        auto lastWriteTime = fs::last_write_time(path, ec);
+        bool changed = true;
+        if (!ec)
+        {
+            std::lock_guard<std::mutex> lock(index_mutex);
+            changed = fileIndex->hasFileChanged(path, lastWriteTime);
+        }
+        if (changed)
+            mismatches++;
+    }
+    if (mismatches > samples * WARM_START_MAX_MISMATCH)
+    {
+        LOG("Warm start: " << mismatches << " of " << samples << " sampled index entries are missing or changed, performing full scan");
+        return false;
+    }
+
+    // 監視ディレクトリが保存時の一覧から変わっていなければ、最初の一覧も省く
+    DirectoryStamp stamp;
+    bool unchanged = haveSavedStamp && rescanInterval > 0 && getDirectoryStamp(task.watchDir, stamp) &&
+                     stamp.modified == savedModified && stamp.changed == savedChanged;
+    if (unchanged)
+    {
+        listedStamp = stamp;
+        listedStampValid = true;
+        lastListing = std::chrono::steady_clock::now();
+    }
+
+    // 次に届くはずのフレームの確認をインデックスから始める（セットのファイルは番号順）
+    for (const auto &fileSet : allSets)
+    {
+        std::string prefix;
+        int run = 0, frameNumber = 0;
+        if (!fileSet.files.empty() && parseFrameFileName(*fileSet.files.rbegin(), prefix, run, frameNumber))
+            trackProbeFrame(run, frameNumber, false);
+    }
+
+    size_t enqueuedCount = enqueueIndexedSets();
+    producerFinishedScan = true;
+    queueCV.notify_all();
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    LOG("Warm start: trusted saved index (" << indexedFiles << " files, " << (samples - mismatches) << "/" << samples
+        << " sampled entries match, watch directory " << (unchanged ? "unchanged" : "changed") << " since the last listing), "
+        << "enqueued " << enqueuedCount << " complete file sets in " << duration.count() << " ms; reconciling in background");
+
+    // 全体の確認（cleanupに相当）は低い優先度で後から行う
+    reconcile_thread = std::thread(&IndexedDirectoryMonitor::reconcileIndex, this);
+    return true;
+}
+
+void IndexedDirectoryMonitor::reconcileIndex()
+{
+#if defined(__linux__)
+    // スキャンと圧縮より低い優先度で（Linuxのnice値はスレッドごと）
+    ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), 10);
+#endif
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        paths = fileIndex->getPaths(true);
+    }
+
+    size_t removed = 0, updated = 0;
+    std::set<TaskKey> updatedSets;
+    for (size_t i = 0; i < paths.size() && running; ++i)
+    {
+        const std::string &path = paths[i];
+        std::error_code ec;
+        auto lastWriteTime = fs::last_write_time(path, ec);
+        if (ec)
+        {
+            std::lock_guard<std::mutex> lock(index_mutex);
+            fileIndex->removeFile(path);
+            removed++;
+        }
+        else
+        {
+            std::string prefix;
+            int run = 0, fileNumber = 0;
+            if (parseFrameFileName(path, prefix, run, fileNumber) && noteFrame(path, run, fileNumber, lastWriteTime, updatedSets))
+                updated++;
+        }
+
+        if ((i + 1) % RECONCILE_BATCH == 0)
+        {
+            enqueueCompleteSets(updatedSets);
+            updatedSets.clear();
+            std::this_thread::sleep_for(RECONCILE_PAUSE);
+        }
+    }
+    enqueueCompleteSets(updatedSets);
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - startTime);
+    LOG("Background index reconcile " << (running ? "completed" : "stopped") << ": " << paths.size() << " files checked, "
+        << removed << " removed, " << updated << " updated in " << duration.count() << " ms");
+}
+
+void IndexedDirectoryMonitor::scannerWorker()
+{
     try
     {
         while (running)
         {
             try
             {
-                if (firstScan)
-                {
-                    performFullScan();
-                    firstScan = false;
-                    LOG("Initial full scan completed. Switching to incremental scanning only.");
-                }
-                else
-                {
-                    performIncrementalScan();
-                }
-
-                // 1セットずつ効率的に取得（メモリ節約）
-                updateFileSets();
+                scanOnce();
 
                 // スキャン間隔を調整（ディスクI/Oを減らす）
                 std::this_thread::sleep_for(std::chrono::milliseconds(300));
@@ -103,6 +373,62 @@ void IndexedDirectoryMonitor::scannerWorker()
     }
 }
 
+bool IndexedDirectoryMonitor::getDirectoryStamp(const std::string &dir, DirectoryStamp &stamp)
+{
+#ifndef _WIN32
+    // ファイルの追加・削除・名前の変更でディレクトリの更新時刻と状態変更時刻が変わる
+    struct stat st;
+    if (::stat(dir.c_str(), &st) != 0)
+        return false;
+#if defined(__APPLE__)
+    stamp.modified = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    stamp.changed = static_cast<int64_t>(st.st_ctimespec.tv_sec) * 1000000000 + st.st_ctimespec.tv_nsec;
+#else
+    stamp.modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    stamp.changed = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec;
+#endif
+    return true;
+#else
+    std::error_code ec;
+    auto modified = fs::last_write_time(dir, ec);
+    if (ec)
+        return false;
+    stamp.modified = std::chrono::duration_cast<std::chrono::nanoseconds>(modified.time_since_epoch()).count();
+    stamp.changed = 0;
+    return true;
+#endif
+}
+
+bool IndexedDirectoryMonitor::needsListing()
+{
+    if (rescanInterval <= 0 || !listedStampValid)
+        return true;
+    if (std::chrono::steady_clock::now() - lastListing >= std::chrono::seconds(rescanInterval))
+        return true; // 念のため一定間隔で一覧を取り直す（ファイルの上書きなどディレクトリの更新時刻が変わらない変更）
+    DirectoryStamp stamp;
+    return !getDirectoryStamp(task.watchDir, stamp) || !(stamp == listedStamp);
+}
+
+void IndexedDirectoryMonitor::noteListing(bool haveStamp, const DirectoryStamp &stamp,
+                                          std::chrono::system_clock::time_point listingStart)
+{
+    lastListing = std::chrono::steady_clock::now();
+    // 一覧の直前・最中に変わった場合は、次も一覧を取る（同じ時刻のうちに追加されたファイルを見逃さない）
+    // 時刻の粒度が粗いファイルシステム（FATの2秒、SMBなど）も同じ扱いにするため、すべての環境で余裕を取る
+#ifndef _WIN32
+    auto modified = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(stamp.modified)));
+#else
+    // Windowsの更新時刻はファイル時刻の時計（起点が異なる）のため、現在時刻との差からシステム時刻に直す
+    auto fileModified = fs::file_time_type(
+        std::chrono::duration_cast<fs::file_time_type::duration>(std::chrono::nanoseconds(stamp.modified)));
+    auto modified = std::chrono::system_clock::now() -
+                    std::chrono::duration_cast<std::chrono::system_clock::duration>(fs::file_time_type::clock::now() - fileModified);
+#endif
+    listedStampValid = haveStamp && modified + DIRECTORY_STAMP_MARGIN < listingStart;
+    listedStamp = stamp;
+}
+
 void IndexedDirectoryMonitor::performFullScan()
 {
     auto startTime = std::chrono::high_resolution_clock::now();
@@ -113,13 +439,31 @@ void IndexedDirectoryMonitor::performFullScan()
         // ステップ1: ファイルエントリーを全て収集（シングルスレッド）
         std::vector<fs::directory_entry> entries;
         entries.reserve(100000); // 数十万ファイルに備えて事前確保
+        std::set<std::string> seenSidecars;
+        std::vector<std::string> seenSubdirectories;
+
+        // 一覧を取る前のディレクトリの更新時刻（以後の増分スキャンで変わっていなければ一覧を省く）
+        DirectoryStamp stamp;
+        bool haveStamp = rescanInterval > 0 && getDirectoryStamp(task.watchDir, stamp);
+        auto listingStart = std::chrono::system_clock::now();
         
         for (const auto &entry : fs::directory_iterator(task.watchDir))
         {
-            if (entry.is_regular_file())
+            if (entry.is_regular_file() && !noteSidecar(entry, seenSidecars))
             {
                 entries.push_back(entry);
             }
+            else if (recordSubdirectories && entry.is_directory() && !entry.is_symlink())
+            {
+                seenSubdirectories.push_back(entry.path().filename().string());
+            }
+        }
+        forgetMissingSidecars(seenSidecars);
+        noteListing(haveStamp, stamp, listingStart);
+        if (recordSubdirectories)
+        {
+            std::lock_guard<std::mutex> lock(subdirectory_mutex);
+            subdirectories.swap(seenSubdirectories);
         }
         
         LOG("Found " << entries.size() << " files, processing in parallel...");
@@ -168,13 +512,18 @@ void IndexedDirectoryMonitor::performFullScan()
                                 // インデックスへのアクセスは排他制御が必要
                                 {
                                     std::lock_guard<std::mutex> lock(index_mutex);
+                                    trackProbeFrame(run, fileNumber, false);
                                     
                                     // ファイルが変更されているか確認
-                                    if (fileIndex->hasFileChanged(filepath, lastWriteTime))
+                                    if (fileIndex->hasFileChanged(filepath, lastWriteTime) &&
+                                        fileIndex->ensureRunSetSize(filepath, run))
                                     {
                                         // インデックスにファイルを追加または更新
                                         bool processed = !fileIndex->hasFileChanged(filepath, lastWriteTime);
-                                        fileIndex->addFile(filepath, run, fileNumber, lastWriteTime, processed);
+                                        TaskKey taskKey = fileIndex->addFile(filepath, run, fileNumber, lastWriteTime, processed);
+
+                                        // 処理済みのセットのフレームなら既存のアーカイブに追記する
+                                        noteLateFrame(taskKey, filepath, lastWriteTime);
                                     }
                                 }
                                 
@@ -226,19 +575,7 @@ void IndexedDirectoryMonitor::performFullScan()
         // ステップ4: 未処理の完全なセットをタスクキューに積む
         LOG("Enqueuing complete file sets to task queue...");
         
-        // getAllFileSetsで未処理のセットを取得してキューに積む
-        std::vector<FileSet> allSets = fileIndex->getAllFileSets(false);
-        
-        size_t enqueuedCount = 0;
-        for (const auto &fileSet : allSets)
-        {
-            // 完全なセット（setSize個のファイルがある）をキューに積む
-            if (fileSet.files.size() >= static_cast<size_t>(task.setSize))
-            {
-                enqueueTask(fileSet.run, fileSet.setNumber);
-                enqueuedCount++;
-            }
-        }
+        size_t enqueuedCount = enqueueIndexedSets();
         
         LOG("Enqueued " << enqueuedCount << " complete file sets to task queue");
         
@@ -259,21 +596,60 @@ void IndexedDirectoryMonitor::performFullScan()
 
 void IndexedDirectoryMonitor::performIncrementalScan()
 {
+    // 一覧を取り直すまでは、次に届くはずのフレームだけを確認する（ディレクトリのファイル数によらない）
+    // 確認するrunがまだない場合、番号の飛びを見つけた場合、一定間隔ごとには一覧を取る
+    if (probeFrames > 0 && !probeRuns.empty() && !listingRequested &&
+        std::chrono::steady_clock::now() - lastListing < std::chrono::seconds(probeListingInterval))
+    {
+        try
+        {
+            probeExpectedFrames();
+        }
+        catch (const std::exception &e)
+        {
+            LOG("Warning in frame probe: " << e.what());
+        }
+        return;
+    }
+
+    // ディレクトリの更新時刻が前回の一覧から変わっていなければ、一覧と照合を省く
+    // （フレームの間のCPUと、共有ストレージへのメタデータの問い合わせを減らす）
+    if (!listingRequested && !needsListing())
+        return;
+    listingRequested = false;
+
     try
     {
+        DirectoryStamp stamp;
+        bool haveStamp = rescanInterval > 0 && getDirectoryStamp(task.watchDir, stamp);
+        auto listingStart = std::chrono::system_clock::now();
+
         // 新規/変更されたファイルのみを効率的にチェック
         size_t newFilesFound = 0;
         size_t updatedFiles = 0;
         std::set<TaskKey> updatedSets; // 更新されたセットを記録
+        std::set<std::string> seenSidecars;
+        std::vector<std::string> seenSubdirectories;
 
         for (const auto &entry : fs::directory_iterator(task.watchDir))
         {
             try
             {
+                // サブディレクトリは木の監視に渡す（--recursive、シンボリックリンクはたどらない）
+                if (recordSubdirectories && entry.is_directory() && !entry.is_symlink())
+                {
+                    seenSubdirectories.push_back(entry.path().filename().string());
+                    continue;
+                }
+
                 // ファイルの存在と種類を確認
                 if (!entry.exists() || !entry.is_regular_file())
                     continue;
 
+                // 付随ファイルはセットの処理時に渡す
+                if (noteSidecar(entry, seenSidecars))
+                    continue;
+
                 std::string filepath = entry.path().string();
                 std::string filename = entry.path().filename().string();
 
@@ -288,30 +664,13 @@ void IndexedDirectoryMonitor::performIncrementalScan()
                 // ファイルの更新時刻を取得（例外が発生する可能性あり）
                 auto lastWriteTime = entry.last_write_time();
 
-                // ファイルが変更されているか確認（読み取り）をロックで保護
-                bool changed;
-                {
-                    std::lock_guard<std::mutex> lock(index_mutex);
-                    changed = fileIndex->hasFileChanged(filepath, lastWriteTime);
-                }
-
+                // 新規・変更されたファイルのみインデックスに反映（既にインデックスに存在し、変更もない場合は何もしない）
+                bool changed = noteFrame(filepath, run, fileNumber, lastWriteTime, updatedSets);
                 if (changed)
                 {
-                    // インデックスを更新（書き込み）をロックで保護
-                    {
-                        std::lock_guard<std::mutex> lock(index_mutex);
-                        fileIndex->addFile(filepath, run, fileNumber, lastWriteTime, false);
-                    }
-                    
-                    // このファイルが属するTaskKeyを記録
-                    TaskKey taskKey;
-                    taskKey.run = run;
-                    taskKey.setNumber = ((fileNumber - 1) / task.setSize) * task.setSize + 1;
-                    updatedSets.insert(taskKey);
-                    
                     newFilesFound++;
                 }
-                // else: ファイルは既にインデックスに存在し、変更もない → 何もしない
+                trackProbeFrame(run, fileNumber, changed);
             }
             catch (const fs::filesystem_error &e)
             {
@@ -328,30 +687,16 @@ void IndexedDirectoryMonitor::performIncrementalScan()
             }
         }
 
-        // 更新されたセットが完全になったかチェックしてキューに積む
-        if (!updatedSets.empty())
+        forgetMissingSidecars(seenSidecars);
+        noteListing(haveStamp, stamp, listingStart);
+        if (recordSubdirectories)
         {
-            for (const auto &taskKey : updatedSets)
-            {
-                FileSet testSet;
-                bool found;
-                {
-                    std::lock_guard<std::mutex> lock(index_mutex);
-                    found = fileIndex->getFileSet(taskKey, testSet);
-                }
-                
-                if (found)
-                {
-                    // 完全なセット（task.setSizeファイル）かつ未処理の場合のみキューに追加
-                    if (testSet.files.size() >= static_cast<size_t>(task.setSize) && !testSet.processed)
-                    {
-                        // enqueueTask内で重複チェックが行われるので安全
-                        enqueueTask(taskKey.run, taskKey.setNumber);
-                    }
-                }
-            }
+            std::lock_guard<std::mutex> lock(subdirectory_mutex);
+            subdirectories.swap(seenSubdirectories);
         }
 
+        // 更新されたセットが完全になったかチェックしてキューに積む
+        enqueueCompleteSets(updatedSets);
     }
     catch (const fs::filesystem_error &e)
     {
@@ -364,6 +709,392 @@ void IndexedDirectoryMonitor::performIncrementalScan()
     }
 }
 
+bool IndexedDirectoryMonitor::noteFrame(const std::string &filepath, int run, int fileNumber,
+                                        const fs::file_time_type &lastWriteTime, std::set<TaskKey> &updatedSets)
+{
+    // このファイルが属するTaskKeyを記録
+    TaskKey taskKey;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex);
+        if (!fileIndex->hasFileChanged(filepath, lastWriteTime) || !fileIndex->ensureRunSetSize(filepath, run))
+            return false;
+        taskKey = fileIndex->addFile(filepath, run, fileNumber, lastWriteTime, false);
+    }
+    updatedSets.insert(taskKey);
+
+    // 処理済みのセットのフレームなら既存のアーカイブに追記する
+    noteLateFrame(taskKey, filepath, lastWriteTime);
+    return true;
+}
+
+void IndexedDirectoryMonitor::enqueueCompleteSets(const std::set<TaskKey> &updatedSets)
+{
+    for (const auto &taskKey : updatedSets)
+    {
+        FileSet testSet;
+        bool found;
+        int setSize;
+        {
+            std::lock_guard<std::mutex> lock(index_mutex);
+            found = fileIndex->getFileSet(taskKey, testSet);
+            setSize = fileIndex->getSetSize(taskKey.run);
+        }
+
+        // 完全なセット（setSizeファイル）かつ未処理の場合のみキューに追加
+        if (found && testSet.files.size() >= static_cast<size_t>(setSize) && !testSet.processed)
+        {
+            // enqueueTask内で重複チェックが行われるので安全
+            enqueueTask(taskKey.run, taskKey.setNumber);
+        }
+    }
+}
+
+void IndexedDirectoryMonitor::trackProbeFrame(int run, int fileNumber, bool arrived)
+{
+    if (probeFrames <= 0)
+        return;
+
+    ProbeRun &state = probeRuns[run];
+    if (fileNumber >= state.nextFrame)
+        state.nextFrame = fileNumber + 1;
+    state.missingFrames.erase(fileNumber);
+    if (arrived)
+        state.lastArrival = std::chrono::steady_clock::now();
+}
+
+bool IndexedDirectoryMonitor::probeFrame(int run, int fileNumber, std::set<TaskKey> &updatedSets)
+{
+    // 一覧と同じ形のパスにする（インデックスはパスで照合する）
+    std::string filename = filePrefix + "_" + zeroPad(run, 2) + "_" + zeroPad(fileNumber, 5) + ".tif";
+    std::string filepath = (fs::path(task.watchDir) / filename).string();
+
+    std::error_code ec;
+    auto lastWriteTime = fs::last_write_time(filepath, ec);
+    if (ec)
+        return false;
+
+    noteFrame(filepath, run, fileNumber, lastWriteTime, updatedSets);
+    if (collectSidecars)
+    {
+        for (const auto &extension : sidecarExtensions)
+        {
+            probeSidecar(filePrefix + "_" + zeroPad(run, 2) + "_" + zeroPad(fileNumber, 5) + extension);
+        }
+    }
+    return true;
+}
+
+void IndexedDirectoryMonitor::probeSidecar(const std::string &filename)
+{
+    try
+    {
+        std::error_code ec;
+        fs::directory_entry entry(fs::path(task.watchDir) / filename, ec);
+        if (ec || !entry.is_regular_file(ec))
+            return;
+        std::set<std::string> seen;
+        noteSidecar(entry, seen);
+    }
+    catch (const fs::filesystem_error &)
+    {
+        // 確認の直後に削除された場合は次の一覧に任せる
+    }
+}
+
+void IndexedDirectoryMonitor::probeExpectedFrames()
+{
+    auto now = std::chrono::steady_clock::now();
+    std::set<TaskKey> updatedSets;
+    int lastRun = probeRuns.rbegin()->first;
+
+    for (auto &pair : probeRuns)
+    {
+        int run = pair.first;
+        ProbeRun &state = pair.second;
+
+        // 終わったrun（最後のrunでなく、しばらくフレームが届いていない）は一覧に任せる
+        if (run != lastRun && now - state.lastArrival >= std::chrono::seconds(probeListingInterval))
+            continue;
+
+        // 飛ばされたフレームが遅れて届いていないか
+        for (auto it = state.missingFrames.begin(); it != state.missingFrames.end();)
+        {
+            if (probeFrame(run, *it, updatedSets))
+                it = state.missingFrames.erase(it);
+            else
+                ++it;
+        }
+
+        // 次のフレームから、見つからなくなってからprobeFrames個先まで（前回から届いた分はすべて拾う）
+        int misses = 0;
+        for (int frame = state.nextFrame; misses < probeFrames && frame <= 99999; ++frame)
+        {
+            if (!probeFrame(run, frame, updatedSets))
+            {
+                misses++;
+                continue;
+            }
+            if (misses > 0)
+            {
+                // 番号が飛んだ（届く順序が入れ替わった、または欠けた）。間のフレームの確認を続け、念のため一覧も取る
+                for (int skipped = state.nextFrame; skipped < frame; ++skipped)
+                {
+                    state.missingFrames.insert(skipped);
+                }
+                listingRequested = true;
+                misses = 0;
+            }
+            state.nextFrame = frame + 1;
+            state.lastArrival = now;
+        }
+
+        // 飛ばされたフレームが多すぎる場合は一覧に任せる（確認の手間を抑える）
+        if (state.missingFrames.size() > static_cast<size_t>(probeFrames))
+        {
+            state.missingFrames.clear();
+            listingRequested = true;
+        }
+
+        // runに1つの付随ファイル
+        if (collectSidecars)
+        {
+            for (const auto &extension : sidecarExtensions)
+            {
+                probeSidecar(filePrefix + "_" + zeroPad(run, 2) + extension);
+            }
+        }
+    }
+
+    // 次のrunの最初のフレーム
+    if (lastRun < 99 && probeFrame(lastRun + 1, 1, updatedSets))
+    {
+        trackProbeFrame(lastRun + 1, 1, true);
+    }
+
+    enqueueCompleteSets(updatedSets);
+}
+
+bool IndexedDirectoryMonitor::noteSidecar(const fs::directory_entry &entry, std::set<std::string> &seen)
+{
+    if (!collectSidecars)
+        return false;
+
+    std::string filename = entry.path().filename().string();
+    std::smatch matches;
+    if (!std::regex_match(filename, matches, sidecarPattern))
+        return false;
+
+    std::string filepath = entry.path().string();
+    auto lastWriteTime = entry.last_write_time();
+    seen.insert(filepath);
+
+    std::lock_guard<std::mutex> lock(sidecar_mutex);
+    auto it = sidecarFiles.find(filepath);
+    if (it == sidecarFiles.end())
+    {
+        SidecarState state;
+        state.run = std::stoi(matches[1].str());
+        state.frameNumber = matches[3].matched ? std::stoi(matches[3].str()) : -1;
+        state.lastWriteTime = lastWriteTime;
+        state.attached = false;
+        sidecarFiles[filepath] = state;
+    }
+    else if (it->second.lastWriteTime != lastWriteTime)
+    {
+        // 渡した後に書き換えられた場合は、次のセットで改めて同梱する
+        it->second.lastWriteTime = lastWriteTime;
+        it->second.attached = false;
+    }
+    return true;
+}
+
+void IndexedDirectoryMonitor::forgetMissingSidecars(const std::set<std::string> &seen)
+{
+    if (!collectSidecars)
+        return;
+
+    std::lock_guard<std::mutex> lock(sidecar_mutex);
+    for (auto it = sidecarFiles.begin(); it != sidecarFiles.end();)
+    {
+        if (seen.count(it->first) == 0)
+            it = sidecarFiles.erase(it);
+        else
+            ++it;
+    }
+}
+
+void IndexedDirectoryMonitor::attachSidecars(FileSet &fileSet)
+{
+    fileSet.sidecars.clear();
+    if (!collectSidecars)
+        return;
+
+    int setSize = getSetSize(fileSet.run);
+    std::lock_guard<std::mutex> lock(sidecar_mutex);
+    for (auto &pair : sidecarFiles)
+    {
+        SidecarState &state = pair.second;
+        if (state.attached || state.run != fileSet.run)
+            continue;
+        if (state.frameNumber >= 0 &&
+            (state.frameNumber < fileSet.setNumber || state.frameNumber >= fileSet.setNumber + setSize))
+            continue;
+
+        fileSet.sidecars.insert(pair.first);
+        state.attached = true;
+    }
+}
+
+void IndexedDirectoryMonitor::releaseSidecars(const FileSet &fileSet)
+{
+    std::lock_guard<std::mutex> lock(sidecar_mutex);
+    for (const auto &path : fileSet.sidecars)
+    {
+        auto it = sidecarFiles.find(path);
+        if (it != sidecarFiles.end())
+            it->second.attached = false;
+    }
+}
+
+bool IndexedDirectoryMonitor::noteLateFrame(const TaskKey &taskKey, const std::string &path,
+                                            const fs::file_time_type &lastWriteTime)
+{
+    if (!trackLateFrames)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(late_mutex);
+        auto it = archivedSets.find(taskKey);
+        // 処理開始より前に書かれていたフレームはアーカイブに含まれている
+        if (it == archivedSets.end() || lastWriteTime < it->second)
+            return false;
+
+        auto inserted = lateFrames.emplace(taskKey, LateFrames());
+        if (inserted.second)
+        {
+            inserted.first->second.notBefore = std::chrono::steady_clock::now();
+        }
+        inserted.first->second.files.insert(path);
+    }
+    LOG("Late frame for processed set: " << fs::path(path).filename().string() << " (run " << taskKey.run
+        << ", set " << taskKey.setNumber << ")");
+    return true;
+}
+
+void IndexedDirectoryMonitor::loadArchivedSets(const std::string &outputDir, const std::string &basePattern)
+{
+    ArchiveCatalog catalog(outputDir);
+    if (!catalog.load())
+        return;
+
+    std::string prefix = basePattern.substr(0, basePattern.find("_##_"));
+    size_t count = 0;
+    std::lock_guard<std::mutex> lock(late_mutex);
+    for (const auto &entry : catalog.entries())
+    {
+        if (entry.prefix != prefix)
+            continue;
+
+        // 処理開始時刻はカタログの登録時刻から処理時間を引いて求める
+        auto startedAt = std::chrono::system_clock::time_point(std::chrono::milliseconds(entry.committedAt - entry.compressMs));
+        // まとめ直した（--micro-sets、repack）アーカイブは複数のセットを含む
+        TaskKey taskKey;
+        taskKey.run = entry.run;
+        int setSize = fileIndex->getSetSize(entry.run);
+        for (taskKey.setNumber = ((entry.firstFrame - 1) / setSize) * setSize + 1;
+             taskKey.setNumber <= entry.lastFrame; taskKey.setNumber += setSize)
+        {
+            archivedSets[taskKey] = fs::file_time_type::clock::now() +
+                                    std::chrono::duration_cast<fs::file_time_type::duration>(startedAt - std::chrono::system_clock::now());
+            count++;
+        }
+    }
+    LOG("Loaded " << count << " archived set(s) from catalog (late frames will be appended)");
+}
+
+void IndexedDirectoryMonitor::loadRunSetSizes(const std::string &outputDir, const std::string &basePattern)
+{
+    ArchiveCatalog catalog(outputDir);
+    if (!catalog.load())
+        return;
+
+    // 各行に記録したrunのセットのファイル数を使う（同じrunの行は同じ値。後から登録した行を優先する）
+    // 記録のない行（v2以前のカタログ）からは推測しない（アーカイブの範囲からは一部だけのセットなどで誤るため）
+    std::string prefix = basePattern.substr(0, basePattern.find("_##_"));
+    std::map<int, std::pair<int64_t, int>> setSizes; // run -> (登録時刻, ファイル数)
+    for (const auto &entry : catalog.entries())
+    {
+        if (entry.prefix != prefix || entry.setSize <= 0)
+            continue;
+        auto &recorded = setSizes[entry.run];
+        if (entry.committedAt >= recorded.first)
+            recorded = std::make_pair(entry.committedAt, entry.setSize);
+    }
+    for (const auto &pair : setSizes)
+    {
+        if (fileIndex->setRunSetSize(pair.first, pair.second.second))
+        {
+            LOG("Run " << zeroPad(pair.first, 2) << ": " << pair.second.second << " files per set (from catalog)");
+        }
+    }
+}
+
+bool IndexedDirectoryMonitor::getLateFrames(FileSet &outSet)
+{
+    std::lock_guard<std::mutex> lock(late_mutex);
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = lateFrames.begin(); it != lateFrames.end();)
+    {
+        if (now < it->second.notBefore)
+        {
+            ++it;
+            continue;
+        }
+
+        // 追記待ちの間に消えたファイルは除く
+        FileSet lateSet;
+        for (const auto &path : it->second.files)
+        {
+            if (fs::exists(path))
+                lateSet.files.insert(path);
+        }
+        TaskKey taskKey = it->first;
+        it = lateFrames.erase(it);
+        if (lateSet.files.empty())
+            continue;
+
+        // 出力先のパスはセットの先頭ファイルの名前から決まるため、届いたフレームの名前から組み立てる
+        std::string prefix;
+        int run = 0, frameNumber = 0;
+        const std::string &sample = *lateSet.files.begin();
+        if (!parseFrameFileName(sample, prefix, run, frameNumber))
+            continue;
+        lateSet.run = taskKey.run;
+        lateSet.setNumber = taskKey.setNumber;
+        lateSet.firstFile = (fs::path(sample).parent_path() /
+                             (prefix + "_" + zeroPad(taskKey.run, 2) + "_" + zeroPad(taskKey.setNumber, 5) + ".tif"))
+                                .string();
+        lateSet.processed = true;
+        lateSet.lateFrames = true;
+        lateSet.subdirectory = subdirectory;
+        outSet = lateSet;
+        return true;
+    }
+    return false;
+}
+
+void IndexedDirectoryMonitor::requeueLateFrames(const FileSet &lateSet)
+{
+    TaskKey taskKey;
+    taskKey.run = lateSet.run;
+    taskKey.setNumber = lateSet.setNumber;
+
+    std::lock_guard<std::mutex> lock(late_mutex);
+    LateFrames &late = lateFrames[taskKey];
+    late.files.insert(lateSet.files.begin(), lateSet.files.end());
+    late.notBefore = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+}
+
 void IndexedDirectoryMonitor::updateFileSets()
 {
     // メインループが直接getNextCompleteFileSetを呼ぶため、
@@ -415,6 +1146,16 @@ void IndexedDirectoryMonitor::markFileSetProcessed(const FileSet &processedSet,
         std::lock_guard<std::mutex> lock(index_mutex);
         fileIndex->markFileSetProcessed(taskKey, processed);
     }
+
+    // 処理を開始した時刻を記録する（これ以降に更新されたフレームは後から届いたものとして追記する）
+    if (trackLateFrames)
+    {
+        std::lock_guard<std::mutex> lock(late_mutex);
+        if (processed)
+            archivedSets.emplace(taskKey, fs::file_time_type::clock::now());
+        else
+            archivedSets.erase(taskKey);
+    }
 }
 
 void IndexedDirectoryMonitor::saveIndexNow()
@@ -428,6 +1169,12 @@ size_t IndexedDirectoryMonitor::getIndexSize() const
     return fileIndex->size();
 }
 
+int IndexedDirectoryMonitor::getSetSize(int run)
+{
+    std::lock_guard<std::mutex> lock(index_mutex);
+    return fileIndex->getSetSize(run);
+}
+
 void IndexedDirectoryMonitor::enqueueTask(int run, int setNumber)
 {
     std::lock_guard<std::mutex> lock(queueMutex);
@@ -475,7 +1222,11 @@ bool IndexedDirectoryMonitor::getNextTaskKey(TaskKey &outKey)
 bool IndexedDirectoryMonitor::getFileSet(const TaskKey &taskKey, FileSet &outFileSet)
 {
     std::lock_guard<std::mutex> lock(index_mutex);
-    return fileIndex->getFileSet(taskKey, outFileSet);
+    if (!fileIndex->getFileSet(taskKey, outFileSet))
+        return false;
+    outFileSet.subdirectory = subdirectory;
+    outFileSet.setSize = fileIndex->getSetSize(taskKey.run);
+    return true;
 }
 
 void IndexedDirectoryMonitor::requeueFileSet(const FileSet &fileSet)
@@ -485,15 +1236,91 @@ void IndexedDirectoryMonitor::requeueFileSet(const FileSet &fileSet)
 
 void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                       const std::string &basePattern, int setSize, int pollInterval,
-                      int maxThreads, int maxProcesses, int lz4Acceleration, bool deleteAfter, bool stopOnInterrupt)
+                      int maxThreads, int maxProcesses, int lz4Acceleration, bool deleteAfter, bool stopOnInterrupt,
+                      const CompressorOptions &options)
 {
     bool running = true;
 
     LOG("Starting indexed directory monitor on: " << watchDir);
     LOG("Output directory: " << outputDir);
     LOG("Set size: " << setSize << " files");
+    // マイクロセットごとに圧縮・書き込みし、セットのアーカイブには後からまとめる
+    int groupSize = options.microSetSize > 0 ? options.microSetSize : setSize;
+    if (options.microSetSize > 0)
+    {
+        LOG("Micro-sets: " << options.microSetSize << " files (compacted into sets of " << setSize << " in the background)");
+    }
+    if (options.targetSetBytes > 0)
+    {
+        LOG("Target set size: " << options.targetSetBytes / (1024 * 1024) << " MiB (files per set chosen per run from the first frame)");
+    }
     LOG("Max threads per set: " << maxThreads);
     LOG("Max concurrent processes: " << maxProcesses);
+    if (options.runContainer)
+    {
+        LOG("Output mode: run container (.lz4c)");
+    }
+    if (options.archiveVersion >= 2)
+    {
+        LOG("Archive format: v2 (codec: " << blockCodecName(options.codec)
+            << (options.alignBlocks ? ", blocks aligned to 4 KiB" : "")
+            << (options.checkpointInterval > 0 ? ", checkpoints every " + std::to_string(options.checkpointInterval) + " frames" : "")
+            << (options.findSpots ? ", spots >= " + std::to_string(options.spotFinder.threshold) : "")
+            << (options.storeThreshold < 1.0 ? ", stored raw above " + std::to_string(static_cast<int>(options.storeThreshold * 100)) + "%" : "")
+            << ")");
+    }
+
+    // アーカイブの出力先（先頭が主出力ディレクトリ）
+    std::vector<std::string> outputRoots = getOutputRoots(outputDir, options);
+    if (outputRoots.size() > 1)
+    {
+        LOG("Output roots: " << outputRoots.size() << " ("
+            << (options.stripePolicy == StripePolicy::Balanced ? "balanced" : "round-robin") << ")");
+        for (const auto &root : outputRoots)
+        {
+            LOG("  " << root);
+        }
+    }
+
+    // アーカイブの書き込みのライトバックを平滑化する（--dirty-window-mb）
+    setDirtyWindow(options.dirtyWindowBytes);
+    if (options.dirtyWindowBytes > 0)
+    {
+        LOG("Write smoothing: flush every " << options.dirtyWindowBytes / (1024 * 1024) << " MiB of archive data");
+    }
+#if defined(__linux__)
+    bool writesWaitForDisk = options.dirtyWindowBytes > 0;
+#else
+    bool writesWaitForDisk = false;
+#endif
+    if (outputRoots.size() > 1 && options.stripePolicy == StripePolicy::Balanced && !writesWaitForDisk)
+    {
+        // 書き出しを待たない書き込みの時間はページキャッシュへのコピーの時間で、出力先の速さを表さない
+        LOG("Balanced striping: choosing by free space only (write latency is measured with --dirty-window-mb)");
+    }
+
+    if (options.rescanInterval > 0)
+    {
+        LOG("Directory listing: skipped while the watch directory is unchanged (full listing at least every "
+            << options.rescanInterval << " s)");
+    }
+    if (options.warmStart)
+    {
+        LOG("Warm start: the saved index is trusted after a spot-check and reconciled in the background");
+    }
+    if (options.probeFrames > 0)
+    {
+        LOG("Frame probing: next " << options.probeFrames << " expected frame(s) per active run between listings "
+            << "(full listing every " << options.probeListingInterval << " s and after gaps)");
+    }
+
+    // ネットワーク共有の大きなフレームを範囲に分けて並列に読む（--split-reads）
+    setReadSplitRules(options.readSplitRules);
+    for (const auto &rule : options.readSplitRules)
+    {
+        LOG("Split reads: " << (rule.root.empty() ? "all files" : rule.root) << " - " << rule.rangeBytes / 1024 << " KiB ranges x "
+            << rule.concurrency << " concurrent reads per file");
+    }
 
     // 削除キューを初期化
     deleteQueue = std::make_unique<FastDeleteQueue>();
@@ -509,8 +1336,90 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
         return;
     }
 
-    // メモリマップドインデックスを使用するモニターを初期化
-    IndexedDirectoryMonitor dirMonitor(watchDir, outputDir, basePattern, setSize);
+    // 複数プロセスで分担する場合はリース管理を初期化（インデックスはプロセスごとに分ける）
+    std::string indexFileName = "compressor_file_index.bin";
+    if (options.cooperative)
+    {
+        std::string instanceId = options.instanceId.empty() ? defaultInstanceId() : options.instanceId;
+        leaseManager = std::make_unique<LeaseManager>(outputDir, instanceId, options.leaseTimeout);
+
+        std::string safeId = instanceId;
+        std::replace_if(safeId.begin(), safeId.end(), [](char c)
+                        { return !std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_'; }, '_');
+        indexFileName = "compressor_file_index_" + safeId + ".bin";
+
+        LOG("Cooperative mode: instance " << instanceId << ", lease timeout " << options.leaseTimeout << " s");
+    }
+
+    // メモリマップドインデックスを使用するモニターを初期化（--recursive の場合はサブディレクトリごと）
+    DirectoryTreeMonitor dirMonitor(watchDir, outputDir, basePattern, groupSize, indexFileName, options);
+    if (options.recursive)
+    {
+        LOG("Recursive monitoring: subdirectories are watched with " << options.treeWalkers
+            << " walker(s) and mirrored under the output directory");
+    }
+    if (!options.sidecarExtensions.empty())
+    {
+        std::string extensions;
+        for (const auto &extension : options.sidecarExtensions)
+            extensions += (extensions.empty() ? "" : ", ") + extension;
+        LOG("Bundling sidecar files: " << extensions);
+    }
+
+    // 失敗し続けるセットの再試行の間隔と隔離（--quarantine-after）
+    SetQuarantine quarantine(outputDir, options.quarantineAfter);
+    if (options.quarantineAfter > 0)
+    {
+        LOG("Quarantine: sets failing " << options.quarantineAfter << " times are held until 'archive_tool retry " << outputDir << "'");
+    }
+
+    // 処理に失敗したセットを未処理に戻し、失敗の回数に応じた間隔の後に再キューする（リースも解放して他のプロセスに任せられるようにする）
+    // 後から届いたフレームの追記に失敗した場合は、追記待ちに戻して後で再試行する
+    auto revertFailedSet = [&dirMonitor, &quarantine](const FileSet &failedSet)
+    {
+        if (failedSet.lateFrames)
+        {
+            dirMonitor.requeueLateFrames(failedSet);
+            if (leaseManager)
+            {
+                leaseManager->release(LeaseManager::keyFor(failedSet));
+            }
+            return;
+        }
+        dirMonitor.markFileSetProcessed(failedSet, false);
+        dirMonitor.releaseSidecars(failedSet);
+        quarantine.recordFailure(failedSet);
+        if (leaseManager)
+        {
+            leaseManager->release(LeaseManager::keyFor(failedSet));
+        }
+    };
+
+    // マイクロセットのまとめ直しを初期化（書き込みステージより先に作り、後に解放する）
+    if (options.microSetSize > 0)
+    {
+        microCompactor = std::make_unique<MicroSetCompactor>(outputDir, setSize, options.microSetSize);
+    }
+
+    // 書き込みステージを初期化（書き込み失敗時は未処理に戻して再キュー、書き込みを終えたセットは失敗の記録を消す）
+    archiveWriter = std::make_unique<ArchiveWriter>([&revertFailedSet](const FileSet &failedSet)
+                                                    {
+        LOG("Warning: Failed to write set, reverting processed flag: run "
+            << failedSet.run << ", set " << failedSet.setNumber);
+        revertFailedSet(failedSet); }, [&quarantine](const FileSet &committedSet)
+                                                    { quarantine.recordSuccess(committedSet); }, outputRoots, options.stripePolicy, 2, options.verifyReadback);
+    if (options.verifyReadback)
+    {
+        LOG("Readback verification: enabled (sources are deleted after the written archive is re-read and checked)");
+    }
+
+    // 他のプロセスがリースを保持しているセット（一定時間後に再キューして、完了または期限切れを確認する）
+    std::vector<std::pair<FileSet, std::chrono::steady_clock::time_point>> deferredSets;
+    const auto leaseRetryInterval = std::chrono::seconds(5);
+
+    // 手動の再試行要求（archive_tool retry）を確認する間隔
+    const auto retryRequestInterval = std::chrono::seconds(5);
+    auto nextRetryRequestCheck = std::chrono::steady_clock::now();
 
     // futureプール（非ブロッキングで完了検出可能）
     std::vector<std::future<std::pair<FileSet, bool>>> futures;
@@ -562,10 +1471,8 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                         {
                             LOG("Warning: Task completed with error, reverting processed flag: run " 
                                 << completedSet.run << ", set " << completedSet.setNumber);
-                            // 失敗時は未処理に戻す
-                            dirMonitor.markFileSetProcessed(completedSet, false);
-                            // 展開テスト失敗時など、圧縮待ちqueueの最後に戻す
-                            dirMonitor.requeueFileSet(completedSet);
+                            // 失敗時は未処理に戻し、展開テスト失敗時など、圧縮待ちqueueの最後に戻す
+                            revertFailedSet(completedSet);
                         }
                     }
                     catch (const std::exception &e)
@@ -580,37 +1487,65 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                 }
             }
 
+            // リース待ちのセットのうち、再確認の時刻になったものを再キュー
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = deferredSets.begin(); it != deferredSets.end();)
+            {
+                if (now >= it->second)
+                {
+                    dirMonitor.requeueFileSet(it->first);
+                    it = deferredSets.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            // 再試行の時刻が来た失敗セットと、手動で隔離を解いたセットを再キュー
+            for (const auto &retrySet : quarantine.takeDueSets())
+            {
+                dirMonitor.requeueFileSet(retrySet);
+            }
+            if (now >= nextRetryRequestCheck)
+            {
+                nextRetryRequestCheck = now + retryRequestInterval;
+                for (const auto &retrySet : quarantine.takeRetryRequests())
+                {
+                    dirMonitor.requeueFileSet(retrySet);
+                }
+            }
+
             // 並列処理枠が空いている限り、新しいセットを取得して処理
             bool processedAny = false;
             while (futures.size() < static_cast<size_t>(maxProcesses))
             {
-                // タスクキューから軽量なキーを取得 (O(1))
-                TaskKey taskKey;
-                if (!dirMonitor.getNextTaskKey(taskKey))
+                // タスクキューから軽量なキーを取得し、FileSetをO(1)で取得（スレッドセーフ）
+                FileSet fileSet;
+                if (!dirMonitor.getNextFileSet(fileSet))
                 {
                     // キューが空になり、初回スキャンも完了した場合
                     break; // ループを抜ける
                 }
 
-                // FileSetをO(1)で取得（スレッドセーフ）
-                FileSet fileSet;
-                if (!dirMonitor.getFileSet(taskKey, fileSet))
+                // 隔離中、または再試行の時刻を待っている失敗セット（時刻が来たらtakeDueSetsで戻る）
+                if (quarantine.isHeld(fileSet))
                 {
-                    LOG("Failed to get FileSet for: run " << taskKey.run << ", set " << taskKey.setNumber);
-                    continue; // 次のキーへ
+                    continue;
                 }
 
                 // セットが完全であるか確認（念のため二重チェック）
-                if (!isSetComplete(fileSet, setSize))
+                int expectedFiles = options.targetSetBytes > 0 ? dirMonitor.getSetSize(fileSet) : groupSize;
+                if (!isSetComplete(fileSet, expectedFiles))
                 {
                     LOG("Warning: Incomplete set received: run " << fileSet.run 
                         << ", set " << fileSet.setNumber << " (" << fileSet.files.size() 
-                        << "/" << setSize << " files)");
+                        << "/" << expectedFiles << " files)");
                     continue;
                 }
 
                 // 既に出力ファイルが存在するかチェック
-                if (isSetProcessed(fileSet, outputDir))
+                if (isSetArchived(fileSet, outputRoots, options.runContainer))
                 {
                     LOG("Set already processed: run " << fileSet.run << ", set " << fileSet.setNumber);
                     dirMonitor.markFileSetProcessed(fileSet);
@@ -618,15 +1553,40 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                     continue; // 次のセットをチェック
                 }
 
-                LOG("Processing set: run " << fileSet.run << ", set " << fileSet.setNumber 
-                    << " (" << fileSet.files.size() << " files)");
+                // 複数プロセスで分担する場合はリースを取得できたセットだけを処理する
+                if (leaseManager)
+                {
+                    if (!leaseManager->tryAcquire(LeaseManager::keyFor(fileSet)))
+                    {
+                        deferredSets.emplace_back(fileSet, std::chrono::steady_clock::now() + leaseRetryInterval);
+                        continue;
+                    }
+                    // リース取得前に他のプロセスが処理を終えてリースを解放した場合
+                    if (isSetProcessed(fileSet, outputRoots, options.runContainer))
+                    {
+                        leaseManager->release(LeaseManager::keyFor(fileSet));
+                        LOG("Set already processed by another instance: run " << fileSet.run << ", set " << fileSet.setNumber);
+                        dirMonitor.markFileSetProcessed(fileSet);
+                        processedAny = true;
+                        continue;
+                    }
+                }
+
+                // 付随ファイルを同梱する（--sidecars）
+                dirMonitor.attachSidecars(fileSet);
+
+                LOG("Processing set: " << (fileSet.subdirectory.empty() ? "" : fileSet.subdirectory + ", ")
+                    << "run " << fileSet.run << ", set " << fileSet.setNumber 
+                    << " (" << fileSet.files.size() << " files"
+                    << (fileSet.sidecars.empty() ? "" : ", " + std::to_string(fileSet.sidecars.size()) + " sidecar(s)")
+                    << ")");
 
                 // 処理開始前に即座に処理済みとしてマーク（重複検出を防ぐ）
                 dirMonitor.markFileSetProcessed(fileSet);
 
                 // 新しいタスクを非同期で起動（std::asyncで真の並列処理）
                 futures.emplace_back(std::async(std::launch::async, [=]() {
-                    bool ok = processFileSet(fileSet, outputDir, deleteAfter, maxThreads, lz4Acceleration);
+                    bool ok = processFileSet(fileSet, outputDir, deleteAfter, maxThreads, lz4Acceleration, options);
                     return std::make_pair(fileSet, ok);
                 }));
                 processedAny = true;
@@ -642,6 +1602,33 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                 }
             }
 
+            // 処理済みのセットに後から届いたフレームを既存のアーカイブに追記する
+            FileSet lateSet;
+            while (futures.size() < static_cast<size_t>(maxProcesses) && dirMonitor.getLateFrames(lateSet))
+            {
+                // セットのアーカイブがまだ書き込まれていない（処理中）場合は後で再試行する
+                if (!isSetArchived(lateSet, outputRoots, options.runContainer))
+                {
+                    dirMonitor.requeueLateFrames(lateSet);
+                    continue;
+                }
+                if (leaseManager && !leaseManager->tryAcquire(LeaseManager::keyFor(lateSet)))
+                {
+                    dirMonitor.requeueLateFrames(lateSet);
+                    continue;
+                }
+
+                LOG("Appending late frame(s): run " << lateSet.run << ", set " << lateSet.setNumber
+                    << " (" << lateSet.files.size() << " file(s))");
+                dirMonitor.markFileSetProcessed(lateSet);
+
+                futures.emplace_back(std::async(std::launch::async, [=]() {
+                    bool ok = processFileSet(lateSet, outputDir, deleteAfter, maxThreads, lz4Acceleration, options);
+                    return std::make_pair(lateSet, ok);
+                }));
+                processedAny = true;
+            }
+
             // セットを処理しなかった場合は少し待機
             if (!processedAny)
             {
@@ -670,10 +1657,8 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
             {
                 LOG("Warning: Final task completed with error, reverting processed flag: run " 
                     << completedSet.run << ", set " << completedSet.setNumber);
-                // 失敗時は未処理に戻す
-                dirMonitor.markFileSetProcessed(completedSet, false);
-                // 展開テスト失敗時など、圧縮待ちqueueの最後に戻す
-                dirMonitor.requeueFileSet(completedSet);
+                // 失敗時は未処理に戻し、展開テスト失敗時など、圧縮待ちqueueの最後に戻す
+                revertFailedSet(completedSet);
             }
         }
         catch (const std::exception &e)
@@ -682,6 +1667,26 @@ void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
         }
     }
 
+    // 書き込みステージを解放（待機中のアーカイブは書き切り、読み戻し検証も終える）
+    LOG("Waiting for archive writer to finish...");
+    archiveWriter.reset();
+
+    // マイクロセットのまとめ直しを解放（揃っていないセットもまとめる）
+    if (microCompactor)
+    {
+        LOG("Waiting for micro-set compaction to finish...");
+        microCompactor.reset();
+    }
+
+    // 残っているリースを解放
+    leaseManager.reset();
+
+    size_t quarantinedCount = quarantine.getQuarantinedCount();
+    if (quarantinedCount > 0)
+    {
+        LOG("Quarantined sets: " << quarantinedCount << " (" << outputDir << "/" << QUARANTINE_FILE_NAME << ")");
+    }
+
     // 削除キューを解放
     LOG("Waiting for delete queue to finish...");
     deleteQueue.reset();
@@ -3,6 +3,7 @@
 
 #include "file_set.hpp"
 #include "file_index.hpp"
+#include "compressor_options.hpp"
 #include <string>
 #include <vector>
 #include <set>
@@ -13,6 +14,9 @@
 #include <memory>
 #include <queue>
 #include <atomic>
+#include <filesystem>
+#include <map>
+#include <chrono>
 
 // メモリマップドインデックスを使用したディレクトリモニター
 class IndexedDirectoryMonitor
@@ -40,6 +44,42 @@ private:
     // パターンマッチング用の正規表現
     std::regex filePattern;
 
+    // 付随ファイル（--sidecars）の状態
+    struct SidecarState
+    {
+        int run;
+        int frameNumber; // runに1つのファイル（"<prefix>_<run>.<拡張子>"）の場合は-1
+        std::filesystem::file_time_type lastWriteTime;
+        bool attached;   // アーカイブ対象としてセットに渡し済み
+    };
+    bool collectSidecars;
+    std::regex sidecarPattern;
+    std::map<std::string, SidecarState> sidecarFiles; // パス -> 状態
+    std::mutex sidecar_mutex;
+
+    // 付随ファイルなら状態を記録してtrueを返す
+    bool noteSidecar(const std::filesystem::directory_entry &entry, std::set<std::string> &seen);
+    // 今回のスキャンで見つからなかった付随ファイルを忘れる
+    void forgetMissingSidecars(const std::set<std::string> &seen);
+
+    // 処理済みのセットに後から届いたフレーム（v2の既存のアーカイブに追記する）
+    struct LateFrames
+    {
+        std::set<std::string> files;
+        std::chrono::steady_clock::time_point notBefore; // 再試行の時刻
+    };
+    bool trackLateFrames;
+    std::map<TaskKey, std::filesystem::file_time_type> archivedSets; // 処理を開始したセット -> 開始時刻（これ以降に更新されたフレームを追記する）
+    std::map<TaskKey, LateFrames> lateFrames;
+    std::mutex late_mutex;
+
+    // 処理済みのセットのフレームが新規・更新されていれば追記待ちに加えてtrueを返す
+    bool noteLateFrame(const TaskKey &taskKey, const std::string &path, const std::filesystem::file_time_type &lastWriteTime);
+    // カタログに登録済みのセットを処理済みとして読み込む（再起動前に処理したセット）
+    void loadArchivedSets(const std::string &outputDir, const std::string &basePattern);
+    // インデックスにないrunのセットのファイル数を、カタログに記録した値から戻す（--target-set-mb）
+    void loadRunSetSizes(const std::string &outputDir, const std::string &basePattern);
+
     // Producer-Consumerモデル用のタスクキュー
     std::queue<TaskKey> taskQueue;
     std::set<TaskKey> enqueuedTasks; // 既にキューに積まれているTaskKeyを追跡
@@ -47,20 +87,110 @@ private:
     std::condition_variable queueCV;
     std::atomic<bool> producerFinishedScan; // 初回スキャン完了フラグ
 
+    // 監視ディレクトリの更新時刻（変わっていなければ一覧を取り直さない）
+    struct DirectoryStamp
+    {
+        int64_t modified = 0; // 更新時刻（ナノ秒）
+        int64_t changed = 0;  // 状態変更時刻（ナノ秒、POSIXのみ）
+        bool operator==(const DirectoryStamp &other) const { return modified == other.modified && changed == other.changed; }
+    };
+    int rescanInterval;                          // 更新時刻が変わらなくても一覧を取り直す間隔（秒、0: 毎回一覧を取る）
+    bool listedStampValid;                       // listedStampを最後の一覧と比べられる
+    DirectoryStamp listedStamp;                  // 最後に一覧を取った時点の更新時刻
+    std::chrono::steady_clock::time_point lastListing;
+
+    static bool getDirectoryStamp(const std::string &dir, DirectoryStamp &stamp);
+    // 一覧を取る直前に呼び、取り直しが必要か判定する（不要ならfalse）
+    bool needsListing();
+    // 一覧を取る直前の時刻（listingStart）と更新時刻を記録する
+    void noteListing(bool haveStamp, const DirectoryStamp &stamp, std::chrono::system_clock::time_point listingStart);
+
+    // 次に届くはずのフレームの確認（一覧の代わりに、runごとに予想されるファイル名だけを調べる）
+    struct ProbeRun
+    {
+        int nextFrame = 0;           // 次に届くはずのフレーム番号（見つかった最大の番号+1）
+        std::set<int> missingFrames; // 飛ばされたフレーム番号（遅れて届く場合に備えて確認を続ける）
+        std::chrono::steady_clock::time_point lastArrival; // 最後に新しいフレームが見つかった時刻
+    };
+    int probeFrames;                 // 見つからなくなってから先を確認するフレーム数（0: 確認せず毎回一覧を取る）
+    int probeListingInterval;        // 確認する場合に一覧を取り直す間隔（秒）
+    std::string filePrefix;          // フレームのファイル名の"<prefix>"の部分
+    std::vector<std::string> sidecarExtensions;
+    std::map<int, ProbeRun> probeRuns; // run -> 確認の状態
+    bool listingRequested;           // 番号の飛びを見つけたため次は一覧を取る
+
+    // 一覧・確認で見つかったフレームを確認の状態に反映する（arrived: 新規・更新されたフレーム）
+    void trackProbeFrame(int run, int fileNumber, bool arrived);
+    // 予想されるフレームがあればインデックスに反映してtrueを返す
+    bool probeFrame(int run, int fileNumber, std::set<TaskKey> &updatedSets);
+    // 予想される付随ファイルがあれば記録する
+    void probeSidecar(const std::string &filename);
+    // 確認するrun（最後のrunと最近フレームが届いたrun）の次のフレームと、次のrunの最初のフレームを確認する
+    void probeExpectedFrames();
+
+    // 新規・更新されたフレームをインデックスに加え、セットをupdatedSetsに記録する（変化がなければfalse）
+    bool noteFrame(const std::string &filepath, int run, int fileNumber,
+                   const std::filesystem::file_time_type &lastWriteTime, std::set<TaskKey> &updatedSets);
+    // 更新されたセットのうち完全になった未処理のものをキューに積む
+    void enqueueCompleteSets(const std::set<TaskKey> &updatedSets);
+
+    // サブディレクトリの監視（--recursive）
+    std::string subdirectory;                 // 監視ディレクトリの根からの相対パス（FileSetに付ける）
+    bool recordSubdirectories;                // 一覧で見つけたサブディレクトリを記録する
+    std::vector<std::string> subdirectories;  // 最後の一覧で見つけたサブディレクトリの名前
+    std::mutex subdirectory_mutex;
+
+    // 保存されたインデックスからの再開（--warm-start）
+    bool warmStart;
+    std::thread reconcile_thread;
+
+    // 最後の一覧の時点の更新時刻をインデックスに記録する（一覧の結果をインデックスに反映した後に呼ぶ）
+    void recordListedStamp();
+    // インデックスの一部を確認し、信用できれば全体のスキャンを省いて増分スキャンに移る（信用できなければfalse）
+    bool performWarmStart();
+    // インデックスのファイルを低い優先度で確認し、消えたものを除き、更新されたものを反映する
+    void reconcileIndex();
+    // インデックスの完全な未処理のセットをタスクキューに積む
+    size_t enqueueIndexedSets();
+
     void scannerWorker();
     void performFullScan();
     void performIncrementalScan();
     void updateFileSets();
 
 public:
-    IndexedDirectoryMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern, int setSize);
+    // indexFileName: 出力ディレクトリに保存するインデックスのファイル名（複数プロセスで分担する場合はプロセスごとに分ける）
+    // sidecarExtensions: セットと一緒にアーカイブする付随ファイルの拡張子（空の場合は集めない）
+    // trackLateFrames: 処理済みのセットに後から届いたフレームを追記待ちとして集める（v2のみ）
+    // targetSetBytes: 0より大きい場合、セットのファイル数をrunごとにセットの合計サイズから決める（--target-set-mb）
+    // rescanInterval: 0より大きい場合、監視ディレクトリの更新時刻が変わらない間はこの秒数まで一覧を取り直さない（--rescan-interval）
+    // probeFrames: 0より大きい場合、一覧の代わりに次に届くはずのフレームだけを確認し、probeListingInterval秒ごとに一覧を取る（--probe-frames）
+    // subdirectory: 監視ディレクトリの木の中での相対パス（取り出したFileSetに付ける）
+    // recursive: スキャンのスレッドを持たず、scanOnceで外から走査する。一覧で見つけたサブディレクトリを記録する（--recursive）
+    // warmStart: 保存されたインデックスを確認して信用できれば、初回の全体のスキャンを省く（--warm-start）
+    IndexedDirectoryMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern, int setSize,
+                            const std::string &indexFileName = "compressor_file_index.bin",
+                            const std::vector<std::string> &sidecarExtensions = std::vector<std::string>(),
+                            bool trackLateFrames = false, uint64_t targetSetBytes = 0, int rescanInterval = 0,
+                            int probeFrames = 0, int probeListingInterval = 60,
+                            const std::string &subdirectory = "", bool recursive = false, bool warmStart = false);
     ~IndexedDirectoryMonitor();
 
+    // 1回分のスキャン（初回スキャンが完了するまでは全体のスキャン、以後は増分スキャン）
+    void scanOnce();
+    // 初回スキャンが完了した（getNextTaskKeyが待たない）
+    bool hasFinishedInitialScan() const;
+    // 最後の一覧で見つけたサブディレクトリの名前（recursiveの場合のみ）
+    std::vector<std::string> getSubdirectories();
+
     std::vector<FileSet> getLatestFileSets(bool waitForNew = false);
     bool isDataAvailable();
     void markDataProcessed();
     void markFileSetProcessed(const FileSet &processedSet, bool processed = true);
     size_t getIndexSize() const;
+
+    // runのセットのファイル数（--target-set-mb の場合はrunごとに異なる）
+    int getSetSize(int run);
     
     // メインスレッドが呼び出す新メソッド（キューからタスクキーを取得）
     bool getNextTaskKey(TaskKey &outKey);
@@ -76,12 +206,26 @@ public:
     
     // FileSetを圧縮待ちqueueの最後に戻す（展開テスト失敗時など）
     void requeueFileSet(const FileSet &fileSet);
+
+    // セットに同梱する付随ファイルをfileSet.sidecarsに設定する
+    // 番号付きのものはセットの範囲内の番号のもの、runに1つのものはまだ他のセットに渡していないものを渡す
+    void attachSidecars(FileSet &fileSet);
+
+    // 処理に失敗したセットの付随ファイルを、次に処理するセットに渡せるよう戻す
+    void releaseSidecars(const FileSet &fileSet);
+
+    // 追記待ちのフレームを1セット分取り出す（lateFramesを設定したFileSet、再試行の時刻前のものは除く）
+    bool getLateFrames(FileSet &outSet);
+
+    // 追記できなかったフレームを追記待ちに戻す（一定時間後に再試行する）
+    void requeueLateFrames(const FileSet &lateSet);
 };
 
 // メインの監視関数
 void monitorDirectory(const std::string &watchDir, const std::string &outputDir,
                       const std::string &basePattern, int setSize, int pollInterval,
-                      int maxThreads, int maxProcesses, int lz4Acceleration, bool deleteAfter, bool stopOnInterrupt);
+                      int maxThreads, int maxProcesses, int lz4Acceleration, bool deleteAfter, bool stopOnInterrupt,
+                      const CompressorOptions &options = CompressorOptions());
 
 #endif // DIRECTORY_MONITOR_HPP
 
@@ -0,0 +1,284 @@
+#include "directory_tree.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+
+// 各ディレクトリを走査する間隔（単一ディレクトリのスキャンスレッドと同じ）
+constexpr auto TREE_SCAN_INTERVAL = std::chrono::milliseconds(300);
+
+DirectoryTreeMonitor::DirectoryTreeMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern,
+                                           int setSize, const std::string &indexFileName, const CompressorOptions &options)
+    : watchDir(watchDir), outputDir(outputDir), basePattern(basePattern), setSize(setSize), indexFileName(indexFileName),
+      options(options), recursive(options.recursive), running(true)
+{
+    // 監視ディレクトリの下に出力先がある場合、出力したアーカイブを監視しない
+    if (recursive)
+    {
+        for (const auto &root : getOutputRoots(outputDir, options))
+        {
+            std::error_code ec;
+            fs::path canonical = fs::weakly_canonical(root, ec);
+            if (!ec)
+                excludedDirs.push_back(canonical.generic_string());
+        }
+    }
+
+    addDirectory("");
+
+    if (recursive)
+    {
+        int count = std::max(1, options.treeWalkers);
+        for (int i = 0; i < count; ++i)
+        {
+            walkers.emplace_back(&DirectoryTreeMonitor::walkerWorker, this);
+        }
+    }
+}
+
+DirectoryTreeMonitor::~DirectoryTreeMonitor()
+{
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        running = false;
+    }
+    walkCV.notify_all();
+    for (auto &walker : walkers)
+    {
+        if (walker.joinable())
+            walker.join();
+    }
+}
+
+void DirectoryTreeMonitor::addDirectory(const std::string &subdirectory)
+{
+    std::string directory = subdirectory.empty() ? watchDir : watchDir + "/" + subdirectory;
+    if (!subdirectory.empty())
+    {
+        std::error_code ec;
+        std::string canonical = fs::weakly_canonical(directory, ec).generic_string();
+        for (const auto &excluded : excludedDirs)
+        {
+            if (!ec && (canonical == excluded || canonical.compare(0, excluded.size() + 1, excluded + "/") == 0))
+                return;
+        }
+        LOG("Watching subdirectory: " << subdirectory);
+    }
+
+    // ディレクトリごとのインデックスとカタログは、出力先の同じ構成のディレクトリに置く
+    std::string directoryOutput = subdirectory.empty() ? outputDir : outputDir + "/" + subdirectory;
+    auto monitor = std::make_unique<IndexedDirectoryMonitor>(
+        directory, directoryOutput, basePattern, setSize, indexFileName, options.sidecarExtensions, options.archiveVersion >= 2,
+        options.targetSetBytes, options.rescanInterval, options.probeFrames, options.probeListingInterval, subdirectory, recursive,
+        options.warmStart);
+
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    WatchedDirectory &watched = directories[subdirectory];
+    if (!watched.monitor)
+    {
+        watched.monitor = std::move(monitor);
+        watched.nextScan = std::chrono::steady_clock::now();
+    }
+    walkCV.notify_one();
+}
+
+IndexedDirectoryMonitor *DirectoryTreeMonitor::findMonitor(const std::string &subdirectory)
+{
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    auto it = directories.find(subdirectory);
+    return it != directories.end() ? it->second.monitor.get() : nullptr;
+}
+
+void DirectoryTreeMonitor::walkerWorker()
+{
+    std::unique_lock<std::mutex> lock(tree_mutex);
+    while (running)
+    {
+        // 走査の期限が来たディレクトリのうち、最も長く待っているもの
+        auto now = std::chrono::steady_clock::now();
+        auto wakeAt = now + TREE_SCAN_INTERVAL;
+        std::string path;
+        WatchedDirectory *next = nullptr;
+        for (auto &pair : directories)
+        {
+            WatchedDirectory &watched = pair.second;
+            if (watched.scanning)
+                continue;
+            if (watched.nextScan <= now)
+            {
+                if (!next || watched.nextScan < next->nextScan)
+                {
+                    next = &watched;
+                    path = pair.first;
+                }
+            }
+            else
+            {
+                wakeAt = std::min(wakeAt, watched.nextScan);
+            }
+        }
+        if (!next)
+        {
+            walkCV.wait_until(lock, wakeAt);
+            continue;
+        }
+
+        next->scanning = true;
+        IndexedDirectoryMonitor *monitor = next->monitor.get();
+        lock.unlock();
+
+        std::vector<std::string> found;
+        try
+        {
+            // 消えたディレクトリは再び作られるまで走査しない
+            std::error_code ec;
+            if (fs::is_directory(path.empty() ? watchDir : watchDir + "/" + path, ec))
+            {
+                monitor->scanOnce();
+                found = monitor->getSubdirectories();
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG("Error scanning " << (path.empty() ? watchDir : path) << ": " << e.what());
+        }
+
+        lock.lock();
+        next->scanning = false;
+        next->nextScan = std::chrono::steady_clock::now() + TREE_SCAN_INTERVAL;
+
+        // 新しいサブディレクトリの監視を始める（インデックスの読み込みがあるためロックの外で）
+        std::vector<std::string> added;
+        for (const auto &name : found)
+        {
+            std::string child = path.empty() ? name : path + "/" + name;
+            if (directories.find(child) == directories.end())
+                added.push_back(child);
+        }
+        if (!added.empty())
+        {
+            lock.unlock();
+            for (const auto &child : added)
+            {
+                try
+                {
+                    addDirectory(child);
+                }
+                catch (const std::exception &e)
+                {
+                    LOG("Error watching subdirectory " << child << ": " << e.what());
+                }
+            }
+            lock.lock();
+        }
+    }
+}
+
+size_t DirectoryTreeMonitor::getDirectoryCount()
+{
+    std::lock_guard<std::mutex> lock(tree_mutex);
+    return directories.size();
+}
+
+bool DirectoryTreeMonitor::getNextFileSet(FileSet &outFileSet)
+{
+    // 前回セットを取り出したディレクトリの次から順番に見る（1つのディレクトリが処理枠を占有しない）
+    std::vector<std::pair<std::string, IndexedDirectoryMonitor *>> order;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        auto start = recursive ? directories.upper_bound(lastServed) : directories.begin();
+        for (auto it = start; it != directories.end(); ++it)
+            order.emplace_back(it->first, it->second.monitor.get());
+        for (auto it = directories.begin(); it != start; ++it)
+            order.emplace_back(it->first, it->second.monitor.get());
+    }
+
+    for (const auto &entry : order)
+    {
+        IndexedDirectoryMonitor *monitor = entry.second;
+        // 木の監視では初回スキャン前のディレクトリを待たない
+        if (recursive && !monitor->hasFinishedInitialScan())
+            continue;
+
+        // タスクキューから軽量なキーを取得し、FileSetをO(1)で取得（スレッドセーフ）
+        TaskKey taskKey;
+        while (monitor->getNextTaskKey(taskKey))
+        {
+            if (monitor->getFileSet(taskKey, outFileSet))
+            {
+                std::lock_guard<std::mutex> lock(tree_mutex);
+                lastServed = entry.first;
+                return true;
+            }
+            LOG("Failed to get FileSet for: run " << taskKey.run << ", set " << taskKey.setNumber);
+        }
+    }
+    return false;
+}
+
+int DirectoryTreeMonitor::getSetSize(const FileSet &fileSet)
+{
+    IndexedDirectoryMonitor *monitor = findMonitor(fileSet.subdirectory);
+    return monitor ? monitor->getSetSize(fileSet.run) : setSize;
+}
+
+void DirectoryTreeMonitor::markFileSetProcessed(const FileSet &fileSet, bool processed)
+{
+    if (IndexedDirectoryMonitor *monitor = findMonitor(fileSet.subdirectory))
+        monitor->markFileSetProcessed(fileSet, processed);
+}
+
+void DirectoryTreeMonitor::requeueFileSet(const FileSet &fileSet)
+{
+    if (IndexedDirectoryMonitor *monitor = findMonitor(fileSet.subdirectory))
+        monitor->requeueFileSet(fileSet);
+}
+
+void DirectoryTreeMonitor::attachSidecars(FileSet &fileSet)
+{
+    if (IndexedDirectoryMonitor *monitor = findMonitor(fileSet.subdirectory))
+        monitor->attachSidecars(fileSet);
+}
+
+void DirectoryTreeMonitor::releaseSidecars(const FileSet &fileSet)
+{
+    if (IndexedDirectoryMonitor *monitor = findMonitor(fileSet.subdirectory))
+        monitor->releaseSidecars(fileSet);
+}
+
+bool DirectoryTreeMonitor::getLateFrames(FileSet &outSet)
+{
+    std::vector<IndexedDirectoryMonitor *> monitors;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        for (auto &pair : directories)
+            monitors.push_back(pair.second.monitor.get());
+    }
+    for (auto *monitor : monitors)
+    {
+        if (monitor->getLateFrames(outSet))
+        {
+            outSet.setSize = monitor->getSetSize(outSet.run);
+            return true;
+        }
+    }
+    return false;
+}
+
+void DirectoryTreeMonitor::requeueLateFrames(const FileSet &lateSet)
+{
+    if (IndexedDirectoryMonitor *monitor = findMonitor(lateSet.subdirectory))
+        monitor->requeueLateFrames(lateSet);
+}
+
+void DirectoryTreeMonitor::saveIndexNow()
+{
+    std::vector<IndexedDirectoryMonitor *> monitors;
+    {
+        std::lock_guard<std::mutex> lock(tree_mutex);
+        for (auto &pair : directories)
+            monitors.push_back(pair.second.monitor.get());
+    }
+    for (auto *monitor : monitors)
+    {
+        monitor->saveIndexNow();
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef DIRECTORY_TREE_HPP
+#define DIRECTORY_TREE_HPP
+
+#include "directory_monitor.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 監視ディレクトリの木（--recursive）
+// サブディレクトリごとにIndexedDirectoryMonitor（インデックス・スキャンの状態・更新の検出）を持ち、
+// 共有のワーカー（walkers本）が期限の来たディレクトリから並列に走査する。新しいサブディレクトリは各ディレクトリの一覧で見つける。
+// セットはサブディレクトリごとに管理し（FileSet::subdirectory）、出力ディレクトリの下に同じ構成で書き込む。
+// 再帰しない場合は監視ディレクトリ1つのモニター（自身のスキャンスレッドで走査する）をそのまま使う
+class DirectoryTreeMonitor
+{
+private:
+    struct WatchedDirectory
+    {
+        std::unique_ptr<IndexedDirectoryMonitor> monitor;
+        std::chrono::steady_clock::time_point nextScan; // 次に走査する時刻
+        bool scanning = false;                           // ワーカーが走査中
+    };
+
+    std::string watchDir;
+    std::string outputDir;
+    std::string basePattern;
+    int setSize;
+    std::string indexFileName;
+    CompressorOptions options;
+    bool recursive;
+    std::vector<std::string> excludedDirs; // 走査しないディレクトリ（監視ディレクトリの下に置いた出力先）
+
+    std::map<std::string, WatchedDirectory> directories; // 相対パス -> ディレクトリ（根は空文字列。追加のみで削除しない）
+    std::string lastServed;                              // 最後にセットを取り出したディレクトリ（順番に取り出す）
+    std::mutex tree_mutex;
+    std::condition_variable walkCV;
+    bool running;
+    std::vector<std::thread> walkers;
+
+    void addDirectory(const std::string &subdirectory);
+    IndexedDirectoryMonitor *findMonitor(const std::string &subdirectory);
+    void walkerWorker();
+
+public:
+    // options.recursive: サブディレクトリも監視する。options.treeWalkers: 木を走査するワーカーの数
+    DirectoryTreeMonitor(const std::string &watchDir, const std::string &outputDir, const std::string &basePattern, int setSize,
+                         const std::string &indexFileName, const CompressorOptions &options);
+    ~DirectoryTreeMonitor();
+
+    // 監視しているディレクトリの数
+    size_t getDirectoryCount();
+
+    // 処理できるセットを1つ取り出す（ディレクトリを順番に見る。再帰しない場合は初回スキャンの完了を待つ）
+    bool getNextFileSet(FileSet &outFileSet);
+
+    // 以下はFileSet::subdirectoryのモニターに渡す
+    int getSetSize(const FileSet &fileSet);
+    void markFileSetProcessed(const FileSet &fileSet, bool processed = true);
+    void requeueFileSet(const FileSet &fileSet);
+    void attachSidecars(FileSet &fileSet);
+    void releaseSidecars(const FileSet &fileSet);
+    bool getLateFrames(FileSet &outSet);
+    void requeueLateFrames(const FileSet &lateSet);
+    void saveIndexNow();
+};
+
+#endif // DIRECTORY_TREE_HPP
@@ -1,5 +1,6 @@
 #include "file_index.hpp"
 #include "../common/common.hpp"
+#include "../common/tiff_layout.hpp"
 #include <fstream>
 #include <cstring>
 #include <algorithm>
@@ -25,8 +26,20 @@ fs::file_time_type MemoryMappedFileIndex::int64ToFileTime(int64_t timestamp)
     return fileTime;
 }
 
-MemoryMappedFileIndex::MemoryMappedFileIndex(const std::string &indexFilePath, int setSize)
-    : indexFilePath(indexFilePath), modified(false), setSize(setSize)
+// インデックスの末尾の、runごとのセットのファイル数の節（古いインデックスにはない）
+constexpr uint32_t RUN_SET_SIZES_MAGIC = 0x5a535352; // "RSSZ"
+// インデックスの末尾の、監視ディレクトリの更新時刻の節（古いインデックスにはない）
+constexpr uint32_t DIRECTORY_STAMP_MAGIC = 0x54534457; // "WDST"
+
+// --target-set-mb で決めるセットのファイル数の上限（フレーム番号は5桁）
+constexpr int MAX_TARGET_SET_SIZE = 10000;
+
+// 画素データの配置を解析できないフレームは、この時間更新されていなければ書き込み済みとみなす
+constexpr auto FRAME_SETTLE_TIME = std::chrono::seconds(10);
+
+MemoryMappedFileIndex::MemoryMappedFileIndex(const std::string &indexFilePath, int setSize, uint64_t targetSetBytes)
+    : indexFilePath(indexFilePath), modified(false), setSize(setSize), targetSetBytes(targetSetBytes),
+      hasDirectoryStamp(false), directoryModified(0), directoryChanged(0)
 {
     loadIndex();
 }
@@ -44,12 +57,85 @@ TaskKey MemoryMappedFileIndex::calculateTaskKey(int run, int fileNumber) const
 {
     TaskKey key;
     key.run = run;
-    key.setNumber = ((fileNumber - 1) / setSize) * setSize + 1;
+    int size = getSetSize(run);
+    key.setNumber = ((fileNumber - 1) / size) * size + 1;
     return key;
 }
 
-void MemoryMappedFileIndex::addFile(const std::string &path, int run, int fileNumber,
-                                    const fs::file_time_type &modTime, bool isProcessed)
+int MemoryMappedFileIndex::getSetSize(int run) const
+{
+    auto it = runSetSizes.find(run);
+    return it != runSetSizes.end() ? it->second : setSize;
+}
+
+bool MemoryMappedFileIndex::setRunSetSize(int run, int size)
+{
+    if (size <= 0 || !runSetSizes.emplace(run, size).second)
+        return false;
+    modified = true;
+    return true;
+}
+
+bool MemoryMappedFileIndex::measureCompleteFrame(const std::string &path, int run, uint64_t &frameBytes)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamoff size = file ? static_cast<std::streamoff>(file.tellg()) : 0;
+    if (size <= 0)
+        return false;
+    std::string data(static_cast<size_t>(size), '\0');
+    file.seekg(0);
+    if (!file.read(&data[0], size))
+        return false;
+
+    // ヘッダーと画素データがすべて書き込まれている（IFDがファイルの末尾にある形式は最後に書かれるIFDも含む）
+    TiffLayout layout;
+    if (parseTiffLayout(data.data(), data.size(), layout))
+    {
+        pendingRuns.erase(run);
+        frameBytes = layout.pixelOffset + layout.pixelBytes;
+        return true;
+    }
+
+    // 解析できない形式（圧縮TIFFなど）は、しばらく更新されていなければ書き込み済みとみなす
+    // （一覧の間隔は短いため、書き込みが一時的に止まっただけのフレームをサイズの比較では見分けられない）
+    std::error_code ec;
+    auto modified = fs::last_write_time(path, ec);
+    if (!ec && fs::file_time_type::clock::now() - modified >= FRAME_SETTLE_TIME)
+    {
+        pendingRuns.erase(run);
+        frameBytes = data.size();
+        return true;
+    }
+    if (pendingRuns.insert(run).second)
+    {
+        LOG("Run " << zeroPad(run, 2) << ": waiting for a completely written frame to choose the set size (" << path << ")");
+    }
+    return false;
+}
+
+bool MemoryMappedFileIndex::ensureRunSetSize(const std::string &path, int run)
+{
+    if (targetSetBytes == 0 || runSetSizes.find(run) != runSetSizes.end())
+        return true;
+
+    // 書き込みが終わったフレームの大きさで、そのrunのセットのファイル数を決める（インデックスとカタログに保存され、以後変えない）
+    // 同じrunのフレームは同じ大きさ（検出器の設定が同じ）のため、以後のセットの境界はフレーム番号だけで決まる
+    // 書き込み途中のフレームで決めると小さすぎるサイズからセットが大きくなりすぎるため、決められるまでrunのフレームを追加しない
+    uint64_t frameBytes = 0;
+    if (!measureCompleteFrame(path, run, frameBytes) || frameBytes == 0)
+        return false;
+
+    uint64_t files = (targetSetBytes + frameBytes / 2) / frameBytes;
+    int size = static_cast<int>(std::min<uint64_t>(std::max<uint64_t>(files, 1), MAX_TARGET_SET_SIZE));
+    runSetSizes[run] = size;
+    modified = true;
+    LOG("Run " << zeroPad(run, 2) << ": " << frameBytes << " bytes per frame, " << size << " files per set (target "
+        << targetSetBytes / (1024 * 1024) << " MiB)");
+    return true;
+}
+
+TaskKey MemoryMappedFileIndex::addFile(const std::string &path, int run, int fileNumber,
+                                       const fs::file_time_type &modTime, bool isProcessed)
 {
     // TaskKeyを計算
     TaskKey taskKey = calculateTaskKey(run, fileNumber);
@@ -84,6 +170,7 @@ void MemoryMappedFileIndex::addFile(const std::string &path, int run, int fileNu
     }
 
     modified = true;
+    return taskKey;
 }
 
 bool MemoryMappedFileIndex::hasFileChanged(const std::string &path, const fs::file_time_type &currentModTime)
@@ -181,37 +268,84 @@ void MemoryMappedFileIndex::cleanup()
     // 削除処理
     for (const std::string &path : pathsToRemove)
     {
-        // pathKeyMapから削除
-        auto keyIt = pathKeyMap.find(path);
-        if (keyIt != pathKeyMap.end())
+        removeFile(path);
+    }
+    
+    if (initialSize != fileModTimeMap.size())
+    {
+        modified = true;
+    }
+}
+
+void MemoryMappedFileIndex::removeFile(const std::string &path)
+{
+    // pathKeyMapから削除
+    auto keyIt = pathKeyMap.find(path);
+    if (keyIt != pathKeyMap.end())
+    {
+        TaskKey taskKey = keyIt->second;
+        pathKeyMap.erase(keyIt);
+
+        // FileSetからファイルを削除
+        auto setIt = fileSetMap.find(taskKey);
+        if (setIt != fileSetMap.end())
         {
-            TaskKey taskKey = keyIt->second;
-            pathKeyMap.erase(keyIt);
-            
-            // FileSetからファイルを削除
-            auto setIt = fileSetMap.find(taskKey);
-            if (setIt != fileSetMap.end())
+            setIt->second.files.erase(path);
+
+            // FileSetが空になったら削除
+            if (setIt->second.files.empty())
             {
-                setIt->second.files.erase(path);
-                
-                // FileSetが空になったら削除
-                if (setIt->second.files.empty())
-                {
-                    fileSetMap.erase(setIt);
-                }
+                fileSetMap.erase(setIt);
             }
         }
-        
-        // fileModTimeMapから削除
-        fileModTimeMap.erase(path);
     }
-    
-    if (initialSize != fileModTimeMap.size())
+
+    // fileModTimeMapから削除
+    if (fileModTimeMap.erase(path) > 0)
     {
         modified = true;
     }
 }
 
+std::vector<std::string> MemoryMappedFileIndex::getPaths(bool includeProcessed) const
+{
+    std::vector<std::string> paths;
+    for (const auto &pair : fileSetMap)
+    {
+        if (!includeProcessed && pair.second.processed)
+            continue;
+        paths.insert(paths.end(), pair.second.files.begin(), pair.second.files.end());
+    }
+    return paths;
+}
+
+void MemoryMappedFileIndex::setDirectoryStamp(int64_t modifiedTime, int64_t changedTime)
+{
+    if (hasDirectoryStamp && directoryModified == modifiedTime && directoryChanged == changedTime)
+        return;
+    hasDirectoryStamp = true;
+    directoryModified = modifiedTime;
+    directoryChanged = changedTime;
+    modified = true;
+}
+
+void MemoryMappedFileIndex::clearDirectoryStamp()
+{
+    if (!hasDirectoryStamp)
+        return;
+    hasDirectoryStamp = false;
+    modified = true;
+}
+
+bool MemoryMappedFileIndex::getDirectoryStamp(int64_t &modifiedTime, int64_t &changedTime) const
+{
+    if (!hasDirectoryStamp)
+        return false;
+    modifiedTime = directoryModified;
+    changedTime = directoryChanged;
+    return true;
+}
+
 size_t MemoryMappedFileIndex::size() const
 {
     return fileModTimeMap.size();
@@ -282,6 +416,41 @@ void MemoryMappedFileIndex::loadIndex()
             // fileSetMapに追加
             fileSetMap[taskKey] = fileSet;
         }
+
+        // 末尾の節（runごとのセットのファイル数、監視ディレクトリの更新時刻）
+        uint32_t magic = 0;
+        while (file.read(reinterpret_cast<char *>(&magic), sizeof(magic)))
+        {
+            if (magic == RUN_SET_SIZES_MAGIC)
+            {
+                uint32_t numRuns = 0;
+                file.read(reinterpret_cast<char *>(&numRuns), sizeof(numRuns));
+                for (uint32_t i = 0; i < numRuns && file; ++i)
+                {
+                    int run = 0, size = 0;
+                    file.read(reinterpret_cast<char *>(&run), sizeof(run));
+                    file.read(reinterpret_cast<char *>(&size), sizeof(size));
+                    if (file && size > 0)
+                        runSetSizes[run] = size;
+                }
+            }
+            else if (magic == DIRECTORY_STAMP_MAGIC)
+            {
+                file.read(reinterpret_cast<char *>(&directoryModified), sizeof(directoryModified));
+                file.read(reinterpret_cast<char *>(&directoryChanged), sizeof(directoryChanged));
+                hasDirectoryStamp = static_cast<bool>(file);
+            }
+            else
+            {
+                break;
+            }
+        }
+        // 保存されていないrunのセットはsetSizeで分けている（以前のインデックスなど）。境界を変えないよう固定する
+        if (targetSetBytes > 0)
+        {
+            for (const auto &setPair : fileSetMap)
+                runSetSizes.emplace(setPair.first.run, setSize);
+        }
         
         LOG("Successfully loaded index file: " << indexFilePath << " (" << numSets << " sets, " << fileModTimeMap.size() << " files)");
     }
@@ -346,6 +515,29 @@ void MemoryMappedFileIndex::saveIndex()
                 file.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
             }
         }
+
+        // runごとのセットのファイル数（--target-set-mb で決めたもの）
+        if (!runSetSizes.empty())
+        {
+            uint32_t magic = RUN_SET_SIZES_MAGIC;
+            uint32_t numRuns = static_cast<uint32_t>(runSetSizes.size());
+            file.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+            file.write(reinterpret_cast<const char *>(&numRuns), sizeof(numRuns));
+            for (const auto &runPair : runSetSizes)
+            {
+                file.write(reinterpret_cast<const char *>(&runPair.first), sizeof(runPair.first));
+                file.write(reinterpret_cast<const char *>(&runPair.second), sizeof(runPair.second));
+            }
+        }
+
+        // 監視ディレクトリの更新時刻（--warm-start）
+        if (hasDirectoryStamp)
+        {
+            uint32_t magic = DIRECTORY_STAMP_MAGIC;
+            file.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+            file.write(reinterpret_cast<const char *>(&directoryModified), sizeof(directoryModified));
+            file.write(reinterpret_cast<const char *>(&directoryChanged), sizeof(directoryChanged));
+        }
         
         file.close();
         LOG("Successfully saved index file: " << indexFilePath << " (" << numSets << " sets, " << fileModTimeMap.size() << " files)");
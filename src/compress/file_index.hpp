@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <filesystem>
 
@@ -28,6 +29,21 @@ private:
     std::string indexFilePath;
     bool modified;
     int setSize; // setSize を保持（TaskKey計算に必要）
+    uint64_t targetSetBytes; // セットの目標の合計サイズ（0: setSizeで固定）
+
+    // runごとのセットのファイル数（--target-set-mb。runの最初のフレームのサイズから決め、インデックスに保存する）
+    std::map<int, int> runSetSizes;
+
+    // セットのファイル数を決められずに待っているrun（ログを1回だけ出す）
+    std::set<int> pendingRuns;
+
+    // 書き込みが終わったフレームのバイト数を求める（書き込み途中の可能性がある場合false）
+    bool measureCompleteFrame(const std::string &path, int run, uint64_t &frameBytes);
+
+    // インデックスの内容に反映済みの、最後の一覧の時点の監視ディレクトリの更新時刻（--warm-start で一覧を省けるか判定する）
+    bool hasDirectoryStamp;
+    int64_t directoryModified;
+    int64_t directoryChanged;
 
     // セット中心のデータ構造
     std::map<TaskKey, FileSet> fileSetMap;
@@ -44,14 +60,20 @@ private:
     TaskKey calculateTaskKey(int run, int fileNumber) const;
 
 public:
-    MemoryMappedFileIndex(const std::string &indexFilePath, int setSize);
+    // targetSetBytes: 0より大きい場合、runごとのセットのファイル数を、セットの合計サイズがこの値に近くなるよう決める
+    MemoryMappedFileIndex(const std::string &indexFilePath, int setSize, uint64_t targetSetBytes = 0);
     ~MemoryMappedFileIndex();
 
     // インデックスを手動で保存（定期保存用）
     void saveIndex();
 
+    // runのセットのファイル数（--target-set-mb）が決まっていなければ、pathのフレームの大きさから決める
+    // 戻り値: 決まっている（決めた）場合true。フレームが書き込み途中の可能性がある場合false（このフレームは次の一覧で追加する）
+    bool ensureRunSetSize(const std::string &path, int run);
+
     // ファイルをインデックスに追加または更新
-    void addFile(const std::string &path, int run, int fileNumber,
+    // 戻り値: ファイルが属するセットのキー
+    TaskKey addFile(const std::string &path, int run, int fileNumber,
                  const fs::file_time_type &modTime, bool isProcessed = false);
 
     // ファイルが変更されたかチェック
@@ -76,6 +98,24 @@ public:
     // 存在しないファイルをインデックスから除去
     void cleanup();
 
+    // ファイルをインデックスから除去（セットが空になればセットも除く）
+    void removeFile(const std::string &path);
+
+    // インデックスにあるファイルのパス（includeProcessed=falseの場合は未処理のセットのもののみ）
+    std::vector<std::string> getPaths(bool includeProcessed = true) const;
+
+    // 監視ディレクトリの更新時刻（ナノ秒）を記録・取得する（clearDirectoryStampで無効にする）
+    void setDirectoryStamp(int64_t modified, int64_t changed);
+    void clearDirectoryStamp();
+    bool getDirectoryStamp(int64_t &modified, int64_t &changed) const;
+
+    // runのセットのファイル数（決まっていないrunはsetSize）
+    int getSetSize(int run) const;
+
+    // runのセットのファイル数がまだ決まっていなければsizeにする（インデックスを失った場合にカタログから復元する）
+    // 戻り値: 設定した場合true
+    bool setRunSetSize(int run, int size);
+
     // エントリ数を取得
     size_t size() const;
 };
@@ -0,0 +1,156 @@
+#include "file_link.hpp"
+#include "../common/common.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+const char *linkMethodName(LinkMethod method)
+{
+    switch (method)
+    {
+    case LinkMethod::Reflink:
+        return "reflink";
+    case LinkMethod::Hardlink:
+        return "hardlink";
+    case LinkMethod::CopyFileRange:
+        return "copy_file_range";
+    case LinkMethod::Copy:
+        return "copy";
+    default:
+        return "failed";
+    }
+}
+
+#ifdef __linux__
+// srcとdstの親ディレクトリが同じファイルシステム上にあるか
+static bool isSameFilesystem(const std::string &src, const std::string &dst)
+{
+    struct stat srcStat;
+    struct stat dstStat;
+    std::string dstDir = fs::path(dst).parent_path().string();
+    if (dstDir.empty())
+        dstDir = ".";
+    if (stat(src.c_str(), &srcStat) != 0 || stat(dstDir.c_str(), &dstStat) != 0)
+        return false;
+    return srcStat.st_dev == dstStat.st_dev;
+}
+
+static bool tryReflink(const std::string &src, const std::string &dst)
+{
+#ifdef FICLONE
+    int srcFd = open(src.c_str(), O_RDONLY);
+    if (srcFd < 0)
+        return false;
+    int dstFd = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dstFd < 0)
+    {
+        close(srcFd);
+        return false;
+    }
+
+    bool ok = ioctl(dstFd, FICLONE, srcFd) == 0;
+    close(dstFd);
+    close(srcFd);
+    if (!ok)
+        unlink(dst.c_str());
+    return ok;
+#else
+    return false;
+#endif
+}
+
+static bool tryCopyFileRange(const std::string &src, const std::string &dst)
+{
+    int srcFd = open(src.c_str(), O_RDONLY);
+    if (srcFd < 0)
+        return false;
+
+    struct stat srcStat;
+    if (fstat(srcFd, &srcStat) != 0)
+    {
+        close(srcFd);
+        return false;
+    }
+
+    int dstFd = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dstFd < 0)
+    {
+        close(srcFd);
+        return false;
+    }
+
+    off_t remaining = srcStat.st_size;
+    bool ok = true;
+    while (remaining > 0)
+    {
+        ssize_t copied = copy_file_range(srcFd, nullptr, dstFd, nullptr, static_cast<size_t>(remaining), 0);
+        if (copied <= 0)
+        {
+            // EXDEV/ENOSYS/EINVALなど: 通常のコピーにフォールバック
+            ok = false;
+            break;
+        }
+        remaining -= copied;
+    }
+
+    close(dstFd);
+    close(srcFd);
+    if (!ok)
+        unlink(dst.c_str());
+    return ok;
+}
+#endif
+
+LinkMethod linkOrCopyFile(const std::string &src, const std::string &dst)
+{
+    try
+    {
+        // ファイルが存在している場合は置き換え
+        if (fs::exists(dst))
+        {
+            fs::remove(dst);
+        }
+
+#ifdef __linux__
+        if (isSameFilesystem(src, dst))
+        {
+            if (tryReflink(src, dst))
+                return LinkMethod::Reflink;
+            if (link(src.c_str(), dst.c_str()) == 0)
+                return LinkMethod::Hardlink;
+        }
+        if (tryCopyFileRange(src, dst))
+            return LinkMethod::CopyFileRange;
+#elif defined(_WIN32)
+        // 同一ボリューム上ならハードリンク（異なるボリュームでは失敗する）
+        if (CreateHardLinkA(dst.c_str(), src.c_str(), nullptr))
+            return LinkMethod::Hardlink;
+#else
+        std::error_code ec;
+        fs::create_hard_link(src, dst, ec);
+        if (!ec)
+            return LinkMethod::Hardlink;
+#endif
+
+        fs::copy_file(src, dst, fs::copy_options::overwrite_existing);
+        return LinkMethod::Copy;
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Error copying first file: " << e.what());
+        return LinkMethod::Failed;
+    }
+}
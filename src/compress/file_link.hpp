@@ -0,0 +1,24 @@
+#ifndef FILE_LINK_HPP
+#define FILE_LINK_HPP
+
+#include <string>
+
+// ファイルを出力ディレクトリへ配置した方法
+enum class LinkMethod
+{
+    Reflink,       // FICLONEによるブロック共有（データのコピーなし）
+    Hardlink,      // ハードリンク（データのコピーなし）
+    CopyFileRange, // copy_file_range（カーネル内コピー）
+    Copy,          // 通常のコピー
+    Failed
+};
+
+// ログ表示用の名前
+const char *linkMethodName(LinkMethod method);
+
+// srcをdstに配置する（dstが存在する場合は置き換える）
+// 同一ファイルシステム上ならreflink、ハードリンクの順に試し、
+// 次にcopy_file_range、最後の手段として通常のコピーを行う
+LinkMethod linkOrCopyFile(const std::string &src, const std::string &dst);
+
+#endif // FILE_LINK_HPP
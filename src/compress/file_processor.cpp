@@ -1,69 +1,100 @@
 #include "file_processor.hpp"
 #include "../common/common.hpp"
 #include "compress_to_lz4.hpp"
+#include "compress_to_blocks.hpp"
 #include <chrono>
 
 // グローバル削除キューインスタンス
 std::unique_ptr<FastDeleteQueue> deleteQueue;
 
-bool processFileSet(const FileSet &fileSet, const std::string &outputDir, bool deleteAfter, int maxThreads, int lz4Acceleration)
+// グローバル書き込みステージインスタンス
+std::unique_ptr<ArchiveWriter> archiveWriter;
+
+// グローバルリース管理インスタンス
+std::unique_ptr<LeaseManager> leaseManager;
+
+// グローバルマイクロセットまとめ直しインスタンス
+std::unique_ptr<MicroSetCompactor> microCompactor;
+
+bool isSetArchived(const FileSet &fileSet, const std::vector<std::string> &outputRoots, bool runContainer)
+{
+    return isSetProcessed(fileSet, outputRoots, runContainer) || (microCompactor && microCompactor->isCompacted(fileSet));
+}
+
+bool processFileSet(const FileSet &fileSet, const std::string &outputDir, bool deleteAfter, int maxThreads, int lz4Acceleration,
+                    const CompressorOptions &options)
 {
     try
     {
         // 処理開始時間を記録
         auto startTime = std::chrono::high_resolution_clock::now();
 
-        // 出力パスを取得
-        std::string outputPath = fileSet.getOutputPath(outputDir);
-
-        // 既に処理済みならスキップ
-        if (fs::exists(outputPath))
+        // 既に処理済みならスキップ（すべての出力先を確認、後から届いたフレームは既存のアーカイブに追記する）
+        if (!fileSet.lateFrames && isSetArchived(fileSet, getOutputRoots(outputDir, options), options.runContainer))
         {
-            LOG("Skipping already processed set: " << outputPath);
+            LOG("Skipping already processed set: run " << fileSet.run << ", set " << fileSet.setNumber);
+            if (leaseManager)
+            {
+                leaseManager->release(LeaseManager::keyFor(fileSet));
+            }
             return true;
         }
 
-        // ---------- 並列ファイル読み込み + LZ4圧縮 + メモリ上展開テスト ----------
+        // ---------- 並列ファイル読み込み + 圧縮 + メモリ上展開テスト ----------
         // maxThreadsスレッドで1つのファイルセットを並列処理
         // 圧縮の整合性はメモリ上で検証される（書き込み前）
-        if (!compressFilesToLZ4(fileSet.files, outputPath, maxThreads, lz4Acceleration))
-        {
-            LOG("Error: Failed to compress files to LZ4 (or decompression test failed)");
-            return false;
-        }
-        // 先頭ファイルを出力ディレクトリにコピー
-        if (!fileSet.firstFile.empty())
+        WriteTask task;
+        if (fileSet.lateFrames)
         {
-            fs::path firstFilePath(fileSet.firstFile);
-            fs::path destPath = fs::path(outputDir) / firstFilePath.filename();
-
-            try
+            // 後から届いたフレーム: フレームだけのブロック形式アーカイブを作り、ブロックを既存のアーカイブに写す
+            // （チェックポイントは作らない。既存のチェックポイントは和に含まれるフレームが変わるため解凍時に使われなくなる）
+            // スポットの一覧はセットの一覧を置き換えないよう、時刻を付けた別のブロックにする
+            SpotFinderParams lateSpotFinder = options.spotFinder;
+            lateSpotFinder.listTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                               std::chrono::system_clock::now().time_since_epoch())
+                                               .count();
+            if (!buildBlockArchive(fileSet.files, std::set<std::string>(), task.archiveData, maxThreads, options.codec,
+                                   lz4Acceleration, 0, 0, options.findSpots ? &lateSpotFinder : nullptr, options.storeThreshold,
+                                   &task.stats))
             {
-                // ファイルが存在している場合は上書き
-                if (fs::exists(destPath))
-                {
-                    fs::remove(destPath);
-                }
-                fs::copy_file(firstFilePath, destPath, fs::copy_options::overwrite_existing);
+                LOG("Error: Failed to compress late frames to blocks (or decode test failed)");
+                return false;
             }
-            catch (const std::exception &e)
+        }
+        else if (options.archiveVersion >= 2)
+        {
+            // v2: ファイルごとのブロック
+            uint64_t alignment = options.alignBlocks ? BLOCK_ALIGNMENT : 0;
+            if (!buildBlockArchive(fileSet.files, fileSet.sidecars, task.archiveData, maxThreads, options.codec, lz4Acceleration,
+                                   alignment, options.checkpointInterval,
+                                   options.findSpots ? &options.spotFinder : nullptr, options.storeThreshold, &task.stats))
             {
-                LOG("Error copying first file: " << e.what());
+                LOG("Error: Failed to compress files to blocks (or decode test failed)");
+                return false;
             }
         }
-
-        // 元ファイルを削除 - 削除キューに追加（展開テスト成功後のみ）
-        if (deleteAfter)
+        else if (!buildLZ4Archive(fileSet.files, task.archiveData, maxThreads, lz4Acceleration, &task.stats))
         {
-            // 削除タスクを削除キューに追加（すべてのファイルを削除）
-            deleteQueue->push(fileSet.files);
+            LOG("Error: Failed to compress files to LZ4 (or decompression test failed)");
+            return false;
         }
 
-        // 処理終了時間と経過時間を計算
-        auto endTime = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime).count();
+        // ---------- 書き込みステージへ渡す ----------
+        // 出力先の選択・書き込み・カタログ登録・先頭ファイルの配置・削除キュー投入は書き込みステージで行う
+        // （書き込みに失敗した場合は書き込みステージから再キューされる）
+        task.fileSet = fileSet;
+        task.outputDir = fileSet.getOutputDir(outputDir);
+        task.runContainer = options.runContainer;
+        task.segmentAlignment = options.alignBlocks ? BLOCK_ALIGNMENT : 0;
+        task.blockAlignment = options.alignBlocks ? BLOCK_ALIGNMENT : 0;
+        // ランコンテナ使用時はファイル数を増やさないよう、runの最初のセットのみ先頭ファイルを配置する
+        // マイクロセットの場合はセットの先頭のマイクロセットのみ配置する
+        task.copyFirstFile = !fileSet.lateFrames && (!options.runContainer || fileSet.setNumber == 1) &&
+                             (!microCompactor || microCompactor->getSetNumber(fileSet.setNumber) == fileSet.setNumber);
+        task.deleteAfter = deleteAfter;
+        task.startTime = startTime;
+        archiveWriter->push(std::move(task));
 
-        LOG("Created: " << fs::path(outputPath).filename().string() << " - Processing time: " << duration << " ms");
         return true;
     }
     catch (const std::exception &e)
@@ -72,4 +103,3 @@ bool processFileSet(const FileSet &fileSet, const std::string &outputDir, bool d
         return false;
     }
 }
-
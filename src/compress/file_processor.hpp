@@ -3,13 +3,31 @@
 
 #include "file_set.hpp"
 #include "fast_delete_queue.hpp"
+#include "compressor_options.hpp"
+#include "archive_writer.hpp"
+#include "lease_manager.hpp"
+#include "micro_compactor.hpp"
 #include <memory>
 
 // グローバル削除キューインスタンスの外部宣言
 extern std::unique_ptr<FastDeleteQueue> deleteQueue;
 
-// ファイルセットを処理する関数
-bool processFileSet(const FileSet &fileSet, const std::string &outputDir, bool deleteAfter = true, int maxThreads = 4, int lz4Acceleration = 1);
+// グローバル書き込みステージインスタンスの外部宣言
+extern std::unique_ptr<ArchiveWriter> archiveWriter;
+
+// グローバルリース管理インスタンスの外部宣言（--cooperative の場合のみ作成）
+extern std::unique_ptr<LeaseManager> leaseManager;
+
+// グローバルマイクロセットまとめ直しインスタンスの外部宣言（--micro-sets の場合のみ作成）
+extern std::unique_ptr<MicroSetCompactor> microCompactor;
+
+// 既に処理済みのセットか確認（isSetProcessedに加え、マイクロセットの場合はまとめたアーカイブに含まれているか）
+bool isSetArchived(const FileSet &fileSet, const std::vector<std::string> &outputRoots, bool runContainer);
+
+// ファイルセットを処理する関数（読み込み・圧縮を行い、書き込みステージへ渡す）
+// fileSet.lateFramesの場合は、後から届いたフレームだけを圧縮し、書き込みステージで既存のアーカイブに追記する
+bool processFileSet(const FileSet &fileSet, const std::string &outputDir, bool deleteAfter = true, int maxThreads = 4, int lz4Acceleration = 1,
+                    const CompressorOptions &options = CompressorOptions());
 
 #endif // FILE_PROCESSOR_HPP
 
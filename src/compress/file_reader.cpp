@@ -0,0 +1,242 @@
+#include "file_reader.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static std::vector<ReadSplitRule> readSplitRules;
+static std::mutex readSplitMutex;
+
+bool parseReadSplitRule(const std::string &text, ReadSplitRule &rule)
+{
+    size_t at = text.find('@');
+    std::string sizes = text.substr(0, at);
+    size_t x = sizes.find('x');
+    if (x == std::string::npos)
+        return false;
+    try
+    {
+        long long kilobytes = std::stoll(sizes.substr(0, x));
+        int concurrency = std::stoi(sizes.substr(x + 1));
+        if (kilobytes <= 0 || concurrency <= 0)
+            return false;
+        rule.rangeBytes = static_cast<uint64_t>(kilobytes) * 1024;
+        rule.concurrency = concurrency;
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+    rule.root = at == std::string::npos ? "" : text.substr(at + 1);
+    // 末尾の区切り文字は除く（"/mnt/share/" と "/mnt/share" を同じに扱う）
+    while (rule.root.size() > 1 && (rule.root.back() == '/' || rule.root.back() == '\\'))
+        rule.root.pop_back();
+    return true;
+}
+
+void setReadSplitRules(const std::vector<ReadSplitRule> &rules)
+{
+    std::lock_guard<std::mutex> lock(readSplitMutex);
+    readSplitRules = rules;
+}
+
+// パスに適用する設定を探す（rootが最も長く一致するもの）
+static bool findReadSplitRule(const std::string &path, ReadSplitRule &rule)
+{
+    std::lock_guard<std::mutex> lock(readSplitMutex);
+    bool found = false;
+    for (const auto &candidate : readSplitRules)
+    {
+        const std::string &root = candidate.root;
+        bool matches = root.empty() ||
+                       (path.compare(0, root.size(), root) == 0 &&
+                        (path.size() == root.size() || path[root.size()] == '/' || path[root.size()] == '\\'));
+        if (matches && (!found || root.size() > rule.root.size()))
+        {
+            rule = candidate;
+            found = true;
+        }
+    }
+    return found;
+}
+
+#ifndef _WIN32
+// [0, size) をrule.rangeBytesごとの範囲に分け、rule.concurrency本のpreadで同時に読む
+// 呼び出したスレッドも1本として読む
+static bool readRangesParallel(int fd, uint64_t size, const ReadSplitRule &rule, char *dst)
+{
+    size_t rangeCount = static_cast<size_t>((size + rule.rangeBytes - 1) / rule.rangeBytes);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> ok(true);
+    auto worker = [&]()
+    {
+        for (size_t range = next++; range < rangeCount && ok; range = next++)
+        {
+            uint64_t offset = range * rule.rangeBytes;
+            uint64_t length = std::min(rule.rangeBytes, size - offset);
+            uint64_t done = 0;
+            while (done < length)
+            {
+                ssize_t n = ::pread(fd, dst + offset + done, static_cast<size_t>(length - done),
+                                    static_cast<off_t>(offset + done));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    ok = false; // 読み込みエラー、またはファイルが途中で短くなった
+                    break;
+                }
+                done += static_cast<uint64_t>(n);
+            }
+        }
+    };
+
+    size_t threadCount = std::min(static_cast<size_t>(rule.concurrency), rangeCount);
+    std::vector<std::thread> helpers;
+    for (size_t i = 1; i < threadCount; ++i)
+    {
+        helpers.emplace_back(worker);
+    }
+    worker();
+    for (auto &helper : helpers)
+    {
+        helper.join();
+    }
+    return ok;
+}
+
+// 設定に一致する大きなファイルを範囲に分けて読む
+// 戻り値: 分けて読んだ場合true（結果はok）。分けない場合false（通常の読み込みを使う）
+static bool readWholeFileSplit(const std::string &path, std::string &data, bool &ok)
+{
+    ReadSplitRule rule;
+    if (!findReadSplitRule(path, rule) || rule.concurrency <= 1)
+        return false;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) <= rule.rangeBytes)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    data.resize(static_cast<size_t>(fileSize));
+    ok = readRangesParallel(fd, fileSize, rule, &data[0]);
+    ::close(fd);
+    if (!ok)
+    {
+        LOG("Warning: Short read on " << path << " - expected " << fileSize << " bytes (split read)");
+    }
+    return true;
+}
+#endif
+
+bool readWholeFile(const std::string &path, std::string &data)
+{
+#ifndef _WIN32
+    bool splitOk = false;
+    if (readWholeFileSplit(path, data, splitOk))
+        return splitOk;
+#endif
+
+    try
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        // ファイルサイズを取得
+        file.seekg(0, std::ios::end);
+        std::streamsize fileSize = file.tellg();
+        file.seekg(0, std::ios::beg);
+
+        // データを読み込む
+        data.resize(fileSize);
+        file.read(&data[0], fileSize);
+
+        // 実際に読み込んだバイト数を確認（短い読み取り検出）
+        std::streamsize bytesRead = file.gcount();
+        if (bytesRead != fileSize)
+        {
+            LOG("Warning: Short read on " << path
+                << " - expected " << fileSize << " bytes, got " << bytesRead << " bytes");
+            return false;
+        }
+        return true;
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Error reading file " << path << ": " << e.what());
+        return false;
+    }
+}
+
+// 並列でファイルを読み込む内部関数
+static void readFileWorker(const std::vector<std::string> &filesToRead,
+                           size_t startIdx,
+                           size_t endIdx,
+                           std::vector<FileReadResult> &results)
+{
+    for (size_t i = startIdx; i < endIdx; ++i)
+    {
+        // 各スレッドは自分の範囲だけに書き込むため排他制御は不要
+        FileReadResult &result = results[i];
+        result.filepath = filesToRead[i];
+        result.index = i;
+        result.success = readWholeFile(filesToRead[i], result.data);
+    }
+}
+
+bool readFilesParallel(const std::vector<std::string> &files, int maxThreads, std::vector<FileReadResult> &results)
+{
+    results.clear();
+    results.resize(files.size());
+
+    // ファイルを各スレッドに分配
+    size_t threadCount = static_cast<size_t>(std::max(1, maxThreads));
+    size_t filesPerThread = (files.size() + threadCount - 1) / threadCount;
+    std::vector<std::thread> threads;
+
+    for (size_t threadId = 0; threadId < threadCount; ++threadId)
+    {
+        size_t startIdx = threadId * filesPerThread;
+        size_t endIdx = std::min(startIdx + filesPerThread, files.size());
+
+        if (startIdx >= files.size())
+            break;
+
+        threads.emplace_back(readFileWorker, std::ref(files), startIdx, endIdx, std::ref(results));
+    }
+
+    // 全スレッドの完了を待機
+    for (auto &thread : threads)
+    {
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    bool allRead = true;
+    for (const auto &result : results)
+    {
+        if (!result.success)
+        {
+            LOG("Error: Failed to read file: " << result.filepath);
+            allRead = false;
+        }
+    }
+    return allRead;
+}
@@ -0,0 +1,43 @@
+#ifndef FILE_READER_HPP
+#define FILE_READER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ファイル読み込み結果を格納する構造体
+struct FileReadResult
+{
+    std::string filepath;
+    std::string data;
+    size_t index;     // 元の順序を保持
+    bool success;
+};
+
+// 大きなファイルを範囲に分けて並列に読む設定（--split-reads）
+// SMB/NFSでは1ファイルを1本のストリームで読むと往復の待ち時間で帯域が頭打ちになるため、
+// rangeBytesごとの範囲をconcurrency本のpreadで同時に読む（Windowsでは分けずに読む）
+struct ReadSplitRule
+{
+    std::string root;        // このディレクトリの下のファイルに適用する（空: すべてのファイル）
+    uint64_t rangeBytes = 0; // 1回のpreadで読むバイト数（これより小さいファイルは分けない）
+    int concurrency = 1;     // ファイルあたりの同時読み込み数
+};
+
+// "<KiB>x<N>[@<dir>]" を解析する（例: "4096x8@/mnt/share"）
+bool parseReadSplitRule(const std::string &text, ReadSplitRule &rule);
+
+// 以後の読み込みに使う設定（rootが最も長く一致するものを使う）
+void setReadSplitRules(const std::vector<ReadSplitRule> &rules);
+
+// ファイル全体を読み込む（短い読み取りは失敗として扱う）
+// 設定に一致する大きなファイルは範囲に分けて並列に読む
+// 戻り値: 成功した場合true
+bool readWholeFile(const std::string &path, std::string &data);
+
+// ファイルを最大maxThreadsスレッドで並列に読み込む
+// results: 入力と同じ順序の読み込み結果
+// 戻り値: すべてのファイルを読み込めた場合true
+bool readFilesParallel(const std::vector<std::string> &files, int maxThreads, std::vector<FileReadResult> &results);
+
+#endif // FILE_READER_HPP
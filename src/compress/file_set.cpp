@@ -1,5 +1,6 @@
 #include "file_set.hpp"
 #include "../common/common.hpp"
+#include "../common/run_container.hpp"
 #include <filesystem>
 #include <regex>
 #include <map>
@@ -7,6 +8,11 @@
 
 namespace fs = std::filesystem;
 
+std::string FileSet::getOutputDir(const std::string &outputRoot) const
+{
+    return subdirectory.empty() ? outputRoot : outputRoot + "/" + subdirectory;
+}
+
 std::string FileSet::getOutputPath(const std::string &outputDir) const
 {
     // 最初のファイルのパスからファイル名を取得
@@ -15,6 +21,29 @@ std::string FileSet::getOutputPath(const std::string &outputDir) const
     return outputDir + "/" + filename + ".lz4";
 }
 
+std::string FileSet::getContainerPath(const std::string &outputDir) const
+{
+    // "<prefix>_<run>_<番号>" から末尾の "_<番号>" を除いたものをコンテナ名にする
+    std::string stem = fs::path(firstFile).stem().string();
+    size_t pos = stem.rfind('_');
+    std::string prefixWithRun = (pos != std::string::npos) ? stem.substr(0, pos) : stem;
+    return getRunContainerPath(outputDir, prefixWithRun);
+}
+
+bool parseFrameFileName(const std::string &path, std::string &prefix, int &run, int &frameNumber)
+{
+    static const std::regex framePattern("(.*)_([0-9]{2})_([0-9]{5})");
+    std::string stem = fs::path(path).stem().string();
+    std::smatch matches;
+    if (!std::regex_match(stem, matches, framePattern))
+        return false;
+
+    prefix = matches[1].str();
+    run = std::stoi(matches[2].str());
+    frameNumber = std::stoi(matches[3].str());
+    return true;
+}
+
 std::vector<FileSet> scanAndGroupFiles(const std::string &dir, const std::string &basePattern, int setSize)
 {
     std::map<std::pair<int, int>, FileSet> fileSets; // (run, setNumber) -> FileSet
@@ -89,9 +118,22 @@ bool isSetComplete(const FileSet &fileSet, int setSize)
     return fileSet.files.size() >= static_cast<size_t>(setSize);
 }
 
-bool isSetProcessed(const FileSet &fileSet, const std::string &outputDir)
+bool isSetProcessed(const FileSet &fileSet, const std::vector<std::string> &outputRoots, bool runContainer)
 {
-    std::string outputPath = fileSet.getOutputPath(outputDir);
-    return fs::exists(outputPath);
+    for (const auto &outputRoot : outputRoots)
+    {
+        std::string outputDir = fileSet.getOutputDir(outputRoot);
+        if (runContainer)
+        {
+            RunSegment segment;
+            if (findRunSegment(fileSet.getContainerPath(outputDir), fileSet.setNumber, segment))
+                return true;
+        }
+        else if (fs::exists(fileSet.getOutputPath(outputDir)))
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
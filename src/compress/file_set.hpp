@@ -32,23 +32,37 @@ struct FileSet
     int setNumber;               // setNumberはファイルセットの先頭番号
     std::set<std::string> files; // セット内のファイルパス
     std::string firstFile;       // 最初のファイル（パターン基準）
+    std::set<std::string> sidecars; // セットと一緒にアーカイブする付随ファイル（.finfなど、--sidecars）
     bool processed;              // 処理済みフラグ
+    bool lateFrames;             // 処理済みのセットに後から届いたフレーム（既存のアーカイブに追記する）
+    std::string subdirectory;    // 監視ディレクトリからの相対パス（--recursive、出力先にも同じ構成で置く。直下の場合は空）
+    int setSize;                 // runのセットのファイル数（カタログに記録してセットの境界を復元する。0: 不明）
 
     // デフォルトコンストラクタ
-    FileSet() : run(0), setNumber(0), processed(false) {}
+    FileSet() : run(0), setNumber(0), processed(false), lateFrames(false), setSize(0) {}
+
+    // 出力先（outputRoot）の下のセットの出力ディレクトリ（subdirectoryを付ける）
+    std::string getOutputDir(const std::string &outputRoot) const;
 
     // 出力ファイル名の生成
     std::string getOutputPath(const std::string &outputDir) const;
+
+    // ランコンテナのパスの生成（<prefix>_<run>.lz4c）
+    std::string getContainerPath(const std::string &outputDir) const;
 };
 
+// "<prefix>_<run:2桁>_<番号:5桁>.<拡張子>" 形式のファイル名を分解する
+// 戻り値: 形式に合致した場合true
+bool parseFrameFileName(const std::string &path, std::string &prefix, int &run, int &frameNumber);
+
 // ディレクトリをスキャンし、パターンに合致するファイルをセットとしてグループ化
 std::vector<FileSet> scanAndGroupFiles(const std::string &dir, const std::string &basePattern, int setSize);
 
 // セットが完全であるか確認（ファイル数がsetSize個あるか）
 bool isSetComplete(const FileSet &fileSet, int setSize);
 
-// 既に処理済みのセットか確認（出力ファイルが存在するか）
-bool isSetProcessed(const FileSet &fileSet, const std::string &outputDir);
+// 既に処理済みのセットか確認（いずれかの出力先に出力ファイル、またはランコンテナ内のセグメントが存在するか）
+bool isSetProcessed(const FileSet &fileSet, const std::vector<std::string> &outputRoots, bool runContainer = false);
 
 #endif // FILE_SET_HPP
 
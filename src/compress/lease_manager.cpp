@@ -0,0 +1,223 @@
+// Windows環境でmin/maxマクロを無効化（インクルードの前に定義）
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "lease_manager.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <cstdio>
+
+LeaseManager::LeaseManager(const std::string &outputDir, const std::string &instanceId, int timeoutSeconds)
+    : leaseDir((fs::path(outputDir) / "leases").string()), instanceId(instanceId),
+      timeout(std::max(1, timeoutSeconds)), running(true)
+{
+    try
+    {
+        fs::create_directories(leaseDir);
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Warning: Failed to create lease directory: " << e.what());
+    }
+    heartbeat_thread = std::thread(&LeaseManager::heartbeat, this);
+}
+
+LeaseManager::~LeaseManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+    if (heartbeat_thread.joinable())
+    {
+        heartbeat_thread.join();
+    }
+
+    // 終了時に残っているリース（処理を終えていないセット）は解放して他のプロセスに任せる
+    std::set<std::string> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining.swap(held);
+    }
+    for (const auto &key : remaining)
+    {
+        std::error_code ec;
+        fs::remove(getLeasePath(key), ec);
+    }
+}
+
+std::string LeaseManager::getLeasePath(const std::string &key) const
+{
+    return leaseDir + "/" + key + ".lease";
+}
+
+bool LeaseManager::createLease(const std::string &path)
+{
+    // "x" で既に存在する場合は失敗させる（作成と存在確認を不可分に行う）
+    FILE *file = std::fopen(path.c_str(), "wx");
+    if (!file)
+        return false;
+
+    std::string content = instanceId + "\n";
+    std::fwrite(content.data(), 1, content.size(), file);
+    std::fclose(file);
+    return true;
+}
+
+void LeaseManager::restoreLease(const std::string &stalePath, const std::string &path)
+{
+    // 戻す間に別のプロセスが作成したリースを上書きしないよう、ハードリンクで作成してから元の名前を消す
+    std::error_code ec;
+    fs::create_hard_link(stalePath, path, ec);
+    if (!ec)
+    {
+        fs::remove(stalePath, ec);
+        return;
+    }
+    if (fs::exists(path, ec))
+    {
+        LOG("Warning: Lease was recreated while restoring it: " << path);
+        fs::remove(stalePath, ec);
+        return;
+    }
+    // ハードリンクを作れないファイルシステム（一部のネットワーク共有）
+    fs::rename(stalePath, path, ec);
+    if (ec)
+    {
+        LOG("Warning: Failed to restore lease: " << path << " (" << ec.message() << ")");
+    }
+}
+
+bool LeaseManager::tryAcquire(const std::string &key)
+{
+    std::string path = getLeasePath(key);
+
+    if (!createLease(path))
+    {
+        // 期限切れのリースは引き継ぐ
+        std::error_code ec;
+        auto lastWrite = fs::last_write_time(path, ec);
+        if (ec || fs::file_time_type::clock::now() - lastWrite < timeout)
+            return false;
+
+        // 先にリネームできたプロセスだけが引き継ぐ（同時に引き継ごうとしたプロセスはリネームに失敗する）
+        std::string stalePath = path + ".stale." + instanceId;
+        fs::rename(path, stalePath, ec);
+        if (ec)
+            return false;
+
+        std::string previousOwner;
+        {
+            std::ifstream staleFile(stalePath);
+            std::getline(staleFile, previousOwner);
+        }
+
+        // 期限の確認とリネームの間に、他のプロセスが引き継いで新しいリースを作成していた場合は、そのリースを戻して諦める
+        // （リネームは更新時刻を保つため、リネームしたファイルの時刻で確認できる）
+        auto renamedWrite = fs::last_write_time(stalePath, ec);
+        if (ec || fs::file_time_type::clock::now() - renamedWrite < timeout)
+        {
+            restoreLease(stalePath, path);
+            LOG("Lease was renewed by " << previousOwner << " during takeover, leaving it: " << key);
+            return false;
+        }
+        fs::remove(stalePath, ec);
+
+        if (!createLease(path))
+            return false;
+        LOG("Took over expired lease: " << key << " (previous owner: " << previousOwner << ")");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    held.insert(key);
+    return true;
+}
+
+void LeaseManager::release(const std::string &key)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (held.erase(key) == 0)
+            return;
+    }
+
+    // 引き継がれたリースは他のプロセスのものなので削除しない
+    if (isOwned(key))
+    {
+        std::error_code ec;
+        fs::remove(getLeasePath(key), ec);
+    }
+}
+
+bool LeaseManager::isOwned(const std::string &key)
+{
+    std::ifstream leaseFile(getLeasePath(key));
+    std::string owner;
+    return leaseFile && std::getline(leaseFile, owner) && owner == instanceId;
+}
+
+void LeaseManager::heartbeat()
+{
+    // 期限の1/4ごとに更新時刻を更新する（数回更新に失敗しても期限切れにならない）
+    auto interval = std::max<std::chrono::milliseconds>(std::chrono::milliseconds(250), timeout / 4);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        cv.wait_for(lock, interval, [this]
+                    { return !running; });
+        if (!running)
+            break;
+
+        for (const auto &key : held)
+        {
+            std::error_code ec;
+            fs::last_write_time(getLeasePath(key), fs::file_time_type::clock::now(), ec);
+            if (ec)
+            {
+                LOG("Warning: Failed to renew lease: " << key << " (" << ec.message() << ")");
+            }
+        }
+    }
+}
+
+std::string LeaseManager::keyFor(const FileSet &fileSet)
+{
+    std::string key = fs::path(fileSet.getOutputPath(".")).stem().string();
+    if (fileSet.subdirectory.empty())
+        return key;
+
+    // サブディレクトリごとに同じファイル名のセットがある（--recursive）
+    std::string directory = fileSet.subdirectory;
+    std::replace(directory.begin(), directory.end(), '/', '_');
+    return directory + "_" + key;
+}
+
+std::string defaultInstanceId()
+{
+    std::string host;
+    int pid = 0;
+#ifdef _WIN32
+    char name[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD size = sizeof(name);
+    if (GetComputerNameA(name, &size))
+        host.assign(name, size);
+    pid = _getpid();
+#else
+    char name[256] = {0};
+    if (gethostname(name, sizeof(name) - 1) == 0)
+        host = name;
+    pid = static_cast<int>(getpid());
+#endif
+    if (host.empty())
+        host = "host";
+    return host + "-" + std::to_string(pid);
+}
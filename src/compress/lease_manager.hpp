@@ -0,0 +1,63 @@
+#ifndef LEASE_MANAGER_HPP
+#define LEASE_MANAGER_HPP
+
+#include "file_set.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+// 複数の圧縮プロセス（別ホストを含む）で同じ監視ディレクトリを分担するためのリース
+// 出力ディレクトリの leases/ に "<prefix>_<run>_<番号>.lease" を排他的に作成できたプロセスがセットを処理する。
+// 保持中のリースはハートビートで更新時刻を更新し続け、一定時間更新されないリース
+// （クラッシュしたプロセスのもの）は他のプロセスが引き継ぐ。
+class LeaseManager
+{
+private:
+    std::string leaseDir;
+    std::string instanceId;
+    std::chrono::seconds timeout;
+    std::set<std::string> held; // 保持中のリースのキー
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread heartbeat_thread;
+    bool running;
+
+    std::string getLeasePath(const std::string &key) const;
+
+    // リースファイルを排他的に作成する
+    bool createLease(const std::string &path);
+
+    // 引き継ぐためにリネームしたリースが有効だった場合に元の名前に戻す
+    void restoreLease(const std::string &stalePath, const std::string &path);
+
+    // ハートビートスレッド関数
+    void heartbeat();
+
+public:
+    // outputDir: リースを置く共有の出力ディレクトリ
+    // timeoutSeconds: この時間更新されないリースは期限切れとして引き継ぐ
+    LeaseManager(const std::string &outputDir, const std::string &instanceId, int timeoutSeconds);
+    ~LeaseManager();
+
+    // セットのリースを取得する（他のプロセスが有効なリースを保持している場合false）
+    bool tryAcquire(const std::string &key);
+
+    // リースを解放する（保持している場合のみ）
+    void release(const std::string &key);
+
+    // リースがまだ自分のものか確認する（期限切れで引き継がれていないか）
+    bool isOwned(const std::string &key);
+
+    const std::string &getInstanceId() const { return instanceId; }
+
+    // セットのリースキー（"<prefix>_<run>_<番号>"）
+    static std::string keyFor(const FileSet &fileSet);
+};
+
+// 既定のインスタンスID（"<ホスト名>-<プロセスID>"）
+std::string defaultInstanceId();
+
+#endif // LEASE_MANAGER_HPP
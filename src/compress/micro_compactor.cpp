@@ -0,0 +1,371 @@
+#include "micro_compactor.hpp"
+#include "compress_to_lz4.hpp"
+#include "../common/common.hpp"
+#include "../common/aligned_io.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/checksum.hpp"
+#include <algorithm>
+#include <memory>
+#include <set>
+
+// セットが揃わないまま、この時間マイクロセットのアーカイブが追加されなければまとめる
+constexpr auto MICRO_COMPACT_IDLE = std::chrono::seconds(60);
+
+MicroSetCompactor::MicroSetCompactor(const std::string &outputDir, int setSize, int microSetSize)
+    : outputDir(outputDir), setSize(setSize), microSetSize(microSetSize), running(true)
+{
+    worker_thread = std::thread(&MicroSetCompactor::worker, this);
+}
+
+MicroSetCompactor::~MicroSetCompactor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    cv.notify_all();
+    // 終了時は揃っていないセットもまとめてから終える
+    if (worker_thread.joinable())
+    {
+        worker_thread.join();
+    }
+}
+
+void MicroSetCompactor::add(const CatalogEntry &entry)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int setNumber = getSetNumber(entry.firstFrame);
+        Group &group = groups[GroupKey(entry.prefix, entry.run, setNumber)];
+        group.prefix = entry.prefix;
+        group.run = entry.run;
+        group.setNumber = setNumber;
+        group.archives[resolvePath(entry)] = entry;
+        group.lastUpdate = std::chrono::steady_clock::now();
+        group.failed = false;
+    }
+    cv.notify_one();
+}
+
+int MicroSetCompactor::getSetNumber(int microSetNumber) const
+{
+    return ((microSetNumber - 1) / setSize) * setSize + 1;
+}
+
+bool MicroSetCompactor::isCompacted(const FileSet &microSet)
+{
+    std::string prefix;
+    int run = 0, frameNumber = 0;
+    if (!parseFrameFileName(microSet.firstFile, prefix, run, frameNumber))
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return compactedSets.count(GroupKey(prefix, microSet.run, microSet.setNumber)) > 0;
+}
+
+bool MicroSetCompactor::findCompactedArchive(const FileSet &microSet, std::string &path, std::string &root) const
+{
+    std::string prefix;
+    int run = 0, frameNumber = 0;
+    ArchiveCatalog catalog(outputDir);
+    CatalogEntry entry;
+    if (!parseFrameFileName(microSet.firstFile, prefix, run, frameNumber) || !catalog.load() ||
+        !catalog.findFrame(prefix, microSet.run, microSet.setNumber, entry) || entry.offset != 0)
+    {
+        return false;
+    }
+    path = catalog.resolvePath(entry);
+    root = entry.root.empty() ? outputDir : entry.root;
+    return fs::exists(path);
+}
+
+std::string MicroSetCompactor::resolvePath(const CatalogEntry &entry) const
+{
+    return (fs::path(entry.root.empty() ? outputDir : entry.root) / entry.archive).string();
+}
+
+bool MicroSetCompactor::isComplete(const Group &group) const
+{
+    std::set<int> covered;
+    for (const auto &item : group.archives)
+    {
+        const CatalogEntry &entry = item.second;
+        int first = std::max(entry.firstFrame, group.setNumber);
+        int last = std::min(entry.lastFrame, group.setNumber + setSize - 1);
+        for (int frame = ((first - 1) / microSetSize) * microSetSize + 1; frame <= last; frame += microSetSize)
+            covered.insert(frame);
+    }
+    return covered.size() >= static_cast<size_t>(setSize / microSetSize);
+}
+
+bool MicroSetCompactor::isReady(const Group &group, std::chrono::steady_clock::time_point now) const
+{
+    if (group.archives.size() < 2)
+        return false;
+    if (!running)
+        return true;
+    return (isComplete(group) && !group.failed) || now - group.lastUpdate >= MICRO_COMPACT_IDLE;
+}
+
+bool MicroSetCompactor::compactGroup(const Group &group, std::string &mergedPath, CatalogEntry &merged)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    // 書き込みステージの追記と同じアーカイブを同時に読み書きしない
+    std::lock_guard<std::mutex> archiveLock(archive_mutex);
+
+    // フレーム番号順に並べる
+    // 既にないアーカイブ（まとめた後に届いた追記の通知など）は除く
+    std::vector<std::pair<std::string, CatalogEntry>> members;
+    for (const auto &item : group.archives)
+    {
+        if (fs::exists(item.first))
+            members.push_back(item);
+        else
+            LOG("Warning: Micro-set archive no longer exists, skipping: " << item.first);
+    }
+    if (members.empty())
+        return false;
+    std::sort(members.begin(), members.end(), [](const auto &a, const auto &b)
+              { return a.second.firstFrame < b.second.firstFrame; });
+    // 最初のアーカイブを置き換える（先頭のマイクロセットが遅れて届いた場合も既存のアーカイブを上書きしない）
+    const CatalogEntry &first = members.front().second;
+    mergedPath = members.front().first;
+    std::string mergedName = fs::path(mergedPath).filename().string();
+
+    // ---------- ブロックを再圧縮せずに写す ----------
+    // 後から届いたフレームの追記でカタログの行より新しい場合があるため、ファイル全体を読んでブロックごとに検証する
+    std::unique_ptr<BlockArchiveBuilder> builder;
+    uint64_t inputBytes = 0;
+    uint64_t rawSize = 0;
+    int lastFrame = 0;
+    for (const auto &member : members)
+    {
+        const std::string &path = member.first;
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        AlignedBuffer buffer;
+        const char *data = nullptr;
+        std::vector<BlockEntry> blocks;
+        if (ec || !readFileRangeDirect(path, 0, size, buffer, data) || !readBlockArchiveIndex(data, size, blocks))
+        {
+            LOG("Error: Failed to read micro-set archive for compaction: " << path);
+            return false;
+        }
+        if (!builder)
+        {
+            bool aligned = std::any_of(blocks.begin(), blocks.end(), [](const BlockEntry &block)
+                                       { return (block.flags & BLOCK_FLAG_ALIGNED) != 0; });
+            builder = std::make_unique<BlockArchiveBuilder>(aligned ? BLOCK_ALIGNMENT : 0);
+        }
+        for (const auto &block : blocks)
+        {
+            if (computeChecksum64(data + block.offset, block.storedSize) != block.storedChecksum)
+            {
+                LOG("Error: Corrupted block in micro-set archive: " << block.name << " (" << path << ")");
+                return false;
+            }
+            builder->addBlock(block, std::string(data + block.offset, block.storedSize));
+        }
+        inputBytes += size;
+        lastFrame = std::max(lastFrame, member.second.lastFrame);
+    }
+    std::string archive = builder->finish();
+    // 同じブロックを含むアーカイブ（前回のまとめ直しの途中で残ったものなど）を重複して数えない
+    for (const auto &block : builder->getEntries())
+    {
+        rawSize += block.rawSize;
+    }
+    uint64_t checksum = computeChecksum64(archive);
+    uint32_t fileCount = static_cast<uint32_t>(std::count_if(
+        builder->getEntries().begin(), builder->getEntries().end(), [](const BlockEntry &block)
+        { return block.kind == BlockKind::File; }));
+
+    // ---------- 一時ファイルに書き、読み戻しを確認してから置き換える ----------
+    // 元のフレームは削除済みのため、壊れたアーカイブでマイクロセットのアーカイブを置き換えない
+    std::string tempPath = mergedPath + ".compact.tmp";
+    std::error_code ec;
+    AlignedBuffer buffer;
+    const char *data = nullptr;
+    if (!writeLZ4Archive(archive, tempPath) || !readFileRangeDirect(tempPath, 0, archive.size(), buffer, data) ||
+        computeChecksum64(data, archive.size()) != checksum)
+    {
+        LOG("Error: Failed to write compacted archive: " << tempPath);
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    // カタログの更新に失敗した場合に戻せるよう、置き換える前の先頭のアーカイブを残しておく
+    std::string backupPath = mergedPath + ".compact.orig";
+    fs::remove(backupPath, ec);
+    fs::create_hard_link(mergedPath, backupPath, ec);
+    if (ec)
+    {
+        ec.clear();
+        fs::copy_file(mergedPath, backupPath, ec);
+    }
+    if (ec)
+    {
+        LOG("Error: Failed to keep a copy of " << mergedPath << ": " << ec.message());
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    fs::rename(tempPath, mergedPath, ec);
+    if (ec)
+    {
+        LOG("Error: Failed to replace " << mergedPath << ": " << ec.message());
+        fs::remove(tempPath, ec);
+        fs::remove(backupPath, ec);
+        return false;
+    }
+
+    // ---------- カタログを更新してから古いアーカイブを消す ----------
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+    auto compactMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    merged = first;
+    merged.setSize = setSize;
+    merged.lastFrame = lastFrame;
+    merged.fileCount = fileCount;
+    merged.offset = 0;
+    merged.size = archive.size();
+    merged.rawSize = rawSize;
+    merged.checksum = checksum;
+    merged.compressMs = compactMs;
+    merged.committedAt = now;
+    merged.removed = false;
+    bool mergedCataloged = appendCatalogEntry(outputDir, merged);
+    bool cataloged = mergedCataloged;
+    for (size_t i = 1; i < members.size() && cataloged; ++i)
+    {
+        CatalogEntry tombstone = members[i].second;
+        tombstone.removed = true;
+        tombstone.committedAt = now;
+        cataloged = appendCatalogEntry(outputDir, tombstone);
+    }
+    if (!mergedCataloged)
+    {
+        // カタログの行は置き換え前の先頭のアーカイブを指したままのため、ファイルを元に戻す
+        LOG("Error: Failed to update catalog, restoring micro-set archive: " << mergedPath);
+        fs::rename(backupPath, mergedPath, ec);
+        if (ec)
+        {
+            LOG("Error: Failed to restore " << mergedPath << " from " << backupPath << ": " << ec.message());
+        }
+        return false;
+    }
+    fs::remove(backupPath, ec);
+    if (!cataloged)
+    {
+        // まとめたアーカイブの行は登録済み。残りのアーカイブは削除しない（同じフレームを含むが、カタログの行と内容は一致する）
+        LOG("Error: Failed to update catalog, leaving micro-set archives in place: " << mergedPath);
+        return false;
+    }
+
+    for (const auto &member : members)
+    {
+        if (member.first != mergedPath && !fs::remove(member.first, ec))
+        {
+            LOG("Warning: Failed to remove micro-set archive: " << member.first);
+        }
+    }
+
+    LOG("Compacted " << members.size() << " micro-set archive(s) -> " << mergedName << " (frames " << merged.firstFrame
+        << "-" << merged.lastFrame << ", " << fileCount << " files, " << inputBytes << " -> " << archive.size()
+        << " bytes, " << compactMs << " ms)");
+    return true;
+}
+
+void MicroSetCompactor::worker()
+{
+    try
+    {
+        while (true)
+        {
+            Group group;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (running)
+                    cv.wait_for(lock, std::chrono::seconds(1));
+
+                // まとめる条件を満たすグループを1つ選ぶ
+                // アーカイブが1つしかないグループは、揃った場合と終了時に手放す
+                auto now = std::chrono::steady_clock::now();
+                bool found = false;
+                for (auto it = groups.begin(); it != groups.end();)
+                {
+                    const Group &candidate = it->second;
+                    if (candidate.archives.size() < 2 && (!running || isComplete(candidate)))
+                    {
+                        it = groups.erase(it);
+                        continue;
+                    }
+                    if (isReady(candidate, now))
+                    {
+                        group = candidate;
+                        found = true;
+                        break;
+                    }
+                    ++it;
+                }
+                if (!found)
+                {
+                    if (!running && groups.empty())
+                        break;
+                    continue;
+                }
+            }
+
+            std::string mergedPath;
+            CatalogEntry merged;
+            bool ok = false;
+            try
+            {
+                ok = compactGroup(group, mergedPath, merged);
+            }
+            catch (const std::exception &e)
+            {
+                LOG("Error in micro-set compaction: " << e.what());
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = groups.find(GroupKey(group.prefix, group.run, group.setNumber));
+            if (it == groups.end())
+                continue;
+            if (!ok)
+            {
+                // 終了時は再試行しない（マイクロセットのアーカイブのまま残る）
+                if (!running)
+                    groups.erase(it);
+                else
+                {
+                    it->second.failed = true;
+                    it->second.lastUpdate = std::chrono::steady_clock::now();
+                }
+                continue;
+            }
+
+            // まとめている間に追加（追記）されたアーカイブは残す
+            for (const auto &member : group.archives)
+            {
+                auto current = it->second.archives.find(member.first);
+                if (current != it->second.archives.end() &&
+                    (current->second.checksum == member.second.checksum || !fs::exists(member.first)))
+                    it->second.archives.erase(current);
+            }
+            it->second.archives[mergedPath] = merged;
+            for (int setNumber = ((merged.firstFrame - 1) / microSetSize) * microSetSize + 1; setNumber <= merged.lastFrame;
+                 setNumber += microSetSize)
+                compactedSets.insert(GroupKey(group.prefix, group.run, setNumber));
+            if (isComplete(it->second) && it->second.archives.size() == 1)
+                groups.erase(it);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        LOG("Fatal error in micro-set compactor thread: " << e.what());
+    }
+    catch (...)
+    {
+        LOG("Unknown fatal error in micro-set compactor thread");
+    }
+}
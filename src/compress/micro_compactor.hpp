@@ -0,0 +1,90 @@
+#ifndef MICRO_COMPACTOR_HPP
+#define MICRO_COMPACTOR_HPP
+
+#include "file_set.hpp"
+#include "../common/archive_catalog.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// マイクロセット（--micro-sets）のアーカイブのまとめ直し
+// 低遅延のため、フレームはセットより小さいマイクロセット（例: 10フレーム）ごとに圧縮・書き込みして元ファイルを早く解放し、
+// このクラスが同じセットのマイクロセットのアーカイブを専用スレッドで1つのアーカイブ
+// （先頭のマイクロセットのアーカイブ。通常は "<prefix>_<run>_<セットの先頭番号>.lz4"）にまとめる。
+// ブロックは再圧縮せずにそのまま写す。
+//
+// まとめたアーカイブは一時ファイルに書いて読み戻しを確認してから置き換え、カタログに新しい行と
+// まとめたアーカイブの削除行を登録してから古いマイクロセットのアーカイブを消す（カタログは常に現在の階層を指す）。
+// カタログの更新に失敗した場合は、残しておいた置き換え前の先頭のアーカイブを戻す。
+// セットのすべてのマイクロセットが揃った時点でまとめる。揃わないまま一定時間追加がない場合
+// （runの最後のセットなど）と終了時は、その時点でのアーカイブをまとめる（後から揃った分は再度まとめる）
+class MicroSetCompactor
+{
+private:
+    // 同じセットのマイクロセットのアーカイブ
+    struct Group
+    {
+        std::string prefix;
+        int run = 0;
+        int setNumber = 0;                           // セットの先頭番号
+        std::map<std::string, CatalogEntry> archives; // アーカイブのパス -> カタログエントリ
+        std::chrono::steady_clock::time_point lastUpdate;
+        bool failed = false; // まとめ直しに失敗した（次は一定時間後に再試行する）
+    };
+    using GroupKey = std::tuple<std::string, int, int>; // (prefix, run, セットの先頭番号)
+
+    std::string outputDir; // カタログのあるディレクトリ（エントリのrootが空の場合の出力先）
+    int setSize;
+    int microSetSize;
+    std::map<GroupKey, Group> groups;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::thread worker_thread;
+    bool running;
+    std::set<GroupKey> compactedSets; // まとめたアーカイブに含まれるマイクロセット (prefix, run, マイクロセットの先頭番号)
+    std::mutex archive_mutex;         // アーカイブの読み書き（書き込みステージの追記と直列化する）
+
+    // ワーカースレッド関数
+    void worker();
+
+    // まとめる条件を満たすか（mutexを保持して呼ぶ）
+    bool isReady(const Group &group, std::chrono::steady_clock::time_point now) const;
+
+    // すべてのマイクロセットが揃っているか
+    bool isComplete(const Group &group) const;
+
+    // グループのアーカイブを1つにまとめる（merged: 登録したカタログエントリ）
+    bool compactGroup(const Group &group, std::string &mergedPath, CatalogEntry &merged);
+
+    std::string resolvePath(const CatalogEntry &entry) const;
+
+public:
+    // outputDir: 主出力ディレクトリ（カタログの場所）
+    // setSize: まとめた後のセットのファイル数（microSetSizeの倍数）
+    MicroSetCompactor(const std::string &outputDir, int setSize, int microSetSize);
+    ~MicroSetCompactor();
+
+    // 書き込んだ（または後から届いたフレームを追記した）マイクロセットのアーカイブを登録する
+    void add(const CatalogEntry &entry);
+
+    // マイクロセットを含むセットの先頭番号
+    int getSetNumber(int microSetNumber) const;
+
+    // マイクロセットがこのプロセスでまとめたアーカイブに含まれているか
+    bool isCompacted(const FileSet &microSet);
+
+    // マイクロセットを含むまとめたアーカイブをカタログから探す（マイクロセットのアーカイブが既にない場合の追記先）
+    // path: アーカイブのパス、root: アーカイブのある出力先
+    bool findCompactedArchive(const FileSet &microSet, std::string &path, std::string &root) const;
+
+    // 書き込みステージが既存のアーカイブに追記する間に保持する
+    std::mutex &getArchiveMutex() { return archive_mutex; }
+};
+
+#endif // MICRO_COMPACTOR_HPP
@@ -0,0 +1,173 @@
+#include "output_striper.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <limits>
+
+// 空き容量の下限（これを下回るルートは選ばない）
+constexpr uint64_t MIN_FREE_BYTES = 1ULL << 30; // 1 GB
+
+// 書き込み速度の指数移動平均の重み
+constexpr double LATENCY_EWMA_WEIGHT = 0.2;
+
+// 最速のルートからこの比率以内のルートは同等とみなして順番に使う
+constexpr double LATENCY_TOLERANCE = 1.2;
+
+// この回数選ばれなかったルートは一度だけ選んで測り直す（一時的に遅かったディスクを外したままにしない）
+constexpr uint64_t LATENCY_REPROBE_INTERVAL = 32;
+
+bool parseStripePolicy(const std::string &name, StripePolicy &policy)
+{
+    if (name == "round-robin")
+    {
+        policy = StripePolicy::RoundRobin;
+        return true;
+    }
+    if (name == "balanced")
+    {
+        policy = StripePolicy::Balanced;
+        return true;
+    }
+    return false;
+}
+
+OutputStriper::OutputStriper(const std::vector<std::string> &rootPaths, StripePolicy policy, bool useLatency)
+    : policy(policy), useLatency(useLatency), nextRoot(0), choices(0)
+{
+    for (const auto &path : rootPaths)
+    {
+        try
+        {
+            fs::create_directories(path);
+        }
+        catch (const std::exception &e)
+        {
+            LOG("Warning: Failed to create output root " << path << ": " << e.what());
+        }
+        roots.push_back(Root{path, 0.0, 0, 0, false});
+    }
+}
+
+size_t OutputStriper::chooseBalanced(uint64_t bytes)
+{
+    size_t chosen = pickBalanced(bytes);
+    roots[chosen].lastChosen = ++choices;
+    return chosen;
+}
+
+size_t OutputStriper::pickBalanced(uint64_t bytes)
+{
+    // 1. 空き容量が足りるルートに絞る
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < roots.size(); ++i)
+    {
+        std::error_code ec;
+        auto space = fs::space(roots[i].path, ec);
+        if (!ec && space.available >= bytes + MIN_FREE_BYTES)
+        {
+            candidates.push_back(i);
+        }
+    }
+    if (candidates.empty())
+    {
+        // どこも足りない場合は順番に割り当てる（書き込み失敗は再キューで扱う）
+        return nextRoot++ % roots.size();
+    }
+
+    // 書き込み時間を計測できない場合は空き容量が足りるルートを順番に使う
+    if (!useLatency)
+    {
+        for (size_t n = 0; n < roots.size(); ++n)
+        {
+            size_t i = (nextRoot + n) % roots.size();
+            if (std::find(candidates.begin(), candidates.end(), i) != candidates.end())
+            {
+                nextRoot = i + 1;
+                return i;
+            }
+        }
+        return candidates.front();
+    }
+
+    // 2. まだ計測していないルートを優先して計測する
+    for (size_t i : candidates)
+    {
+        if (roots[i].writes == 0)
+            return i;
+    }
+
+    // 3. 長い間選ばれていないルートは測り直す（計測値は選んだときにしか更新されない）
+    for (size_t i : candidates)
+    {
+        if (choices - roots[i].lastChosen >= LATENCY_REPROBE_INTERVAL)
+        {
+            roots[i].probing = true;
+            return i;
+        }
+    }
+
+    // 4. 最速のルートと同等の速度のルートを順番に使う
+    double best = std::numeric_limits<double>::max();
+    for (size_t i : candidates)
+    {
+        best = std::min(best, roots[i].msPerMB);
+    }
+    for (size_t n = 0; n < roots.size(); ++n)
+    {
+        size_t i = (nextRoot + n) % roots.size();
+        if (std::find(candidates.begin(), candidates.end(), i) != candidates.end() &&
+            roots[i].msPerMB <= best * LATENCY_TOLERANCE)
+        {
+            nextRoot = i + 1;
+            return i;
+        }
+    }
+    return candidates.front();
+}
+
+size_t OutputStriper::chooseRoot(uint64_t bytes, const std::string &stickyName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!stickyName.empty())
+    {
+        auto it = stickyRoots.find(stickyName);
+        if (it != stickyRoots.end())
+            return it->second;
+
+        // 再起動後などで既にファイルがあるルートを使い続ける
+        for (size_t i = 0; i < roots.size(); ++i)
+        {
+            if (fs::exists(fs::path(roots[i].path) / stickyName))
+            {
+                stickyRoots[stickyName] = i;
+                return i;
+            }
+        }
+    }
+
+    size_t chosen = 0;
+    if (roots.size() > 1)
+    {
+        chosen = (policy == StripePolicy::Balanced) ? chooseBalanced(bytes) : nextRoot++ % roots.size();
+    }
+
+    if (!stickyName.empty())
+    {
+        stickyRoots[stickyName] = chosen;
+    }
+    return chosen;
+}
+
+void OutputStriper::recordWrite(size_t rootIndex, uint64_t bytes, double milliseconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!useLatency || rootIndex >= roots.size() || bytes == 0)
+        return;
+
+    Root &root = roots[rootIndex];
+    double msPerMB = milliseconds / (static_cast<double>(bytes) / (1024.0 * 1024.0));
+    root.msPerMB = (root.writes == 0 || root.probing) ? msPerMB
+                                      : root.msPerMB * (1.0 - LATENCY_EWMA_WEIGHT) + msPerMB * LATENCY_EWMA_WEIGHT;
+    root.writes++;
+    root.probing = false;
+}
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_STRIPER_HPP
+#define OUTPUT_STRIPER_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 出力先ルートの選択方針
+enum class StripePolicy
+{
+    RoundRobin, // 順番に割り当てる
+    Balanced    // 空き容量と実測の書き込み速度から選ぶ（速度はディスクへの書き出しを待つ --dirty-window-mb の場合のみ）
+};
+
+// 文字列から選択方針を取得する（不明な場合false）
+bool parseStripePolicy(const std::string &name, StripePolicy &policy);
+
+// 複数の出力先（ディスク）へアーカイブを振り分ける
+class OutputStriper
+{
+private:
+    struct Root
+    {
+        std::string path;
+        double msPerMB;  // 書き込み時間の指数移動平均（ミリ秒/MB）
+        uint64_t writes;     // 書き込み回数
+        uint64_t lastChosen; // 最後に選ばれたときの選択回数
+        bool probing;        // 測り直し中（次の計測値で置き換える）
+    };
+
+    std::vector<Root> roots;
+    StripePolicy policy;
+    bool useLatency; // 書き込み時間がディスクへの書き出しを含む（ページキャッシュへのコピーだけの時間では選ばない）
+    size_t nextRoot;
+    uint64_t choices; // Balancedで選んだ回数
+    std::map<std::string, size_t> stickyRoots; // ランコンテナなど、同じルートに置き続ける必要があるもの
+    std::mutex mutex;
+
+    size_t chooseBalanced(uint64_t bytes);
+    size_t pickBalanced(uint64_t bytes);
+
+public:
+    // roots[0] が主出力ディレクトリ（インデックス・カタログ・ログの保存先）
+    // useLatency: 記録する書き込み時間がディスクへの書き出しの完了までを含む場合true（falseの場合Balancedは空き容量だけで選ぶ）
+    OutputStriper(const std::vector<std::string> &roots, StripePolicy policy, bool useLatency = true);
+
+    // bytesバイトのアーカイブを書き込むルートを選ぶ
+    // stickyKey: 空でなければ、同じキーには常に同じルートを返す（既存ファイルがあればそのルート）
+    // stickyName: stickyKeyのファイル名（既存ファイルの探索用）
+    size_t chooseRoot(uint64_t bytes, const std::string &stickyName = "");
+
+    // 書き込み結果を記録する（Balanced方針の判断材料）
+    void recordWrite(size_t rootIndex, uint64_t bytes, double milliseconds);
+
+    const std::string &getRoot(size_t rootIndex) const { return roots[rootIndex].path; }
+    size_t getRootCount() const { return roots.size(); }
+};
+
+#endif // OUTPUT_STRIPER_HPP
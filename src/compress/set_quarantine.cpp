@@ -0,0 +1,355 @@
+#include "set_quarantine.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// 再試行までの時間（失敗のたびに倍にし、上限で止める）
+constexpr auto RETRY_BACKOFF_BASE = std::chrono::seconds(2);
+constexpr auto RETRY_BACKOFF_MAX = std::chrono::seconds(300);
+
+// 一覧を書き換える間、他のインスタンスを待たせるロックファイル（リースと同じく排他的な作成で取る）
+constexpr auto QUARANTINE_LOCK_WAIT = std::chrono::seconds(5);
+constexpr auto QUARANTINE_LOCK_STALE = std::chrono::seconds(30);
+
+static int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// ロックファイルを作成する（QUARANTINE_LOCK_STALE より古いロックはクラッシュしたプロセスのものとして消す）
+// 戻り値: ロックを取れた場合true（取れなかった場合もロックなしで書き込む）
+static bool acquireQuarantineLock(const std::string &lockPath)
+{
+    auto deadline = std::chrono::steady_clock::now() + QUARANTINE_LOCK_WAIT;
+    while (true)
+    {
+        FILE *file = std::fopen(lockPath.c_str(), "wx");
+        if (file)
+        {
+            std::fclose(file);
+            return true;
+        }
+
+        std::error_code ec;
+        auto lockWrite = fs::last_write_time(lockPath, ec);
+        if (!ec && fs::file_time_type::clock::now() - lockWrite > QUARANTINE_LOCK_STALE)
+        {
+            fs::remove(lockPath, ec);
+            continue;
+        }
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+SetQuarantine::SetQuarantine(const std::string &outputDir, int quarantineAfter)
+    : outputDir(outputDir), quarantineAfter(quarantineAfter), startedAtMs(nowMs())
+{
+    loadQuarantine();
+}
+
+SetQuarantine::SetKey SetQuarantine::keyOf(const FileSet &fileSet)
+{
+    return SetKey(fileSet.subdirectory, fileSet.run, fileSet.setNumber);
+}
+
+std::map<SetQuarantine::SetKey, SetQuarantine::FailedSet> SetQuarantine::readQuarantineFile() const
+{
+    std::map<SetKey, FailedSet> sets;
+    std::ifstream file(outputDir + "/" + QUARANTINE_FILE_NAME);
+    if (!file)
+        return sets;
+
+    // run, set, 失敗の回数, 隔離した日時, 先頭ファイル, サブディレクトリ, 隔離した時刻（エポックミリ秒）
+    // （タブ区切り、#で始まる行は見出し）
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() < 5)
+            continue;
+
+        try
+        {
+            FailedSet failed;
+            failed.fileSet.run = std::stoi(fields[0]);
+            failed.fileSet.setNumber = std::stoi(fields[1]);
+            failed.fileSet.firstFile = fields[4];
+            failed.fileSet.subdirectory = fields.size() > 5 ? fields[5] : "";
+            failed.failures = std::stoi(fields[2]);
+            failed.quarantined = true;
+            failed.quarantinedAt = fields[3];
+            failed.quarantinedAtMs = fields.size() > 6 && !fields[6].empty() ? std::stoll(fields[6]) : 0;
+            sets[keyOf(failed.fileSet)] = failed;
+        }
+        catch (const std::exception &)
+        {
+            // 壊れた行は無視する
+        }
+    }
+    return sets;
+}
+
+void SetQuarantine::loadQuarantine()
+{
+    failedSets = readQuarantineFile();
+
+    size_t count = failedSets.size();
+    if (count > 0)
+    {
+        LOG("Quarantine: " << count << " set(s) stay quarantined from a previous run (" << outputDir << "/" << QUARANTINE_FILE_NAME
+            << ", retry with: archive_tool retry " << outputDir << " all)");
+    }
+}
+
+void SetQuarantine::saveQuarantine(const std::vector<RetryRequest> &applied)
+{
+    std::string path = outputDir + "/" + QUARANTINE_FILE_NAME;
+    std::string lockPath = path + ".lock";
+    bool locked = acquireQuarantineLock(lockPath);
+    if (!locked)
+    {
+        LOG("Warning: Quarantine list is locked by another instance, writing without the lock: " << lockPath);
+    }
+
+    // 他のインスタンスが隔離したセットを残し、再試行要求で解いたセットを消して、自分が隔離したセットを加える
+    std::map<SetKey, FailedSet> sets = readQuarantineFile();
+    for (auto it = sets.begin(); it != sets.end();)
+    {
+        bool released = std::any_of(applied.begin(), applied.end(), [&](const RetryRequest &request)
+                                    { return request.covers(it->first, it->second.quarantinedAtMs); });
+        it = released ? sets.erase(it) : std::next(it);
+    }
+    for (const auto &pair : failedSets)
+    {
+        if (pair.second.quarantined)
+            sets[pair.first] = pair.second;
+    }
+
+    std::string tempPath = path + ".tmp";
+    bool written = false;
+    {
+        std::ofstream file(tempPath, std::ios::trunc);
+        if (file)
+        {
+            file << "# run\tset\tfailures\tquarantined_at\tfirst_file\tsubdirectory\tquarantined_ms\n";
+            for (const auto &pair : sets)
+            {
+                const FailedSet &failed = pair.second;
+                file << zeroPad(failed.fileSet.run, 2) << '\t' << failed.fileSet.setNumber << '\t' << failed.failures << '\t'
+                     << failed.quarantinedAt << '\t' << failed.fileSet.firstFile << '\t' << failed.fileSet.subdirectory
+                     << '\t' << failed.quarantinedAtMs << '\n';
+            }
+            written = static_cast<bool>(file);
+        }
+    }
+
+    std::error_code ec;
+    if (!written)
+    {
+        LOG("Warning: Failed to write quarantine list: " << path);
+    }
+    else
+    {
+        fs::rename(tempPath, path, ec);
+        if (ec)
+        {
+            LOG("Warning: Failed to replace quarantine list: " << path << " (" << ec.message() << ")");
+        }
+    }
+    if (locked)
+        fs::remove(lockPath, ec);
+}
+
+bool SetQuarantine::recordFailure(const FileSet &fileSet)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    FailedSet &failed = failedSets[keyOf(fileSet)];
+    if (failed.quarantined)
+        return true;
+
+    failed.fileSet.run = fileSet.run;
+    failed.fileSet.setNumber = fileSet.setNumber;
+    failed.fileSet.firstFile = fileSet.firstFile;
+    failed.fileSet.subdirectory = fileSet.subdirectory;
+    failed.failures++;
+
+    std::string setName = (fileSet.subdirectory.empty() ? "" : fileSet.subdirectory + ", ") + "run " +
+                          std::to_string(fileSet.run) + ", set " + std::to_string(fileSet.setNumber);
+    if (quarantineAfter > 0 && failed.failures >= quarantineAfter)
+    {
+        failed.quarantined = true;
+        failed.quarantinedAt = getTimestamp();
+        failed.quarantinedAtMs = nowMs();
+        saveQuarantine();
+        size_t count = std::count_if(failedSets.begin(), failedSets.end(),
+                                     [](const std::pair<const SetKey, FailedSet> &pair) { return pair.second.quarantined; });
+        LOG("Quarantined set after " << failed.failures << " failures: " << setName << " (" << count
+            << " quarantined, retry with: archive_tool retry " << outputDir
+            << (fileSet.subdirectory.empty() ? "" : " --subdir=" + fileSet.subdirectory) << " " << fileSet.run << " "
+            << fileSet.setNumber << ")");
+        return true;
+    }
+
+    auto delay = std::min<std::chrono::seconds>(RETRY_BACKOFF_MAX, RETRY_BACKOFF_BASE * (1LL << std::min(failed.failures - 1, 16)));
+    failed.retryAt = std::chrono::steady_clock::now() + delay;
+    failed.requeued = false;
+    LOG("Set failed " << failed.failures << " time(s): " << setName << ", retrying in " << delay.count() << " s");
+    return false;
+}
+
+void SetQuarantine::recordSuccess(const FileSet &fileSet)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = failedSets.find(keyOf(fileSet));
+    if (it == failedSets.end() || it->second.quarantined)
+        return;
+    if (it->second.failures > 0)
+    {
+        LOG("Set succeeded after " << it->second.failures << " failure(s): "
+            << (fileSet.subdirectory.empty() ? "" : fileSet.subdirectory + ", ") << "run " << fileSet.run << ", set " << fileSet.setNumber);
+    }
+    failedSets.erase(it);
+}
+
+bool SetQuarantine::isHeld(const FileSet &fileSet)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = failedSets.find(keyOf(fileSet));
+    if (it == failedSets.end())
+        return false;
+    return it->second.quarantined || (!it->second.requeued && std::chrono::steady_clock::now() < it->second.retryAt);
+}
+
+std::vector<FileSet> SetQuarantine::takeDueSets()
+{
+    std::vector<FileSet> due;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &pair : failedSets)
+    {
+        FailedSet &failed = pair.second;
+        if (failed.quarantined || failed.requeued || now < failed.retryAt)
+            continue;
+        failed.requeued = true;
+        due.push_back(failed.fileSet);
+    }
+    return due;
+}
+
+std::vector<FileSet> SetQuarantine::takeRetryRequests()
+{
+    std::vector<FileSet> released;
+
+    // 前回読んだ位置から、改行まで書き終えた行だけを読む（archive_tool が追記している途中の行は次回に読む）
+    std::string path = outputDir + "/" + RETRY_REQUESTS_FILE_NAME;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+        return released;
+    uint64_t size = static_cast<uint64_t>(file.tellg());
+    if (size < retryRequestsOffset)
+        retryRequestsOffset = 0; // 手動で消して作り直された
+    if (size == retryRequestsOffset)
+        return released;
+
+    std::string text(size - retryRequestsOffset, '\0');
+    file.seekg(retryRequestsOffset);
+    if (!file.read(&text[0], text.size()))
+        return released;
+    size_t complete = text.rfind('\n');
+    if (complete == std::string::npos)
+        return released;
+    text.resize(complete + 1);
+    retryRequestsOffset += text.size();
+
+    // "@<エポックミリ秒>\t" に続けて "all" または "<run>\t<set>[\t<subdirectory>]"
+    std::vector<RetryRequest> requests;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+
+        RetryRequest request;
+        try
+        {
+            size_t tab = line.find('\t');
+            if (line[0] != '@' || tab == std::string::npos)
+                throw std::invalid_argument("missing time");
+            request.requestedAt = std::stoll(line.substr(1, tab - 1));
+            std::string body = line.substr(tab + 1);
+            if (body == "all")
+            {
+                request.all = true;
+            }
+            else
+            {
+                std::istringstream stream(body);
+                std::string run, setNumber, subdirectory;
+                std::getline(stream, run, '\t');
+                std::getline(stream, setNumber, '\t');
+                std::getline(stream, subdirectory);
+                request.key = SetKey(subdirectory, std::stoi(run), std::stoi(setNumber));
+            }
+        }
+        catch (const std::exception &)
+        {
+            LOG("Warning: Ignoring malformed retry request: " << line);
+            continue;
+        }
+        requests.push_back(request);
+    }
+    if (requests.empty())
+        return released;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &request : requests)
+    {
+        bool matched = false;
+        for (auto it = failedSets.begin(); it != failedSets.end();)
+        {
+            if (!it->second.quarantined || !request.covers(it->first, it->second.quarantinedAtMs))
+            {
+                ++it;
+                continue;
+            }
+            LOG("Retry requested: releasing quarantined set " << (std::get<0>(it->first).empty() ? "" : std::get<0>(it->first) + ", ")
+                << "run " << std::get<1>(it->first) << ", set " << std::get<2>(it->first));
+            released.push_back(it->second.fileSet);
+            it = failedSets.erase(it);
+            matched = true;
+        }
+
+        // 起動前の要求の読み直しでは該当しないのが普通なのでログに出さない
+        if (!matched && !request.all && request.requestedAt >= startedAtMs)
+        {
+            LOG("Retry request for a set not quarantined by this instance: run " << std::get<1>(request.key) << ", set "
+                << std::get<2>(request.key));
+        }
+    }
+
+    // 解いたセットと、一覧に残っている該当する行（隔離したインスタンスが終了している場合など）を一覧から消す
+    saveQuarantine(requests);
+    return released;
+}
+
+size_t SetQuarantine::getQuarantinedCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::count_if(failedSets.begin(), failedSets.end(),
+                         [](const std::pair<const SetKey, FailedSet> &pair) { return pair.second.quarantined; });
+}
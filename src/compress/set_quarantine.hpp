@@ -0,0 +1,97 @@
+#ifndef SET_QUARANTINE_HPP
+#define SET_QUARANTINE_HPP
+
+#include "file_set.hpp"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// 出力ディレクトリに置く隔離中のセットの一覧（タブ区切り）と、手動の再試行要求（archive_tool retry が追記する）
+// 再試行要求は "@<要求した時刻（エポックミリ秒）>\t<all | run\tset[\tsubdirectory]>" の行で、圧縮プログラムは消さずに
+// 前回読んだ位置から読み進める（--cooperative で出力ディレクトリを共有する全インスタンスが同じ要求を読む）
+constexpr const char *QUARANTINE_FILE_NAME = "compressor_quarantine.tsv";
+constexpr const char *RETRY_REQUESTS_FILE_NAME = "compressor_retry_requests.txt";
+
+// 処理に失敗したセットの再試行の管理
+// 失敗したセットはすぐにキューに戻さず、失敗の回数に応じて倍々に延ばした時間（上限あり）の後に戻す。
+// quarantineAfter回失敗したセットは隔離し、手動で再試行を要求されるまで処理しない
+// （読めないファイルなどで失敗し続けるセットが、他のセットの処理枠を使い続けないようにする）。
+// 隔離中のセットは出力ディレクトリの QUARANTINE_FILE_NAME に書き出し、再起動後も隔離したままにする。
+// 一覧は出力ディレクトリを共有する他のインスタンスも書くため、ロックファイルを排他的に作成してから読み直し、
+// 自分が隔離したセットの追加と、再試行要求で解いたセットの削除だけを反映する
+class SetQuarantine
+{
+private:
+    using SetKey = std::tuple<std::string, int, int>; // (subdirectory, run, setNumber)
+
+    // 手動の再試行要求（requestedAt より前に隔離したセットだけを解く。起動時に古い要求を読み直しても、
+    // その後に隔離したセットは解かない）
+    struct RetryRequest
+    {
+        int64_t requestedAt = 0; // エポックミリ秒
+        bool all = false;
+        SetKey key;
+
+        bool covers(const SetKey &setKey, int64_t quarantinedAtMs) const
+        {
+            return quarantinedAtMs < requestedAt && (all || key == setKey);
+        }
+    };
+
+    struct FailedSet
+    {
+        FileSet fileSet; // 再キュー用（ファイルの一覧は持たない）
+        int failures = 0;
+        bool quarantined = false;
+        bool requeued = true; // 再試行の時刻が来てキューに戻した
+        std::chrono::steady_clock::time_point retryAt;
+        std::string quarantinedAt; // 隔離した日時（一覧用）
+        int64_t quarantinedAtMs = 0; // 隔離した時刻（エポックミリ秒、再試行要求との比較用）
+    };
+
+    std::string outputDir;
+    int quarantineAfter;
+    std::map<SetKey, FailedSet> failedSets;
+    uint64_t retryRequestsOffset = 0; // 再試行要求のファイルを読み終えた位置
+    int64_t startedAtMs;              // これより前の再試行要求は起動時の読み直し（該当なしをログに出さない）
+    std::mutex mutex;
+
+    static SetKey keyOf(const FileSet &fileSet);
+
+    // 一覧のファイルを読む（key → 行）
+    std::map<SetKey, FailedSet> readQuarantineFile() const;
+
+    // 隔離中のセットの一覧を、他のインスタンスの行と合わせて書き出す（mutexを保持して呼ぶ）
+    // applied: 反映した再試行要求（該当する行を一覧から消す。隔離したインスタンスが終了している行も消す）
+    void saveQuarantine(const std::vector<RetryRequest> &applied = {});
+    // 前回までに隔離したセット（他のインスタンスが隔離したものを含む）を読み込む
+    void loadQuarantine();
+
+public:
+    // quarantineAfter: この回数失敗したセットを隔離する（0: 隔離せず再試行の間隔だけ延ばす）
+    SetQuarantine(const std::string &outputDir, int quarantineAfter);
+
+    // 失敗を記録する
+    // 戻り値: 隔離した場合true（falseの場合はtakeDueSetsで再試行の時刻に返す）
+    bool recordFailure(const FileSet &fileSet);
+
+    // 書き込みを終えたセットの失敗の記録を消す（一時的な失敗の回数を後の失敗に持ち越さない）
+    void recordSuccess(const FileSet &fileSet);
+
+    // 隔離中、または再試行の時刻を待っているセットならtrue（キューから取り出しても処理しない）
+    bool isHeld(const FileSet &fileSet);
+
+    // 再試行の時刻が来たセットを返す
+    std::vector<FileSet> takeDueSets();
+
+    // 前回から追記された手動の再試行要求を読み込み、隔離を解いたセットを返す（失敗の回数も戻す）
+    std::vector<FileSet> takeRetryRequests();
+
+    size_t getQuarantinedCount();
+};
+
+#endif // SET_QUARANTINE_HPP
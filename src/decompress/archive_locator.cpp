@@ -0,0 +1,152 @@
+#include "archive_locator.hpp"
+#include "../common/common.hpp"
+#include "../common/checksum.hpp"
+#include "../common/run_container.hpp"
+#include "../common/aligned_io.hpp"
+#include <iostream>
+
+ArchiveLocation::ArchiveLocation()
+    : inContainer(false), offset(0), size(0), checksum(0), hasChecksum(false), firstFrame(0), lastFrame(0)
+{
+}
+
+std::string ArchiveLocation::describe() const
+{
+    if (inContainer)
+    {
+        return path + " (set " + std::to_string(firstFrame) + ")";
+    }
+    return path;
+}
+
+ArchiveLocation locationFromCatalog(const ArchiveCatalog &catalog, const CatalogEntry &entry,
+                                    const std::vector<std::string> &inputRoots)
+{
+    ArchiveLocation location;
+    location.path = catalog.resolvePath(entry);
+    if (!fs::exists(location.path))
+    {
+        for (const auto &root : inputRoots)
+        {
+            fs::path candidate = fs::path(root) / entry.archive;
+            if (fs::exists(candidate))
+            {
+                location.path = candidate.string();
+                break;
+            }
+        }
+    }
+    location.inContainer = fs::path(entry.archive).extension() == ".lz4c";
+    location.offset = entry.offset;
+    location.size = entry.size;
+    location.checksum = entry.checksum;
+    location.hasChecksum = true;
+    location.firstFrame = entry.firstFrame;
+    location.lastFrame = entry.lastFrame;
+    return location;
+}
+
+bool locateArchive(const std::vector<std::string> &inputRoots, const std::string &prefix, int run, int setStart,
+                   ArchiveLocation &location, const ArchiveCatalog *catalog)
+{
+    // 1. カタログ（アーカイブを開かずに場所が分かる）
+    CatalogEntry entry;
+    if (catalog && catalog->findFrame(prefix, run, setStart, entry))
+    {
+        location = locationFromCatalog(*catalog, entry, inputRoots);
+        return true;
+    }
+
+    std::string prefixWithRun = prefix + "_" + zeroPad(run, 2);
+    for (const auto &inputDir : inputRoots)
+    {
+        // 2. 単独の.lz4ファイル
+        std::string archivePath = inputDir + "/" + prefixWithRun + "_" + zeroPad(setStart, 5) + ".lz4";
+        if (fs::exists(archivePath))
+        {
+            location = ArchiveLocation();
+            location.path = archivePath;
+            location.firstFrame = setStart;
+            return true;
+        }
+
+        // 3. ランコンテナ
+        std::string containerPath = getRunContainerPath(inputDir, prefixWithRun);
+        RunSegment segment;
+        if (fs::exists(containerPath) && findRunSegment(containerPath, setStart, segment))
+        {
+            location = ArchiveLocation();
+            location.path = containerPath;
+            location.inContainer = true;
+            location.offset = segment.offset;
+            location.size = segment.size;
+            location.checksum = segment.checksum;
+            location.hasChecksum = true;
+            location.firstFrame = setStart;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool readArchiveAt(const ArchiveLocation &location, AlignedBuffer &buffer, const char *&archiveData, size_t &archiveSize)
+{
+    // 範囲を指定して読み込み、チェックサムを検証する
+    // （--align-blocksのコンテナはセグメントの先頭が4 KiB境界なので、O_DIRECTで余分なく読める）
+    std::error_code ec;
+    uint64_t fileSize = fs::file_size(location.path, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Cannot open file: " << location.path << std::endl;
+        return false;
+    }
+
+    uint64_t size = location.size;
+    if (size == 0)
+    {
+        size = fileSize - location.offset;
+    }
+
+    // 単独の.lz4ファイルが登録時より大きい場合は、後から届いたフレームが追記されている
+    // （カタログの更新前に読んだ場合など）。ファイル全体を読んで最新のインデックスを使う
+    uint64_t readSize = size;
+    if (!location.inContainer && fileSize > location.offset + size)
+    {
+        readSize = fileSize - location.offset;
+    }
+
+    if (location.offset + size > fileSize ||
+        !readFileRangeDirect(location.path, location.offset, readSize, buffer, archiveData))
+    {
+        std::cerr << "Error: Failed to read archive: " << location.describe() << std::endl;
+        return false;
+    }
+
+    // 追記は既存のバイト列を変えないため、登録時の範囲のチェックサムで検証できる
+    if (location.hasChecksum && computeChecksum64(archiveData, size) != location.checksum)
+    {
+        std::cerr << "Error: Archive checksum mismatch: " << location.describe() << std::endl;
+        return false;
+    }
+
+    archiveSize = static_cast<size_t>(readSize);
+    return true;
+}
+
+std::vector<FileEntry> decompressArchiveAt(const ArchiveLocation &location)
+{
+    if (!location.inContainer && !location.hasChecksum)
+    {
+        return decompressLZ4Archive(location.path);
+    }
+
+    AlignedBuffer buffer;
+    const char *archiveData = nullptr;
+    size_t archiveSize = 0;
+    if (!readArchiveAt(location, buffer, archiveData, archiveSize))
+    {
+        return std::vector<FileEntry>();
+    }
+    return decompressLZ4ArchiveBuffer(archiveData, archiveSize);
+}
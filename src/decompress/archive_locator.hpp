@@ -0,0 +1,50 @@
+#ifndef ARCHIVE_LOCATOR_HPP
+#define ARCHIVE_LOCATOR_HPP
+
+#include "lz4_decompressor.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/aligned_io.hpp"
+#include <string>
+#include <vector>
+
+// アーカイブの格納場所（単独の.lz4ファイル、またはランコンテナ内のセグメント）
+struct ArchiveLocation
+{
+    std::string path;    // .lz4 または .lz4c のパス
+    bool inContainer;    // ランコンテナ内のセグメントならtrue
+    uint64_t offset;     // ファイル内のアーカイブ先頭位置
+    uint64_t size;       // アーカイブのバイト数（0の場合はファイル全体）
+    uint64_t checksum;   // アーカイブのチェックサム（hasChecksumの場合のみ有効）
+    bool hasChecksum;
+    int firstFrame;      // アーカイブに含まれる最初のファイル番号
+    int lastFrame;       // アーカイブに含まれる最後のファイル番号（不明な場合は0）
+
+    ArchiveLocation();
+
+    // ログ表示用の名前
+    std::string describe() const;
+};
+
+/// セットの先頭番号からアーカイブを探す
+/// カタログがあればカタログを参照し、なければ各入力ディレクトリで単独の.lz4ファイル（<prefix>_<run>_<番号>.lz4）、
+/// ランコンテナ（<prefix>_<run>.lz4c）の順に探す
+/// @param inputRoots: 入力ディレクトリ（出力を複数のディレクトリに振り分けた場合はそのすべて）
+/// @param catalog: 読み込み済みのカタログ（ない場合はnullptr）
+/// @return 見つかった場合true
+bool locateArchive(const std::vector<std::string> &inputRoots, const std::string &prefix, int run, int setStart,
+                   ArchiveLocation &location, const ArchiveCatalog *catalog = nullptr);
+
+/// カタログのエントリから格納場所を作成
+/// 記録された場所にファイルがない場合（別のマウント位置など）は、各入力ディレクトリで同じ相対パスを探す
+ArchiveLocation locationFromCatalog(const ArchiveCatalog &catalog, const CatalogEntry &entry,
+                                    const std::vector<std::string> &inputRoots);
+
+/// アーカイブのバイト列を読み込む（カタログのチェックサムがあれば検証する）
+/// archiveData: buffer内のアーカイブの先頭、archiveSize: バイト数（後から届いたフレームが追記されていればその分を含む）
+/// @return 読み込めた場合true
+bool readArchiveAt(const ArchiveLocation &location, AlignedBuffer &buffer, const char *&archiveData, size_t &archiveSize);
+
+/// アーカイブを解凍してメモリ上に展開する（格納場所の種類を問わない）
+std::vector<FileEntry> decompressArchiveAt(const ArchiveLocation &location);
+
+#endif // ARCHIVE_LOCATOR_HPP
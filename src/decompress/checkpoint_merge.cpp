@@ -0,0 +1,345 @@
+#include "checkpoint_merge.hpp"
+#include "tiff_processor.hpp"
+#include "../common/common.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/frame_checkpoint.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+
+namespace
+{
+    // 内容を確認したチェックポイント
+    struct CheckpointRef
+    {
+        const BlockEntry *block;
+        int lastFrame;
+    };
+
+    // 累積和 S(x)（baseFrameからxまでのフレームの和）の求め方
+    struct PrefixPlan
+    {
+        const CheckpointRef *checkpoint = nullptr; // nullptrの場合はbaseFrameから直接足す
+        size_t cost = 0;                           // 復号するブロック数
+        bool cached = false;                       // 直前に求めたS(x)を使う
+    };
+
+    class CheckpointMerger
+    {
+    private:
+        const char *archiveData;
+        std::map<int, const BlockEntry *> frames;               // フレーム番号 -> ブロック
+        std::map<int, std::vector<CheckpointRef>> checkpoints; // baseFrame -> チェックポイント（lastFrame順）
+        size_t pixelCount = 0;
+
+        // 直前に求めた累積和（隣のグループの下端と上端は同じ位置になる）
+        int cachedBase = 0;
+        int cachedFrame = 0;
+        std::vector<double> cachedPrefix;
+
+    public:
+        size_t decodedFrames = 0;
+        size_t decodedCheckpoints = 0;
+
+        explicit CheckpointMerger(const char *archiveData) : archiveData(archiveData) {}
+
+        size_t getFrameCount() const { return frames.size(); }
+        bool hasCheckpoints() const { return !checkpoints.empty(); }
+
+        // インデックスからフレームとチェックポイントを集める
+        // チェックポイントは復号して、和に含まれるフレームが現在のインデックスと一致するものだけを使う
+        bool load(const std::vector<BlockEntry> &blocks, const std::string &prefix_with_run)
+        {
+            std::vector<const BlockEntry *> checkpointBlocks;
+            for (const auto &block : blocks)
+            {
+                if (block.kind == BlockKind::Checkpoint)
+                {
+                    checkpointBlocks.push_back(&block);
+                }
+                else if (block.kind == BlockKind::File)
+                {
+                    int frame = getFrameNumber(block.name);
+                    if (frame < 0 || block.name.compare(0, prefix_with_run.size(), prefix_with_run) != 0)
+                        return false;
+                    frames[frame] = &block;
+                }
+            }
+
+            for (const BlockEntry *block : checkpointBlocks)
+            {
+                FrameCheckpoint checkpoint;
+                if (!readCheckpoint(*block, checkpoint))
+                    continue;
+
+                std::vector<uint64_t> rawChecksums;
+                for (auto it = frames.lower_bound(checkpoint.baseFrame);
+                     it != frames.end() && it->first <= checkpoint.lastFrame; ++it)
+                {
+                    rawChecksums.push_back(it->second->rawChecksum);
+                }
+                if (rawChecksums.size() != checkpoint.frameCount ||
+                    computeFramesChecksum(rawChecksums) != checkpoint.framesChecksum)
+                {
+                    continue;
+                }
+                if (pixelCount == 0)
+                    pixelCount = checkpoint.sums.size();
+                if (checkpoint.sums.size() != pixelCount)
+                    continue;
+
+                checkpoints[checkpoint.baseFrame].push_back(CheckpointRef{block, checkpoint.lastFrame});
+            }
+            for (auto &group : checkpoints)
+            {
+                std::sort(group.second.begin(), group.second.end(), [](const CheckpointRef &a, const CheckpointRef &b)
+                          { return a.lastFrame < b.lastFrame; });
+            }
+            return true;
+        }
+
+        // (lo, hi] のフレーム数
+        size_t countFrames(int lo, int hi) const
+        {
+            if (hi <= lo)
+                return 0;
+            return std::distance(frames.upper_bound(lo), frames.upper_bound(hi));
+        }
+
+        // フレームを復号して FileEntry にする
+        bool decodeFrame(const BlockEntry &block, FileEntry &entry)
+        {
+            entry.name = block.name;
+            if (!decodeAndVerifyBlock(block, archiveData + block.offset, entry.data))
+            {
+                std::cerr << "Error: Failed to decode block: " << block.name << std::endl;
+                return false;
+            }
+            decodedFrames++;
+            return true;
+        }
+
+        // 最初のフレーム（出力するTIFFのヘッダーの元）
+        bool decodeFirstFrame(int fromFrame, FileEntry &entry, uint32_t &width, uint32_t &height)
+        {
+            auto it = frames.lower_bound(fromFrame);
+            if (it == frames.end())
+                it = frames.begin();
+            std::vector<float> image;
+            if (!decodeFrame(*it->second, entry) || !readTiffFloat(entry, image, width, height))
+                return false;
+            if (pixelCount == 0)
+                pixelCount = image.size();
+            return image.size() == pixelCount;
+        }
+
+        // S(x) の求め方を選ぶ（x < baseFrame の場合は0）
+        PrefixPlan planPrefix(int baseFrame, int x) const
+        {
+            PrefixPlan plan;
+            if (x < baseFrame)
+                return plan;
+            if (!cachedPrefix.empty() && cachedBase == baseFrame && cachedFrame == x)
+            {
+                plan.cached = true;
+                return plan;
+            }
+
+            plan.cost = countFrames(baseFrame - 1, x);
+            auto group = checkpoints.find(baseFrame);
+            if (group == checkpoints.end())
+                return plan;
+            for (const auto &checkpoint : group->second)
+            {
+                size_t cost = 1 + countFrames(std::min(checkpoint.lastFrame, x), std::max(checkpoint.lastFrame, x));
+                if (cost < plan.cost)
+                {
+                    plan.checkpoint = &checkpoint;
+                    plan.cost = cost;
+                }
+            }
+            return plan;
+        }
+
+        // (lo, hi] のフレームを sign 倍して sum に加える
+        bool addFrames(int lo, int hi, double sign, std::vector<double> &sum)
+        {
+            if (hi <= lo)
+                return true;
+            for (auto it = frames.upper_bound(lo); it != frames.end() && it->first <= hi; ++it)
+            {
+                FileEntry entry;
+                std::vector<float> image;
+                uint32_t width = 0, height = 0;
+                if (!decodeFrame(*it->second, entry) || !readTiffFloat(entry, image, width, height) ||
+                    image.size() != sum.size())
+                {
+                    std::cerr << "Image size mismatch or read failure: " << it->second->name << std::endl;
+                    return false;
+                }
+                for (size_t p = 0; p < image.size(); p++)
+                {
+                    sum[p] += sign * image[p];
+                }
+            }
+            return true;
+        }
+
+        // S(x) を sign 倍して sum に加える
+        bool addPrefix(int baseFrame, int x, const PrefixPlan &plan, double sign, std::vector<double> &sum)
+        {
+            if (x < baseFrame)
+                return true;
+
+            // 計画後に保持している値が変わっていれば求め直す
+            if (plan.cached && (cachedBase != baseFrame || cachedFrame != x))
+                return addPrefix(baseFrame, x, planPrefix(baseFrame, x), sign, sum);
+
+            std::vector<double> prefix;
+            if (plan.cached)
+            {
+                prefix = cachedPrefix;
+            }
+            else
+            {
+                prefix.assign(sum.size(), 0.0);
+                if (!plan.checkpoint)
+                {
+                    if (!addFrames(baseFrame - 1, x, 1.0, prefix))
+                        return false;
+                }
+                else
+                {
+                    FrameCheckpoint checkpoint;
+                    if (!readCheckpoint(*plan.checkpoint->block, checkpoint) || checkpoint.sums.size() != sum.size())
+                        return false;
+                    decodedCheckpoints++;
+                    for (size_t p = 0; p < prefix.size(); p++)
+                        prefix[p] = static_cast<double>(checkpoint.sums[p]);
+
+                    int lastFrame = plan.checkpoint->lastFrame;
+                    bool ok = lastFrame <= x ? addFrames(lastFrame, x, 1.0, prefix) : addFrames(x, lastFrame, -1.0, prefix);
+                    if (!ok)
+                        return false;
+                }
+            }
+
+            for (size_t p = 0; p < sum.size(); p++)
+                sum[p] += sign * prefix[p];
+
+            cachedBase = baseFrame;
+            cachedFrame = x;
+            cachedPrefix = std::move(prefix);
+            return true;
+        }
+
+        // 窓 [a, b] の和を求める
+        bool sumWindow(int a, int b, std::vector<double> &sum)
+        {
+            // 直接足す場合と、各baseFrameのチェックポイントを使う場合で復号するブロック数を比べる
+            size_t bestCost = countFrames(a - 1, b);
+            int bestBase = 0;
+            PrefixPlan bestUpper, bestLower;
+            bool useCheckpoints = false;
+            for (const auto &group : checkpoints)
+            {
+                int baseFrame = group.first;
+                if (b < baseFrame)
+                    continue;
+                // baseFrameより前のフレームは直接足す
+                int lowerEnd = std::max(a - 1, baseFrame - 1);
+                PrefixPlan upper = planPrefix(baseFrame, b);
+                PrefixPlan lower = planPrefix(baseFrame, lowerEnd);
+                size_t cost = countFrames(a - 1, std::min(b, baseFrame - 1)) + upper.cost + lower.cost;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestBase = baseFrame;
+                    bestUpper = upper;
+                    bestLower = lower;
+                    useCheckpoints = true;
+                }
+            }
+
+            if (!useCheckpoints)
+                return addFrames(a - 1, b, 1.0, sum);
+
+            // 下端を先に求める（直前のグループの上端と同じ位置なら保持している値を使う）
+            int lowerEnd = std::max(a - 1, bestBase - 1);
+            return addFrames(a - 1, std::min(b, bestBase - 1), 1.0, sum) &&
+                   addPrefix(bestBase, lowerEnd, bestLower, -1.0, sum) &&
+                   addPrefix(bestBase, b, bestUpper, 1.0, sum);
+        }
+
+    private:
+        bool readCheckpoint(const BlockEntry &block, FrameCheckpoint &checkpoint) const
+        {
+            std::vector<char> raw;
+            return decodeAndVerifyBlock(block, archiveData + block.offset, raw) &&
+                   deserializeCheckpoint(raw.data(), raw.size(), checkpoint);
+        }
+    };
+}
+
+bool mergeTiffFilesWithCheckpoints(const char *archiveData, size_t archiveSize,
+                                   const std::string &prefix_with_run,
+                                   const int first, const int last,
+                                   MergeWindows &windows,
+                                   std::vector<FileEntry> &sidecars)
+{
+    std::vector<BlockEntry> blocks;
+    if (!isBlockArchive(archiveData, archiveSize) || !readBlockArchiveIndex(archiveData, archiveSize, blocks))
+        return false;
+    if (std::none_of(blocks.begin(), blocks.end(), [](const BlockEntry &block)
+                     { return block.kind == BlockKind::Checkpoint; }))
+        return false;
+
+    CheckpointMerger merger(archiveData);
+    if (!merger.load(blocks, prefix_with_run) || !merger.hasCheckpoints())
+        return false;
+
+    int firstWindow = 0, lastWindow = -1;
+    windows.windowsOverlapping(first, last, firstWindow, lastWindow);
+    if (firstWindow > lastWindow ||
+        merger.countFrames(std::max(first, windows.windowFirst(firstWindow)) - 1,
+                           std::min(last, windows.windowLast(lastWindow))) == 0)
+        return false;
+
+    FileEntry originalTiffEntry;
+    uint32_t width = 0, height = 0;
+    if (!merger.decodeFirstFrame(std::max(first, windows.windowFirst(firstWindow)), originalTiffEntry, width, height))
+        return false;
+
+    for (int i = firstWindow; i <= lastWindow; i++)
+    {
+        // 窓のうちこのアーカイブに含まれる範囲だけを足す（残りは隣のアーカイブから加わる）
+        int windowFirst = std::max(windows.windowFirst(i), first);
+        int windowLast = std::min(windows.windowLast(i), last);
+        std::vector<double> sum(static_cast<size_t>(width) * height, 0.0);
+        if (merger.countFrames(windowFirst - 1, windowLast) == 0 || !merger.sumWindow(windowFirst, windowLast, sum))
+        {
+            windows.add(i, first, last, std::vector<float>(), 0, 0, nullptr);
+            continue;
+        }
+
+        windows.add(i, first, last, std::vector<float>(sum.begin(), sum.end()), width, height, &originalTiffEntry);
+    }
+
+    for (const auto &block : blocks)
+    {
+        if (block.kind != BlockKind::Sidecar)
+            continue;
+        FileEntry entry;
+        entry.name = block.name;
+        entry.sidecar = true;
+        if (decodeAndVerifyBlock(block, archiveData + block.offset, entry.data))
+            sidecars.push_back(std::move(entry));
+        else
+            std::cerr << "Error: Failed to decode block: " << block.name << std::endl;
+    }
+
+    std::cout << "Merged with checkpoints: decoded " << merger.decodedFrames << " of " << merger.getFrameCount()
+              << " frame(s) and " << merger.decodedCheckpoints << " checkpoint(s)" << std::endl;
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef CHECKPOINT_MERGE_HPP
+#define CHECKPOINT_MERGE_HPP
+
+#include "lz4_decompressor.hpp"
+#include "merge_windows.hpp"
+#include <string>
+#include <vector>
+
+/// チェックポイント（フレームの累積和画像、frame_checkpoint.hpp）を使ってマージする
+/// 各グループの和を2つのチェックポイントの差と、チェックポイントの位置からずれた分のフレームだけで求める
+/// （直接足す方が復号するフレームが少ないグループは直接足す）。窓と出力はmergeTiffFilesWithLibTiffと同じ
+/// @param archiveData: ブロック形式アーカイブのバイト列
+/// @param first, last: アーカイブが含むフレームの範囲（窓のうちこの範囲だけを足す）
+/// @param sidecars: アーカイブに同梱された付随ファイルの出力先
+/// @return 使えるチェックポイントがあり、マージを出力した場合true
+///         （falseの場合は何も出力していないので、呼び出し側で全フレームを復号してマージする）
+bool mergeTiffFilesWithCheckpoints(const char *archiveData, size_t archiveSize,
+                                   const std::string &prefix_with_run,
+                                   const int first, const int last,
+                                   MergeWindows &windows,
+                                   std::vector<FileEntry> &sidecars);
+
+#endif // CHECKPOINT_MERGE_HPP
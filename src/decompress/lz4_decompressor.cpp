@@ -1,5 +1,7 @@
 #include "lz4_decompressor.hpp"
 #include "../common/common.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/aligned_io.hpp"
 #include <lz4.h>
 #include <fstream>
 #include <iostream>
@@ -132,71 +134,142 @@ std::vector<FileEntry> decompressLZ4Archive(const std::string& lz4FilePath)
     
     try
     {
-        // 1. ファイルを開く
-        std::ifstream inFile(lz4FilePath, std::ios::binary);
-        if (!inFile)
+        // 1. ファイル全体を読み込む（一度しか読まないのでページキャッシュを経由しないO_DIRECTで読む）
+        std::error_code ec;
+        uint64_t fileSize = fs::file_size(lz4FilePath, ec);
+        if (ec)
         {
             std::cerr << "Error: Cannot open file: " << lz4FilePath << std::endl;
             return entries;
         }
+
+        AlignedBuffer buffer;
+        const char* archiveData = nullptr;
+        if (!readFileRangeDirect(lz4FilePath, 0, fileSize, buffer, archiveData))
+        {
+            std::cerr << "Error: Failed to read archive: " << lz4FilePath << std::endl;
+            return entries;
+        }
+        
+        // 2. メモリ上で解凍
+        return decompressLZ4ArchiveBuffer(archiveData, static_cast<size_t>(fileSize));
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Exception: " << e.what() << std::endl;
+        entries.clear();
+    }
+    
+    return entries;
+}
+
+// ブロック形式アーカイブ（v2）を解凍する
+static std::vector<FileEntry> decompressBlockArchiveBuffer(const char* archiveData, size_t archiveSize)
+{
+    std::vector<FileEntry> entries;
+
+    std::vector<BlockEntry> blocks;
+    if (!readBlockArchiveIndex(archiveData, archiveSize, blocks))
+    {
+        std::cerr << "Error: Failed to read block archive index" << std::endl;
+        return entries;
+    }
+
+    for (const auto& block : blocks)
+    {
+        if (block.kind != BlockKind::File && block.kind != BlockKind::Sidecar)
+            continue;
+
+        FileEntry entry;
+        entry.name = block.name;
+        entry.sidecar = (block.kind == BlockKind::Sidecar);
+        if (!decodeAndVerifyBlock(block, archiveData + block.offset, entry.data))
+        {
+            std::cerr << "Error: Failed to decode block: " << block.name
+                      << " (" << blockCodecName(block.codec) << ")" << std::endl;
+            entries.clear();
+            return entries;
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    return entries;
+}
+
+std::vector<FileEntry> decompressLZ4ArchiveBuffer(const std::vector<char>& archiveData)
+{
+    return decompressLZ4ArchiveBuffer(archiveData.data(), archiveData.size());
+}
+
+std::vector<FileEntry> decompressLZ4ArchiveBuffer(const char* archiveData, size_t archiveSize)
+{
+    std::vector<FileEntry> entries;
+
+    // 先頭のマジックナンバーでv2（ブロック形式）を判別する
+    // （v1の先頭はメタデータのサイズなので、このマジックナンバーと一致することはない）
+    if (isBlockArchive(archiveData, archiveSize))
+    {
+        return decompressBlockArchiveBuffer(archiveData, archiveSize);
+    }
+    
+    try
+    {
+        size_t offset = 0;
         
-        // 2. メタデータのサイズを読み込む
+        // 1. メタデータのサイズを読み込む
         uint64_t metadataSize;
-        inFile.read(reinterpret_cast<char*>(&metadataSize), sizeof(uint64_t));
-        if (!inFile)
+        if (archiveSize < offset + sizeof(uint64_t))
         {
             std::cerr << "Error: Failed to read metadata size" << std::endl;
             return entries;
         }
+        std::memcpy(&metadataSize, archiveData + offset, sizeof(uint64_t));
+        offset += sizeof(uint64_t);
         
-        // 3. メタデータを読み込む
-        std::vector<char> metadataBuffer(metadataSize);
-        inFile.read(metadataBuffer.data(), metadataSize);
-        if (!inFile)
+        // 2. メタデータをデシリアライズ
+        if (archiveSize < offset + metadataSize)
         {
             std::cerr << "Error: Failed to read metadata" << std::endl;
             return entries;
         }
         
-        // 4. メタデータをデシリアライズ
         std::vector<FileMetadata> metadata;
-        if (!deserializeMetadata(metadataBuffer.data(), metadataSize, metadata))
+        if (!deserializeMetadata(archiveData + offset, metadataSize, metadata))
         {
             std::cerr << "Error: Failed to deserialize metadata" << std::endl;
             return entries;
         }
+        offset += metadataSize;
         
-        // 5. 圧縮データのサイズを読み込む
+        // 3. 圧縮データのサイズを読み込む
         uint64_t compressedSize;
-        inFile.read(reinterpret_cast<char*>(&compressedSize), sizeof(uint64_t));
-        if (!inFile)
+        if (archiveSize < offset + sizeof(uint64_t))
         {
             std::cerr << "Error: Failed to read compressed data size" << std::endl;
             return entries;
         }
+        std::memcpy(&compressedSize, archiveData + offset, sizeof(uint64_t));
+        offset += sizeof(uint64_t);
         
-        // 6. 圧縮データを読み込む
-        std::vector<char> compressedData(compressedSize);
-        inFile.read(compressedData.data(), compressedSize);
-        if (!inFile)
+        // 4. 圧縮データの範囲を確認
+        if (archiveSize < offset + compressedSize)
         {
             std::cerr << "Error: Failed to read compressed data" << std::endl;
             return entries;
         }
+        const char* compressedData = archiveData + offset;
         
-        inFile.close();
-        
-        // 7. 解凍後のデータサイズを計算
+        // 5. 解凍後のデータサイズを計算
         size_t totalUncompressedSize = 0;
         for (const auto& meta : metadata)
         {
             totalUncompressedSize += meta.originalSize;
         }
         
-        // 8. LZ4解凍
+        // 6. LZ4解凍
         std::vector<char> uncompressedData(totalUncompressedSize);
         int decompressedSize = LZ4_decompress_safe(
-            compressedData.data(),
+            compressedData,
             uncompressedData.data(),
             static_cast<int>(compressedSize),
             static_cast<int>(totalUncompressedSize)
@@ -214,7 +287,7 @@ std::vector<FileEntry> decompressLZ4Archive(const std::string& lz4FilePath)
             return entries;
         }
         
-        // 9. 各ファイルのデータを分割してFileEntryに格納
+        // 7. 各ファイルのデータを分割してFileEntryに格納
         for (const auto& meta : metadata)
         {
             FileEntry entry;
@@ -237,4 +310,3 @@ std::vector<FileEntry> decompressLZ4Archive(const std::string& lz4FilePath)
     
     return entries;
 }
-
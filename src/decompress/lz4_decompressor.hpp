@@ -23,6 +23,7 @@ struct FileEntry
 {
     std::string name;       // 元のファイル名
     std::vector<char> data; // ファイルの中身（バイナリデータ）
+    bool sidecar = false;   // runの付随ファイル（.finfなど、v2のBlockKind::Sidecar）
 };
 
 /// LZ4アーカイブファイルを解凍してメモリ上に展開する関数
@@ -30,5 +31,12 @@ struct FileEntry
 /// @return FileEntryのvector
 std::vector<FileEntry> decompressLZ4Archive(const std::string& lz4FilePath);
 
+/// メモリ上のLZ4アーカイブ（.lz4ファイルの内容、またはランコンテナのセグメント）を解凍する関数
+/// v1（セット全体を1つのLZ4ブロック）とv2（ファイルごとのブロック）の両方に対応
+/// @param archiveData: アーカイブのバイト列
+/// @return FileEntryのvector
+std::vector<FileEntry> decompressLZ4ArchiveBuffer(const std::vector<char>& archiveData);
+std::vector<FileEntry> decompressLZ4ArchiveBuffer(const char* archiveData, size_t archiveSize);
+
 #endif // LZ4_DECOMPRESSOR_HPP
 
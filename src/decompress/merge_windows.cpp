@@ -0,0 +1,105 @@
+#include "merge_windows.hpp"
+#include "tiff_processor.hpp"
+#include "../common/common.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+MergeWindows::MergeWindows(const std::string &outputFolder, const std::string &prefix_with_run, int s_img, int e_img,
+                           int integ_frame_num)
+    : outputFolder(outputFolder), prefix_with_run(prefix_with_run), s_img(s_img), e_img(e_img),
+      integ_frame_num(std::max(1, integ_frame_num))
+{
+    int incre_num = e_img - s_img + 1;
+    windowCount = std::max(0, static_cast<int>(std::round(double(incre_num) / this->integ_frame_num)));
+}
+
+int MergeWindows::windowLast(int window) const
+{
+    return std::min(windowFirst(window) + integ_frame_num - 1, e_img);
+}
+
+void MergeWindows::windowsOverlapping(int first, int last, int &firstWindow, int &lastWindow) const
+{
+    first = std::max(first, s_img);
+    last = std::min(last, e_img);
+    firstWindow = (first - s_img) / integ_frame_num;
+    lastWindow = std::min((last - s_img) / integ_frame_num, windowCount - 1);
+    if (first > last)
+        lastWindow = firstWindow - 1;
+}
+
+void MergeWindows::write(int window, std::vector<float> &sum, uint32_t width, uint32_t height, const FileEntry *header)
+{
+    int outputNumber = (windowFirst(window) - 1) / integ_frame_num + 1;
+    if (sum.empty() || !header)
+    {
+        std::cerr << "Failed to initialize group " << zeroPad(outputNumber, 5) << std::endl;
+        return;
+    }
+    writeMergedImage(sum, width, height, outputFolder, prefix_with_run, outputNumber, integ_frame_num, header);
+}
+
+void MergeWindows::add(int window, int first, int last, std::vector<float> &&sum, uint32_t width, uint32_t height,
+                       const FileEntry *header)
+{
+    int covered = std::min(last, windowLast(window)) - std::max(first, windowFirst(window)) + 1;
+    int length = windowLast(window) - windowFirst(window) + 1;
+    if (covered <= 0)
+        return;
+
+    // 窓全体が1つのアーカイブに含まれる場合はそのまま出力する
+    if (covered >= length)
+    {
+        write(window, sum, width, height, header);
+        return;
+    }
+
+    PendingWindow complete;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PendingWindow &entry = pending[window];
+        if (!sum.empty() && entry.sum.empty())
+        {
+            entry.sum = std::move(sum);
+            entry.width = width;
+            entry.height = height;
+            entry.header = *header;
+            entry.hasHeader = true;
+        }
+        else if (!sum.empty() && sum.size() != entry.sum.size())
+        {
+            std::cerr << "Image size mismatch in merge group " << zeroPad((windowFirst(window) - 1) / integ_frame_num + 1, 5)
+                      << std::endl;
+        }
+        else
+        {
+            for (size_t p = 0; p < sum.size(); p++)
+                entry.sum[p] += sum[p];
+        }
+        entry.coveredFrames += covered;
+        if (entry.coveredFrames < length)
+            return;
+
+        complete = std::move(entry);
+        pending.erase(window);
+    }
+    write(window, complete.sum, complete.width, complete.height, complete.hasHeader ? &complete.header : nullptr);
+}
+
+void MergeWindows::flush()
+{
+    std::map<int, PendingWindow> remaining;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining.swap(pending);
+    }
+    for (auto &item : remaining)
+    {
+        std::cerr << "Warning: Merge group " << prefix_with_run << zeroPad(windowFirst(item.first), 5) << "-"
+                  << zeroPad(windowLast(item.first), 5) << " is missing frames (" << item.second.coveredFrames << " of "
+                  << windowLast(item.first) - windowFirst(item.first) + 1 << " found)" << std::endl;
+        write(item.first, item.second.sum, item.second.width, item.second.height,
+              item.second.hasHeader ? &item.second.header : nullptr);
+    }
+}
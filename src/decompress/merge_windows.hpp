@@ -0,0 +1,68 @@
+#ifndef MERGE_WINDOWS_HPP
+#define MERGE_WINDOWS_HPP
+
+#include "lz4_decompressor.hpp"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// マージ（実行タイプ 1）の窓
+// 窓はrun全体で s_img から integ_frame_num フレームずつ区切り（k番目の窓は s_img + k * integ_frame_num から）、
+// 出力ファイルの番号は (窓の先頭フレーム - 1) / integ_frame_num + 1 にする（アーカイブの境界によらない）。
+// セットの境界が窓とずれる場合（--target-set-mb、まとめる前のマイクロセット）は、窓の一部を含む各アーカイブのフレームの和を
+// 足し合わせ、窓のフレームの範囲を含むアーカイブがすべて届いた時点で出力する。解凍スレッドから並行して呼ばれる
+class MergeWindows
+{
+private:
+    // 一部のアーカイブの和だけが届いた窓
+    struct PendingWindow
+    {
+        std::vector<float> sum;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int coveredFrames = 0; // 届いたアーカイブが含むフレームの範囲の長さ
+        FileEntry header;      // 出力に使う元のTIFF（最初に届いた和のもの）
+        bool hasHeader = false;
+    };
+
+    std::string outputFolder;
+    std::string prefix_with_run;
+    int s_img;
+    int e_img;
+    int integ_frame_num;
+    int windowCount;
+    std::map<int, PendingWindow> pending;
+    std::mutex mutex;
+
+    // 窓の和を出力する（不感画素の置き換えを含む。フレームが1つもない場合は出力しない）
+    void write(int window, std::vector<float> &sum, uint32_t width, uint32_t height, const FileEntry *header);
+
+public:
+    MergeWindows(const std::string &outputFolder, const std::string &prefix_with_run, int s_img, int e_img,
+                 int integ_frame_num);
+
+    int getFrameCount() const { return integ_frame_num; }
+
+    // 出力する窓の数（s_img〜e_img のフレーム数を integ_frame_num で割って丸めた数）
+    int getWindowCount() const { return windowCount; }
+
+    // 窓のフレームの範囲（e_img を超えない）
+    int windowFirst(int window) const { return s_img + window * integ_frame_num; }
+    int windowLast(int window) const;
+
+    // [first, last] と重なる窓の範囲（重なる窓がない場合 firstWindow > lastWindow）
+    void windowsOverlapping(int first, int last, int &firstWindow, int &lastWindow) const;
+
+    // 窓のうち [first, last] の範囲のフレームの和を加える（アーカイブごとに、窓と重なる範囲で1回呼ぶ）
+    // 範囲にフレームがなかった場合は sum を空、header を nullptr にする（範囲が届いたことだけを記録する）
+    // 窓の範囲がすべて届いた場合は出力する
+    void add(int window, int first, int last, std::vector<float> &&sum, uint32_t width, uint32_t height,
+             const FileEntry *header);
+
+    // 範囲が揃わなかった窓（アーカイブが見つからないフレームがある場合）を、届いた分の和で出力する
+    void flush();
+};
+
+#endif // MERGE_WINDOWS_HPP
@@ -37,20 +37,14 @@ std::vector<std::string> search_finf_files(const std::string& directory) {
     return finf_files;
 }
 
-void process_finf_file(const std::string& input_path, const std::string& output_path) {
-    std::ifstream file(input_path);
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot open file '" << input_path << "'" << std::endl;
-        return;
-    }
-    
+std::string convert_finf_content(const std::string& content) {
     std::vector<std::string> lines;
+    std::istringstream input(content);
     std::string line;
     
-    while (std::getline(file, line)) {
+    while (std::getline(input, line)) {
         lines.push_back(line);
     }
-    file.close();
     
     for (size_t i = 0; i < lines.size(); ++i) {
         std::istringstream iss(lines[i]);
@@ -84,6 +78,14 @@ void process_finf_file(const std::string& input_path, const std::string& output_
         }
     }
     
+    std::ostringstream output;
+    for (const auto& l : lines) {
+        output << l << "\n";
+    }
+    return output.str();
+}
+
+bool write_finf_file(const std::string& output_path, const std::string& content) {
     fs::path output_file_path(output_path);
     fs::path output_dir = output_file_path.parent_path();
     if (!output_dir.empty() && !fs::exists(output_dir)) {
@@ -93,13 +95,26 @@ void process_finf_file(const std::string& input_path, const std::string& output_
     std::ofstream out_file(output_path);
     if (!out_file.is_open()) {
         std::cerr << "Error: Cannot open file for writing '" << output_path << "'" << std::endl;
-        return;
+        return false;
     }
     
-    for (const auto& l : lines) {
-        out_file << l << std::endl;
-    }
+    out_file << content;
     out_file.close();
+    return static_cast<bool>(out_file);
+}
+
+void process_finf_file(const std::string& input_path, const std::string& output_path) {
+    std::ifstream file(input_path);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open file '" << input_path << "'" << std::endl;
+        return;
+    }
+    
+    std::ostringstream content;
+    content << file.rdbuf();
+    file.close();
+    
+    write_finf_file(output_path, convert_finf_content(content.str()));
 }
 
 int process_all_finf_files(const std::string& input_dir, const std::string& output_dir) {
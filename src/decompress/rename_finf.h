@@ -7,6 +7,12 @@
 /// 指定されたディレクトリ内の.finfファイルを検索
 std::vector<std::string> search_finf_files(const std::string& directory);
 
+/// .finfファイルの内容を変換（do, Eti を10倍、Nim を1/10）
+std::string convert_finf_content(const std::string& content);
+
+/// 変換済みの内容を書き込む（出力先のディレクトリがなければ作成）
+bool write_finf_file(const std::string& output_path, const std::string& content);
+
 /// 単一の.finfファイルを処理
 void process_finf_file(const std::string& input_path, const std::string& output_path);
 
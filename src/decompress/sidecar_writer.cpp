@@ -0,0 +1,70 @@
+#include "sidecar_writer.hpp"
+#include "rename_finf.h"
+#include "../common/common.hpp"
+#include <fstream>
+#include <iostream>
+
+SidecarWriter::SidecarWriter(const std::string &outputDir, bool convertFinf)
+    : outputDir(outputDir), convertFinf(convertFinf), finfCount(0), otherCount(0)
+{
+}
+
+void SidecarWriter::write(const FileEntry &entry, int setStart)
+{
+    bool isFinf = fs::path(entry.name).extension() == ".finf";
+    if (isFinf && !convertFinf)
+        return;
+
+    // 変換は書き込みの排他の外で行う
+    std::string content(entry.data.begin(), entry.data.end());
+    if (isFinf)
+        content = convert_finf_content(content);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = writtenSet.find(entry.name);
+    if (it != writtenSet.end() && it->second > setStart)
+        return; // より新しいセットのものを書き出し済み
+
+    std::string outputPath = (fs::path(outputDir) / entry.name).string();
+    bool ok = false;
+    if (isFinf)
+    {
+        ok = write_finf_file(outputPath, content);
+    }
+    else
+    {
+        fs::create_directories(outputDir);
+        std::ofstream outFile(outputPath, std::ios::binary);
+        outFile.write(content.data(), static_cast<std::streamsize>(content.size()));
+        ok = static_cast<bool>(outFile);
+        if (!ok)
+            std::cerr << "Error: Cannot write sidecar file: " << outputPath << std::endl;
+    }
+    if (!ok)
+        return;
+
+    if (it == writtenSet.end())
+    {
+        writtenSet[entry.name] = setStart;
+        if (isFinf)
+            finfCount++;
+        else
+            otherCount++;
+    }
+    else
+    {
+        it->second = setStart;
+    }
+}
+
+size_t SidecarWriter::getFinfCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return finfCount;
+}
+
+size_t SidecarWriter::getOtherCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return otherCount;
+}
@@ -0,0 +1,34 @@
+#ifndef SIDECAR_WRITER_HPP
+#define SIDECAR_WRITER_HPP
+
+#include "lz4_decompressor.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+
+// アーカイブに同梱された付随ファイル（.finfなど）を出力ディレクトリに書き出す
+// 解凍スレッドから並行して呼ばれる。同じ名前のファイルが複数のセットにある場合は
+// 後のセット（番号の大きいセット）のものを採用する
+class SidecarWriter
+{
+private:
+    std::string outputDir;
+    bool convertFinf;                     // .finfを変換して書き出す（falseの場合.finfは書き出さない）
+    std::mutex mutex;
+    std::map<std::string, int> writtenSet; // ファイル名 -> 書き出したセットの先頭番号
+    size_t finfCount;
+    size_t otherCount;
+
+public:
+    // convertFinf: .finfを変換して書き出すか（.finf以外の付随ファイルはそのまま書き出す）
+    SidecarWriter(const std::string &outputDir, bool convertFinf);
+
+    // setStart: 付随ファイルを含んでいたセットの先頭番号
+    void write(const FileEntry &entry, int setStart);
+
+    // 書き出した.finfの数（同名の上書きは1つと数える）
+    size_t getFinfCount();
+    size_t getOtherCount();
+};
+
+#endif // SIDECAR_WRITER_HPP
@@ -429,21 +429,11 @@ bool writeTiffInt32WithOriginalHeader(const std::string &filename,
 
 void mergeTiffFilesWithLibTiff(const std::vector<FileEntry> &entries, 
                               const std::string &prefix_with_run, 
-                              const std::string &outputFolder, 
-                              const int s_img, const int e_img, 
-                              const int integ_frame_num)
+                              const int first, const int last, 
+                              MergeWindows &windows)
 {
-    fs::create_directories(outputFolder);
-
-    int incre_num = e_img - s_img + 1;
-    int inc_set = static_cast<int>(std::round(double(incre_num) / integ_frame_num));
-
-    uint32_t width = 0, height = 0;
-    bool size_initialized = false;
-
-    const FileEntry *originalTiffEntry = nullptr;
-
-    std::vector<std::vector<float>> merged_images(inc_set);
+    int firstWindow = 0, lastWindow = -1;
+    windows.windowsOverlapping(first, last, firstWindow, lastWindow);
 
     std::unordered_map<std::string, const FileEntry *> file_map;
     for (const auto &entry : entries)
@@ -451,11 +441,18 @@ void mergeTiffFilesWithLibTiff(const std::vector<FileEntry> &entries,
         file_map[entry.name] = &entry;
     }
 
-    for (int t = 0; t < integ_frame_num; t++)
+    for (int i = firstWindow; i <= lastWindow; i++)
     {
-        for (int i = 0; i < inc_set; i++)
+        // 窓のうちこのアーカイブに含まれる範囲だけを足す（残りは隣のアーカイブから加わる）
+        int windowFirst = std::max(windows.windowFirst(i), first);
+        int windowLast = std::min(windows.windowLast(i), last);
+
+        uint32_t width = 0, height = 0;
+        const FileEntry *originalTiffEntry = nullptr;
+        std::vector<float> merged;
+
+        for (int idx = windowFirst; idx <= windowLast; idx++)
         {
-            int idx = s_img + i * integ_frame_num + t;
             std::string i_num = zeroPad(idx, 5);
             std::string input_name = prefix_with_run + i_num + ".tif";
 
@@ -473,17 +470,12 @@ void mergeTiffFilesWithLibTiff(const std::vector<FileEntry> &entries,
                 continue;
             }
 
-            if (!size_initialized)
+            if (!originalTiffEntry)
             {
                 width = imgWidth;
                 height = imgHeight;
-                size_initialized = true;
                 originalTiffEntry = it->second;
-
-                for (int j = 0; j < inc_set; j++)
-                {
-                    merged_images[j].assign(width * height, 0.0f);
-                }
+                merged.assign(width * height, 0.0f);
             }
 
             if (img.size() != width * height)
@@ -494,41 +486,42 @@ void mergeTiffFilesWithLibTiff(const std::vector<FileEntry> &entries,
 
             for (size_t p = 0; p < img.size(); p++)
             {
-                merged_images[i][p] += img[p];
+                merged[p] += img[p];
             }
         }
+
+        windows.add(i, first, last, std::move(merged), width, height, originalTiffEntry);
     }
+}
 
-    for (int i = 0; i < inc_set; i++)
-    {
-        if (merged_images[i].empty())
-        {
-            std::cerr << "Failed to initialize group " << zeroPad(i + 1, 5) << std::endl;
-            continue;
-        }
+void writeMergedImage(std::vector<float> &image, uint32_t width, uint32_t height,
+                      const std::string &outputFolder, const std::string &prefix_with_run,
+                      const int outputNumber, const int integ_frame_num,
+                      const FileEntry *originalTiffEntry)
+{
+    fs::create_directories(outputFolder);
 
-        float threshold = -1.0f * integ_frame_num;
-        for (size_t p = 0; p < merged_images[i].size(); p++)
-        {
-            if (merged_images[i][p] == threshold)
-                merged_images[i][p] = -1.0f;
-            else if (merged_images[i][p] < threshold)
-                merged_images[i][p] = -2.0f;
-        }
+    float threshold = -1.0f * integ_frame_num;
+    for (size_t p = 0; p < image.size(); p++)
+    {
+        if (image[p] == threshold)
+            image[p] = -1.0f;
+        else if (image[p] < threshold)
+            image[p] = -2.0f;
+    }
 
-        std::string output_name = outputFolder + "/" + prefix_with_run + zeroPad(s_img / 10 + i + 1, 5) + ".tif";
-        if (originalTiffEntry)
-        {
-            if (!writeTiffInt32WithOriginalHeader(output_name, merged_images[i], width, height, *originalTiffEntry))
-            {
-                std::cerr << "TIFF output failed: " << output_name << std::endl;
-            }
-        }
-        else
+    std::string output_name = outputFolder + "/" + prefix_with_run + zeroPad(outputNumber, 5) + ".tif";
+    if (originalTiffEntry)
+    {
+        if (!writeTiffInt32WithOriginalHeader(output_name, image, width, height, *originalTiffEntry))
         {
-            std::cerr << "No original TIFF entry available for: " << output_name << std::endl;
+            std::cerr << "TIFF output failed: " << output_name << std::endl;
         }
     }
+    else
+    {
+        std::cerr << "No original TIFF entry available for: " << output_name << std::endl;
+    }
 }
 
 void extractTiffFilesFromMemory(const std::vector<FileEntry> &entries, const std::string &outputFolder)
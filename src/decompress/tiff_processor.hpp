@@ -2,6 +2,7 @@
 #define TIFF_PROCESSOR_HPP
 
 #include "lz4_decompressor.hpp"
+#include "merge_windows.hpp"
 #include <vector>
 #include <string>
 #include <cstdint>
@@ -55,11 +56,18 @@ bool writeTiffInt32WithOriginalHeader(const std::string &filename,
                                      const FileEntry &originalTiffEntry);
 
 /// libtiffを使ったTIFFマージ処理
+/// アーカイブに含まれるフレームの範囲 [first, last] について、重なる各窓の和をwindowsに加える
 void mergeTiffFilesWithLibTiff(const std::vector<FileEntry> &entries, 
                               const std::string &prefix_with_run, 
-                              const std::string &outputFolder, 
-                              const int s_img, const int e_img, 
-                              const int integ_frame_num);
+                              const int first, const int last, 
+                              MergeWindows &windows);
+
+/// マージした画像の不感画素を置き換えて出力する（<prefix_with_run><outputNumber>.tif）
+/// 和が -integ_frame_num の画素は -1、それより小さい画素は -2 にする
+void writeMergedImage(std::vector<float> &image, uint32_t width, uint32_t height,
+                      const std::string &outputFolder, const std::string &prefix_with_run,
+                      const int outputNumber, const int integ_frame_num,
+                      const FileEntry *originalTiffEntry);
 
 /// メモリ上のTIFFファイルを直接出力する関数
 void extractTiffFilesFromMemory(const std::vector<FileEntry> &entries, 
@@ -0,0 +1,80 @@
+#include "archive_convert.hpp"
+#include "../common/common.hpp"
+#include "../common/checksum.hpp"
+#include "../decompress/lz4_decompressor.hpp"
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+bool addV1ArchiveBlocks(const char *data, size_t size, BlockCodec codec, int lz4Acceleration,
+                        BlockArchiveBuilder &builder, size_t *blockCount)
+{
+    std::vector<FileEntry> files = decompressLZ4ArchiveBuffer(data, size);
+    if (files.empty())
+        return false;
+
+    for (const auto &file : files)
+    {
+        std::string raw(file.data.begin(), file.data.end());
+        BlockEntry entry;
+        entry.name = file.name;
+        entry.kind = file.sidecar ? BlockKind::Sidecar : BlockKind::File;
+        entry.rawSize = raw.size();
+        entry.rawChecksum = computeChecksum64(raw);
+        std::string stored;
+        if (encodeBlock(raw, file.sidecar ? BlockCodec::LZ4 : codec, lz4Acceleration, stored, entry.codec, 1.0, &entry.flags))
+            entry.flags |= BLOCK_FLAG_STORED_RAW;
+        builder.addBlock(entry, stored);
+    }
+    if (blockCount)
+        *blockCount = files.size();
+    return true;
+}
+
+bool verifyBlockArchive(const std::string &archive, uint32_t &fileCount, uint64_t &rawSize, int maxThreads)
+{
+    std::vector<BlockEntry> blocks;
+    if (!readBlockArchiveIndex(archive.data(), archive.size(), blocks))
+        return false;
+
+    fileCount = 0;
+    rawSize = 0;
+    std::vector<char> raw;
+    for (const auto &block : blocks)
+    {
+        if (!decodeAndVerifyBlock(block, archive.data() + block.offset, raw, maxThreads))
+        {
+            std::cerr << "Error: Block verify failed: " << block.name << std::endl;
+            return false;
+        }
+        if (block.kind == BlockKind::File)
+            fileCount++;
+        rawSize += block.rawSize;
+    }
+    return true;
+}
+
+bool replaceFileAtomically(const std::string &path, const std::string &data, const std::string &tempSuffix)
+{
+    std::string tempPath = path + tempSuffix;
+    std::error_code ec;
+    {
+        std::ofstream outFile(tempPath, std::ios::binary | std::ios::trunc);
+        outFile.write(data.data(), static_cast<std::streamsize>(data.size()));
+        outFile.close();
+        if (!outFile || fs::file_size(tempPath, ec) != data.size())
+        {
+            std::cerr << "Error: Failed to write: " << tempPath << std::endl;
+            fs::remove(tempPath, ec);
+            return false;
+        }
+    }
+    fs::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Failed to replace " << path << ": " << ec.message() << std::endl;
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef ARCHIVE_CONVERT_HPP
+#define ARCHIVE_CONVERT_HPP
+
+#include "../common/block_archive.hpp"
+#include <cstdint>
+#include <string>
+
+// repack・migrate で共有するアーカイブの変換処理
+
+// v1アーカイブ（セット全体で1つのLZ4ブロック）を展開し、ファイルごとのブロックとしてbuilderに加える
+// blockCount: 加えたブロック数の出力先（不要ならnullptr）
+// 戻り値: 展開できた場合true
+bool addV1ArchiveBlocks(const char *data, size_t size, BlockCodec codec, int lz4Acceleration,
+                        BlockArchiveBuilder &builder, size_t *blockCount = nullptr);
+
+// ブロック形式アーカイブの全ブロックを復号して検証する
+// fileCount: フレーム（BlockKind::File）の数、rawSize: 復号後の合計バイト数
+bool verifyBlockArchive(const std::string &archive, uint32_t &fileCount, uint64_t &rawSize, int maxThreads = 1);
+
+// 同じディレクトリの一時ファイル（path + tempSuffix）に書き込んでからリネームで置き換える
+bool replaceFileAtomically(const std::string &path, const std::string &data, const std::string &tempSuffix);
+
+#endif // ARCHIVE_CONVERT_HPP
@@ -0,0 +1,181 @@
+#include "tool_commands.hpp"
+#include "../common/common.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/checksum.hpp"
+#include "../compress/file_reader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+// 1コーデック分の測定結果
+struct BenchResult
+{
+    uint64_t rawBytes = 0;
+    uint64_t storedBytes = 0;
+    double encodeSeconds = 0;
+    double decodeSeconds = 0;
+    size_t fallbackCount = 0; // 指定したコーデックを使えなかったファイル数
+    bool verified = true;
+};
+
+// 引数のファイル・ディレクトリから測定対象の .tif ファイルを集める
+static std::vector<std::string> collectFiles(const std::vector<std::string> &paths, size_t limit)
+{
+    std::vector<std::string> files;
+    for (const auto &path : paths)
+    {
+        if (fs::is_directory(path))
+        {
+            std::vector<std::string> dirFiles;
+            for (const auto &entry : fs::directory_iterator(path))
+            {
+                if (entry.is_regular_file() && entry.path().extension() == ".tif")
+                    dirFiles.push_back(entry.path().string());
+            }
+            std::sort(dirFiles.begin(), dirFiles.end());
+            files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+        }
+        else
+        {
+            files.push_back(path);
+        }
+    }
+    if (files.size() > limit)
+        files.resize(limit);
+    return files;
+}
+
+// ファイル単位でthreadCountスレッドに分配して処理する
+template <typename Func>
+static double timedParallel(size_t count, int threadCount, Func func)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            for (size_t i = next++; i < count; i = next++)
+                func(i); });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static BenchResult runCodec(const std::vector<FileReadResult> &inputs, BlockCodec codec, int threadCount,
+                            int lz4Acceleration)
+{
+    BenchResult result;
+    std::vector<BlockEntry> entries(inputs.size());
+    std::vector<std::string> stored(inputs.size());
+
+    result.encodeSeconds = timedParallel(inputs.size(), threadCount, [&](size_t i)
+                                         {
+        entries[i].rawSize = inputs[i].data.size();
+        entries[i].rawChecksum = computeChecksum64(inputs[i].data);
+        encodeBlock(inputs[i].data, codec, lz4Acceleration, stored[i], entries[i].codec, 1.0, &entries[i].flags);
+        entries[i].storedSize = stored[i].size(); });
+
+    std::atomic<bool> verified(true);
+    result.decodeSeconds = timedParallel(inputs.size(), threadCount, [&](size_t i)
+                                         {
+        std::vector<char> decoded;
+        if (!decodeBlock(entries[i], stored[i].data(), decoded) ||
+            computeChecksum64(decoded.data(), decoded.size()) != entries[i].rawChecksum)
+            verified = false; });
+    result.verified = verified;
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        result.rawBytes += entries[i].rawSize;
+        result.storedBytes += entries[i].storedSize;
+        if (entries[i].codec != codec && codec != BlockCodec::Auto)
+            result.fallbackCount++;
+    }
+    return result;
+}
+
+int benchCommand(const std::vector<std::string> &args)
+{
+    int threadCount = 1;
+    int lz4Acceleration = 1;
+    size_t limit = 100;
+    std::vector<std::string> paths;
+
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+        {
+            paths.push_back(arg);
+            continue;
+        }
+        try
+        {
+            if (name == "--threads")
+                threadCount = std::max(1, std::stoi(value));
+            else if (name == "--lz4-acceleration")
+                lz4Acceleration = std::max(1, std::stoi(value));
+            else if (name == "--limit")
+                limit = static_cast<size_t>(std::max(1, std::stoi(value)));
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (paths.empty())
+    {
+        std::cerr << "Usage: bl02b1_archive_tool bench [--threads=N] [--lz4-acceleration=N] [--limit=N] <file|dir>..."
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files = collectFiles(paths, limit);
+    if (files.empty())
+    {
+        std::cerr << "Error: No input files" << std::endl;
+        return 1;
+    }
+
+    std::vector<FileReadResult> inputs;
+    if (!readFilesParallel(files, threadCount, inputs))
+        return 1;
+
+    std::cout << "Files: " << files.size() << ", threads: " << threadCount << std::endl;
+    std::cout << std::left << std::setw(12) << "codec" << std::right << std::setw(10) << "ratio"
+              << std::setw(14) << "encode MB/s" << std::setw(14) << "decode MB/s" << "  notes" << std::endl;
+
+    int exitCode = 0;
+    for (BlockCodec codec : {BlockCodec::Store, BlockCodec::LZ4, BlockCodec::Predictive, BlockCodec::Auto})
+    {
+        BenchResult result = runCodec(inputs, codec, threadCount, lz4Acceleration);
+        double rawMB = result.rawBytes / (1024.0 * 1024.0);
+        std::cout << std::left << std::setw(12) << blockCodecName(codec) << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(9) << (100.0 * result.storedBytes / std::max<uint64_t>(1, result.rawBytes)) << "%"
+                  << std::setprecision(1) << std::setw(14) << rawMB / std::max(1e-9, result.encodeSeconds)
+                  << std::setw(14) << rawMB / std::max(1e-9, result.decodeSeconds) << "  ";
+        std::cout.unsetf(std::ios::fixed);
+        if (result.fallbackCount > 0)
+            std::cout << result.fallbackCount << " file(s) used another codec ";
+        if (!result.verified)
+        {
+            std::cout << "VERIFY FAILED";
+            exitCode = 1;
+        }
+        std::cout << std::endl;
+    }
+    return exitCode;
+}
@@ -0,0 +1,211 @@
+#include "tool_commands.hpp"
+#include "../common/common.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/run_container.hpp"
+#include "../common/aligned_io.hpp"
+#include "../common/checksum.hpp"
+#include <algorithm>
+#include <iostream>
+
+// ブロックをファイルから個別に読み直して検証する
+// 境界に揃った無圧縮のブロックはページ境界でマップしてそのまま検証し、それ以外はO_DIRECTで読んで復号する
+static bool verifyBlocks(const std::string &path, uint64_t regionOffset, const std::vector<BlockEntry> &blocks,
+                         const std::string &indent)
+{
+    size_t mappedCount = 0, directCount = 0, failedCount = 0;
+    AlignedBuffer buffer;
+    for (const auto &block : blocks)
+    {
+        uint64_t blockOffset = regionOffset + block.offset;
+        bool ok = false;
+        if ((block.flags & BLOCK_FLAG_ALIGNED) && block.codec == BlockCodec::Store &&
+            blockOffset % BLOCK_ALIGNMENT == 0)
+        {
+            MappedFileRange mapping;
+            if (mapping.map(path, blockOffset, block.storedSize))
+            {
+                ok = computeChecksum64(mapping.data(), mapping.size()) == block.rawChecksum;
+                mappedCount++;
+            }
+        }
+        else
+        {
+            const char *stored = nullptr;
+            bool usedDirect = false;
+            std::vector<char> raw;
+            if (readFileRangeDirect(path, blockOffset, block.storedSize, buffer, stored, &usedDirect))
+            {
+                ok = decodeAndVerifyBlock(block, stored, raw);
+                if (usedDirect)
+                    directCount++;
+            }
+        }
+        if (!ok)
+        {
+            std::cout << indent << "  Verify failed: " << block.name << std::endl;
+            failedCount++;
+        }
+    }
+    std::cout << indent << "Verified " << (blocks.size() - failedCount) << " of " << blocks.size()
+              << " block(s) (mapped: " << mappedCount << ", direct I/O: " << directCount << ")" << std::endl;
+    return failedCount == 0;
+}
+
+// メモリ上のアーカイブ（.lz4ファイルの内容、またはランコンテナのセグメント）の内容を表示する
+// regionOffset: ファイル内でのアーカイブの先頭位置（--verifyでファイルから読み直すため）
+static bool printArchive(const std::string &path, uint64_t regionOffset, const std::vector<char> &data,
+                         const std::string &indent, bool verify)
+{
+    if (!isBlockArchive(data.data(), data.size()))
+    {
+        std::cout << indent << "Format: v1 (single LZ4 block), " << data.size() << " bytes" << std::endl;
+        return true;
+    }
+
+    std::vector<BlockEntry> blocks;
+    if (!readBlockArchiveIndex(data.data(), data.size(), blocks))
+    {
+        std::cout << indent << "Error: Failed to read block index" << std::endl;
+        return false;
+    }
+
+    uint64_t rawTotal = 0, storedTotal = 0;
+    uint64_t checkpointStored = 0, spotsStored = 0;
+    size_t alignedCount = 0, checkpointCount = 0, spotsCount = 0, storedRawCount = 0;
+    std::cout << indent << "Format: v2 (blocks), " << blocks.size() << " block(s)" << std::endl;
+    for (const auto &block : blocks)
+    {
+        // チェックポイントとスポットの一覧は元ファイルではないため合計に含めず、別に表示する
+        if (block.kind == BlockKind::Checkpoint)
+        {
+            checkpointCount++;
+            checkpointStored += block.storedSize;
+        }
+        else if (block.kind == BlockKind::Spots)
+        {
+            spotsCount++;
+            spotsStored += block.storedSize;
+        }
+        else
+        {
+            rawTotal += block.rawSize;
+            storedTotal += block.storedSize;
+        }
+        if (block.flags & BLOCK_FLAG_ALIGNED)
+            alignedCount++;
+        if (block.flags & BLOCK_FLAG_STORED_RAW)
+            storedRawCount++;
+        std::cout << indent << "  " << block.name << "  "
+                  << (block.kind != BlockKind::File ? std::string(blockKindName(block.kind)) + "  " : "")
+                  << ((block.flags & BLOCK_FLAG_LZ4HC) ? "lz4hc" : blockCodecName(block.codec)) << "  "
+                  << block.rawSize << " -> " << block.storedSize << " bytes" << std::endl;
+    }
+    if (rawTotal > 0)
+    {
+        std::cout << indent << "Total: " << rawTotal << " -> " << storedTotal << " bytes ("
+                  << std::fixed << std::setprecision(1) << (100.0 * storedTotal / rawTotal) << "%)" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+    if (checkpointCount > 0)
+    {
+        std::cout << indent << "Checkpoints: " << checkpointCount << " block(s), " << checkpointStored << " bytes" << std::endl;
+    }
+    if (storedRawCount > 0)
+    {
+        std::cout << indent << "Stored raw (incompressible): " << storedRawCount << " block(s)" << std::endl;
+    }
+    if (spotsCount > 0)
+    {
+        std::cout << indent << "Spot lists: " << spotsCount << " block(s), " << spotsStored << " bytes" << std::endl;
+    }
+    if (alignedCount > 0)
+    {
+        uint64_t padding = countBlockPadding(blocks);
+        std::cout << indent << "Aligned to " << BLOCK_ALIGNMENT << " bytes: " << alignedCount << " block(s), padding "
+                  << padding << " bytes (" << std::fixed << std::setprecision(1)
+                  << (100.0 * padding / std::max<size_t>(1, data.size())) << "% of archive)" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+    else if (uint64_t superseded = countBlockPadding(blocks))
+    {
+        // 後から届いたフレームを追記したアーカイブ（置き換えられたブロックと古いインデックス）
+        std::cout << indent << "Superseded by appends: " << superseded << " bytes" << std::endl;
+    }
+
+    if (verify)
+        return verifyBlocks(path, regionOffset, blocks, indent);
+    return true;
+}
+
+static bool readWholeArchive(const std::string &path, std::vector<char> &data)
+{
+    std::ifstream inFile(path, std::ios::binary);
+    if (!inFile)
+        return false;
+    data.resize(fs::file_size(path));
+    inFile.read(data.data(), static_cast<std::streamsize>(data.size()));
+    return static_cast<bool>(inFile);
+}
+
+int infoCommand(const std::vector<std::string> &args)
+{
+    bool verify = false;
+    std::vector<std::string> paths;
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+            paths.push_back(arg);
+        else if (name == "--verify")
+            verify = true;
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (paths.empty())
+    {
+        std::cerr << "Usage: bl02b1_archive_tool info [--verify] <archive.lz4|container.lz4c>..." << std::endl;
+        return 1;
+    }
+
+    int result = 0;
+    for (const auto &path : paths)
+    {
+        std::cout << path << std::endl;
+        if (!fs::exists(path))
+        {
+            std::cerr << "Error: File not found: " << path << std::endl;
+            result = 1;
+            continue;
+        }
+
+        if (fs::path(path).extension() == ".lz4c")
+        {
+            std::vector<RunSegment> segments;
+            if (!readRunContainerIndex(path, segments))
+            {
+                std::cerr << "Error: Failed to read run container index: " << path << std::endl;
+                result = 1;
+                continue;
+            }
+            std::cout << "Run container: " << segments.size() << " segment(s)" << std::endl;
+            for (const auto &segment : segments)
+            {
+                std::cout << "  Set " << segment.setNumber << " (" << segment.fileCount << " files, offset "
+                          << segment.offset << ")" << std::endl;
+                std::vector<char> data;
+                if (!readRunSegment(path, segment, data) || !printArchive(path, segment.offset, data, "    ", verify))
+                    result = 1;
+            }
+            continue;
+        }
+
+        std::vector<char> data;
+        if (!readWholeArchive(path, data) || !printArchive(path, 0, data, "  ", verify))
+            result = 1;
+    }
+    return result;
+}
@@ -0,0 +1,507 @@
+#include "tool_commands.hpp"
+#include "archive_convert.hpp"
+#include "../common/common.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/checksum.hpp"
+#include "../common/run_container.hpp"
+#include "../compress/file_reader.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// Ctrl+Cで中断を要求された（変換中のアーカイブは最後まで処理してから終了する）
+static volatile std::sig_atomic_t migrateInterrupted = 0;
+
+static void onMigrateInterrupt(int)
+{
+    migrateInterrupted = 1;
+}
+
+// migrateの設定
+struct MigrateOptions
+{
+    // ファイルごとのブロックはフレームをまたいだ一致を使えないため、LZ4では多くの場合v1より大きくなる
+    BlockCodec codec = BlockCodec::Auto;
+    int lz4Acceleration = 1;
+    uint64_t alignment = 0;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+    uint64_t ioBytesPerSecond = 0; // 読み書きの合計の上限（0: 制限なし）
+    std::string progressPath;
+    bool dryRun = false;
+    int maxGrowthPercent = 10; // 変換後のサイズがこの割合を超えて増えるアーカイブは変換しない（負の値: 制限なし）
+};
+
+// 変換後のサイズの増加が上限を超える
+static bool grewTooMuch(const MigrateOptions &options, uint64_t bytesBefore, uint64_t bytesAfter)
+{
+    return options.maxGrowthPercent >= 0 && bytesAfter * 100 > bytesBefore * (100 + options.maxGrowthPercent);
+}
+
+// 全スレッドで共有する読み書きの帯域の上限
+// 読み書きするバイト数に応じて各スレッドの開始時刻をずらす
+class IoBudget
+{
+private:
+    uint64_t bytesPerSecond;
+    std::chrono::steady_clock::time_point nextFree;
+    std::mutex mutex;
+
+public:
+    explicit IoBudget(uint64_t bytesPerSecond) : bytesPerSecond(bytesPerSecond), nextFree(std::chrono::steady_clock::now()) {}
+
+    void acquire(uint64_t bytes)
+    {
+        if (bytesPerSecond == 0)
+            return;
+
+        std::chrono::steady_clock::time_point start;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            start = std::max(nextFree, std::chrono::steady_clock::now());
+            nextFree = start + std::chrono::microseconds(bytes * 1000000 / bytesPerSecond);
+        }
+        std::this_thread::sleep_until(start);
+    }
+};
+
+// 完了したアーカイブの記録（1行1パス、再実行時は記録済みのアーカイブを飛ばす）
+class MigrateProgress
+{
+private:
+    std::string path;
+    std::set<std::string> done;
+    std::mutex mutex;
+
+public:
+    explicit MigrateProgress(const std::string &path) : path(path)
+    {
+        std::ifstream inFile(path);
+        std::string line;
+        while (std::getline(inFile, line))
+        {
+            if (!line.empty())
+                done.insert(line);
+        }
+    }
+
+    size_t size() const { return done.size(); }
+
+    bool isDone(const std::string &archivePath)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return done.count(archivePath) > 0;
+    }
+
+    void markDone(const std::string &archivePath)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!done.insert(archivePath).second)
+            return;
+        std::ofstream outFile(path, std::ios::app);
+        outFile << archivePath << '\n';
+    }
+};
+
+// カタログに登録されたアーカイブ（パスとファイル内の位置から、カタログのディレクトリとエントリを引く）
+using CatalogRefs = std::map<std::pair<std::string, uint64_t>, std::pair<std::string, CatalogEntry>>;
+
+static std::string normalizePath(const std::string &path)
+{
+    std::error_code ec;
+    fs::path normalized = fs::weakly_canonical(path, ec);
+    return ec ? fs::absolute(path).lexically_normal().string() : normalized.string();
+}
+
+// 変換後のアーカイブをカタログに登録し直す（登録されていない場合は何もしない）
+static void updateCatalog(const CatalogRefs &refs, const std::string &path, uint64_t oldOffset, uint64_t newOffset,
+                          const std::string &archive, uint32_t fileCount, uint64_t rawSize)
+{
+    auto it = refs.find(std::make_pair(path, oldOffset));
+    if (it == refs.end())
+        return;
+
+    CatalogEntry entry = it->second.second;
+    entry.offset = newOffset;
+    entry.size = archive.size();
+    entry.checksum = computeChecksum64(archive);
+    entry.fileCount = fileCount;
+    entry.rawSize = rawSize;
+    entry.committedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    if (!appendCatalogEntry(it->second.first, entry))
+    {
+        std::cerr << "Warning: Failed to update catalog for " << path << std::endl;
+    }
+}
+
+// v1アーカイブをブロック形式に変換し、全ブロックを復号して元のファイルのチェックサムと照合する
+static bool convertArchive(const char *data, size_t size, const MigrateOptions &options, std::string &archive,
+                           uint32_t &fileCount, uint64_t &rawSize)
+{
+    BlockArchiveBuilder builder(options.alignment);
+    size_t blockCount = 0;
+    if (!addV1ArchiveBlocks(data, size, options.codec, options.lz4Acceleration, builder, &blockCount))
+        return false;
+    archive = builder.finish();
+
+    // ブロックのrawChecksumは変換前のデータから計算しているため、復号して一致すれば往復で同一
+    return verifyBlockArchive(archive, fileCount, rawSize) && builder.getEntries().size() == blockCount;
+}
+
+// 結果の集計
+struct MigrateCounts
+{
+    std::atomic<size_t> migrated{0};
+    std::atomic<size_t> alreadyCurrent{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> grown{0}; // サイズが増えるため変換しなかった
+    std::atomic<uint64_t> bytesBefore{0};
+    std::atomic<uint64_t> bytesAfter{0};
+};
+
+// 単独の.lz4ファイルを変換する
+// kept: サイズが増えるため変換しなかった場合true（進捗ファイルには記録しない）
+static bool migrateArchiveFile(const std::string &path, const MigrateOptions &options, IoBudget &budget,
+                               const CatalogRefs &refs, MigrateCounts &counts, bool &kept)
+{
+    std::error_code ec;
+    budget.acquire(fs::file_size(path, ec));
+    std::string data;
+    if (!readWholeFile(path, data))
+    {
+        std::cerr << "Error: Failed to read: " << path << std::endl;
+        return false;
+    }
+    if (isBlockArchive(data.data(), data.size()))
+    {
+        counts.alreadyCurrent++;
+        return true;
+    }
+    if (options.dryRun)
+    {
+        std::cout << "Would migrate: " << path << std::endl;
+        return true;
+    }
+
+    std::string archive;
+    uint32_t fileCount = 0;
+    uint64_t rawSize = 0;
+    if (!convertArchive(data.data(), data.size(), options, archive, fileCount, rawSize))
+    {
+        std::cerr << "Error: Conversion or verify failed: " << path << std::endl;
+        return false;
+    }
+    if (grewTooMuch(options, data.size(), archive.size()))
+    {
+        std::cout << "Kept v1 (would grow " << data.size() << " -> " << archive.size() << " bytes): " << path << std::endl;
+        counts.grown++;
+        kept = true;
+        return true;
+    }
+
+    budget.acquire(archive.size());
+    if (!replaceFileAtomically(path, archive, ".migrate.tmp"))
+        return false;
+    updateCatalog(refs, path, 0, 0, archive, fileCount, rawSize);
+
+    counts.migrated++;
+    counts.bytesBefore += data.size();
+    counts.bytesAfter += archive.size();
+    std::cout << "Migrated: " << path << " (" << fileCount << " files, " << data.size() << " -> " << archive.size()
+              << " bytes)" << std::endl;
+    return true;
+}
+
+// ランコンテナ内のv1セグメントを変換する
+// 有効なセグメントだけを新しいコンテナ（一時ファイル）に書き直してからリネームで置き換える
+// kept: サイズが増えるため変換しなかった場合true（進捗ファイルには記録しない）
+static bool migrateContainer(const std::string &path, const MigrateOptions &options, IoBudget &budget,
+                             const CatalogRefs &refs, MigrateCounts &counts, bool &kept)
+{
+    std::vector<RunSegment> segments;
+    if (!readRunContainerIndex(path, segments))
+    {
+        std::cerr << "Error: Failed to read run container index: " << path << std::endl;
+        return false;
+    }
+
+    // 変換前にすべてのセグメントを読み込み、v1が含まれるか確認する
+    std::vector<std::vector<char>> segmentData(segments.size());
+    bool hasV1 = false;
+    uint64_t bytesBefore = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        budget.acquire(segments[i].size);
+        if (!readRunSegment(path, segments[i], segmentData[i]))
+        {
+            std::cerr << "Error: Failed to read set " << segments[i].setNumber << " from run container: " << path << std::endl;
+            return false;
+        }
+        hasV1 = hasV1 || !isBlockArchive(segmentData[i].data(), segmentData[i].size());
+        bytesBefore += segments[i].size;
+    }
+    if (!hasV1)
+    {
+        counts.alreadyCurrent++;
+        return true;
+    }
+    if (options.dryRun)
+    {
+        std::cout << "Would migrate: " << path << " (" << segments.size() << " set(s))" << std::endl;
+        return true;
+    }
+
+    std::string tempPath = path + ".migrate.tmp";
+    std::error_code ec;
+    fs::remove(tempPath, ec);
+
+    // 変換後のセグメント（カタログ更新用）
+    struct ConvertedSegment
+    {
+        uint64_t oldOffset;
+        RunSegment segment;
+        std::string archive;
+        uint32_t fileCount;
+        uint64_t rawSize;
+    };
+    std::vector<ConvertedSegment> converted;
+    uint64_t bytesAfter = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        ConvertedSegment result;
+        result.oldOffset = segments[i].offset;
+        const std::vector<char> &data = segmentData[i];
+        if (isBlockArchive(data.data(), data.size()))
+        {
+            result.archive.assign(data.begin(), data.end());
+            std::vector<BlockEntry> blocks;
+            readBlockArchiveIndex(data.data(), data.size(), blocks);
+            result.fileCount = segments[i].fileCount;
+            result.rawSize = 0;
+            for (const auto &block : blocks)
+                result.rawSize += block.rawSize;
+        }
+        else if (!convertArchive(data.data(), data.size(), options, result.archive, result.fileCount, result.rawSize))
+        {
+            std::cerr << "Error: Conversion or verify failed: " << path << " (set " << segments[i].setNumber << ")" << std::endl;
+            fs::remove(tempPath, ec);
+            return false;
+        }
+
+        budget.acquire(result.archive.size());
+        if (!appendRunSegment(tempPath, segments[i].setNumber, result.fileCount, result.archive, &result.segment,
+                              options.alignment))
+        {
+            std::cerr << "Error: Failed to write: " << tempPath << std::endl;
+            fs::remove(tempPath, ec);
+            return false;
+        }
+        bytesAfter += result.archive.size();
+        converted.push_back(std::move(result));
+    }
+    if (grewTooMuch(options, bytesBefore, bytesAfter))
+    {
+        std::cout << "Kept v1 (would grow " << bytesBefore << " -> " << bytesAfter << " bytes): " << path << std::endl;
+        fs::remove(tempPath, ec);
+        counts.grown++;
+        kept = true;
+        return true;
+    }
+
+    fs::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Failed to replace " << path << ": " << ec.message() << std::endl;
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    for (const auto &result : converted)
+    {
+        updateCatalog(refs, path, result.oldOffset, result.segment.offset, result.archive, result.fileCount, result.rawSize);
+    }
+
+    counts.migrated++;
+    counts.bytesBefore += bytesBefore;
+    counts.bytesAfter += bytesAfter;
+    std::cout << "Migrated: " << path << " (" << segments.size() << " set(s), " << bytesBefore << " -> " << bytesAfter
+              << " bytes)" << std::endl;
+    return true;
+}
+
+int migrateCommand(const std::vector<std::string> &args)
+{
+    MigrateOptions options;
+    std::vector<std::string> dirs;
+
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+        {
+            dirs.push_back(arg);
+            continue;
+        }
+        try
+        {
+            if (name == "--codec")
+            {
+                if (!parseBlockCodec(value, options.codec))
+                {
+                    std::cerr << "Unknown codec: " << value << std::endl;
+                    return 1;
+                }
+            }
+            else if (name == "--lz4-acceleration")
+                options.lz4Acceleration = std::max(1, std::stoi(value));
+            else if (name == "--align-blocks")
+                options.alignment = BLOCK_ALIGNMENT;
+            else if (name == "--threads")
+                options.threadCount = std::max(1, std::stoi(value));
+            else if (name == "--io-mb-per-sec")
+                options.ioBytesPerSecond = static_cast<uint64_t>(std::max(0, std::stoi(value))) * 1024 * 1024;
+            else if (name == "--progress")
+                options.progressPath = value;
+            else if (name == "--max-growth")
+                options.maxGrowthPercent = std::stoi(value);
+            else if (name == "--dry-run")
+                options.dryRun = true;
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (dirs.empty())
+    {
+        std::cerr << "Usage: bl02b1_archive_tool migrate [--threads=N] [--io-mb-per-sec=N] [--codec=lz4|predictive|store|auto]"
+                  << " [--max-growth=<percent>] [--align-blocks] [--progress=<file>] [--dry-run] <dir>..." << std::endl;
+        std::cerr << "  --codec defaults to auto; lz4 usually grows v1 archives (about 80%) because each frame is compressed alone."
+                  << std::endl;
+        std::cerr << "  Archives that would grow by more than --max-growth percent (default 10, negative: no limit) stay v1."
+                  << std::endl;
+        return 1;
+    }
+    if (options.progressPath.empty())
+    {
+        options.progressPath = (fs::path(dirs.front()) / "compressor_migrate_progress.txt").string();
+    }
+
+    // ---------- ディレクトリを再帰的に走査して、アーカイブとカタログを集める ----------
+    std::vector<std::string> archives;
+    CatalogRefs refs;
+    for (const auto &dir : dirs)
+    {
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+             !ec && it != end; it.increment(ec))
+        {
+            if (!it->is_regular_file())
+                continue;
+            std::string extension = it->path().extension().string();
+            if (extension == ".lz4" || extension == ".lz4c")
+            {
+                archives.push_back(normalizePath(it->path().string()));
+            }
+            else if (it->path().filename() == "compressor_catalog.tsv")
+            {
+                std::string catalogDir = it->path().parent_path().string();
+                ArchiveCatalog catalog(catalogDir);
+                if (!catalog.load())
+                    continue;
+                for (const auto &entry : catalog.entries())
+                {
+                    refs[std::make_pair(normalizePath(catalog.resolvePath(entry)), entry.offset)] =
+                        std::make_pair(catalogDir, entry);
+                }
+            }
+        }
+    }
+    std::sort(archives.begin(), archives.end());
+    archives.erase(std::unique(archives.begin(), archives.end()), archives.end());
+
+    MigrateProgress progress(options.progressPath);
+    std::cout << "Archives: " << archives.size() << ", threads: " << options.threadCount;
+    if (options.ioBytesPerSecond > 0)
+        std::cout << ", I/O budget: " << options.ioBytesPerSecond / (1024 * 1024) << " MB/s";
+    if (progress.size() > 0)
+        std::cout << ", resuming (" << progress.size() << " already done, " << options.progressPath << ")";
+    std::cout << std::endl;
+
+    // ---------- 並列に変換する ----------
+    migrateInterrupted = 0;
+    auto previousHandler = std::signal(SIGINT, onMigrateInterrupt);
+
+    IoBudget budget(options.ioBytesPerSecond);
+    MigrateCounts counts;
+    std::atomic<size_t> nextArchive(0);
+    std::atomic<size_t> skipped(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threadCount; ++t)
+    {
+        threads.emplace_back([&]()
+                             {
+            for (size_t i = nextArchive++; i < archives.size() && !migrateInterrupted; i = nextArchive++)
+            {
+                const std::string &path = archives[i];
+                if (progress.isDone(path))
+                {
+                    skipped++;
+                    continue;
+                }
+
+                bool ok = false;
+                bool kept = false;
+                try
+                {
+                    if (fs::path(path).extension() == ".lz4c")
+                        ok = migrateContainer(path, options, budget, refs, counts, kept);
+                    else
+                        ok = migrateArchiveFile(path, options, budget, refs, counts, kept);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "Error: " << path << ": " << e.what() << std::endl;
+                }
+
+                if (!ok)
+                    counts.failed++;
+                else if (!options.dryRun && !kept)
+                    progress.markDone(path);
+            } });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    std::signal(SIGINT, previousHandler == SIG_ERR ? SIG_DFL : previousHandler);
+
+    std::cout << (options.dryRun ? "Plan: " : "Done: ") << counts.migrated << " migrated, " << counts.alreadyCurrent
+              << " already v2, " << counts.grown << " kept v1 (would grow), " << skipped << " skipped (progress file), "
+              << counts.failed << " failed";
+    if (counts.bytesBefore > 0)
+        std::cout << ", " << counts.bytesBefore << " -> " << counts.bytesAfter << " bytes";
+    std::cout << std::endl;
+
+    if (migrateInterrupted)
+    {
+        std::cout << "Interrupted. Run the same command again to resume." << std::endl;
+        return 1;
+    }
+    return counts.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,311 @@
+#include "tool_commands.hpp"
+#include "archive_convert.hpp"
+#include "../common/common.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/aligned_io.hpp"
+#include "../common/checksum.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// repackの設定
+struct RepackOptions
+{
+    uint64_t targetBytes = 256ull * 1024 * 1024; // まとめたアーカイブの上限
+    bool reencode = false;                        // --codec が指定された場合、異なるコーデックのブロックを符号化し直す
+    BlockCodec codec = BlockCodec::LZ4;
+    int lz4Acceleration = 1;
+    uint64_t alignment = 0;
+    int threadCount = 1;
+    bool dryRun = false;
+};
+
+// 1グループ分の集計
+struct RepackResult
+{
+    size_t streamedBlocks = 0;  // 復号せずに写したブロック数
+    size_t reencodedBlocks = 0; // 復号して符号化し直したブロック数
+};
+
+// カタログのエントリのアーカイブを読み込み、カタログのチェックサムで検証する
+static bool readCatalogArchive(const ArchiveCatalog &catalog, const CatalogEntry &entry, std::vector<char> &data)
+{
+    std::string path = catalog.resolvePath(entry);
+    AlignedBuffer buffer;
+    const char *archiveData = nullptr;
+    if (!readFileRangeDirect(path, entry.offset, entry.size, buffer, archiveData))
+    {
+        std::cerr << "Error: Failed to read archive: " << path << std::endl;
+        return false;
+    }
+    if (computeChecksum64(archiveData, entry.size) != entry.checksum)
+    {
+        std::cerr << "Error: Archive checksum mismatch: " << path << std::endl;
+        return false;
+    }
+    data.assign(archiveData, archiveData + entry.size);
+    return true;
+}
+
+// アーカイブのブロックをbuilderに加える
+// v2のブロックはコーデックを変えない限り格納データをそのまま写し、v1はファイルごとのブロックに符号化する
+static bool addArchiveBlocks(const std::vector<char> &data, const RepackOptions &options, BlockArchiveBuilder &builder,
+                             RepackResult &result)
+{
+    if (!isBlockArchive(data.data(), data.size()))
+    {
+        size_t blockCount = 0;
+        if (!addV1ArchiveBlocks(data.data(), data.size(), options.codec, options.lz4Acceleration, builder, &blockCount))
+            return false;
+        result.reencodedBlocks += blockCount;
+        return true;
+    }
+
+    std::vector<BlockEntry> blocks;
+    if (!readBlockArchiveIndex(data.data(), data.size(), blocks))
+    {
+        std::cerr << "Error: Failed to read block index" << std::endl;
+        return false;
+    }
+    for (auto block : blocks)
+    {
+        const char *stored = data.data() + block.offset;
+        bool keep = !options.reencode || block.kind != BlockKind::File || block.codec == options.codec;
+        if (keep)
+        {
+            if (computeChecksum64(stored, block.storedSize) != block.storedChecksum)
+            {
+                std::cerr << "Error: Block checksum mismatch: " << block.name << std::endl;
+                return false;
+            }
+            builder.addBlock(block, std::string(stored, block.storedSize));
+            result.streamedBlocks++;
+            continue;
+        }
+
+        std::vector<char> raw;
+        if (!decodeAndVerifyBlock(block, stored, raw, options.threadCount))
+        {
+            std::cerr << "Error: Block verify failed: " << block.name << std::endl;
+            return false;
+        }
+        std::string reencoded;
+        block.flags &= ~BLOCK_FLAG_STORED_RAW;
+        if (encodeBlock(std::string(raw.begin(), raw.end()), options.codec, options.lz4Acceleration, reencoded,
+                        block.codec, 1.0, &block.flags))
+            block.flags |= BLOCK_FLAG_STORED_RAW;
+        builder.addBlock(block, reencoded);
+        result.reencodedBlocks++;
+    }
+    return true;
+}
+
+// 連続するアーカイブを1つにまとめる
+// 先頭のアーカイブを一時ファイルへの書き込みとリネームで置き換え、カタログに新しい行と残りのアーカイブの
+// 削除済みの行を追記してから、残りのアーカイブを削除する
+static bool repackGroup(const ArchiveCatalog &catalog, const std::vector<CatalogEntry> &group, const RepackOptions &options)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    const CatalogEntry &first = group.front();
+    std::string targetPath = catalog.resolvePath(first);
+
+    BlockArchiveBuilder builder(options.alignment);
+    RepackResult result;
+    uint64_t inputBytes = 0;
+    for (const auto &entry : group)
+    {
+        std::vector<char> data;
+        if (!readCatalogArchive(catalog, entry, data) || !addArchiveBlocks(data, options, builder, result))
+        {
+            std::cerr << "Skipped: " << targetPath << " (could not read " << entry.archive << ")" << std::endl;
+            return false;
+        }
+        inputBytes += entry.size;
+    }
+    std::string archive = builder.finish();
+
+    uint32_t fileCount = 0;
+    uint64_t rawSize = 0;
+    if (!verifyBlockArchive(archive, fileCount, rawSize, options.threadCount))
+    {
+        std::cerr << "Error: Verify failed after repack: " << targetPath << std::endl;
+        return false;
+    }
+
+    // ---------- 置き換え ----------
+    if (!replaceFileAtomically(targetPath, archive, ".repack.tmp"))
+        return false;
+
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+    CatalogEntry merged = first;
+    merged.lastFrame = group.back().lastFrame;
+    merged.fileCount = fileCount;
+    merged.offset = 0;
+    merged.size = archive.size();
+    merged.rawSize = rawSize;
+    merged.checksum = computeChecksum64(archive);
+    merged.compressMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+    merged.committedAt = now;
+    bool cataloged = appendCatalogEntry(catalog.getDir(), merged);
+    for (size_t i = 1; i < group.size() && cataloged; ++i)
+    {
+        CatalogEntry tombstone = group[i];
+        tombstone.removed = true;
+        tombstone.committedAt = now;
+        cataloged = appendCatalogEntry(catalog.getDir(), tombstone);
+    }
+    if (!cataloged)
+    {
+        // 残りのアーカイブは削除しない（カタログの古い行から引き続き読める）
+        std::cerr << "Error: Failed to update catalog, leaving the merged archives in place" << std::endl;
+        return false;
+    }
+
+    for (size_t i = 1; i < group.size(); ++i)
+    {
+        std::string path = catalog.resolvePath(group[i]);
+        std::error_code ec;
+        if (path != targetPath && !fs::remove(path, ec))
+        {
+            std::cerr << "Warning: Failed to remove " << path << std::endl;
+        }
+    }
+
+    std::cout << "Repacked " << group.size() << " archive(s) -> " << first.archive << " (frames " << first.firstFrame
+              << "-" << merged.lastFrame << ", " << inputBytes << " -> " << archive.size() << " bytes, streamed "
+              << result.streamedBlocks << ", re-encoded " << result.reencodedBlocks << " block(s))" << std::endl;
+    return true;
+}
+
+int repackCommand(const std::vector<std::string> &args)
+{
+    RepackOptions options;
+    std::string prefixFilter;
+    int runFilter = -1;
+    std::vector<std::string> dirs;
+
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+        {
+            dirs.push_back(arg);
+            continue;
+        }
+        try
+        {
+            if (name == "--target-mb")
+                options.targetBytes = static_cast<uint64_t>(std::max(1, std::stoi(value))) * 1024 * 1024;
+            else if (name == "--codec")
+            {
+                if (!parseBlockCodec(value, options.codec))
+                {
+                    std::cerr << "Unknown codec: " << value << std::endl;
+                    return 1;
+                }
+                options.reencode = true;
+            }
+            else if (name == "--lz4-acceleration")
+                options.lz4Acceleration = std::max(1, std::stoi(value));
+            else if (name == "--align-blocks")
+                options.alignment = BLOCK_ALIGNMENT;
+            else if (name == "--threads")
+                options.threadCount = std::max(1, std::stoi(value));
+            else if (name == "--prefix")
+                prefixFilter = value;
+            else if (name == "--run")
+                runFilter = std::stoi(value);
+            else if (name == "--dry-run")
+                options.dryRun = true;
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (dirs.size() != 1)
+    {
+        std::cerr << "Usage: bl02b1_archive_tool repack [--target-mb=N] [--codec=lz4|predictive|store|auto] [--align-blocks]"
+                  << " [--threads=N] [--prefix=P] [--run=N] [--dry-run] <output_dir>" << std::endl;
+        return 1;
+    }
+
+    ArchiveCatalog catalog(dirs.front());
+    if (!catalog.load())
+    {
+        std::cerr << "Error: Catalog not found: " << getCatalogPath(dirs.front()) << std::endl;
+        return 1;
+    }
+
+    // runごとに、先頭から順に上限を超えない範囲で連続するアーカイブをまとめる
+    // ランコンテナのセグメントは既にrunで1ファイルなので対象外
+    std::vector<std::vector<CatalogEntry>> groups;
+    size_t containerCount = 0;
+    for (const auto &entry : catalog.entries())
+    {
+        if ((!prefixFilter.empty() && entry.prefix != prefixFilter) || (runFilter >= 0 && entry.run != runFilter))
+            continue;
+        if (fs::path(entry.archive).extension() == ".lz4c")
+        {
+            containerCount++;
+            continue;
+        }
+
+        bool startGroup = groups.empty() || groups.back().back().prefix != entry.prefix ||
+                          groups.back().back().run != entry.run;
+        if (!startGroup)
+        {
+            uint64_t groupBytes = 0;
+            for (const auto &member : groups.back())
+                groupBytes += member.size;
+            startGroup = groupBytes + entry.size > options.targetBytes;
+        }
+        if (startGroup)
+            groups.emplace_back();
+        groups.back().push_back(entry);
+    }
+
+    size_t before = 0, after = 0, failed = 0;
+    for (const auto &group : groups)
+    {
+        before += group.size();
+        // 1つだけのグループはコーデックを変える場合のみ書き直す
+        if (group.size() < 2 && !options.reencode)
+        {
+            after += group.size();
+            continue;
+        }
+        if (options.dryRun)
+        {
+            std::cout << "Would repack " << group.size() << " archive(s) -> " << group.front().archive << " (frames "
+                      << group.front().firstFrame << "-" << group.back().lastFrame << ")" << std::endl;
+            after++;
+            continue;
+        }
+        if (repackGroup(catalog, group, options))
+            after++;
+        else
+        {
+            failed++;
+            after += group.size();
+        }
+    }
+
+    if (containerCount > 0)
+        std::cout << "Skipped " << containerCount << " run container segment(s)" << std::endl;
+    std::cout << (options.dryRun ? "Plan: " : "Done: ") << before << " archive(s) -> " << after << " archive(s)";
+    if (failed > 0)
+        std::cout << ", " << failed << " group(s) failed";
+    std::cout << std::endl;
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include "tool_commands.hpp"
+#include "../common/common.hpp"
+#include "../compress/set_quarantine.hpp"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// 隔離中のセットの一覧を表示する
+static int listQuarantine(const std::string &outputDir)
+{
+    std::string path = outputDir + "/" + QUARANTINE_FILE_NAME;
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "No quarantined sets (" << path << " not found)" << std::endl;
+        return 0;
+    }
+
+    size_t count = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() < 5)
+            continue;
+
+        if (count == 0)
+            std::cout << "Quarantined sets:" << std::endl;
+        std::cout << "  " << (fields.size() > 5 && !fields[5].empty() ? fields[5] + ", " : "") << "run " << fields[0]
+                  << ", set " << fields[1] << ": " << fields[2] << " failures, since " << fields[3]
+                  << " (" << fields[4] << ")" << std::endl;
+        count++;
+    }
+    if (count == 0)
+        std::cout << "No quarantined sets" << std::endl;
+    return 0;
+}
+
+int retryCommand(const std::vector<std::string> &args)
+{
+    std::string subdirectory;
+    std::vector<std::string> positional;
+
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+        {
+            positional.push_back(arg);
+            continue;
+        }
+        if (name == "--subdir" && !value.empty())
+            subdirectory = value;
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (positional.empty() || positional.size() > 3 || (positional.size() == 2 && positional[1] != "all"))
+    {
+        std::cerr << "Usage: bl02b1_archive_tool retry <output_dir> [all | [--subdir=<path>] <run> <set>]" << std::endl;
+        return 1;
+    }
+
+    const std::string &outputDir = positional[0];
+    if (!fs::is_directory(outputDir))
+    {
+        std::cerr << "Error: Directory not found: " << outputDir << std::endl;
+        return 1;
+    }
+    if (positional.size() == 1)
+        return listQuarantine(outputDir);
+
+    // 圧縮プログラム（--cooperative の場合はすべてのインスタンス）が数秒ごとに追記された行を読む
+    // （動いていない場合は次の起動時に読む）。要求した時刻より後に隔離したセットは解かない
+    std::string request;
+    if (positional[1] == "all")
+    {
+        request = "all";
+    }
+    else
+    {
+        try
+        {
+            int run = std::stoi(positional[1]);
+            int setNumber = std::stoi(positional[2]);
+            request = std::to_string(run) + "\t" + std::to_string(setNumber) + (subdirectory.empty() ? "" : "\t" + subdirectory);
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid run or set: " << positional[1] << " " << positional[2] << std::endl;
+            return 1;
+        }
+    }
+
+    std::string path = outputDir + "/" + RETRY_REQUESTS_FILE_NAME;
+    int64_t requestedAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              std::chrono::system_clock::now().time_since_epoch())
+                              .count();
+    std::ofstream file(path, std::ios::app);
+    if (!file || !(file << '@' << requestedAt << '\t' << request << '\n'))
+    {
+        std::cerr << "Error: Failed to write retry request: " << path << std::endl;
+        return 1;
+    }
+    std::cout << "Retry requested: " << (request == "all" ? "all quarantined sets" : "run " + positional[1] + ", set " + positional[2])
+              << " (picked up by every running compressor within a few seconds)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include "tool_commands.hpp"
+#include "../common/common.hpp"
+#include "../common/archive_catalog.hpp"
+#include "../common/block_archive.hpp"
+#include "../common/frame_checkpoint.hpp"
+#include "../common/run_container.hpp"
+#include "../common/spot_finder.hpp"
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+// スポットの一覧を読むアーカイブ（ファイル内の領域）
+struct SpotSource
+{
+    std::string path;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// 集計
+struct SpotReadStats
+{
+    size_t archives = 0;      // インデックスを読んだアーカイブ数
+    size_t lists = 0;         // 読み込んだ一覧のブロック数
+    size_t withoutLists = 0;  // 一覧のないアーカイブ数（v1、または --spots なしで圧縮したもの）
+    size_t failed = 0;        // 読み込みまたは検証に失敗した数
+};
+
+// 引数（アーカイブ、ランコンテナ、または出力ディレクトリ）から読み込む領域を集める
+static bool collectSources(const std::string &arg, const std::string &prefixFilter, int runFilter,
+                           std::vector<SpotSource> &sources)
+{
+    if (fs::is_directory(arg))
+    {
+        ArchiveCatalog catalog(arg);
+        if (!catalog.load())
+        {
+            std::cerr << "Error: Catalog not found: " << getCatalogPath(arg) << std::endl;
+            return false;
+        }
+        for (const auto &entry : catalog.entries())
+        {
+            if ((!prefixFilter.empty() && entry.prefix != prefixFilter) || (runFilter >= 0 && entry.run != runFilter))
+                continue;
+            sources.push_back(SpotSource{catalog.resolvePath(entry), entry.offset, entry.size});
+        }
+        return true;
+    }
+
+    if (!fs::exists(arg))
+    {
+        std::cerr << "Error: File not found: " << arg << std::endl;
+        return false;
+    }
+    if (fs::path(arg).extension() == ".lz4c")
+    {
+        std::vector<RunSegment> segments;
+        if (!readRunContainerIndex(arg, segments))
+        {
+            std::cerr << "Error: Failed to read run container index: " << arg << std::endl;
+            return false;
+        }
+        for (const auto &segment : segments)
+            sources.push_back(SpotSource{arg, segment.offset, segment.size});
+        return true;
+    }
+    sources.push_back(SpotSource{arg, 0, fs::file_size(arg)});
+    return true;
+}
+
+// アーカイブのインデックスと一覧のブロックだけを読み、フレームごとの一覧に加える
+// 同じフレームの一覧が複数ある場合は後のブロック（後から届いたフレームの一覧）を使う
+static void readSpotLists(const SpotSource &source, std::map<std::string, FrameSpots> &frames, SpotReadStats &stats)
+{
+    std::ifstream inFile(source.path, std::ios::binary);
+    std::vector<BlockEntry> blocks;
+    if (!inFile || !readBlockArchiveIndex(inFile, source.offset, source.size, blocks))
+    {
+        stats.withoutLists++;
+        return;
+    }
+    stats.archives++;
+
+    bool found = false;
+    for (const auto &block : blocks)
+    {
+        if (block.kind != BlockKind::Spots)
+            continue;
+        found = true;
+
+        std::vector<char> stored(block.storedSize), raw;
+        std::vector<FrameSpots> list;
+        inFile.clear();
+        inFile.seekg(static_cast<std::streamoff>(source.offset + block.offset));
+        if (!inFile.read(stored.data(), static_cast<std::streamsize>(stored.size())) ||
+            !decodeAndVerifyBlock(block, stored.data(), raw) || !parseSpotList(raw.data(), raw.size(), list))
+        {
+            std::cerr << "Error: Failed to read spot list: " << block.name << " (" << source.path << ")" << std::endl;
+            stats.failed++;
+            continue;
+        }
+        for (auto &frame : list)
+            frames[frame.frame] = std::move(frame);
+        stats.lists++;
+    }
+    if (!found)
+        stats.withoutLists++;
+}
+
+// "A-B" または "A" を解析する
+static bool parseFrameRange(const std::string &value, int &first, int &last)
+{
+    size_t dash = value.find('-');
+    first = std::stoi(value.substr(0, dash));
+    last = dash == std::string::npos ? first : std::stoi(value.substr(dash + 1));
+    return first >= 0 && first <= last;
+}
+
+int spotsCommand(const std::vector<std::string> &args)
+{
+    std::string prefixFilter;
+    int runFilter = -1;
+    int firstFrame = -1, lastFrame = -1;
+    bool summary = false;
+    std::vector<std::string> paths;
+
+    for (const auto &arg : args)
+    {
+        std::string name, value;
+        if (!splitToolOption(arg, name, value))
+        {
+            paths.push_back(arg);
+            continue;
+        }
+        try
+        {
+            if (name == "--frames")
+            {
+                if (!parseFrameRange(value, firstFrame, lastFrame))
+                    throw std::invalid_argument(value);
+            }
+            else if (name == "--summary")
+                summary = true;
+            else if (name == "--prefix")
+                prefixFilter = value;
+            else if (name == "--run")
+                runFilter = std::stoi(value);
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+        }
+        catch (const std::exception &)
+        {
+            std::cerr << "Invalid value for " << name << ": " << value << std::endl;
+            return 1;
+        }
+    }
+
+    if (paths.empty())
+    {
+        std::cerr << "Usage: bl02b1_archive_tool spots [--frames=A-B] [--summary] [--prefix=P] [--run=N]"
+                  << " <archive.lz4|container.lz4c|output_dir>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<SpotSource> sources;
+    for (const auto &path : paths)
+    {
+        if (!collectSources(path, prefixFilter, runFilter, sources))
+            return 1;
+    }
+
+    // フレーム名（"<prefix>_<run>_<番号>.tif"、番号はゼロ埋め）の順に並べる
+    std::map<std::string, FrameSpots> frames;
+    SpotReadStats stats;
+    for (const auto &source : sources)
+        readSpotLists(source, frames, stats);
+
+    size_t frameCount = 0, spotCount = 0;
+    if (summary)
+        std::cout << "frame\tspots\tintensity" << std::endl;
+    else
+        std::cout << "frame\tx\ty\tintensity\tpixels\tpeak" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto &item : frames)
+    {
+        const FrameSpots &frame = item.second;
+        int number = getFrameNumber(frame.frame);
+        if (firstFrame >= 0 && (number < firstFrame || number > lastFrame))
+            continue;
+        frameCount++;
+        spotCount += frame.spots.size();
+
+        if (summary)
+        {
+            int64_t intensity = 0;
+            for (const auto &spot : frame.spots)
+                intensity += spot.intensity;
+            std::cout << frame.frame << "\t" << frame.spots.size() << "\t" << intensity << "\n";
+            continue;
+        }
+        for (const auto &spot : frame.spots)
+        {
+            std::cout << frame.frame << "\t" << spot.x << "\t" << spot.y << "\t" << spot.intensity << "\t"
+                      << spot.pixels << "\t" << spot.peak << "\n";
+        }
+    }
+    std::cout.flush();
+
+    // 集計は標準エラーに出す（標準出力はそのまま解析に渡せるようにする）
+    std::cerr << spotCount << " spot(s) in " << frameCount << " frame(s) from " << stats.lists << " list(s) in "
+              << stats.archives << " archive(s)";
+    if (stats.withoutLists > 0)
+        std::cerr << ", " << stats.withoutLists << " archive(s) without spot lists";
+    std::cerr << std::endl;
+    return stats.failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TOOL_COMMANDS_HPP
+#define TOOL_COMMANDS_HPP
+
+#include <string>
+#include <vector>
+
+// bl02b1_archive_tool のサブコマンド
+// args: サブコマンド名より後の引数
+// 戻り値: プロセスの終了コード
+
+// アーカイブ（.lz4 / .lz4c）の内容を表示する
+int infoCommand(const std::vector<std::string> &args);
+
+// コーデックごとの圧縮率と速度を測定する
+int benchCommand(const std::vector<std::string> &args);
+
+// 連続する小さなアーカイブをまとめる（カタログを更新する）
+int repackCommand(const std::vector<std::string> &args);
+
+// ディレクトリ以下のv1アーカイブを並列にv2へ変換する（中断・再開可能）
+int migrateCommand(const std::vector<std::string> &args);
+
+// 圧縮時に格納したスポットの一覧を、フレームを復号せずに表示する
+int spotsCommand(const std::vector<std::string> &args);
+
+// 圧縮プログラムが隔離したセットを表示し、再試行を要求する
+int retryCommand(const std::vector<std::string> &args);
+
+// "--name=value" 形式の引数を分解する（"--name" のみの場合valueは空）
+// 戻り値: "--" で始まる場合true
+bool splitToolOption(const std::string &arg, std::string &name, std::string &value);
+
+#endif // TOOL_COMMANDS_HPP